@@ -203,6 +203,15 @@ public:
         }
     }
     
+    /// Add to the call count of a named counter block under the current block without timing it. Used for counting events such as cache hits.
+    void AddCount(const char* name, unsigned count)
+    {
+        if (!Thread::IsMainThread())
+            return;
+        
+        current_->GetChild(name)->count_ += count;
+    }
+    
     /// Begin the profiling frame. Called by HandleBeginFrame().
     void BeginFrame();
     /// End the profiling frame. Called by HandleEndFrame().
@@ -257,8 +266,10 @@ private:
 
 #ifdef URHO3D_PROFILING
 #define PROFILE(name) Urho3D::AutoProfileBlock profile_ ## name (GetSubsystem<Urho3D::Profiler>(), #name)
+#define PROFILE_COUNT(name, count) { Urho3D::Profiler* profiler_ ## name = GetSubsystem<Urho3D::Profiler>(); if (profiler_ ## name) profiler_ ## name->AddCount(#name, count); }
 #else
 #define PROFILE(name)
+#define PROFILE_COUNT(name, count)
 #endif
 
 }
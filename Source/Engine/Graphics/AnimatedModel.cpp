@@ -40,8 +40,13 @@
 #include "ResourceEvents.h"
 #include "Scene.h"
 #include "Sort.h"
+#include "Thread.h"
 #include "VertexBuffer.h"
 
+#ifdef URHO3D_SSE
+#include <xmmintrin.h>
+#endif
+
 #include "DebugNew.h"
 
 namespace Urho3D
@@ -63,10 +68,13 @@ AnimatedModel::AnimatedModel(Context* context) :
     animationLodBias_(1.0f),
     animationLodTimer_(-1.0f),
     animationLodDistance_(0.0f),
+    poseCacheStep_(0.0f),
     updateInvisible_(false),
+    nodelessSkeleton_(false),
     animationDirty_(false),
     animationOrderDirty_(false),
     morphsDirty_(false),
+    morphsUploadPending_(false),
     skinningDirty_(true),
     boneBoundingBoxDirty_(true),
     isMaster_(true),
@@ -92,6 +100,7 @@ void AnimatedModel::RegisterObject(Context* context)
     context->RegisterFactory<AnimatedModel>(GEOMETRY_CATEGORY);
 
     ACCESSOR_ATTRIBUTE("Is Enabled", IsEnabled, SetEnabled, bool, true, AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Nodeless Skeleton", GetNodelessSkeleton, SetNodelessSkeleton, bool, false, AM_DEFAULT);
     MIXED_ACCESSOR_ATTRIBUTE("Model", GetModelAttr, SetModelAttr, ResourceRef, ResourceRef(Model::GetTypeStatic()), AM_DEFAULT);
     ACCESSOR_ATTRIBUTE("Material", GetMaterialsAttr, SetMaterialsAttr, ResourceRefList, ResourceRefList(Material::GetTypeStatic()), AM_DEFAULT);
     ATTRIBUTE("Is Occluder", bool, occluder_, false, AM_DEFAULT);
@@ -102,6 +111,7 @@ void AnimatedModel::RegisterObject(Context* context)
     ACCESSOR_ATTRIBUTE("Shadow Distance", GetShadowDistance, SetShadowDistance, float, 0.0f, AM_DEFAULT);
     ACCESSOR_ATTRIBUTE("LOD Bias", GetLodBias, SetLodBias, float, 1.0f, AM_DEFAULT);
     ACCESSOR_ATTRIBUTE("Animation LOD Bias", GetAnimationLodBias, SetAnimationLodBias, float, 1.0f, AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Pose Cache Step", GetPoseCacheStep, SetPoseCacheStep, float, 0.0f, AM_DEFAULT);
     COPY_BASE_ATTRIBUTES(Drawable);
     MIXED_ACCESSOR_ATTRIBUTE("Bone Animation Enabled", GetBonesEnabledAttr, SetBonesEnabledAttr, VariantVector, Variant::emptyVariantVector, AM_FILE | AM_NOEDIT);
     MIXED_ACCESSOR_ATTRIBUTE("Animation States", GetAnimationStatesAttr, SetAnimationStatesAttr, VariantVector, Variant::emptyVariantVector, AM_FILE);
@@ -152,7 +162,12 @@ void AnimatedModel::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQu
     for (unsigned i = 0; i < bones.Size(); ++i)
     {
         const Bone& bone = bones[i];
-        if (!bone.node_)
+        Matrix3x4 transform;
+        if (boneTransforms_.Size())
+            transform = node_->GetWorldTransform() * boneTransforms_[i];
+        else if (bone.node_)
+            transform = bone.node_->GetWorldTransform();
+        else
             continue;
 
         float distance;
@@ -162,7 +177,6 @@ void AnimatedModel::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQu
         {
             // Do an initial crude test using the bone's AABB
             const BoundingBox& box = bone.boundingBox_;
-            const Matrix3x4& transform = bone.node_->GetWorldTransform();
             distance = query.ray_.HitDistance(box.Transformed(transform));
             if (distance >= query.maxDistance_)
                 continue;
@@ -178,7 +192,7 @@ void AnimatedModel::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQu
         }
         else if (bone.collisionMask_ & BONECOLLISION_SPHERE)
         {
-            boneSphere.center_ = bone.node_->GetWorldPosition();
+            boneSphere.center_ = transform.Translation();
             boneSphere.radius_ = bone.radius_;
             distance = query.ray_.HitDistance(boneSphere);
             if (distance >= query.maxDistance_)
@@ -265,16 +279,21 @@ void AnimatedModel::UpdateGeometry(const FrameInfo& frame)
     if (morphsDirty_)
         UpdateMorphs();
 
+    // Vertex buffers can only be written on the main thread. If the morphs were applied in a worker thread, the view calls
+    // again from the main thread to upload them
+    if (morphsUploadPending_ && Thread::IsMainThread())
+        UploadMorphs();
+
     if (skinningDirty_)
         UpdateSkinning();
 }
 
 UpdateGeometryType AnimatedModel::GetUpdateGeometryType()
 {
-    if (morphsDirty_)
-        return UPDATE_MAIN_THREAD;
-    else if (skinningDirty_)
+    if (morphsDirty_ || skinningDirty_)
         return UPDATE_WORKER_THREAD;
+    else if (morphsUploadPending_)
+        return UPDATE_MAIN_THREAD;
     else
         return UPDATE_NONE;
 }
@@ -284,7 +303,32 @@ void AnimatedModel::DrawDebugGeometry(DebugRenderer* debug, bool depthTest)
     if (debug && IsEnabledEffective())
     {
         debug->AddBoundingBox(GetWorldBoundingBox(), Color::GREEN, depthTest);
-        debug->AddSkeleton(skeleton_, Color(0.75f, 0.75f, 0.75f), depthTest);
+        if (!boneTransforms_.Size())
+            debug->AddSkeleton(skeleton_, Color(0.75f, 0.75f, 0.75f), depthTest);
+        else
+        {
+            // In nodeless skeleton mode draw the bones from the model-space transforms
+            const Matrix3x4& worldTransform = node_->GetWorldTransform();
+            const Vector<Bone>& bones = skeleton_.GetBones();
+            unsigned color = Color(0.75f, 0.75f, 0.75f).ToUInt();
+
+            for (unsigned i = 0; i < bones.Size(); ++i)
+            {
+                // Skip if bone contains no skinned geometry
+                if (bones[i].radius_ < M_EPSILON && bones[i].boundingBox_.Size().LengthSquared() < M_EPSILON)
+                    continue;
+
+                Vector3 start = worldTransform * boneTransforms_[i].Translation();
+                Vector3 end = start;
+
+                unsigned j = bones[i].parentIndex_;
+                if (j != i && j < bones.Size() && (bones[j].radius_ >= M_EPSILON ||
+                    bones[j].boundingBox_.Size().LengthSquared() >= M_EPSILON))
+                    end = worldTransform * boneTransforms_[j].Translation();
+
+                debug->AddLine(start, end, color, depthTest);
+            }
+        }
     }
 }
 
@@ -385,6 +429,7 @@ void AnimatedModel::SetModel(Model* model, bool createBones)
         SetSkeleton(Skeleton(), false);
     }
 
+    MarkBatchesDirty();
     MarkNetworkUpdate();
 }
 
@@ -496,6 +541,74 @@ void AnimatedModel::SetUpdateInvisible(bool enable)
     MarkNetworkUpdate();
 }
 
+void AnimatedModel::SetNodelessSkeleton(bool enable)
+{
+    if (enable == nodelessSkeleton_)
+        return;
+
+    // If a skeleton already exists, recreate it in the new mode
+    if (skeleton_.GetNumBones() && isMaster_)
+    {
+        RemoveRootBone();
+        skeleton_.ClearBones();
+        nodelessSkeleton_ = enable;
+        if (model_)
+            SetSkeleton(model_->GetSkeleton(), !loading_);
+    }
+    else
+        nodelessSkeleton_ = enable;
+
+    MarkNetworkUpdate();
+}
+
+void AnimatedModel::SetPoseCacheStep(float step)
+{
+    poseCacheStep_ = Max(step, 0.0f);
+    MarkNetworkUpdate();
+}
+
+Node* AnimatedModel::CreateBoneNode(const String& boneName)
+{
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    unsigned index = M_MAX_UNSIGNED;
+    for (unsigned i = 0; i < bones.Size(); ++i)
+    {
+        if (bones[i].name_ == boneName)
+        {
+            index = i;
+            break;
+        }
+    }
+
+    if (index == M_MAX_UNSIGNED)
+    {
+        LOGERROR("Bone " + boneName + " not found");
+        return 0;
+    }
+
+    if (!boneTransforms_.Size())
+        return bones[index].node_;
+
+    for (Vector<Pair<unsigned, WeakPtr<Node> > >::ConstIterator i = boneAttachments_.Begin(); i != boneAttachments_.End(); ++i)
+    {
+        if (i->first_ == index && i->second_)
+            return i->second_;
+    }
+
+    if (!node_)
+        return 0;
+
+    // Create as local, as the transform is driven by the animation on each client
+    Node* boneNode = node_->CreateChild(boneName, LOCAL);
+    Vector3 position;
+    Quaternion rotation;
+    Vector3 scale;
+    boneTransforms_[index].Decompose(position, rotation, scale);
+    boneNode->SetTransform(position, rotation, scale);
+    boneAttachments_.Push(MakePair(index, WeakPtr<Node>(boneNode)));
+    return boneNode;
+}
+
 
 void AnimatedModel::SetMorphWeight(unsigned index, float weight)
 {
@@ -660,8 +773,8 @@ void AnimatedModel::SetSkeleton(const Skeleton& skeleton, bool createBones)
 
             for (unsigned i = 0; i < destBones.Size(); ++i)
             {
-                if (destBones[i].node_ && destBones[i].name_ == srcBones[i].name_ && destBones[i].parentIndex_ ==
-                    srcBones[i].parentIndex_)
+                if ((destBones[i].node_ || nodelessSkeleton_) && destBones[i].name_ == srcBones[i].name_ &&
+                    destBones[i].parentIndex_ == srcBones[i].parentIndex_)
                 {
                     // If compatible, just copy the values and retain the old node and animated status
                     Node* boneNode = destBones[i].node_;
@@ -677,7 +790,11 @@ void AnimatedModel::SetSkeleton(const Skeleton& skeleton, bool createBones)
                 }
             }
             if (compatible)
+            {
+                if (nodelessSkeleton_)
+                    SetupBonePose();
                 return;
+            }
         }
 
         RemoveAllAnimationStates();
@@ -699,8 +816,8 @@ void AnimatedModel::SetSkeleton(const Skeleton& skeleton, bool createBones)
                 i->collisionMask_ &= ~BONECOLLISION_SPHERE;
         }
 
-        // Create scene nodes for the bones
-        if (createBones)
+        // Create scene nodes for the bones, unless in nodeless skeleton mode
+        if (createBones && !nodelessSkeleton_)
         {
             for (Vector<Bone>::Iterator i = bones.Begin(); i != bones.End(); ++i)
             {
@@ -746,6 +863,7 @@ void AnimatedModel::SetSkeleton(const Skeleton& skeleton, bool createBones)
     // Reserve space for skinning matrices
     skinMatrices_.Resize(skeleton_.GetNumBones());
     SetGeometryBoneMappings();
+    SetupBonePose();
 
     assignBonesPending_ = !createBones;
 }
@@ -907,6 +1025,26 @@ void AnimatedModel::AssignBoneNodes()
     if (!node_)
         return;
 
+    // In nodeless skeleton mode only adopt the bone attachment nodes, which are direct children of the model's node
+    if (nodelessSkeleton_ && isMaster_)
+    {
+        const Vector<Bone>& bones = skeleton_.GetBones();
+        boneAttachments_.Clear();
+        for (unsigned i = 0; i < bones.Size(); ++i)
+        {
+            Node* boneNode = node_->GetChild(bones[i].name_, false);
+            if (boneNode)
+                boneAttachments_.Push(MakePair(i, WeakPtr<Node>(boneNode)));
+        }
+
+        for (Vector<SharedPtr<AnimationState> >::Iterator i = animationStates_.Begin(); i != animationStates_.End(); ++i)
+        {
+            AnimationState* state = *i;
+            state->SetStartBone(state->GetStartBone());
+        }
+        return;
+    }
+
     // Find the bone nodes from the node hierarchy and add listeners
     Vector<Bone>& bones = skeleton_.GetModifiableBones();
     bool boneFound = false;
@@ -939,6 +1077,169 @@ void AnimatedModel::RemoveRootBone()
     Bone* rootBone = skeleton_.GetRootBone();
     if (rootBone && rootBone->node_)
         rootBone->node_->Remove();
+
+    for (Vector<Pair<unsigned, WeakPtr<Node> > >::Iterator i = boneAttachments_.Begin(); i != boneAttachments_.End(); ++i)
+    {
+        if (i->second_)
+            i->second_->Remove();
+    }
+    boneAttachments_.Clear();
+}
+
+void AnimatedModel::SetupBonePose()
+{
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    unsigned numBones = bones.Size();
+
+    // The bone count or skinning layout may change, so views must rebuild their retained batches. Animation updates
+    // only rewrite the skin matrices in place and do not need this
+    MarkBatchesDirty();
+
+    // The pose arrays are only used by the master model, other models read bone nodes
+    if (!nodelessSkeleton_ || !isMaster_ || !numBones)
+    {
+        bonePositions_.Clear();
+        boneRotations_.Clear();
+        boneScales_.Clear();
+        boneTransforms_.Clear();
+        boneSkinMatrices_.Clear();
+        boneUpdateOrder_.Clear();
+        boneAttachments_.Clear();
+        return;
+    }
+
+    bonePositions_.Resize(numBones);
+    boneRotations_.Resize(numBones);
+    boneScales_.Resize(numBones);
+    boneTransforms_.Resize(numBones);
+    boneSkinMatrices_.Resize(numBones);
+    for (unsigned i = 0; i < numBones; ++i)
+    {
+        bonePositions_[i] = bones[i].initialPosition_;
+        boneRotations_[i] = bones[i].initialRotation_;
+        boneScales_[i] = bones[i].initialScale_;
+    }
+
+    // Order the bones so that parents are always evaluated before their children. Bones without a valid parent are
+    // relative to the model's scene node
+    boneUpdateOrder_.Clear();
+    boneUpdateOrder_.Reserve(numBones);
+    PODVector<bool> ordered(numBones);
+    for (unsigned i = 0; i < numBones; ++i)
+    {
+        unsigned parentIndex = bones[i].parentIndex_;
+        ordered[i] = parentIndex == i || parentIndex >= numBones;
+        if (ordered[i])
+            boneUpdateOrder_.Push(i);
+    }
+
+    for (unsigned i = 0; i < boneUpdateOrder_.Size(); ++i)
+    {
+        unsigned parentIndex = boneUpdateOrder_[i];
+        for (unsigned j = 0; j < numBones; ++j)
+        {
+            if (!ordered[j] && bones[j].parentIndex_ == parentIndex)
+            {
+                ordered[j] = true;
+                boneUpdateOrder_.Push(j);
+            }
+        }
+    }
+
+    // Bones in a parent cycle can not be evaluated, treat them as relative to the model's scene node
+    for (unsigned i = 0; i < numBones; ++i)
+    {
+        if (!ordered[i])
+            boneUpdateOrder_.Push(i);
+    }
+
+    UpdateBoneTransforms();
+}
+
+void AnimatedModel::ResetBonePose()
+{
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    for (unsigned i = 0; i < bones.Size(); ++i)
+    {
+        const Bone& bone = bones[i];
+        if (bone.animated_)
+        {
+            bonePositions_[i] = bone.initialPosition_;
+            boneRotations_[i] = bone.initialRotation_;
+            boneScales_[i] = bone.initialScale_;
+        }
+    }
+}
+
+void AnimatedModel::UpdateBoneTransforms()
+{
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    unsigned numBones = boneUpdateOrder_.Size();
+
+    for (unsigned i = 0; i < numBones; ++i)
+    {
+        unsigned index = boneUpdateOrder_[i];
+        unsigned parentIndex = bones[index].parentIndex_;
+        Matrix3x4 localTransform(bonePositions_[index], boneRotations_[index], boneScales_[index]);
+
+        if (parentIndex != index && parentIndex < numBones)
+            boneTransforms_[index] = boneTransforms_[parentIndex] * localTransform;
+        else
+            boneTransforms_[index] = localTransform;
+        boneSkinMatrices_[index] = boneTransforms_[index] * bones[index].offsetMatrix_;
+    }
+
+    UpdateBoneAttachments();
+}
+
+void AnimatedModel::UpdateBoneAttachments()
+{
+    // Only the attachment nodes are dirtied, the rest of the skeleton has no scene nodes
+    for (Vector<Pair<unsigned, WeakPtr<Node> > >::Iterator i = boneAttachments_.Begin(); i != boneAttachments_.End(); ++i)
+    {
+        Node* boneNode = i->second_;
+        if (!boneNode || i->first_ >= boneTransforms_.Size())
+            continue;
+
+        Vector3 position;
+        Quaternion rotation;
+        Vector3 scale;
+        boneTransforms_[i->first_].Decompose(position, rotation, scale);
+        boneNode->SetTransform(position, rotation, scale);
+    }
+}
+
+bool AnimatedModel::GetPoseKey(PODVector<unsigned>& key) const
+{
+    key.Clear();
+    if (poseCacheStep_ <= 0.0f || !model_)
+        return false;
+
+    unsigned long long modelAddress = (unsigned long long)(size_t)model_.Get();
+    key.Push((unsigned)modelAddress);
+    key.Push((unsigned)(modelAddress >> 32));
+    unsigned stepBits;
+    memcpy(&stepBits, &poseCacheStep_, sizeof stepBits);
+    key.Push(stepBits);
+
+    // Bones with animation disabled keep their initial pose, so they affect the result too
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    unsigned animatedMask = 0;
+    for (unsigned i = 0; i < bones.Size(); ++i)
+    {
+        if (bones[i].animated_)
+            animatedMask |= 1 << (i & 31);
+        if ((i & 31) == 31 || i == bones.Size() - 1)
+        {
+            key.Push(animatedMask);
+            animatedMask = 0;
+        }
+    }
+
+    for (Vector<SharedPtr<AnimationState> >::ConstIterator i = animationStates_.Begin(); i != animationStates_.End(); ++i)
+        (*i)->AddPoseKey(key, poseCacheStep_);
+
+    return true;
 }
 
 void AnimatedModel::MarkAnimationDirty()
@@ -1142,15 +1443,50 @@ void AnimatedModel::UpdateAnimation(const FrameInfo& frame)
     // (first AnimatedModel in a node)
     if (isMaster_)
     {
-        skeleton_.ResetSilent();
-        for (Vector<SharedPtr<AnimationState> >::Iterator i = animationStates_.Begin(); i != animationStates_.End(); ++i)
-            (*i)->Apply();
+        if (boneTransforms_.Size())
+        {
+            // If pose caching is enabled, check whether another model has already evaluated the same pose this frame
+            AnimationPoseCache* poseCache = octant_ && GetPoseKey(poseKey_) ? &octant_->GetRoot()->GetAnimationPoseCache() : 0;
+            if (poseCache && poseCache->GetPose(poseKey_, boneTransforms_, boneSkinMatrices_, boneBoundingBox_))
+            {
+                UpdateBoneAttachments();
+                boneBoundingBoxDirty_ = false;
+                worldBoundingBoxDirty_ = true;
+            }
+            else
+            {
+                // In nodeless skeleton mode the animations are blended into the pose arrays, after which the model-space
+                // transforms are calculated in one pass. There is no node hierarchy to dirty. When the pose is cached,
+                // evaluate at the quantized key values so that the result does not depend on which model missed first
+                ResetBonePose();
+                for (Vector<SharedPtr<AnimationState> >::Iterator i = animationStates_.Begin(); i != animationStates_.End(); ++i)
+                {
+                    if (poseCache)
+                        (*i)->ApplyQuantized(poseCacheStep_);
+                    else
+                        (*i)->Apply();
+                }
 
-        // Skeleton reset and animations apply the node transforms "silently" to avoid repeated marking dirty. Mark dirty now
-        node_->MarkDirty();
+                UpdateBoneTransforms();
+                UpdateBoneBoundingBox();
+                if (poseCache)
+                    poseCache->StorePose(poseKey_, boneTransforms_, boneSkinMatrices_, boneBoundingBox_);
+            }
 
-        // Calculate new bone bounding box
-        UpdateBoneBoundingBox();
+            skinningDirty_ = true;
+        }
+        else
+        {
+            skeleton_.ResetSilent();
+            for (Vector<SharedPtr<AnimationState> >::Iterator i = animationStates_.Begin(); i != animationStates_.End(); ++i)
+                (*i)->Apply();
+
+            // Skeleton reset and animations apply the node transforms "silently" to avoid repeated marking dirty. Mark dirty now
+            node_->MarkDirty();
+
+            // Calculate new bone bounding box
+            UpdateBoneBoundingBox();
+        }
     }
 
     animationDirty_ = false;
@@ -1165,18 +1501,23 @@ void AnimatedModel::UpdateBoneBoundingBox()
         Matrix3x4 inverseNodeTransform = node_->GetWorldTransform().Inverse();
 
         const Vector<Bone>& bones = skeleton_.GetBones();
-        for (Vector<Bone>::ConstIterator i = bones.Begin(); i != bones.End(); ++i)
+        for (unsigned i = 0; i < bones.Size(); ++i)
         {
-            Node* boneNode = i->node_;
-            if (!boneNode)
+            const Bone& bone = bones[i];
+            Matrix3x4 transform;
+            if (boneTransforms_.Size())
+                transform = boneTransforms_[i];
+            else if (bone.node_)
+                transform = inverseNodeTransform * bone.node_->GetWorldTransform();
+            else
                 continue;
 
             // Use hitbox if available. If not, use only half of the sphere radius
             /// \todo The sphere radius should be multiplied with bone scale
-            if (i->collisionMask_ & BONECOLLISION_BOX)
-                boneBoundingBox_.Merge(i->boundingBox_.Transformed(inverseNodeTransform * boneNode->GetWorldTransform()));
-            else if (i->collisionMask_ & BONECOLLISION_SPHERE)
-                boneBoundingBox_.Merge(Sphere(inverseNodeTransform * boneNode->GetWorldPosition(), i->radius_ * 0.5f));
+            if (bone.collisionMask_ & BONECOLLISION_BOX)
+                boneBoundingBox_.Merge(bone.boundingBox_.Transformed(transform));
+            else if (bone.collisionMask_ & BONECOLLISION_SPHERE)
+                boneBoundingBox_.Merge(Sphere(transform.Translation(), bone.radius_ * 0.5f));
         }
     }
 
@@ -1190,6 +1531,7 @@ void AnimatedModel::UpdateSkinning()
     const Vector<Bone>& bones = skeleton_.GetBones();
     // Use model's world transform in case a bone is missing
     const Matrix3x4& worldTransform = node_->GetWorldTransform();
+    bool nodeless = boneTransforms_.Size() != 0;
 
     // Skinning with global matrices only
     if (!geometrySkinMatrices_.Size())
@@ -1197,7 +1539,9 @@ void AnimatedModel::UpdateSkinning()
         for (unsigned i = 0; i < bones.Size(); ++i)
         {
             const Bone& bone = bones[i];
-            if (bone.node_)
+            if (nodeless)
+                skinMatrices_[i] = worldTransform * boneSkinMatrices_[i];
+            else if (bone.node_)
                 skinMatrices_[i] = bone.node_->GetWorldTransform() * bone.offsetMatrix_;
             else
                 skinMatrices_[i] = worldTransform;
@@ -1209,7 +1553,9 @@ void AnimatedModel::UpdateSkinning()
         for (unsigned i = 0; i < bones.Size(); ++i)
         {
             const Bone& bone = bones[i];
-            if (bone.node_)
+            if (nodeless)
+                skinMatrices_[i] = worldTransform * boneSkinMatrices_[i];
+            else if (bone.node_)
                 skinMatrices_[i] = bone.node_->GetWorldTransform() * bone.offsetMatrix_;
             else
                 skinMatrices_[i] = worldTransform;
@@ -1231,84 +1577,128 @@ void AnimatedModel::UpdateMorphs()
 
     if (morphs_.Size())
     {
-        // Reset the morph data range from all morphable vertex buffers, then apply morphs
-        for (unsigned i = 0; i < morphVertexBuffers_.Size(); ++i)
+        // Gather the weights once. Deltas of morphs with zero weight are skipped while applying
+        morphWeights_.Resize(morphs_.Size());
+        for (unsigned i = 0; i < morphs_.Size(); ++i)
+            morphWeights_[i] = morphs_[i].weight_;
+
+        const Vector<VertexBufferMorphStream>& streams = model_->GetMorphStreams();
+        for (unsigned i = 0; i < morphVertexBuffers_.Size() && i < streams.Size(); ++i)
         {
             VertexBuffer* buffer = morphVertexBuffers_[i];
-            if (buffer)
-            {
-                VertexBuffer* originalBuffer = model_->GetVertexBuffers()[i];
-                unsigned morphStart = model_->GetMorphRangeStart(i);
-                unsigned morphCount = model_->GetMorphRangeCount(i);
-
-                void* dest = buffer->Lock(morphStart, morphCount);
-                if (dest)
-                {
-                    // Reset morph range by copying data from the original vertex buffer
-                    CopyMorphVertices(dest, originalBuffer->GetShadowData() + morphStart * originalBuffer->GetVertexSize(),
-                        morphCount, buffer, originalBuffer);
-
-                    for (unsigned j = 0; j < morphs_.Size(); ++j)
-                    {
-                        if (morphs_[j].weight_ > 0.0f)
-                        {
-                            HashMap<unsigned, VertexBufferMorph>::Iterator k = morphs_[j].buffers_.Find(i);
-                            if (k != morphs_[j].buffers_.End())
-                                ApplyMorph(buffer, dest, morphStart, k->second_, morphs_[j].weight_);
-                        }
-                    }
-
-                    buffer->Unlock();
-                }
-            }
+            if (buffer && buffer->GetShadowData() && streams[i].vertices_.Size())
+                ApplyMorphs(buffer, model_->GetVertexBuffers()[i], model_->GetMorphRangeStart(i), streams[i]);
         }
+
+        morphsUploadPending_ = true;
     }
 
     morphsDirty_ = false;
 }
 
-void AnimatedModel::ApplyMorph(VertexBuffer* buffer, void* destVertexData, unsigned morphRangeStart, const VertexBufferMorph& morph, float weight)
+void AnimatedModel::UploadMorphs()
+{
+    const Vector<VertexBufferMorphStream>& streams = model_->GetMorphStreams();
+    for (unsigned i = 0; i < morphVertexBuffers_.Size() && i < streams.Size(); ++i)
+    {
+        VertexBuffer* buffer = morphVertexBuffers_[i];
+        const PODVector<unsigned>& vertices = streams[i].vertices_;
+        if (!buffer || !buffer->GetShadowData() || vertices.Empty())
+            continue;
+
+        // Only the range between the first and last morphed vertex has changed
+        unsigned start = model_->GetMorphRangeStart(i) + vertices.Front();
+        unsigned count = vertices.Back() - vertices.Front() + 1;
+        buffer->SetDataRange(buffer->GetShadowData() + start * buffer->GetVertexSize(), start, count);
+    }
+
+    morphsUploadPending_ = false;
+}
+
+void AnimatedModel::ApplyMorphs(VertexBuffer* buffer, VertexBuffer* originalBuffer, unsigned morphRangeStart,
+    const VertexBufferMorphStream& stream)
 {
-    unsigned elementMask = morph.elementMask_ & buffer->GetElementMask();
-    unsigned vertexCount = morph.vertexCount_;
+    unsigned elementMask = buffer->GetElementMask();
     unsigned normalOffset = buffer->GetElementOffset(ELEMENT_NORMAL);
     unsigned tangentOffset = buffer->GetElementOffset(ELEMENT_TANGENT);
     unsigned vertexSize = buffer->GetVertexSize();
+    unsigned srcNormalOffset = originalBuffer->GetElementOffset(ELEMENT_NORMAL);
+    unsigned srcTangentOffset = originalBuffer->GetElementOffset(ELEMENT_TANGENT);
+    unsigned srcVertexSize = originalBuffer->GetVertexSize();
+
+    unsigned char* destData = buffer->GetShadowData() + morphRangeStart * vertexSize;
+    const unsigned char* srcData = originalBuffer->GetShadowData() + morphRangeStart * srcVertexSize;
+    const float* weights = &morphWeights_[0];
+    const unsigned* deltaStarts = &stream.deltaStarts_[0];
+    const unsigned* deltaMorphs = &stream.deltaMorphs_[0];
+    const Vector4* deltaData = &stream.deltaData_[0];
+
+    for (unsigned i = 0; i < stream.vertices_.Size(); ++i)
+    {
+        // Sum the weighted deltas of all morphs affecting the vertex, then add to the original vertex. As every morphed
+        // vertex is rewritten, the morph range does not need to be reset first
+        Vector4 offsets[3];
+#ifdef URHO3D_SSE
+        __m128 position = _mm_setzero_ps();
+        __m128 normal = _mm_setzero_ps();
+        __m128 tangent = _mm_setzero_ps();
+        for (unsigned j = deltaStarts[i]; j < deltaStarts[i + 1]; ++j)
+        {
+            float weight = weights[deltaMorphs[j]];
+            if (weight == 0.0f)
+                continue;
 
-    unsigned char* srcData = morph.morphData_;
-    unsigned char* destData = (unsigned char*)destVertexData;
+            __m128 weightVec = _mm_set1_ps(weight);
+            const float* delta = &deltaData[j * 3].x_;
+            position = _mm_add_ps(position, _mm_mul_ps(_mm_loadu_ps(delta), weightVec));
+            normal = _mm_add_ps(normal, _mm_mul_ps(_mm_loadu_ps(delta + 4), weightVec));
+            tangent = _mm_add_ps(tangent, _mm_mul_ps(_mm_loadu_ps(delta + 8), weightVec));
+        }
+        _mm_storeu_ps(&offsets[0].x_, position);
+        _mm_storeu_ps(&offsets[1].x_, normal);
+        _mm_storeu_ps(&offsets[2].x_, tangent);
+#else
+        for (unsigned j = deltaStarts[i]; j < deltaStarts[i + 1]; ++j)
+        {
+            float weight = weights[deltaMorphs[j]];
+            if (weight == 0.0f)
+                continue;
 
-    while (vertexCount--)
-    {
-        unsigned vertexIndex = *((unsigned*)srcData) - morphRangeStart;
-        srcData += sizeof(unsigned);
+            const Vector4* delta = &deltaData[j * 3];
+            offsets[0] += delta[0] * weight;
+            offsets[1] += delta[1] * weight;
+            offsets[2] += delta[2] * weight;
+        }
+#endif
+
+        unsigned vertexIndex = stream.vertices_[i];
+        const unsigned char* src = srcData + vertexIndex * srcVertexSize;
+        unsigned char* dest = destData + vertexIndex * vertexSize;
 
         if (elementMask & MASK_POSITION)
         {
-            float* dest = (float*)(destData + vertexIndex * vertexSize);
-            float* src = (float*)srcData;
-            dest[0] += src[0] * weight;
-            dest[1] += src[1] * weight;
-            dest[2] += src[2] * weight;
-            srcData += 3 * sizeof(float);
+            const float* posSrc = (const float*)src;
+            float* posDest = (float*)dest;
+            posDest[0] = posSrc[0] + offsets[0].x_;
+            posDest[1] = posSrc[1] + offsets[0].y_;
+            posDest[2] = posSrc[2] + offsets[0].z_;
         }
         if (elementMask & MASK_NORMAL)
         {
-            float* dest = (float*)(destData + vertexIndex * vertexSize + normalOffset);
-            float* src = (float*)srcData;
-            dest[0] += src[0] * weight;
-            dest[1] += src[1] * weight;
-            dest[2] += src[2] * weight;
-            srcData += 3 * sizeof(float);
+            const float* normalSrc = (const float*)(src + srcNormalOffset);
+            float* normalDest = (float*)(dest + normalOffset);
+            normalDest[0] = normalSrc[0] + offsets[1].x_;
+            normalDest[1] = normalSrc[1] + offsets[1].y_;
+            normalDest[2] = normalSrc[2] + offsets[1].z_;
         }
         if (elementMask & MASK_TANGENT)
         {
-            float* dest = (float*)(destData + vertexIndex * vertexSize + tangentOffset);
-            float* src = (float*)srcData;
-            dest[0] += src[0] * weight;
-            dest[1] += src[1] * weight;
-            dest[2] += src[2] * weight;
-            srcData += 3 * sizeof(float);
+            const float* tangentSrc = (const float*)(src + srcTangentOffset);
+            float* tangentDest = (float*)(dest + tangentOffset);
+            tangentDest[0] = tangentSrc[0] + offsets[2].x_;
+            tangentDest[1] = tangentSrc[1] + offsets[2].y_;
+            tangentDest[2] = tangentSrc[2] + offsets[2].z_;
+            tangentDest[3] = tangentSrc[3];
         }
     }
 }
@@ -86,6 +86,12 @@ public:
     void SetAnimationLodBias(float bias);
     /// Set whether to update animation and the bounding box when not visible. Recommended to enable for physically controlled models like ragdolls.
     void SetUpdateInvisible(bool enable);
+    /// Set nodeless skeleton mode. When enabled, bone transforms are evaluated in flat arrays instead of scene nodes, and nodes are only created on request for attachments. Bone nodes are then not available for ragdolls or skinned decals. Changing the mode recreates the skeleton and removes animation states.
+    void SetNodelessSkeleton(bool enable);
+    /// Set time quantization step for sharing evaluated poses through the octree's animation pose cache with models that play the same animations at the same quantized time and weights. Requires nodeless skeleton mode. Zero (default) disables.
+    void SetPoseCacheStep(float step);
+    /// Return a scene node that follows a bone, for attaching objects. In nodeless skeleton mode the node is created on demand as a child of the model's scene node.
+    Node* CreateBoneNode(const String& boneName);
     /// Set vertex morph weight by index.
     void SetMorphWeight(unsigned index, float weight);
     /// Set vertex morph weight by name.
@@ -113,6 +119,12 @@ public:
     float GetAnimationLodBias() const { return animationLodBias_; }
     /// Return whether to update animation when not visible.
     bool GetUpdateInvisible() const { return updateInvisible_; }
+    /// Return whether nodeless skeleton mode is enabled.
+    bool GetNodelessSkeleton() const { return nodelessSkeleton_; }
+    /// Return pose cache time quantization step.
+    float GetPoseCacheStep() const { return poseCacheStep_; }
+    /// Return model-space bone transforms in nodeless skeleton mode.
+    const PODVector<Matrix3x4>& GetBoneTransforms() const { return boneTransforms_; }
     /// Return all vertex morphs.
     const Vector<ModelMorph>& GetMorphs() const { return morphs_; }
     /// Return all morph vertex buffers.
@@ -160,8 +172,18 @@ protected:
 private:
     /// Assign skeleton and animation bone node references as a postprocess. Called by ApplyAttributes.
     void AssignBoneNodes();
-    /// Remove (old) skeleton root bone.
+    /// Remove (old) skeleton root bone, or the bone attachment nodes in nodeless skeleton mode.
     void RemoveRootBone();
+    /// Set up the bone pose arrays and update order for nodeless skeleton mode.
+    void SetupBonePose();
+    /// Reset animating bones' pose to initial values in nodeless skeleton mode.
+    void ResetBonePose();
+    /// Calculate model-space bone transforms and skinning matrices from the bone pose in one linear pass, and update bone attachment nodes.
+    void UpdateBoneTransforms();
+    /// Update bone attachment nodes from the model-space bone transforms.
+    void UpdateBoneAttachments();
+    /// Build the pose cache key from the skeleton and animation states. Return false if the pose should not be cached.
+    bool GetPoseKey(PODVector<unsigned>& key) const;
     /// Mark animation and skinning to require an update.
     void MarkAnimationDirty();
     /// Mark animation and skinning to require a forced update (blending order changed.)
@@ -182,10 +204,12 @@ private:
     void UpdateBoneBoundingBox();
     /// Recalculate skinning.
     void UpdateSkinning();
-    /// Reapply all vertex morphs.
+    /// Reapply all vertex morphs into the shadow data of the morph vertex buffers. May be called from a worker thread.
     void UpdateMorphs();
-    /// Apply a vertex morph.
-    void ApplyMorph(VertexBuffer* buffer, void* destVertexData, unsigned morphRangeStart, const VertexBufferMorph& morph, float weight);
+    /// Upload the morphed vertex ranges to the GPU. Must be called from the main thread.
+    void UploadMorphs();
+    /// Write the morphed vertices of a vertex buffer as the original vertices plus the weighted sum of all morph deltas.
+    void ApplyMorphs(VertexBuffer* buffer, VertexBuffer* originalBuffer, unsigned morphRangeStart, const VertexBufferMorphStream& stream);
     /// Handle model reload finished.
     void HandleModelReloadFinished(StringHash eventType, VariantMap& eventData);
 
@@ -205,6 +229,24 @@ private:
     Vector<PODVector<Matrix3x4> > geometrySkinMatrices_;
     /// Subgeometry skinning matrix pointers, if more bones than skinning shader can manage.
     Vector<PODVector<Matrix3x4*> > geometrySkinMatrixPtrs_;
+    /// Morph weights gathered for applying the morphs.
+    PODVector<float> morphWeights_;
+    /// Bone local positions in nodeless skeleton mode.
+    PODVector<Vector3> bonePositions_;
+    /// Bone local rotations in nodeless skeleton mode.
+    PODVector<Quaternion> boneRotations_;
+    /// Bone local scales in nodeless skeleton mode.
+    PODVector<Vector3> boneScales_;
+    /// Bone model-space transforms in nodeless skeleton mode.
+    PODVector<Matrix3x4> boneTransforms_;
+    /// Bone model-space skinning matrices (transform multiplied by offset matrix) in nodeless skeleton mode.
+    PODVector<Matrix3x4> boneSkinMatrices_;
+    /// Pose cache key of the current animation update.
+    PODVector<unsigned> poseKey_;
+    /// Bone indices ordered so that parents precede their children, for nodeless skeleton mode.
+    PODVector<unsigned> boneUpdateOrder_;
+    /// Bone attachment nodes by bone index in nodeless skeleton mode.
+    Vector<Pair<unsigned, WeakPtr<Node> > > boneAttachments_;
     /// Bounding box calculated from bones.
     BoundingBox boneBoundingBox_;
     /// Attribute buffer.
@@ -219,14 +261,20 @@ private:
     float animationLodTimer_;
     /// Animation LOD distance, the minimum of all LOD view distances last frame.
     float animationLodDistance_;
+    /// Pose cache time quantization step.
+    float poseCacheStep_;
     /// Update animation when invisible flag.
     bool updateInvisible_;
+    /// Nodeless skeleton mode flag.
+    bool nodelessSkeleton_;
     /// Animation dirty flag.
     bool animationDirty_;
     /// Animation order dirty flag.
     bool animationOrderDirty_;
     /// Vertex morphs dirty flag.
     bool morphsDirty_;
+    /// Morphed vertex data waiting for upload flag.
+    bool morphsUploadPending_;
     /// Skinning dirty flag.
     bool skinningDirty_;
     /// Bone bounding box dirty flag.
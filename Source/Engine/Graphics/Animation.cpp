@@ -31,6 +31,10 @@
 #include "Serializer.h"
 #include "XMLFile.h"
 
+#ifdef URHO3D_SSE
+#include <emmintrin.h>
+#endif
+
 #include "DebugNew.h"
 
 namespace Urho3D
@@ -41,11 +45,75 @@ inline bool CompareTriggers(AnimationTriggerPoint& lhs, AnimationTriggerPoint& r
     return lhs.time_ < rhs.time_;
 }
 
+static const unsigned MAX_ANIMATION_SAMPLES = 65536;
+static const float QUANTIZE_POSITION_RANGE = 65535.0f;
+static const float QUANTIZE_ROTATION_RANGE = 32767.0f;
+
+/// Quantize a vector channel of the samples, then replace the samples with the dequantized values.
+static void QuantizeVectors(Vector<AnimationKeyFrame>& samples, Vector3 AnimationKeyFrame::* member, Vector3& min,
+    Vector3& scale, PODVector<unsigned short>& dest)
+{
+    min = samples[0].*member;
+    Vector3 max = min;
+    for (unsigned i = 1; i < samples.Size(); ++i)
+    {
+        const Vector3& value = samples[i].*member;
+        min = Vector3(Min(min.x_, value.x_), Min(min.y_, value.y_), Min(min.z_, value.z_));
+        max = Vector3(Max(max.x_, value.x_), Max(max.y_, value.y_), Max(max.z_, value.z_));
+    }
+    
+    scale = (max - min) / QUANTIZE_POSITION_RANGE;
+    Vector3 invScale(scale.x_ > 0.0f ? 1.0f / scale.x_ : 0.0f, scale.y_ > 0.0f ? 1.0f / scale.y_ : 0.0f, scale.z_ > 0.0f ?
+        1.0f / scale.z_ : 0.0f);
+    
+    dest.Resize(samples.Size() * 3);
+    for (unsigned i = 0; i < samples.Size(); ++i)
+    {
+        Vector3 quantized = ((samples[i].*member) - min) * invScale;
+        dest[i * 3] = (unsigned short)(quantized.x_ + 0.5f);
+        dest[i * 3 + 1] = (unsigned short)(quantized.y_ + 0.5f);
+        dest[i * 3 + 2] = (unsigned short)(quantized.z_ + 0.5f);
+        samples[i].*member = min + scale * Vector3((float)dest[i * 3], (float)dest[i * 3 + 1], (float)dest[i * 3 + 2]);
+    }
+}
+
+/// Quantize the rotations of the samples, then replace the samples with the dequantized values.
+static void QuantizeRotations(Vector<AnimationKeyFrame>& samples, PODVector<short>& dest)
+{
+    dest.Resize(samples.Size() * 4);
+    Quaternion previous = Quaternion::IDENTITY;
+    for (unsigned i = 0; i < samples.Size(); ++i)
+    {
+        // Keep consecutive rotations in the same hemisphere so that interpolation takes the short path
+        Quaternion rotation = samples[i].rotation_.Normalized();
+        if (rotation.DotProduct(previous) < 0.0f)
+            rotation = -rotation;
+        previous = rotation;
+        
+        short* quantized = &dest[i * 4];
+        quantized[0] = (short)floorf(rotation.w_ * QUANTIZE_ROTATION_RANGE + 0.5f);
+        quantized[1] = (short)floorf(rotation.x_ * QUANTIZE_ROTATION_RANGE + 0.5f);
+        quantized[2] = (short)floorf(rotation.y_ * QUANTIZE_ROTATION_RANGE + 0.5f);
+        quantized[3] = (short)floorf(rotation.z_ * QUANTIZE_ROTATION_RANGE + 0.5f);
+        samples[i].rotation_ = Quaternion((float)quantized[0], (float)quantized[1], (float)quantized[2], (float)quantized[3]) *
+            (1.0f / QUANTIZE_ROTATION_RANGE);
+        samples[i].rotation_.Normalize();
+    }
+}
+
 void AnimationTrack::GetKeyFrameIndex(float time, unsigned& index) const
 {
     if (time < 0.0f)
         time = 0.0f;
     
+    // Compressed tracks are uniformly sampled, so the index can be calculated directly
+    if (numSamples_)
+    {
+        float sample = sampleInterval_ > 0.0f ? time / sampleInterval_ : 0.0f;
+        index = sample < (float)(numSamples_ - 1) ? (unsigned)sample : numSamples_ - 1;
+        return;
+    }
+    
     if (index >= keyFrames_.Size())
         index = keyFrames_.Size() - 1;
     
@@ -58,6 +126,229 @@ void AnimationTrack::GetKeyFrameIndex(float time, unsigned& index) const
         ++index;
 }
 
+void AnimationTrack::GetKeyFrame(unsigned index, AnimationKeyFrame& dest) const
+{
+    if (!numSamples_)
+    {
+        dest = keyFrames_[index];
+        return;
+    }
+    
+    dest.time_ = index * sampleInterval_;
+    
+    if (channelMask_ & CHANNEL_POSITION)
+    {
+        const unsigned short* src = &positions_[index * 3];
+        dest.position_ = positionMin_ + positionScale_ * Vector3((float)src[0], (float)src[1], (float)src[2]);
+    }
+    else
+        dest.position_ = Vector3::ZERO;
+    
+    if (channelMask_ & CHANNEL_ROTATION)
+    {
+        const short* src = &rotations_[index * 4];
+        #ifdef URHO3D_SSE
+        // Sign-extend the four 16-bit components to 32-bit and convert in one go
+        __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+        __m128i expanded = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+        __m128 values = _mm_mul_ps(_mm_cvtepi32_ps(expanded), _mm_set1_ps(1.0f / QUANTIZE_ROTATION_RANGE));
+        _mm_storeu_ps(&dest.rotation_.w_, values);
+        #else
+        dest.rotation_ = Quaternion((float)src[0], (float)src[1], (float)src[2], (float)src[3]) * (1.0f /
+            QUANTIZE_ROTATION_RANGE);
+        #endif
+        dest.rotation_.Normalize();
+    }
+    else
+        dest.rotation_ = Quaternion::IDENTITY;
+    
+    if (channelMask_ & CHANNEL_SCALE)
+    {
+        const unsigned short* src = &scales_[index * 3];
+        dest.scale_ = scaleMin_ + scaleScale_ * Vector3((float)src[0], (float)src[1], (float)src[2]);
+    }
+    else
+        dest.scale_ = Vector3::ONE;
+}
+
+bool AnimationTrack::Sample(float time, float length, bool looped, unsigned& index, AnimationKeyFrame& dest) const
+{
+    unsigned numKeyFrames = GetNumKeyFrames();
+    if (!numKeyFrames)
+        return false;
+    
+    GetKeyFrameIndex(time, index);
+    
+    // Check if next frame to interpolate to is valid, or if wrapping is needed (looping animation only)
+    unsigned nextIndex = index + 1;
+    bool interpolate = true;
+    if (nextIndex >= numKeyFrames)
+    {
+        if (!looped)
+        {
+            nextIndex = index;
+            interpolate = false;
+        }
+        else
+            nextIndex = 0;
+    }
+    
+    // Compressed samples are decoded to temporary keyframes
+    AnimationKeyFrame decodedKeyFrame;
+    AnimationKeyFrame decodedNextKeyFrame;
+    const AnimationKeyFrame* keyFrame;
+    const AnimationKeyFrame* nextKeyFrame;
+    if (numSamples_)
+    {
+        GetKeyFrame(index, decodedKeyFrame);
+        keyFrame = &decodedKeyFrame;
+        if (interpolate)
+        {
+            GetKeyFrame(nextIndex, decodedNextKeyFrame);
+            nextKeyFrame = &decodedNextKeyFrame;
+        }
+        else
+            nextKeyFrame = keyFrame;
+    }
+    else
+    {
+        keyFrame = &keyFrames_[index];
+        nextKeyFrame = &keyFrames_[nextIndex];
+    }
+    
+    dest.time_ = time;
+    
+    if (!interpolate)
+    {
+        if (channelMask_ & CHANNEL_POSITION)
+            dest.position_ = keyFrame->position_;
+        if (channelMask_ & CHANNEL_ROTATION)
+            dest.rotation_ = keyFrame->rotation_;
+        if (channelMask_ & CHANNEL_SCALE)
+            dest.scale_ = keyFrame->scale_;
+    }
+    else
+    {
+        float timeInterval = nextKeyFrame->time_ - keyFrame->time_;
+        if (timeInterval < 0.0f)
+            timeInterval += length;
+        float t = timeInterval > 0.0f ? (time - keyFrame->time_) / timeInterval : 1.0f;
+        
+        if (channelMask_ & CHANNEL_POSITION)
+            dest.position_ = keyFrame->position_.Lerp(nextKeyFrame->position_, t);
+        if (channelMask_ & CHANNEL_ROTATION)
+            dest.rotation_ = keyFrame->rotation_.Slerp(nextKeyFrame->rotation_, t);
+        if (channelMask_ & CHANNEL_SCALE)
+            dest.scale_ = keyFrame->scale_.Lerp(nextKeyFrame->scale_, t);
+    }
+    
+    return true;
+}
+
+void AnimationTrack::Compress(float positionError, float rotationError, float scaleError)
+{
+    if (numSamples_ || keyFrames_.Empty())
+        return;
+    
+    // Sample over the span of the original keyframes. As the last sample lands on the last keyframe, looping playback
+    // wraps to the first sample the same way as before. Find the smallest keyframe spacing to bound the sample count
+    float duration = keyFrames_.Back().time_;
+    unsigned maxSamples = 1;
+    if (keyFrames_.Size() > 1 && duration > 0.0f)
+    {
+        float minSpacing = duration;
+        for (unsigned i = 1; i < keyFrames_.Size(); ++i)
+        {
+            float spacing = keyFrames_[i].time_ - keyFrames_[i - 1].time_;
+            if (spacing > M_EPSILON && spacing < minSpacing)
+                minSpacing = spacing;
+        }
+        
+        float samples = duration / minSpacing + 1.5f;
+        maxSamples = samples < (float)MAX_ANIMATION_SAMPLES ? Max((int)samples, 2) : MAX_ANIMATION_SAMPLES;
+    }
+    
+    // Error bounds are checked at the original keyframe times: as both the original and the resampled track are
+    // interpolated piecewise, the largest deviation occurs at the original keyframes. The samples are quantized before
+    // the check, so the bounds cover both the resampling and the quantization error
+    Vector<AnimationKeyFrame> samples;
+    Vector3 quantizeMin;
+    Vector3 quantizeScale;
+    PODVector<unsigned short> quantizedVectors;
+    PODVector<short> quantizedRotations;
+    float cosHalfRotationError = cosf(Clamp(rotationError, 0.0f, 180.0f) * M_DEGTORAD * 0.5f);
+    unsigned low = Min((int)maxSamples, 2);
+    unsigned high = maxSamples;
+    
+    // Binary search for the fewest samples within the error bounds. If none qualifies, the maximum is used
+    while (low < high)
+    {
+        unsigned mid = (low + high) / 2;
+        float interval = duration / (float)(mid - 1);
+        samples.Resize(mid);
+        unsigned index = 0;
+        for (unsigned i = 0; i < mid; ++i)
+            Sample(i * interval, duration, false, index, samples[i]);
+        if (channelMask_ & CHANNEL_POSITION)
+            QuantizeVectors(samples, &AnimationKeyFrame::position_, quantizeMin, quantizeScale, quantizedVectors);
+        if (channelMask_ & CHANNEL_ROTATION)
+            QuantizeRotations(samples, quantizedRotations);
+        if (channelMask_ & CHANNEL_SCALE)
+            QuantizeVectors(samples, &AnimationKeyFrame::scale_, quantizeMin, quantizeScale, quantizedVectors);
+        
+        bool withinError = true;
+        for (unsigned i = 0; i < keyFrames_.Size() && withinError; ++i)
+        {
+            const AnimationKeyFrame& keyFrame = keyFrames_[i];
+            float sample = keyFrame.time_ / interval;
+            unsigned j = Min((int)sample, (int)mid - 2);
+            float t = sample - (float)j;
+            
+            if (channelMask_ & CHANNEL_POSITION && (samples[j].position_.Lerp(samples[j + 1].position_, t) -
+                keyFrame.position_).Length() > positionError)
+                withinError = false;
+            if (channelMask_ & CHANNEL_ROTATION && Abs(samples[j].rotation_.Slerp(samples[j + 1].rotation_, t).DotProduct(
+                keyFrame.rotation_)) < cosHalfRotationError)
+                withinError = false;
+            if (channelMask_ & CHANNEL_SCALE && (samples[j].scale_.Lerp(samples[j + 1].scale_, t) -
+                keyFrame.scale_).Length() > scaleError)
+                withinError = false;
+        }
+        
+        if (withinError)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    
+    unsigned numSamples = low;
+    float sampleInterval = numSamples > 1 ? duration / (float)(numSamples - 1) : 0.0f;
+    samples.Resize(numSamples);
+    unsigned index = 0;
+    for (unsigned i = 0; i < numSamples; ++i)
+        Sample(i * sampleInterval, duration, false, index, samples[i]);
+    
+    numSamples_ = numSamples;
+    sampleInterval_ = sampleInterval;
+    
+    // Quantize the samples
+    if (channelMask_ & CHANNEL_POSITION)
+        QuantizeVectors(samples, &AnimationKeyFrame::position_, positionMin_, positionScale_, positions_);
+    if (channelMask_ & CHANNEL_ROTATION)
+        QuantizeRotations(samples, rotations_);
+    if (channelMask_ & CHANNEL_SCALE)
+        QuantizeVectors(samples, &AnimationKeyFrame::scale_, scaleMin_, scaleScale_, scales_);
+    
+    keyFrames_.Clear();
+    keyFrames_.Compact();
+}
+
+unsigned AnimationTrack::GetMemoryUse() const
+{
+    return keyFrames_.Capacity() * sizeof(AnimationKeyFrame) + positions_.Capacity() * sizeof(unsigned short) +
+        rotations_.Capacity() * sizeof(short) + scales_.Capacity() * sizeof(unsigned short);
+}
+
 Animation::Animation(Context* context) :
     Resource(context),
     length_(0.f)
@@ -75,14 +366,14 @@ void Animation::RegisterObject(Context* context)
 
 bool Animation::BeginLoad(Deserializer& source)
 {
-    unsigned memoryUse = sizeof(Animation);
-    
     // Check ID
-    if (source.ReadFileID() != "UANI")
+    String fileID = source.ReadFileID();
+    if (fileID != "UANI" && fileID != "UANC")
     {
         LOGERROR(source.GetName() + " is not a valid animation file");
         return false;
     }
+    bool compressedFormat = fileID == "UANC";
     
     // Read name and length
     animationName_ = source.ReadString();
@@ -92,7 +383,6 @@ bool Animation::BeginLoad(Deserializer& source)
     
     unsigned tracks = source.ReadUInt();
     tracks_.Resize(tracks);
-    memoryUse += tracks * sizeof(AnimationTrack);
     
     // Read tracks
     for (unsigned i = 0; i < tracks; ++i)
@@ -102,9 +392,39 @@ bool Animation::BeginLoad(Deserializer& source)
         newTrack.nameHash_ = newTrack.name_;
         newTrack.channelMask_ = source.ReadUByte();
         
+        // In the compressed format a track may contain uniformly spaced, quantized samples instead of keyframes
+        if (compressedFormat && source.ReadBool())
+        {
+            newTrack.numSamples_ = source.ReadUInt();
+            newTrack.sampleInterval_ = source.ReadFloat();
+            unsigned numSamples = newTrack.numSamples_;
+            if (!numSamples)
+                continue;
+            
+            if (newTrack.channelMask_ & CHANNEL_POSITION)
+            {
+                newTrack.positionMin_ = source.ReadVector3();
+                newTrack.positionScale_ = source.ReadVector3();
+                newTrack.positions_.Resize(numSamples * 3);
+                source.Read(&newTrack.positions_[0], numSamples * 3 * sizeof(unsigned short));
+            }
+            if (newTrack.channelMask_ & CHANNEL_ROTATION)
+            {
+                newTrack.rotations_.Resize(numSamples * 4);
+                source.Read(&newTrack.rotations_[0], numSamples * 4 * sizeof(short));
+            }
+            if (newTrack.channelMask_ & CHANNEL_SCALE)
+            {
+                newTrack.scaleMin_ = source.ReadVector3();
+                newTrack.scaleScale_ = source.ReadVector3();
+                newTrack.scales_.Resize(numSamples * 3);
+                source.Read(&newTrack.scales_[0], numSamples * 3 * sizeof(unsigned short));
+            }
+            continue;
+        }
+        
         unsigned keyFrames = source.ReadUInt();
         newTrack.keyFrames_.Resize(keyFrames);
-        memoryUse += keyFrames * sizeof(AnimationKeyFrame);
         
         // Read keyframes of the track
         for (unsigned j = 0; j < keyFrames; ++j)
@@ -138,18 +458,17 @@ bool Animation::BeginLoad(Deserializer& source)
             
             triggerElem = triggerElem.GetNext("trigger");
         }
-
-        memoryUse += triggers_.Size() * sizeof(AnimationTriggerPoint);
     }
     
-    SetMemoryUse(memoryUse);
+    UpdateMemoryUse();
     return true;
 }
 
 bool Animation::Save(Serializer& dest) const
 {
-    // Write ID, name and length
-    dest.WriteFileID("UANI");
+    // Write ID, name and length. Use the compressed format only if necessary
+    bool compressedFormat = IsCompressed();
+    dest.WriteFileID(compressedFormat ? "UANC" : "UANI");
     dest.WriteString(animationName_);
     dest.WriteFloat(length_);
     
@@ -160,6 +479,34 @@ bool Animation::Save(Serializer& dest) const
         const AnimationTrack& track = tracks_[i];
         dest.WriteString(track.name_);
         dest.WriteUByte(track.channelMask_);
+        
+        if (compressedFormat)
+        {
+            dest.WriteBool(track.IsCompressed());
+            if (track.IsCompressed())
+            {
+                unsigned numSamples = track.numSamples_;
+                dest.WriteUInt(numSamples);
+                dest.WriteFloat(track.sampleInterval_);
+                
+                if (track.channelMask_ & CHANNEL_POSITION)
+                {
+                    dest.WriteVector3(track.positionMin_);
+                    dest.WriteVector3(track.positionScale_);
+                    dest.Write(&track.positions_[0], numSamples * 3 * sizeof(unsigned short));
+                }
+                if (track.channelMask_ & CHANNEL_ROTATION)
+                    dest.Write(&track.rotations_[0], numSamples * 4 * sizeof(short));
+                if (track.channelMask_ & CHANNEL_SCALE)
+                {
+                    dest.WriteVector3(track.scaleMin_);
+                    dest.WriteVector3(track.scaleScale_);
+                    dest.Write(&track.scales_[0], numSamples * 3 * sizeof(unsigned short));
+                }
+                continue;
+            }
+        }
+        
         dest.WriteUInt(track.keyFrames_.Size());
         
         // Write keyframes of the track
@@ -218,6 +565,17 @@ void Animation::SetLength(float length)
 void Animation::SetTracks(const Vector<AnimationTrack>& tracks)
 {
     tracks_ = tracks;
+    UpdateMemoryUse();
+}
+
+void Animation::Compress(float positionError, float rotationError, float scaleError)
+{
+    PROFILE(CompressAnimation);
+    
+    for (Vector<AnimationTrack>::Iterator i = tracks_.Begin(); i != tracks_.End(); ++i)
+        i->Compress(positionError, rotationError, scaleError);
+    
+    UpdateMemoryUse();
 }
 
 void Animation::AddTrigger(float time, bool timeIsNormalized, const Variant& data)
@@ -273,4 +631,25 @@ const AnimationTrack* Animation::GetTrack(StringHash nameHash) const
     return 0;
 }
 
+bool Animation::IsCompressed() const
+{
+    for (Vector<AnimationTrack>::ConstIterator i = tracks_.Begin(); i != tracks_.End(); ++i)
+    {
+        if (i->IsCompressed())
+            return true;
+    }
+    
+    return false;
+}
+
+void Animation::UpdateMemoryUse()
+{
+    unsigned memoryUse = sizeof(Animation) + tracks_.Size() * sizeof(AnimationTrack) + triggers_.Size() *
+        sizeof(AnimationTriggerPoint);
+    for (Vector<AnimationTrack>::ConstIterator i = tracks_.Begin(); i != tracks_.End(); ++i)
+        memoryUse += i->GetMemoryUse();
+    
+    SetMemoryUse(memoryUse);
+}
+
 }
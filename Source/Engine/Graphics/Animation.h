@@ -43,11 +43,31 @@ struct AnimationKeyFrame
     Vector3 scale_;
 };
 
-/// Skeletal animation track, stores keyframes of a single bone.
-struct AnimationTrack
+/// Skeletal animation track, stores keyframes of a single bone. May alternatively be compressed into uniformly spaced, quantized samples.
+struct URHO3D_API AnimationTrack
 {
-    /// Return keyframe index based on time and previous index.
+    /// Construct.
+    AnimationTrack() :
+        channelMask_(0),
+        numSamples_(0),
+        sampleInterval_(0.0f)
+    {
+    }
+    
+    /// Return keyframe index based on time and previous index. Is constant time for a compressed track.
     void GetKeyFrameIndex(float time, unsigned& index) const;
+    /// Return keyframe by index. Decompresses the sample if the track is compressed.
+    void GetKeyFrame(unsigned index, AnimationKeyFrame& dest) const;
+    /// Sample the track at time position. Only the channels included in the channel mask are written. Return false if the track has no keyframes.
+    bool Sample(float time, float length, bool looped, unsigned& index, AnimationKeyFrame& dest) const;
+    /// Compress by resampling uniformly with the fewest samples that stay within the error bounds after quantization. Rotation error is in degrees. The keyframes are removed.
+    void Compress(float positionError, float rotationError, float scaleError);
+    /// Return number of keyframes, or samples if compressed.
+    unsigned GetNumKeyFrames() const { return numSamples_ ? numSamples_ : keyFrames_.Size(); }
+    /// Return whether is compressed.
+    bool IsCompressed() const { return numSamples_ != 0; }
+    /// Return memory use of the keyframe data in bytes.
+    unsigned GetMemoryUse() const;
     
     /// Bone name.
     String name_;
@@ -55,8 +75,26 @@ struct AnimationTrack
     StringHash nameHash_;
     /// Bitmask of included data (position, rotation, scale.)
     unsigned char channelMask_;
-    /// Keyframes.
+    /// Keyframes. Empty when compressed, use GetKeyFrame() to access the decompressed samples.
     Vector<AnimationKeyFrame> keyFrames_;
+    /// Number of samples when compressed, zero if not compressed.
+    unsigned numSamples_;
+    /// Time between samples when compressed. The first sample is at time zero.
+    float sampleInterval_;
+    /// Minimum value of the quantized positions.
+    Vector3 positionMin_;
+    /// Dequantization scale of the positions.
+    Vector3 positionScale_;
+    /// Minimum value of the quantized scales.
+    Vector3 scaleMin_;
+    /// Dequantization scale of the scales.
+    Vector3 scaleScale_;
+    /// Quantized positions, 3 components per sample.
+    PODVector<unsigned short> positions_;
+    /// Quantized rotations, 4 components (w, x, y, z) per sample.
+    PODVector<short> rotations_;
+    /// Quantized scales, 3 components per sample.
+    PODVector<unsigned short> scales_;
 };
 
 /// %Animation trigger point.
@@ -102,6 +140,8 @@ public:
     void SetLength(float length);
     /// Set all animation tracks.
     void SetTracks(const Vector<AnimationTrack>& tracks);
+    /// Compress all tracks into uniformly spaced, quantized samples within the error bounds. Rotation error is in degrees. A compressed animation is saved in the compressed format.
+    void Compress(float positionError, float rotationError, float scaleError);
     /// Add a trigger point.
     void AddTrigger(float time, bool timeIsNormalized, const Variant& data);
     /// Remove a trigger point by index.
@@ -131,8 +171,13 @@ public:
     const Vector<AnimationTriggerPoint>& GetTriggers() const { return triggers_; }
     /// Return number of animation trigger points.
     unsigned GetNumTriggers() const {return triggers_.Size(); }
+    /// Return whether any track is compressed.
+    bool IsCompressed() const;
     
 private:
+    /// Recalculate memory use.
+    void UpdateMemoryUse();
+    
     /// Animation name.
     String animationName_;
     /// Animation name hash.
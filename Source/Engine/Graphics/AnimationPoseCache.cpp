@@ -0,0 +1,135 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Precompiled.h"
+#include "AnimationPoseCache.h"
+
+#include "DebugNew.h"
+
+namespace Urho3D
+{
+
+static unsigned CalculateKeyHash(const PODVector<unsigned>& key)
+{
+    unsigned hash = 0;
+    for (PODVector<unsigned>::ConstIterator i = key.Begin(); i != key.End(); ++i)
+        hash = *i + (hash << 6) + (hash << 16) - hash;
+    return hash;
+}
+
+AnimationPoseCache::AnimationPoseCache() :
+    numPoses_(0),
+    numHits_(0),
+    numMisses_(0)
+{
+}
+
+void AnimationPoseCache::Clear()
+{
+    MutexLock lock(poseMutex_);
+    
+    poseIndices_.Clear();
+    numPoses_ = 0;
+    numHits_ = 0;
+    numMisses_ = 0;
+}
+
+bool AnimationPoseCache::GetPose(const PODVector<unsigned>& key, PODVector<Matrix3x4>& boneTransforms,
+    PODVector<Matrix3x4>& skinMatrices, BoundingBox& boneBoundingBox)
+{
+    unsigned hash = CalculateKeyHash(key);
+    
+    MutexLock lock(poseMutex_);
+    
+    unsigned index = FindPose(key, hash);
+    if (index == M_MAX_UNSIGNED)
+    {
+        ++numMisses_;
+        return false;
+    }
+    
+    const AnimationPose& pose = poses_[index];
+    if (pose.boneTransforms_.Size() != boneTransforms.Size() || pose.skinMatrices_.Size() != skinMatrices.Size())
+    {
+        ++numMisses_;
+        return false;
+    }
+    
+    boneTransforms = pose.boneTransforms_;
+    skinMatrices = pose.skinMatrices_;
+    boneBoundingBox = pose.boneBoundingBox_;
+    ++numHits_;
+    return true;
+}
+
+void AnimationPoseCache::StorePose(const PODVector<unsigned>& key, const PODVector<Matrix3x4>& boneTransforms,
+    const PODVector<Matrix3x4>& skinMatrices, const BoundingBox& boneBoundingBox)
+{
+    unsigned hash = CalculateKeyHash(key);
+    
+    MutexLock lock(poseMutex_);
+    
+    // Another model may have evaluated the same pose concurrently
+    if (FindPose(key, hash) != M_MAX_UNSIGNED)
+        return;
+    
+    if (numPoses_ == poses_.Size())
+        poses_.Resize(numPoses_ + 1);
+    
+    AnimationPose& pose = poses_[numPoses_];
+    pose.key_ = key;
+    pose.boneTransforms_ = boneTransforms;
+    pose.skinMatrices_ = skinMatrices;
+    pose.boneBoundingBox_ = boneBoundingBox;
+    
+    // Chain poses with colliding key hashes
+    HashMap<unsigned, unsigned>::Iterator i = poseIndices_.Find(hash);
+    if (i != poseIndices_.End())
+    {
+        pose.next_ = i->second_;
+        i->second_ = numPoses_;
+    }
+    else
+    {
+        pose.next_ = M_MAX_UNSIGNED;
+        poseIndices_[hash] = numPoses_;
+    }
+    
+    ++numPoses_;
+}
+
+unsigned AnimationPoseCache::FindPose(const PODVector<unsigned>& key, unsigned hash) const
+{
+    HashMap<unsigned, unsigned>::ConstIterator i = poseIndices_.Find(hash);
+    if (i == poseIndices_.End())
+        return M_MAX_UNSIGNED;
+    
+    for (unsigned index = i->second_; index != M_MAX_UNSIGNED; index = poses_[index].next_)
+    {
+        if (poses_[index].key_ == key)
+            return index;
+    }
+    
+    return M_MAX_UNSIGNED;
+}
+
+}
@@ -0,0 +1,93 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "BoundingBox.h"
+#include "HashMap.h"
+#include "Matrix3x4.h"
+#include "Mutex.h"
+
+namespace Urho3D
+{
+
+/// Evaluated skeleton pose stored in the animation pose cache.
+struct AnimationPose
+{
+    /// Construct.
+    AnimationPose() :
+        next_(M_MAX_UNSIGNED)
+    {
+    }
+    
+    /// Key values that determine the pose.
+    PODVector<unsigned> key_;
+    /// Model-space bone transforms.
+    PODVector<Matrix3x4> boneTransforms_;
+    /// Model-space skinning matrices.
+    PODVector<Matrix3x4> skinMatrices_;
+    /// Bounding box calculated from bones.
+    BoundingBox boneBoundingBox_;
+    /// Index of the next pose with the same key hash.
+    unsigned next_;
+};
+
+/// Per-frame cache of evaluated skeleton poses, shared by animated models that play the same animations at the same quantized time and weights. Is thread-safe.
+class URHO3D_API AnimationPoseCache
+{
+public:
+    /// Construct.
+    AnimationPoseCache();
+    
+    /// Remove all poses and reset the hit counters. Pose storage is retained for reuse on the next frame.
+    void Clear();
+    /// Copy a matching pose to the destination. Return true on a cache hit.
+    bool GetPose(const PODVector<unsigned>& key, PODVector<Matrix3x4>& boneTransforms, PODVector<Matrix3x4>& skinMatrices, BoundingBox& boneBoundingBox);
+    /// Store an evaluated pose. If a matching pose already exists, it is kept.
+    void StorePose(const PODVector<unsigned>& key, const PODVector<Matrix3x4>& boneTransforms, const PODVector<Matrix3x4>& skinMatrices, const BoundingBox& boneBoundingBox);
+    
+    /// Return number of stored poses.
+    unsigned GetNumPoses() const { return numPoses_; }
+    /// Return number of cache hits since the last clear.
+    unsigned GetNumHits() const { return numHits_; }
+    /// Return number of cache misses since the last clear.
+    unsigned GetNumMisses() const { return numMisses_; }
+    
+private:
+    /// Return index of a matching pose, or M_MAX_UNSIGNED if not found.
+    unsigned FindPose(const PODVector<unsigned>& key, unsigned hash) const;
+    
+    /// Pose storage. Only the first numPoses_ entries are in use.
+    Vector<AnimationPose> poses_;
+    /// First pose index by key hash.
+    HashMap<unsigned, unsigned> poseIndices_;
+    /// Mutex for accessing the cache from worker threads.
+    Mutex poseMutex_;
+    /// Number of poses in use.
+    unsigned numPoses_;
+    /// Number of cache hits.
+    unsigned numHits_;
+    /// Number of cache misses.
+    unsigned numMisses_;
+};
+
+}
@@ -34,9 +34,17 @@
 namespace Urho3D
 {
 
+static const float POSE_KEY_WEIGHT_SCALE = 1024.0f;
+
+static unsigned QuantizePoseWeight(float weight)
+{
+    return (unsigned)(weight * POSE_KEY_WEIGHT_SCALE + 0.5f);
+}
+
 AnimationStateTrack::AnimationStateTrack() :
     track_(0),
     bone_(0),
+    boneIndex_(M_MAX_UNSIGNED),
     weight_(1.0f),
     keyFrame_(0)
 {
@@ -128,6 +136,47 @@ void AnimationState::SetStartBone(Bone* startBone)
     const Vector<AnimationTrack>& tracks = animation_->GetTracks();
     stateTracks_.Clear();
     
+    // In nodeless skeleton mode, check the bone hierarchy through the parent indices instead of the bone nodes
+    if (model_->GetNodelessSkeleton())
+    {
+        const Vector<Bone>& bones = skeleton.GetBones();
+        unsigned startIndex = M_MAX_UNSIGNED;
+        HashMap<StringHash, unsigned> boneIndices;
+        for (unsigned i = 0; i < bones.Size(); ++i)
+        {
+            boneIndices[bones[i].nameHash_] = i;
+            if (&bones[i] == startBone)
+                startIndex = i;
+        }
+        
+        for (unsigned i = 0; i < tracks.Size(); ++i)
+        {
+            HashMap<StringHash, unsigned>::ConstIterator j = boneIndices.Find(tracks[i].nameHash_);
+            if (j == boneIndices.End())
+                continue;
+            
+            // Include those tracks that are either the start bone itself, or its children
+            unsigned boneIndex = j->second_;
+            unsigned index = boneIndex;
+            unsigned depth = 0;
+            while (index != startIndex && bones[index].parentIndex_ != index && bones[index].parentIndex_ < bones.Size() &&
+                depth++ < bones.Size())
+                index = bones[index].parentIndex_;
+            
+            if (index == startIndex)
+            {
+                AnimationStateTrack stateTrack;
+                stateTrack.track_ = &tracks[i];
+                stateTrack.bone_ = skeleton.GetBone(boneIndex);
+                stateTrack.boneIndex_ = boneIndex;
+                stateTracks_.Push(stateTrack);
+            }
+        }
+        
+        model_->MarkAnimationDirty();
+        return;
+    }
+    
     if (!startBone->node_)
         return;
     
@@ -210,7 +259,18 @@ void AnimationState::SetBoneWeight(unsigned index, float weight, bool recursive)
     if (recursive)
     {
         Node* boneNode = stateTracks_[index].node_;
-        if (boneNode)
+        unsigned boneIndex = stateTracks_[index].boneIndex_;
+        // In nodeless skeleton mode find the child bones through the parent indices
+        if (!boneNode && boneIndex != M_MAX_UNSIGNED)
+        {
+            for (unsigned i = 0; i < stateTracks_.Size(); ++i)
+            {
+                const AnimationStateTrack& stateTrack = stateTracks_[i];
+                if (stateTrack.boneIndex_ != boneIndex && stateTrack.bone_ && stateTrack.bone_->parentIndex_ == boneIndex)
+                    SetBoneWeight(i, weight, true);
+            }
+        }
+        else if (boneNode)
         {
             const Vector<SharedPtr<Node> >& children = boneNode->GetChildren();
             for (unsigned i = 0; i < children.Size(); ++i)
@@ -355,7 +415,8 @@ unsigned AnimationState::GetTrackIndex(const String& name) const
     for (unsigned i = 0; i < stateTracks_.Size(); ++i)
     {
         Node* node = stateTracks_[i].node_;
-        if (node && node->GetName() == name)
+        Bone* bone = stateTracks_[i].bone_;
+        if (node ? node->GetName() == name : bone && bone->name_ == name)
             return i;
     }
     
@@ -378,7 +439,8 @@ unsigned AnimationState::GetTrackIndex(StringHash nameHash) const
     for (unsigned i = 0; i < stateTracks_.Size(); ++i)
     {
         Node* node = stateTracks_[i].node_;
-        if (node && node->GetNameHash() == nameHash)
+        Bone* bone = stateTracks_[i].bone_;
+        if (node ? node->GetNameHash() == nameHash : bone && bone->nameHash_ == nameHash)
             return i;
     }
 
@@ -401,8 +463,58 @@ void AnimationState::Apply()
         ApplyToNodes();
 }
 
+void AnimationState::ApplyQuantized(float timeStep)
+{
+    if (!animation_ || !IsEnabled())
+        return;
+    
+    if (!model_ || !model_->GetNodelessSkeleton() || timeStep <= 0.0f)
+    {
+        Apply();
+        return;
+    }
+    
+    // Evaluate at the start of the time step and at the weights stored in the key, not at the exact values of this model
+    float time = (float)(unsigned)(time_ / timeStep) * timeStep;
+    float weight = QuantizePoseWeight(weight_) / POSE_KEY_WEIGHT_SCALE;
+    
+    for (Vector<AnimationStateTrack>::Iterator i = stateTracks_.Begin(); i != stateTracks_.End(); ++i)
+    {
+        AnimationStateTrack& stateTrack = *i;
+        float finalWeight = weight * (QuantizePoseWeight(stateTrack.weight_) / POSE_KEY_WEIGHT_SCALE);
+        
+        if (Equals(finalWeight, 0.0f) || !stateTrack.bone_->animated_)
+            continue;
+        
+        ApplyTrackToBonePose(stateTrack, finalWeight, time);
+    }
+}
+
+void AnimationState::AddPoseKey(PODVector<unsigned>& key, float timeStep) const
+{
+    if (!animation_ || !IsEnabled())
+        return;
+    
+    unsigned long long animationAddress = (unsigned long long)(size_t)animation_.Get();
+    key.Push((unsigned)animationAddress);
+    key.Push((unsigned)(animationAddress >> 32));
+    key.Push((unsigned)(time_ / timeStep));
+    key.Push(QuantizePoseWeight(weight_));
+    key.Push(layer_ | (looped_ ? 0x100 : 0));
+    
+    // The bone indices of the tracks also identify the start bone
+    key.Push(stateTracks_.Size());
+    for (Vector<AnimationStateTrack>::ConstIterator i = stateTracks_.Begin(); i != stateTracks_.End(); ++i)
+    {
+        key.Push(i->boneIndex_);
+        key.Push(QuantizePoseWeight(i->weight_));
+    }
+}
+
 void AnimationState::ApplyToModel()
 {
+    bool nodeless = model_->GetNodelessSkeleton();
+    
     for (Vector<AnimationStateTrack>::Iterator i = stateTracks_.Begin(); i != stateTracks_.End(); ++i)
     {
         AnimationStateTrack& stateTrack = *i;
@@ -412,7 +524,9 @@ void AnimationState::ApplyToModel()
         if (Equals(finalWeight, 0.0f) || !stateTrack.bone_->animated_)
             continue;
         
-        if (Equals(finalWeight, 1.0f))
+        if (nodeless)
+            ApplyTrackToBonePose(stateTrack, finalWeight, time_);
+        else if (Equals(finalWeight, 1.0f))
             ApplyTrackFullWeightSilent(stateTrack);
         else
             ApplyTrackBlendedSilent(stateTrack, finalWeight);
@@ -430,176 +544,83 @@ void AnimationState::ApplyTrackFullWeight(AnimationStateTrack& stateTrack)
 {
     const AnimationTrack* track = stateTrack.track_;
     Node* node = stateTrack.node_;
+    AnimationKeyFrame sample;
     
-    if (track->keyFrames_.Empty() || !node)
+    if (!node || !track->Sample(time_, animation_->GetLength(), looped_, stateTrack.keyFrame_, sample))
         return;
     
-    unsigned& frame = stateTrack.keyFrame_;
-    track->GetKeyFrameIndex(time_, frame);
-    
-    // Check if next frame to interpolate to is valid, or if wrapping is needed (looping animation only)
-    unsigned nextFrame = frame + 1;
-    bool interpolate = true;
-    if (nextFrame >= track->keyFrames_.Size())
-    {
-        if (!looped_)
-        {
-            nextFrame = frame;
-            interpolate = false;
-        }
-        else
-            nextFrame = 0;
-    }
-    
-    const AnimationKeyFrame* keyFrame = &track->keyFrames_[frame];
     unsigned char channelMask = track->channelMask_;
-    
-    if (!interpolate)
-    {
-        // No interpolation, full weight
-        if (channelMask & CHANNEL_POSITION)
-            node->SetPosition(keyFrame->position_);
-        if (channelMask & CHANNEL_ROTATION)
-            node->SetRotation(keyFrame->rotation_);
-        if (channelMask & CHANNEL_SCALE)
-            node->SetScale(keyFrame->scale_);
-    }
-    else
-    {
-        const AnimationKeyFrame* nextKeyFrame = &track->keyFrames_[nextFrame];
-        float timeInterval = nextKeyFrame->time_ - keyFrame->time_;
-        if (timeInterval < 0.0f)
-            timeInterval += animation_->GetLength();
-        float t = timeInterval > 0.0f ? (time_ - keyFrame->time_) / timeInterval : 1.0f;
-        
-        // Interpolation, full weight
-        if (channelMask & CHANNEL_POSITION)
-            node->SetPosition(keyFrame->position_.Lerp(nextKeyFrame->position_, t));
-        if (channelMask & CHANNEL_ROTATION)
-            node->SetRotation(keyFrame->rotation_.Slerp(nextKeyFrame->rotation_, t));
-        if (channelMask & CHANNEL_SCALE)
-            node->SetScale(keyFrame->scale_.Lerp(nextKeyFrame->scale_, t));
-    }
+    if (channelMask & CHANNEL_POSITION)
+        node->SetPosition(sample.position_);
+    if (channelMask & CHANNEL_ROTATION)
+        node->SetRotation(sample.rotation_);
+    if (channelMask & CHANNEL_SCALE)
+        node->SetScale(sample.scale_);
 }
 
 void AnimationState::ApplyTrackFullWeightSilent(AnimationStateTrack& stateTrack)
 {
     const AnimationTrack* track = stateTrack.track_;
     Node* node = stateTrack.node_;
-
-    if (track->keyFrames_.Empty() || !node)
+    AnimationKeyFrame sample;
+    
+    if (!node || !track->Sample(time_, animation_->GetLength(), looped_, stateTrack.keyFrame_, sample))
         return;
-
-    unsigned& frame = stateTrack.keyFrame_;
-    track->GetKeyFrameIndex(time_, frame);
-
-    // Check if next frame to interpolate to is valid, or if wrapping is needed (looping animation only)
-    unsigned nextFrame = frame + 1;
-    bool interpolate = true;
-    if (nextFrame >= track->keyFrames_.Size())
-    {
-        if (!looped_)
-        {
-            nextFrame = frame;
-            interpolate = false;
-        }
-        else
-            nextFrame = 0;
-    }
-
-    const AnimationKeyFrame* keyFrame = &track->keyFrames_[frame];
+    
     unsigned char channelMask = track->channelMask_;
-
-    if (!interpolate)
-    {
-        // No interpolation, full weight
-        if (channelMask & CHANNEL_POSITION)
-            node->SetPositionSilent(keyFrame->position_);
-        if (channelMask & CHANNEL_ROTATION)
-            node->SetRotationSilent(keyFrame->rotation_);
-        if (channelMask & CHANNEL_SCALE)
-            node->SetScaleSilent(keyFrame->scale_);
-    }
-    else
-    {
-        const AnimationKeyFrame* nextKeyFrame = &track->keyFrames_[nextFrame];
-        float timeInterval = nextKeyFrame->time_ - keyFrame->time_;
-        if (timeInterval < 0.0f)
-            timeInterval += animation_->GetLength();
-        float t = timeInterval > 0.0f ? (time_ - keyFrame->time_) / timeInterval : 1.0f;
-
-        // Interpolation, full weight
-        if (channelMask & CHANNEL_POSITION)
-            node->SetPositionSilent(keyFrame->position_.Lerp(nextKeyFrame->position_, t));
-        if (channelMask & CHANNEL_ROTATION)
-            node->SetRotationSilent(keyFrame->rotation_.Slerp(nextKeyFrame->rotation_, t));
-        if (channelMask & CHANNEL_SCALE)
-            node->SetScaleSilent(keyFrame->scale_.Lerp(nextKeyFrame->scale_, t));
-    }
+    if (channelMask & CHANNEL_POSITION)
+        node->SetPositionSilent(sample.position_);
+    if (channelMask & CHANNEL_ROTATION)
+        node->SetRotationSilent(sample.rotation_);
+    if (channelMask & CHANNEL_SCALE)
+        node->SetScaleSilent(sample.scale_);
 }
 
 void AnimationState::ApplyTrackBlendedSilent(AnimationStateTrack& stateTrack, float weight)
 {
     const AnimationTrack* track = stateTrack.track_;
     Node* node = stateTrack.node_;
+    AnimationKeyFrame sample;
     
-    if (track->keyFrames_.Empty() || !node)
+    if (!node || !track->Sample(time_, animation_->GetLength(), looped_, stateTrack.keyFrame_, sample))
         return;
     
-    unsigned& frame = stateTrack.keyFrame_;
-    track->GetKeyFrameIndex(time_, frame);
+    // Blend between old transform & animation
+    unsigned char channelMask = track->channelMask_;
+    if (channelMask & CHANNEL_POSITION)
+        node->SetPositionSilent(node->GetPosition().Lerp(sample.position_, weight));
+    if (channelMask & CHANNEL_ROTATION)
+        node->SetRotationSilent(node->GetRotation().Slerp(sample.rotation_, weight));
+    if (channelMask & CHANNEL_SCALE)
+        node->SetScaleSilent(node->GetScale().Lerp(sample.scale_, weight));
+}
+
+void AnimationState::ApplyTrackToBonePose(AnimationStateTrack& stateTrack, float weight, float time)
+{
+    const AnimationTrack* track = stateTrack.track_;
+    unsigned index = stateTrack.boneIndex_;
+    AnimationKeyFrame sample;
     
-    // Check if next frame to interpolate to is valid, or if wrapping is needed (looping animation only)
-    unsigned nextFrame = frame + 1;
-    bool interpolate = true;
-    if (nextFrame >= track->keyFrames_.Size())
-    {
-        if (!looped_)
-        {
-            nextFrame = frame;
-            interpolate = false;
-        }
-        else
-            nextFrame = 0;
-    }
+    if (index >= model_->boneTransforms_.Size() || !track->Sample(time, animation_->GetLength(), looped_,
+        stateTrack.keyFrame_, sample))
+        return;
     
-    const AnimationKeyFrame* keyFrame = &track->keyFrames_[frame];
     unsigned char channelMask = track->channelMask_;
-    
-    if (!interpolate)
+    bool blend = !Equals(weight, 1.0f);
+    if (channelMask & CHANNEL_POSITION)
     {
-        // No interpolation, blend between old transform & animation
-        if (channelMask & CHANNEL_POSITION)
-            node->SetPositionSilent(node->GetPosition().Lerp(keyFrame->position_, weight));
-        if (channelMask & CHANNEL_ROTATION)
-            node->SetRotationSilent(node->GetRotation().Slerp(keyFrame->rotation_, weight));
-        if (channelMask & CHANNEL_SCALE)
-            node->SetScaleSilent(node->GetScale().Lerp(keyFrame->scale_, weight));
+        Vector3& position = model_->bonePositions_[index];
+        position = blend ? position.Lerp(sample.position_, weight) : sample.position_;
     }
-    else
+    if (channelMask & CHANNEL_ROTATION)
     {
-        const AnimationKeyFrame* nextKeyFrame = &track->keyFrames_[nextFrame];
-        float timeInterval = nextKeyFrame->time_ - keyFrame->time_;
-        if (timeInterval < 0.0f)
-            timeInterval += animation_->GetLength();
-        float t = timeInterval > 0.0f ? (time_ - keyFrame->time_) / timeInterval : 1.0f;
-        
-        // Interpolation, blend between old transform & animation
-        if (channelMask & CHANNEL_POSITION)
-        {
-            node->SetPositionSilent(node->GetPosition().Lerp(
-                keyFrame->position_.Lerp(nextKeyFrame->position_, t), weight));
-        }
-        if (channelMask & CHANNEL_ROTATION)
-        {
-            node->SetRotationSilent(node->GetRotation().Slerp(
-                keyFrame->rotation_.Slerp(nextKeyFrame->rotation_, t), weight));
-        }
-        if (channelMask & CHANNEL_SCALE)
-        {
-            node->SetScaleSilent(node->GetScale().Lerp(
-                keyFrame->scale_.Lerp(nextKeyFrame->scale_, t), weight));
-        }
+        Quaternion& rotation = model_->boneRotations_[index];
+        rotation = blend ? rotation.Slerp(sample.rotation_, weight) : sample.rotation_;
+    }
+    if (channelMask & CHANNEL_SCALE)
+    {
+        Vector3& scale = model_->boneScales_[index];
+        scale = blend ? scale.Lerp(sample.scale_, weight) : sample.scale_;
     }
 }
 
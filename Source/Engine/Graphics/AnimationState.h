@@ -48,6 +48,8 @@ struct AnimationStateTrack
     const AnimationTrack* track_;
     /// Bone pointer.
     Bone* bone_;
+    /// Bone index.
+    unsigned boneIndex_;
     /// Scene node pointer.
     WeakPtr<Node> node_;
     /// Blending weight.
@@ -123,6 +125,10 @@ public:
     
     /// Apply the animation at the current time position.
     void Apply();
+    /// Apply the animation at the time position and weights quantized like in the pose cache key, so that all models with the same key get an identical pose. Used in nodeless skeleton mode.
+    void ApplyQuantized(float timeStep);
+    /// Append the values that determine the applied pose to an animation pose cache key, with the time position quantized to the specified step.
+    void AddPoseKey(PODVector<unsigned>& key, float timeStep) const;
     
 private:
     /// Apply animation to a skeleton. Transform changes are applied silently, so the model needs to dirty its root model afterward.
@@ -135,6 +141,8 @@ private:
     void ApplyTrackFullWeightSilent(AnimationStateTrack& stateTrack);
     /// Apply animation track to a scene node, blended with current node transform. Apply transform changes silently without marking the node dirty.
     void ApplyTrackBlendedSilent(AnimationStateTrack& stateTrack, float weight);
+    /// Apply animation track to the bone pose arrays of a model in nodeless skeleton mode, blended with the current pose.
+    void ApplyTrackToBonePose(AnimationStateTrack& stateTrack, float weight, float time);
 
     /// Animated model (model mode.)
     WeakPtr<AnimatedModel> model_;
@@ -38,6 +38,10 @@
 #include "View.h"
 #include "Zone.h"
 
+#ifdef URHO3D_SSE
+#include <xmmintrin.h>
+#endif
+
 #include "DebugNew.h"
 
 namespace Urho3D
@@ -230,8 +234,14 @@ void Batch::Prepare(View* view, bool setModelTransform) const
         view->SetGBufferShaderParameters(viewSize, IntRect(0, 0, viewSize.x_, viewSize.y_));
     }
     
-    // Set model or skinning transforms
-    if (setModelTransform && graphics->NeedParameterUpdate(SP_OBJECTTRANSFORM, worldTransform_))
+    // Set model or skinning transforms. Packed positions are dequantized by the model transform, which then differs from
+    // the other geometries of the same object, so it is always set and its source forgotten
+    if (setModelTransform && geometryType_ != GEOM_SKINNED && geometry_->IsPositionQuantized())
+    {
+        graphics->SetShaderParameter(VSP_MODEL, *worldTransform_ * geometry_->GetPositionTransform());
+        graphics->ClearParameterSource(SP_OBJECTTRANSFORM);
+    }
+    else if (setModelTransform && graphics->NeedParameterUpdate(SP_OBJECTTRANSFORM, worldTransform_))
     {
         if (geometryType_ == GEOM_SKINNED)
         {
@@ -603,19 +613,65 @@ void Batch::Draw(View* view) const
 }
 
 void BatchGroup::SetTransforms(void* lockedData, unsigned& freeIndex)
+{
+    if (SetStartIndex(freeIndex))
+    {
+        WriteTransforms(lockedData);
+        FinishTransforms();
+    }
+}
+
+bool BatchGroup::SetStartIndex(unsigned& freeIndex)
 {
     // Do not use up buffer space if not going to draw as instanced
     if (geometryType_ != GEOM_INSTANCED)
-        return;
+        return false;
     
     startIndex_ = freeIndex;
+    freeIndex += instances_.Size();
+    return true;
+}
+
+void BatchGroup::WriteTransforms(void* lockedData) const
+{
     Matrix3x4* dest = (Matrix3x4*)lockedData;
-    dest += freeIndex;
+    dest += startIndex_;
+    
+    if (geometry_->IsPositionQuantized())
+    {
+        const Matrix3x4& positionTransform = geometry_->GetPositionTransform();
+        for (unsigned i = 0; i < instances_.Size(); ++i)
+            *dest++ = *instances_[i].worldTransform_ * positionTransform;
+        return;
+    }
+    
+    #ifdef URHO3D_SSE
+    // The instancing buffer is write-only, so use streaming stores to bypass the cache when the destination is aligned
+    if (!((size_t)dest & 15))
+    {
+        float* destData = reinterpret_cast<float*>(dest);
+        for (unsigned i = 0; i < instances_.Size(); ++i)
+        {
+            const float* srcData = instances_[i].worldTransform_->Data();
+            _mm_stream_ps(destData, _mm_loadu_ps(srcData));
+            _mm_stream_ps(destData + 4, _mm_loadu_ps(srcData + 4));
+            _mm_stream_ps(destData + 8, _mm_loadu_ps(srcData + 8));
+            destData += 12;
+        }
+        return;
+    }
+    #endif
     
     for (unsigned i = 0; i < instances_.Size(); ++i)
         *dest++ = *instances_[i].worldTransform_;
-    
-    freeIndex += instances_.Size();
+}
+
+void BatchGroup::FinishTransforms()
+{
+    #ifdef URHO3D_SSE
+    // Make the streaming stores globally visible. One fence covers all groups written by this thread
+    _mm_sfence();
+    #endif
 }
 
 void BatchGroup::Draw(View* view) const
@@ -636,7 +692,12 @@ void BatchGroup::Draw(View* view) const
             
             for (unsigned i = 0; i < instances_.Size(); ++i)
             {
-                if (graphics->NeedParameterUpdate(SP_OBJECTTRANSFORM, instances_[i].worldTransform_))
+                if (geometry_->IsPositionQuantized())
+                {
+                    graphics->SetShaderParameter(VSP_MODEL, *instances_[i].worldTransform_ * geometry_->GetPositionTransform());
+                    graphics->ClearParameterSource(SP_OBJECTTRANSFORM);
+                }
+                else if (graphics->NeedParameterUpdate(SP_OBJECTTRANSFORM, instances_[i].worldTransform_))
                     graphics->SetShaderParameter(VSP_MODEL, *instances_[i].worldTransform_);
                 
                 graphics->Draw(geometry_->GetPrimitiveType(), geometry_->GetIndexStart(), geometry_->GetIndexCount(),
@@ -669,8 +730,17 @@ void BatchGroup::Draw(View* view) const
                     Matrix3x4* dest = (Matrix3x4*)instanceBuffer->Lock(0, instances, true);
                     if (dest)
                     {
-                        for (unsigned i = 0; i < instances; ++i)
-                            dest[i] = *instances_[i + startIndex].worldTransform_;
+                        if (geometry_->IsPositionQuantized())
+                        {
+                            const Matrix3x4& positionTransform = geometry_->GetPositionTransform();
+                            for (unsigned i = 0; i < instances; ++i)
+                                dest[i] = *instances_[i + startIndex].worldTransform_ * positionTransform;
+                        }
+                        else
+                        {
+                            for (unsigned i = 0; i < instances; ++i)
+                                dest[i] = *instances_[i + startIndex].worldTransform_;
+                        }
                         instanceBuffer->Unlock();
                         
                         graphics->SetIndexBuffer(geometry_->GetIndexBuffer());
@@ -831,7 +901,21 @@ void BatchQueue::SortFrontToBack2Pass(PODVector<Batch*>& batches)
 void BatchQueue::SetTransforms(void* lockedData, unsigned& freeIndex)
 {
     for (HashMap<BatchGroupKey, BatchGroup>::Iterator i = batchGroups_.Begin(); i != batchGroups_.End(); ++i)
-        i->second_.SetTransforms(lockedData, freeIndex);
+    {
+        if (i->second_.SetStartIndex(freeIndex))
+            i->second_.WriteTransforms(lockedData);
+    }
+    
+    BatchGroup::FinishTransforms();
+}
+
+void BatchQueue::SetStartIndices(unsigned& freeIndex, PODVector<BatchGroup*>& instancedGroups)
+{
+    for (HashMap<BatchGroupKey, BatchGroup>::Iterator i = batchGroups_.Begin(); i != batchGroups_.End(); ++i)
+    {
+        if (i->second_.SetStartIndex(freeIndex))
+            instancedGroups.Push(&i->second_);
+    }
 }
 
 void BatchQueue::Draw(View* view, bool markToStencil, bool usingLightOptimization) const
@@ -167,8 +167,14 @@ struct BatchGroup : public Batch
     
     /// Pre-set the instance transforms. Buffer must be big enough to hold all transforms.
     void SetTransforms(void* lockedData, unsigned& freeIndex);
+    /// Assign the instance stream start index and advance the free index. Return whether is drawn instanced.
+    bool SetStartIndex(unsigned& freeIndex);
+    /// Copy the instance transforms to the assigned start index. May be called from worker threads. Call FinishTransforms() on the same thread after the last group has been written.
+    void WriteTransforms(void* lockedData) const;
     /// Prepare and draw.
     void Draw(View* view) const;
+    /// Make the instance transforms written by the calling thread visible before the buffer is unlocked.
+    static void FinishTransforms();
     
     /// Instance data.
     PODVector<InstanceData> instances_;
@@ -228,6 +234,8 @@ public:
     void SortFrontToBack2Pass(PODVector<Batch*>& batches);
     /// Pre-set instance transforms of all groups. The vertex buffer must be big enough to hold all transforms.
     void SetTransforms(void* lockedData, unsigned& freeIndex);
+    /// Assign instance stream start indices of all groups and collect the instanced groups for writing the transforms.
+    void SetStartIndices(unsigned& freeIndex, PODVector<BatchGroup*>& instancedGroups);
     /// Draw.
     void Draw(View* view, bool markToStencil = false, bool usingLightOptimization = false) const;
     /// Return the combined amount of instances.
@@ -33,9 +33,11 @@
 #include "Node.h"
 #include "OctreeQuery.h"
 #include "Profiler.h"
+#include "Renderer.h"
 #include "ResourceCache.h"
-#include "Sort.h"
-#include "VertexBuffer.h"
+#include "Thread.h"
+#include "TransientBuffer.h"
+#include "WorkQueue.h"
 
 #include "DebugNew.h"
 
@@ -45,6 +47,9 @@ namespace Urho3D
 extern const char* GEOMETRY_CATEGORY;
 
 static const float INV_SQRT_TWO = 1.0f / sqrtf(2.0f);
+static const unsigned BILLBOARDS_PER_WORK_ITEM = 1024;
+static const unsigned BILLBOARD_SORT_RADIX_BITS = 8;
+static const unsigned BILLBOARD_SORT_RADIX_SIZE = 1 << BILLBOARD_SORT_RADIX_BITS;
 
 const char* faceCameraModeNames[] =
 {
@@ -56,9 +61,13 @@ const char* faceCameraModeNames[] =
     0
 };
 
-inline bool CompareBillboards(Billboard* lhs, Billboard* rhs)
+void WriteBillboardVerticesWork(const WorkItem* item, unsigned threadIndex)
 {
-    return lhs->sortDistance_ > rhs->sortDistance_;
+    BillboardSet* billboardSet = reinterpret_cast<BillboardSet*>(item->aux_);
+    float* start = reinterpret_cast<float*>(item->start_);
+    float* end = reinterpret_cast<float*>(item->end_);
+    float* first = &billboardSet->vertexData_[0];
+    billboardSet->WriteVertices((start - first) / 32, (end - first) / 32);
 }
 
 BillboardSet::BillboardSet(Context* context) :
@@ -69,19 +78,20 @@ BillboardSet::BillboardSet(Context* context) :
     scaled_(true),
     sorted_(false),
     faceCameraMode_(FC_ROTATE_XYZ),
+    billboardsModified_(false),
     geometry_(new Geometry(context)),
-    vertexBuffer_(new VertexBuffer(context_)),
-    indexBuffer_(new IndexBuffer(context_)),
-    bufferSizeDirty_(true),
     bufferDirty_(true),
     forceUpdate_(false),
     sortThisFrame_(false),
     sortFrameNumber_(0),
-    previousOffset_(Vector3::ZERO)
+    previousOffset_(Vector3::ZERO),
+    transientFrameNumber_(0),
+    rewriteVertices_(false),
+    transientVertices_(0),
+    transientIndices_(0),
+    transientVertexStart_(0),
+    largeIndices_(false)
 {
-    geometry_->SetVertexBuffer(0, vertexBuffer_, MASK_POSITION | MASK_COLOR | MASK_TEXCOORD1 | MASK_TEXCOORD2);
-    geometry_->SetIndexBuffer(indexBuffer_);
-
     batches_.Resize(1);
     batches_[0].geometry_ = geometry_;
     batches_[0].geometryType_ = GEOM_BILLBOARD;
@@ -191,11 +201,12 @@ void BillboardSet::UpdateBatches(const FrameInfo& frame)
 
 void BillboardSet::UpdateGeometry(const FrameInfo& frame)
 {
-    if (bufferSizeDirty_ || indexBuffer_->IsDataLost())
-        UpdateBufferSize();
-
-    if (bufferDirty_ || sortThisFrame_ || vertexBuffer_->IsDataLost())
-        UpdateVertexBuffer(frame);
+    bool rewritten = (bufferDirty_ || sortThisFrame_) && UpdateVertexBuffer(frame);
+    
+    // The transient geometry is only valid for the current frame, so copy the vertices on each frame, and again if they
+    // were rewritten for this view
+    if (rewritten || frame.frameNumber_ != transientFrameNumber_)
+        WriteTransientGeometry(frame, rewritten);
     
     // If using camera facing, re-update the rotation for the current view now
     if (faceCameraMode_ != FC_NONE)
@@ -207,13 +218,13 @@ void BillboardSet::UpdateGeometry(const FrameInfo& frame)
 
 UpdateGeometryType BillboardSet::GetUpdateGeometryType()
 {
-    // If using camera facing, always need some kind of geometry update, in case the billboard set is rendered from several views
-    if (bufferDirty_ || bufferSizeDirty_ || vertexBuffer_->IsDataLost() || indexBuffer_->IsDataLost() || sortThisFrame_)
+    // The vertices are copied into the renderer's transient buffers on each frame, which can happen in a worker thread. Large
+    // billboard sets are instead written in parallel chunks queued from the main thread
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    if (queue && queue->GetNumThreads() && billboards_.Size() >= BILLBOARDS_PER_WORK_ITEM * 2)
         return UPDATE_MAIN_THREAD;
-    else if (faceCameraMode_ != FC_NONE)
-        return UPDATE_WORKER_THREAD;
     else
-        return UPDATE_NONE;
+        return UPDATE_WORKER_THREAD;
 }
 
 void BillboardSet::SetMaterial(Material* material)
@@ -245,7 +256,7 @@ void BillboardSet::SetNumBillboards(unsigned num)
         billboards_[i].enabled_ = false;
     }
 
-    bufferSizeDirty_ = true;
+    forceUpdate_ = true;
     Commit();
 }
 
@@ -292,6 +303,7 @@ Material* BillboardSet::GetMaterial() const
 
 Billboard* BillboardSet::GetBillboard(unsigned index)
 {
+    billboardsModified_ = true;
     return index < billboards_.Size() ? &billboards_[index] : (Billboard*)0;
 }
 
@@ -337,6 +349,7 @@ void BillboardSet::SetNetBillboardsAttr(const PODVector<unsigned char>& value)
         i->enabled_ = buf.ReadBool();
     }
 
+    billboardsModified_ = true;
     Commit();
 }
 
@@ -409,42 +422,7 @@ void BillboardSet::OnWorldBoundingBoxUpdate()
     worldBoundingBox_ = worldBox;
 }
 
-void BillboardSet::UpdateBufferSize()
-{
-    unsigned numBillboards = billboards_.Size();
-
-    if (vertexBuffer_->GetVertexCount() != numBillboards * 4)
-        vertexBuffer_->SetSize(numBillboards * 4, MASK_POSITION | MASK_COLOR | MASK_TEXCOORD1 | MASK_TEXCOORD2, true);
-    if (indexBuffer_->GetIndexCount() != numBillboards * 6)
-        indexBuffer_->SetSize(numBillboards * 6, false);
-
-    bufferSizeDirty_ = false;
-    bufferDirty_ = true;
-    forceUpdate_ = true;
-
-    if (!numBillboards)
-        return;
-
-    // Indices do not change for a given billboard capacity
-    unsigned short* dest = (unsigned short*)indexBuffer_->Lock(0, numBillboards * 6, true);
-    if (!dest)
-        return;
-
-    unsigned vertexIndex = 0;
-    while (numBillboards--)
-    {
-        dest[0] = vertexIndex; dest[1] = vertexIndex + 1; dest[2] = vertexIndex + 2;
-        dest[3] = vertexIndex + 2; dest[4] = vertexIndex + 3; dest[5] = vertexIndex;
-
-        dest += 6;
-        vertexIndex += 4;
-    }
-
-    indexBuffer_->Unlock();
-    indexBuffer_->ClearDataLost();
-}
-
-void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
+bool BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
 {
     // If using animation LOD, accumulate time and see if it is time to update
     if (animationLodBias_ > 0.0f && lodDistance_ > 0.0f)
@@ -456,7 +434,7 @@ void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
         {
             // No LOD if immediate update forced
             if (!forceUpdate_)
-                return;
+                return false;
         }
     }
 
@@ -464,7 +442,7 @@ void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
     unsigned enabledBillboards = 0;
     const Matrix3x4& worldTransform = node_->GetWorldTransform();
     Matrix3x4 billboardTransform = relative_ ? worldTransform : Matrix3x4::IDENTITY;
-    Vector3 billboardScale = scaled_ ? worldTransform.Scale() : Vector3::ONE;
+    billboardScale_ = scaled_ ? worldTransform.Scale() : Vector3::ONE;
 
     // First check number of enabled billboards
     for (unsigned i = 0; i < numBillboards; ++i)
@@ -488,67 +466,236 @@ void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
         }
     }
 
-    batches_[0].geometry_->SetDrawRange(TRIANGLE_LIST, 0, enabledBillboards * 6, false);
-
     bufferDirty_ = false;
     forceUpdate_ = false;
     if (!enabledBillboards)
-        return;
+    {
+        vertexData_.Clear();
+        return true;
+    }
 
     if (sorted_)
     {
-        Sort(sortedBillboards_.Begin(), sortedBillboards_.End(), CompareBillboards);
+        SortBillboards();
         Vector3 worldPos = node_->GetWorldPosition();
         // Store the "last sorted position" now
         previousOffset_ = (worldPos - frame.camera_->GetNode()->GetWorldPosition());
     }
     
-    float* dest = (float*)vertexBuffer_->Lock(0, enabledBillboards * 4, true);
-    if (!dest)
+    // Keep the vertices in CPU memory, so that they can be copied to the transient buffers on the following frames. They
+    // are written along with the transient buffers
+    vertexData_.Resize(enabledBillboards * 32);
+    return true;
+}
+
+void BillboardSet::WriteTransientGeometry(const FrameInfo& frame, bool rewrite)
+{
+    transientFrameNumber_ = frame.frameNumber_;
+    rewriteVertices_ = rewrite;
+    transientVertices_ = 0;
+    transientIndices_ = 0;
+    
+    unsigned numBillboards = vertexData_.Size() / 32;
+    if (!numBillboards)
+    {
+        geometry_->SetDrawRange(TRIANGLE_LIST, 0, 0, 0, 0, false);
+        return;
+    }
+    
+    Renderer* renderer = GetSubsystem<Renderer>();
+    if (renderer)
+        AllocateTransientGeometry(renderer, numBillboards);
+    else
+        geometry_->SetDrawRange(TRIANGLE_LIST, 0, 0, 0, 0, false);
+    
+    // If nothing to copy, and no need to keep the rewritten vertices, can return now
+    if (!transientVertices_ && !rewriteVertices_)
+        return;
+    
+    // Split large billboard sets into chunks that write disjoint ranges of the vertex data and the transient buffers in
+    // parallel. This is only done on the main thread during the view's geometry update, which completes the work items
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    unsigned numWorkItems = queue && Thread::IsMainThread() ? Min((int)(numBillboards / BILLBOARDS_PER_WORK_ITEM),
+        (int)queue->GetNumThreads() + 1) : 1;
+    if (numWorkItems > 1)
+    {
+        unsigned billboardsPerItem = numBillboards / numWorkItems;
+        float* start = &vertexData_[0];
+        for (unsigned i = 0; i < numWorkItems; ++i)
+        {
+            float* end = i < numWorkItems - 1 ? start + billboardsPerItem * 32 : &vertexData_[0] + numBillboards * 32;
+            
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = WriteBillboardVerticesWork;
+            item->aux_ = this;
+            item->start_ = start;
+            item->end_ = end;
+            queue->AddWorkItem(item);
+            
+            start = end;
+        }
+    }
+    else
+        WriteVertices(0, numBillboards);
+}
+
+void BillboardSet::AllocateTransientGeometry(Renderer* renderer, unsigned numBillboards)
+{
+    // Allocate the vertices and indices of this frame from the renderer's transient buffers. They were created on the main
+    // thread by Renderer, so looking them up is thread-safe
+    TransientBuffer* vertexBuffer = renderer->GetTransientVertexBuffer(MASK_BILLBOARD);
+    unsigned vertexStart;
+    void* vertices = vertexBuffer->Allocate(numBillboards * 4, vertexStart);
+    bool largeIndices = vertexStart + numBillboards * 4 > 0xffff;
+    TransientBuffer* indexBuffer = renderer->GetTransientIndexBuffer(largeIndices);
+    unsigned indexStart;
+    void* indices = indexBuffer->Allocate(numBillboards * 6, indexStart);
+    if (!vertices || !indices)
+    {
+        geometry_->SetDrawRange(TRIANGLE_LIST, 0, 0, 0, 0, false);
+        return;
+    }
+    
+    transientVertices_ = reinterpret_cast<float*>(vertices);
+    transientIndices_ = indices;
+    transientVertexStart_ = vertexStart;
+    largeIndices_ = largeIndices;
+    
+    geometry_->SetVertexBuffer(0, vertexBuffer->GetVertexBuffer(), MASK_BILLBOARD);
+    geometry_->SetIndexBuffer(indexBuffer->GetIndexBuffer());
+    geometry_->SetDrawRange(TRIANGLE_LIST, indexStart, numBillboards * 6, vertexStart, numBillboards * 4, false);
+}
+
+void BillboardSet::SortBillboards()
+{
+    unsigned numBillboards = sortedBillboards_.Size();
+    sortBuffer_.Resize(numBillboards);
+    sortKeys_.Resize(numBillboards);
+    sortKeyBuffer_.Resize(numBillboards);
+
+    // Squared distances are non-negative, so their bit patterns sort in the same order as the floats. Invert them to sort
+    // back to front
+    for (unsigned i = 0; i < numBillboards; ++i)
+    {
+        union
+        {
+            float distance_;
+            unsigned bits_;
+        } key;
+        key.distance_ = sortedBillboards_[i]->sortDistance_;
+        sortKeys_[i] = ~key.bits_;
+    }
+
+    // Stable least significant digit radix sort. Skip the passes where all keys have the same digit
+    unsigned counts[BILLBOARD_SORT_RADIX_SIZE];
+    for (unsigned shift = 0; shift < 32; shift += BILLBOARD_SORT_RADIX_BITS)
+    {
+        memset(counts, 0, sizeof counts);
+        for (unsigned i = 0; i < numBillboards; ++i)
+            ++counts[(sortKeys_[i] >> shift) & (BILLBOARD_SORT_RADIX_SIZE - 1)];
+        if (counts[(sortKeys_[0] >> shift) & (BILLBOARD_SORT_RADIX_SIZE - 1)] == numBillboards)
+            continue;
+
+        unsigned offset = 0;
+        for (unsigned i = 0; i < BILLBOARD_SORT_RADIX_SIZE; ++i)
+        {
+            unsigned count = counts[i];
+            counts[i] = offset;
+            offset += count;
+        }
+
+        for (unsigned i = 0; i < numBillboards; ++i)
+        {
+            unsigned dest = counts[(sortKeys_[i] >> shift) & (BILLBOARD_SORT_RADIX_SIZE - 1)]++;
+            sortKeyBuffer_[dest] = sortKeys_[i];
+            sortBuffer_[dest] = sortedBillboards_[i];
+        }
+
+        sortKeys_.Swap(sortKeyBuffer_);
+        sortedBillboards_.Swap(sortBuffer_);
+    }
+}
+
+void BillboardSet::WriteVertices(unsigned start, unsigned end)
+{
+    if (rewriteVertices_)
+        ExpandBillboards(start, end);
+    
+    if (!transientVertices_)
         return;
+    
+    memcpy(transientVertices_ + start * 32, &vertexData_[start * 32], (end - start) * 32 * sizeof(float));
+    
+    // The indices refer to the vertices by their position in the whole transient buffer
+    if (largeIndices_)
+    {
+        unsigned* dest = reinterpret_cast<unsigned*>(transientIndices_) + start * 6;
+        for (unsigned i = start; i < end; ++i)
+        {
+            unsigned base = transientVertexStart_ + i * 4;
+            dest[0] = base; dest[1] = base + 1; dest[2] = base + 2;
+            dest[3] = base + 2; dest[4] = base + 3; dest[5] = base;
+            dest += 6;
+        }
+    }
+    else
+    {
+        unsigned short* dest = reinterpret_cast<unsigned short*>(transientIndices_) + start * 6;
+        for (unsigned i = start; i < end; ++i)
+        {
+            unsigned short base = (unsigned short)(transientVertexStart_ + i * 4);
+            dest[0] = base; dest[1] = base + 1; dest[2] = base + 2;
+            dest[3] = base + 2; dest[4] = base + 3; dest[5] = base;
+            dest += 6;
+        }
+    }
+}
+
+void BillboardSet::ExpandBillboards(unsigned start, unsigned end)
+{
+    float* dest = &vertexData_[start * 32];
 
-    for (unsigned i = 0; i < enabledBillboards; ++i)
+    for (unsigned i = start; i < end; ++i)
     {
-        Billboard& billboard = *sortedBillboards_[i];
+        const Billboard& billboard = *sortedBillboards_[i];
 
-        Vector2 size(billboard.size_.x_ * billboardScale.x_, billboard.size_.y_ * billboardScale.y_);
+        Vector2 size(billboard.size_.x_ * billboardScale_.x_, billboard.size_.y_ * billboardScale_.y_);
         unsigned color = billboard.color_.ToUInt();
-
-        float rotationMatrix[2][2];
-        rotationMatrix[0][0] = Cos(billboard.rotation_);
-        rotationMatrix[0][1] = Sin(billboard.rotation_);
-        rotationMatrix[1][0] = -rotationMatrix[0][1];
-        rotationMatrix[1][1] = rotationMatrix[0][0];
+        float cosAngle = Cos(billboard.rotation_);
+        float sinAngle = Sin(billboard.rotation_);
+
+        // The corner offsets are combinations of the rotated X and Y half-extents: (-x + y), (x + y), (x - y), (-x - y)
+        float corners[8];
+        float axisX[2] = { size.x_ * cosAngle, -size.x_ * sinAngle };
+        float axisY[2] = { size.y_ * sinAngle, size.y_ * cosAngle };
+        corners[0] = -axisX[0] + axisY[0]; corners[1] = -axisX[1] + axisY[1];
+        corners[2] = axisX[0] + axisY[0]; corners[3] = axisX[1] + axisY[1];
+        corners[4] = axisX[0] - axisY[0]; corners[5] = axisX[1] - axisY[1];
+        corners[6] = -axisX[0] - axisY[0]; corners[7] = -axisX[1] - axisY[1];
 
         dest[0] = billboard.position_.x_; dest[1] = billboard.position_.y_; dest[2] = billboard.position_.z_;
         ((unsigned&)dest[3]) = color;
         dest[4] = billboard.uv_.min_.x_; dest[5] = billboard.uv_.min_.y_;
-        dest[6] = -size.x_ * rotationMatrix[0][0] + size.y_ * rotationMatrix[0][1];
-        dest[7] = -size.x_ * rotationMatrix[1][0] + size.y_ * rotationMatrix[1][1];
+        dest[6] = corners[0]; dest[7] = corners[1];
 
         dest[8] = billboard.position_.x_; dest[9] = billboard.position_.y_; dest[10] = billboard.position_.z_;
         ((unsigned&)dest[11]) = color;
         dest[12] = billboard.uv_.max_.x_; dest[13] = billboard.uv_.min_.y_;
-        dest[14] = size.x_ * rotationMatrix[0][0] + size.y_ * rotationMatrix[0][1];
-        dest[15] = size.x_ * rotationMatrix[1][0] + size.y_ * rotationMatrix[1][1];
+        dest[14] = corners[2]; dest[15] = corners[3];
 
         dest[16] = billboard.position_.x_; dest[17] = billboard.position_.y_; dest[18] = billboard.position_.z_;
         ((unsigned&)dest[19]) = color;
         dest[20] = billboard.uv_.max_.x_; dest[21] = billboard.uv_.max_.y_;
-        dest[22] = size.x_ * rotationMatrix[0][0] - size.y_ * rotationMatrix[0][1];
-        dest[23] = size.x_ * rotationMatrix[1][0] - size.y_ * rotationMatrix[1][1];
+        dest[22] = corners[4]; dest[23] = corners[5];
 
         dest[24] = billboard.position_.x_; dest[25] = billboard.position_.y_; dest[26] = billboard.position_.z_;
         ((unsigned&)dest[27]) = color;
         dest[28] = billboard.uv_.min_.x_; dest[29] = billboard.uv_.max_.y_;
-        dest[30] = -size.x_ * rotationMatrix[0][0] - size.y_ * rotationMatrix[0][1];
-        dest[31] = -size.x_ * rotationMatrix[1][0] - size.y_ * rotationMatrix[1][1];
+        dest[30] = corners[6]; dest[31] = corners[7];
 
         dest += 32;
     }
-
-    vertexBuffer_->Unlock();
-    vertexBuffer_->ClearDataLost();
 }
 
 void BillboardSet::MarkPositionsDirty()
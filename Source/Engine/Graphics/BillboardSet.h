@@ -31,8 +31,7 @@
 namespace Urho3D
 {
 
-class IndexBuffer;
-class VertexBuffer;
+class Renderer;
 
 /// One billboard in the billboard set.
 struct URHO3D_API Billboard
@@ -54,10 +53,13 @@ struct URHO3D_API Billboard
 };
 
 static const unsigned MAX_BILLBOARDS = 65536 / 4;
+static const unsigned MASK_BILLBOARD = MASK_POSITION | MASK_COLOR | MASK_TEXCOORD1 | MASK_TEXCOORD2;
 
 /// %Billboard component.
 class URHO3D_API BillboardSet : public Drawable
 {
+    friend void WriteBillboardVerticesWork(const WorkItem* item, unsigned threadIndex);
+    
     OBJECT(BillboardSet);
 
 public:
@@ -98,9 +100,9 @@ public:
     Material* GetMaterial() const;
     /// Return number of billboards.
     unsigned GetNumBillboards() const { return billboards_.Size(); }
-    /// Return all billboards.
-    PODVector<Billboard>& GetBillboards() { return billboards_; }
-    /// Return billboard by index.
+    /// Return all billboards for modification.
+    PODVector<Billboard>& GetBillboards() { billboardsModified_ = true; return billboards_; }
+    /// Return billboard by index for modification.
     Billboard* GetBillboard(unsigned index);
     /// Return whether billboards are relative to the scene node.
     bool IsRelative() const { return relative_; }
@@ -148,23 +150,27 @@ protected:
     bool sorted_;
     /// Billboard rotation mode in relation to the camera.
     FaceCameraMode faceCameraMode_;
+    /// Billboards returned for modification flag.
+    bool billboardsModified_;
 
 private:
-    /// Resize billboard vertex and index buffers.
-    void UpdateBufferSize();
-    /// Rewrite billboard vertex buffer.
-    void UpdateVertexBuffer(const FrameInfo& frame);
+    /// Sort the billboards and resize the vertex data for a rewrite. May be called from a worker thread. Return true if the vertices changed.
+    bool UpdateVertexBuffer(const FrameInfo& frame);
+    /// Rewrite the vertices if necessary, and copy them and write the indices into the renderer's transient buffers for the current frame. Large billboard sets are split into work items when called from the main thread. May be called from a worker thread.
+    void WriteTransientGeometry(const FrameInfo& frame, bool rewrite);
+    /// Allocate the vertices and indices of the current frame from the renderer's transient buffers and set the draw range.
+    void AllocateTransientGeometry(Renderer* renderer, unsigned numBillboards);
+    /// Sort the enabled billboards back to front by their sort distance.
+    void SortBillboards();
+    /// Rewrite and copy the vertices and write the indices of a range of billboards. May be called from worker threads.
+    void WriteVertices(unsigned start, unsigned end);
+    /// Write the vertices of a range of sorted billboards into the vertex data.
+    void ExpandBillboards(unsigned start, unsigned end);
 
     /// Geometry.
     SharedPtr<Geometry> geometry_;
-    /// Vertex buffer.
-    SharedPtr<VertexBuffer> vertexBuffer_;
-    /// Index buffer.
-    SharedPtr<IndexBuffer> indexBuffer_;
     /// Transform matrices for position and billboard orientation.
     Matrix3x4 transforms_[2];
-    /// Buffers need resize flag.
-    bool bufferSizeDirty_;
     /// Vertex buffer needs rewrite flag.
     bool bufferDirty_;
     /// Force update flag (ignore animation LOD momentarily.)
@@ -176,7 +182,29 @@ private:
     /// Previous offset to camera for determining whether sorting is necessary.
     Vector3 previousOffset_;
     /// Billboard pointers for sorting.
-    Vector<Billboard*> sortedBillboards_;
+    PODVector<Billboard*> sortedBillboards_;
+    /// Billboard pointer buffer for the radix sort passes.
+    PODVector<Billboard*> sortBuffer_;
+    /// Radix sort keys.
+    PODVector<unsigned> sortKeys_;
+    /// Radix sort key buffer.
+    PODVector<unsigned> sortKeyBuffer_;
+    /// Vertex data, copied to the transient buffers on each frame.
+    PODVector<float> vertexData_;
+    /// Frame number on which the vertices were last copied to the transient buffers.
+    unsigned transientFrameNumber_;
+    /// Rewrite the vertex data during the transient buffer write flag.
+    bool rewriteVertices_;
+    /// Transient vertex allocation of the current frame.
+    float* transientVertices_;
+    /// Transient index allocation of the current frame.
+    void* transientIndices_;
+    /// First vertex of the transient vertex allocation.
+    unsigned transientVertexStart_;
+    /// Transient indices are 32-bit flag.
+    bool largeIndices_;
+    /// Billboard size scale during the vertex buffer rewrite.
+    Vector3 billboardScale_;
     /// Attribute buffer for network replication.
     mutable VectorBuffer attrBuffer_;
 };
@@ -64,6 +64,7 @@ Camera::Camera(Context* context) :
     lodBias_(1.0f),
     viewMask_(DEFAULT_VIEWMASK),
     viewOverrideFlags_(VO_NONE),
+    revision_(0),
     fillMode_(FILL_SOLID),
     projectionOffset_(Vector2::ZERO),
     reflectionPlane_(Plane::UP),
@@ -114,6 +115,7 @@ void Camera::SetNearClip(float nearClip)
     nearClip_ = Max(nearClip, M_MIN_NEARCLIP);
     frustumDirty_ = true;
     projectionDirty_ = true;
+    ++revision_;
     MarkNetworkUpdate();
 }
 
@@ -122,6 +124,7 @@ void Camera::SetFarClip(float farClip)
     farClip_ = Max(farClip, M_MIN_NEARCLIP);
     frustumDirty_ = true;
     projectionDirty_ = true;
+    ++revision_;
     MarkNetworkUpdate();
 }
 
@@ -130,6 +133,7 @@ void Camera::SetFov(float fov)
     fov_ = Clamp(fov, 0.0f, M_MAX_FOV);
     frustumDirty_ = true;
     projectionDirty_ = true;
+    ++revision_;
     MarkNetworkUpdate();
 }
 
@@ -139,6 +143,7 @@ void Camera::SetOrthoSize(float orthoSize)
     aspectRatio_ = 1.0f;
     frustumDirty_ = true;
     projectionDirty_ = true;
+    ++revision_;
     MarkNetworkUpdate();
 }
 
@@ -149,6 +154,7 @@ void Camera::SetOrthoSize(const Vector2& orthoSize)
     aspectRatio_ = orthoSize.x_ / orthoSize.y_;
     frustumDirty_ = true;
     projectionDirty_ = true;
+    ++revision_;
     MarkNetworkUpdate();
 }
 
@@ -163,24 +169,28 @@ void Camera::SetZoom(float zoom)
     zoom_ = Max(zoom, M_EPSILON);
     frustumDirty_ = true;
     projectionDirty_ = true;
+    ++revision_;
     MarkNetworkUpdate();
 }
 
 void Camera::SetLodBias(float bias)
 {
     lodBias_ = Max(bias, M_EPSILON);
+    ++revision_;
     MarkNetworkUpdate();
 }
 
 void Camera::SetViewMask(unsigned mask)
 {
     viewMask_ = mask;
+    ++revision_;
     MarkNetworkUpdate();
 }
 
 void Camera::SetViewOverrideFlags(unsigned flags)
 {
     viewOverrideFlags_ = flags;
+    ++revision_;
     MarkNetworkUpdate();
 }
 
@@ -195,6 +205,7 @@ void Camera::SetOrthographic(bool enable)
     orthographic_ = enable;
     frustumDirty_ = true;
     projectionDirty_ = true;
+    ++revision_;
     MarkNetworkUpdate();
 }
 
@@ -216,6 +227,7 @@ void Camera::SetUseReflection(bool enable)
     useReflection_ = enable;
     viewDirty_ = true;
     frustumDirty_ = true;
+    ++revision_;
     MarkNetworkUpdate();
 }
 
@@ -225,6 +237,7 @@ void Camera::SetReflectionPlane(const Plane& plane)
     reflectionMatrix_ = reflectionPlane_.ReflectionMatrix();
     viewDirty_ = true;
     frustumDirty_ = true;
+    ++revision_;
     MarkNetworkUpdate();
 }
 
@@ -596,6 +609,8 @@ const Matrix3x4& Camera::GetView() const
 
 void Camera::SetAspectRatioInternal(float aspectRatio)
 {
+    if (aspectRatio != aspectRatio_)
+        ++revision_;
     aspectRatio_ = aspectRatio;
     frustumDirty_ = true;
     projectionDirty_ = true;
@@ -632,6 +647,7 @@ void Camera::OnMarkedDirty(Node* node)
 {
     frustumDirty_ = true;
     viewDirty_ = true;
+    ++revision_;
 }
 
 }
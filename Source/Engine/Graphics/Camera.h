@@ -169,6 +169,8 @@ public:
     Matrix3x4 GetEffectiveWorldTransform() const;
     /// Return if projection parameters are valid for rendering and raycasting.
     bool IsProjectionValid() const;
+    /// Return revision. Is incremented when the transform or a parameter affecting culling or LOD changes.
+    unsigned GetRevision() const { return revision_; }
 
     /// Set aspect ratio without disabling the "auto aspect ratio" mode. Called internally by View.
     void SetAspectRatioInternal(float aspectRatio);
@@ -220,6 +222,8 @@ private:
     unsigned viewMask_;
     /// View override flags.
     unsigned viewOverrideFlags_;
+    /// Revision.
+    unsigned revision_;
     /// Fill mode.
     FillMode fillMode_;
     /// Projection offset.
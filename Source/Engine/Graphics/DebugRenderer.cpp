@@ -28,11 +28,14 @@
 #include "CoreEvents.h"
 #include "DebugRenderer.h"
 #include "Graphics.h"
+#include "GraphicsEvents.h"
 #include "Light.h"
 #include "Polyhedron.h"
 #include "Profiler.h"
+#include "Renderer.h"
 #include "ResourceCache.h"
 #include "ShaderVariation.h"
+#include "TransientBuffer.h"
 #include "VertexBuffer.h"
 
 #include "DebugNew.h"
@@ -48,10 +51,11 @@ static const unsigned MAX_LINES = 1000000;
 static const unsigned MAX_TRIANGLES = 100000;
 
 DebugRenderer::DebugRenderer(Context* context) :
-    Component(context)
+    Component(context),
+    vertexStart_(0),
+    numVertices_(0)
 {
-    vertexBuffer_ = new VertexBuffer(context_);
-
+    SubscribeToEvent(E_BEGINRENDERING, HANDLER(DebugRenderer, HandleBeginRendering));
     SubscribeToEvent(E_ENDFRAME, HANDLER(DebugRenderer, HandleEndFrame));
 }
 
@@ -327,23 +331,103 @@ void DebugRenderer::Render()
         return;
 
     Graphics* graphics = GetSubsystem<Graphics>();
+    Renderer* renderer = GetSubsystem<Renderer>();
     // Engine does not render when window is closed or device is lost
     assert(graphics && graphics->IsInitialized() && !graphics->IsDeviceLost());
+    if (!renderer)
+        return;
 
     PROFILE(RenderDebugGeometry);
 
     ShaderVariation* vs = graphics->GetShader(VS, "Basic", "VERTEXCOLOR");
     ShaderVariation* ps = graphics->GetShader(PS, "Basic", "VERTEXCOLOR");
     
-    unsigned numVertices = (lines_.Size() + noDepthLines_.Size()) * 2 + (triangles_.Size() + noDepthTriangles_.Size()) * 3;
-    // Resize the vertex buffer if too small or much too large
-    if (vertexBuffer_->GetVertexCount() < numVertices || vertexBuffer_->GetVertexCount() > numVertices * 2)
-        vertexBuffer_->SetSize(numVertices, MASK_POSITION | MASK_COLOR, true);
+    // The vertices are normally written when rendering begins and uploaded by Renderer along with the other transient
+    // geometry. Only geometry added after that needs to be written and uploaded here
+    TransientBuffer* vertexBuffer = renderer->GetTransientVertexBuffer(MASK_POSITION | MASK_COLOR);
+    if (GetNumVertices() != numVertices_)
+    {
+        WriteVertices();
+        vertexBuffer->Upload();
+    }
+    if (!numVertices_)
+        return;
+    unsigned start = vertexStart_;
+
+    graphics->SetBlendMode(BLEND_REPLACE);
+    graphics->SetColorWrite(true);
+    graphics->SetCullMode(CULL_NONE);
+    graphics->SetDepthWrite(true);
+    graphics->SetDrawAntialiased(true);
+    graphics->SetScissorTest(false);
+    graphics->SetStencilTest(false);
+    graphics->SetShaders(vs, ps);
+    graphics->SetShaderParameter(VSP_MODEL, Matrix3x4::IDENTITY);
+    graphics->SetShaderParameter(VSP_VIEWPROJ, projection_ * view_);
+    graphics->SetShaderParameter(PSP_MATDIFFCOLOR, Color(1.0f, 1.0f, 1.0f, 1.0f));
+    // The parameters were set directly, so forget the sources remembered for them
+    graphics->ClearTransformSources();
+    graphics->ClearParameterSource(SP_MATERIAL);
+    graphics->SetVertexBuffer(vertexBuffer->GetVertexBuffer());
+
+    unsigned count = 0;
+    if (lines_.Size())
+    {
+        count = lines_.Size() * 2;
+        graphics->SetDepthTest(CMP_LESSEQUAL);
+        graphics->Draw(LINE_LIST, start, count);
+        start += count;
+    }
+    if (noDepthLines_.Size())
+    {
+        count = noDepthLines_.Size() * 2;
+        graphics->SetDepthTest(CMP_ALWAYS);
+        graphics->Draw(LINE_LIST, start, count);
+        start += count;
+    }
+    
+    graphics->SetBlendMode(BLEND_ALPHA);
+    
+    if (triangles_.Size())
+    {
+        count = triangles_.Size() * 3;
+        graphics->SetDepthTest(CMP_LESSEQUAL);
+        graphics->Draw(TRIANGLE_LIST, start, count);
+        start += count;
+    }
+    if (noDepthTriangles_.Size())
+    {
+        count = noDepthTriangles_.Size() * 3;
+        graphics->SetDepthTest(CMP_ALWAYS);
+        graphics->Draw(TRIANGLE_LIST, start, count);
+    }
+}
+
+bool DebugRenderer::IsInside(const BoundingBox& box) const
+{
+    return frustum_.IsInsideFast(box) == INSIDE;
+}
 
-    float* dest = (float*)vertexBuffer_->Lock(0, numVertices, true);
+unsigned DebugRenderer::GetNumVertices() const
+{
+    return (lines_.Size() + noDepthLines_.Size()) * 2 + (triangles_.Size() + noDepthTriangles_.Size()) * 3;
+}
+
+void DebugRenderer::WriteVertices()
+{
+    numVertices_ = 0;
+    
+    Renderer* renderer = GetSubsystem<Renderer>();
+    unsigned numVertices = GetNumVertices();
+    if (!renderer || !numVertices)
+        return;
+    
+    // Write the vertices into the renderer's transient vertex buffer shared with other dynamic geometry
+    TransientBuffer* vertexBuffer = renderer->GetTransientVertexBuffer(MASK_POSITION | MASK_COLOR);
+    float* dest = (float*)vertexBuffer->Allocate(numVertices, vertexStart_);
     if (!dest)
         return;
-
+    
     for (unsigned i = 0; i < lines_.Size(); ++i)
     {
         const DebugLine& line = lines_[i];
@@ -400,58 +484,14 @@ void DebugRenderer::Render()
         dest += 12;
     }
 
-    vertexBuffer_->Unlock();
-
-    graphics->SetBlendMode(BLEND_REPLACE);
-    graphics->SetColorWrite(true);
-    graphics->SetCullMode(CULL_NONE);
-    graphics->SetDepthWrite(true);
-    graphics->SetDrawAntialiased(true);
-    graphics->SetScissorTest(false);
-    graphics->SetStencilTest(false);
-    graphics->SetShaders(vs, ps);
-    graphics->SetShaderParameter(VSP_MODEL, Matrix3x4::IDENTITY);
-    graphics->SetShaderParameter(VSP_VIEWPROJ, projection_ * view_);
-    graphics->SetShaderParameter(PSP_MATDIFFCOLOR, Color(1.0f, 1.0f, 1.0f, 1.0f));
-    graphics->SetVertexBuffer(vertexBuffer_);
-
-    unsigned start = 0;
-    unsigned count = 0;
-    if (lines_.Size())
-    {
-        count = lines_.Size() * 2;
-        graphics->SetDepthTest(CMP_LESSEQUAL);
-        graphics->Draw(LINE_LIST, start, count);
-        start += count;
-    }
-    if (noDepthLines_.Size())
-    {
-        count = noDepthLines_.Size() * 2;
-        graphics->SetDepthTest(CMP_ALWAYS);
-        graphics->Draw(LINE_LIST, start, count);
-        start += count;
-    }
-    
-    graphics->SetBlendMode(BLEND_ALPHA);
-    
-    if (triangles_.Size())
-    {
-        count = triangles_.Size() * 3;
-        graphics->SetDepthTest(CMP_LESSEQUAL);
-        graphics->Draw(TRIANGLE_LIST, start, count);
-        start += count;
-    }
-    if (noDepthTriangles_.Size())
-    {
-        count = noDepthTriangles_.Size() * 3;
-        graphics->SetDepthTest(CMP_ALWAYS);
-        graphics->Draw(TRIANGLE_LIST, start, count);
-    }
+    numVertices_ = numVertices;
 }
 
-bool DebugRenderer::IsInside(const BoundingBox& box) const
+void DebugRenderer::HandleBeginRendering(StringHash eventType, VariantMap& eventData)
 {
-    return frustum_.IsInsideFast(box) == INSIDE;
+    // Write the vertices before Renderer uploads the transient geometry of the frame, so that each view can reuse them
+    if (IsEnabledEffective())
+        WriteVertices();
 }
 
 void DebugRenderer::HandleEndFrame(StringHash eventType, VariantMap& eventData)
@@ -462,6 +502,7 @@ void DebugRenderer::HandleEndFrame(StringHash eventType, VariantMap& eventData)
     unsigned trianglesSize = triangles_.Size();
     unsigned noDepthTrianglesSize = noDepthTriangles_.Size();
 
+    numVertices_ = 0;
     lines_.Clear();
     noDepthLines_.Clear();
     triangles_.Clear();
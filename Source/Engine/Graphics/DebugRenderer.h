@@ -38,7 +38,6 @@ class Matrix3x4;
 class Renderer;
 class Skeleton;
 class Sphere;
-class VertexBuffer;
 
 /// Debug rendering line.
 struct DebugLine
@@ -130,7 +129,7 @@ public:
     void AddSkeleton(const Skeleton& skeleton, const Color& color, bool depthTest = true);
     /// Add a triangle mesh.
     void AddTriangleMesh(const void* vertexData, unsigned vertexSize, const void* indexData, unsigned indexSize, unsigned indexStart, unsigned indexCount, const Matrix3x4& transform, const Color& color, bool depthTest = true);
-    /// Update vertex buffer and render all debug lines. The viewport and rendertarget should be set before.
+    /// Render all debug lines, writing and uploading any geometry added after rendering began. The viewport and rendertarget should be set before.
     void Render();
     
     /// Return the view transform.
@@ -143,6 +142,12 @@ public:
     bool IsInside(const BoundingBox& box) const;
     
 private:
+    /// Return number of vertices needed for the current debug geometry.
+    unsigned GetNumVertices() const;
+    /// Write the debug geometry into the transient vertex buffer.
+    void WriteVertices();
+    /// Handle frame rendering start. Write the debug geometry.
+    void HandleBeginRendering(StringHash eventType, VariantMap& eventData);
     /// Handle end of frame. Clear debug geometry.
     void HandleEndFrame(StringHash eventType, VariantMap& eventData);
     
@@ -160,8 +165,10 @@ private:
     Matrix4 projection_;
     /// View frustum.
     Frustum frustum_;
-    /// Vertex buffer.
-    SharedPtr<VertexBuffer> vertexBuffer_;
+    /// Start of the written vertices in the transient vertex buffer.
+    unsigned vertexStart_;
+    /// Number of vertices written on this frame.
+    unsigned numVertices_;
 };
 
 }
@@ -40,6 +40,11 @@
 #include "Tangent.h"
 #include "VectorBuffer.h"
 #include "VertexBuffer.h"
+#include "WorkQueue.h"
+
+#ifdef URHO3D_SSE
+#include <xmmintrin.h>
+#endif
 
 #include "DebugNew.h"
 
@@ -57,6 +62,113 @@ static const unsigned STATIC_ELEMENT_MASK = MASK_POSITION | MASK_NORMAL | MASK_T
 static const unsigned SKINNED_ELEMENT_MASK = MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1 | MASK_TANGENT | MASK_BLENDWEIGHTS |
     MASK_BLENDINDICES;
 
+/// Decal frustum planes in structure-of-arrays layout for testing a vertex against all planes at once.
+struct DecalClipPlanes
+{
+    /// Construct from a frustum. The unused planes are always passed.
+    DecalClipPlanes(const Frustum& frustum)
+    {
+        for (unsigned i = 0; i < 8; ++i)
+        {
+            if (i < NUM_FRUSTUM_PLANES)
+            {
+                const Plane& plane = frustum.planes_[i];
+                normalX_[i] = plane.normal_.x_;
+                normalY_[i] = plane.normal_.y_;
+                normalZ_[i] = plane.normal_.z_;
+                d_[i] = plane.d_;
+            }
+            else
+            {
+                normalX_[i] = normalY_[i] = normalZ_[i] = 0.0f;
+                d_[i] = 1.0f;
+            }
+        }
+    }
+
+    /// Return a bitmask of the planes the point is outside of.
+    unsigned GetOutsidePlanes(const Vector3& point) const
+    {
+#ifdef URHO3D_SSE
+        __m128 x = _mm_set1_ps(point.x_);
+        __m128 y = _mm_set1_ps(point.y_);
+        __m128 z = _mm_set1_ps(point.z_);
+        __m128 zero = _mm_setzero_ps();
+        __m128 distances0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&normalX_[0]), x), _mm_mul_ps(_mm_loadu_ps(&normalY_[0]),
+            y)), _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&normalZ_[0]), z), _mm_loadu_ps(&d_[0])));
+        __m128 distances1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&normalX_[4]), x), _mm_mul_ps(_mm_loadu_ps(&normalY_[4]),
+            y)), _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&normalZ_[4]), z), _mm_loadu_ps(&d_[4])));
+        return _mm_movemask_ps(_mm_cmplt_ps(distances0, zero)) | (_mm_movemask_ps(_mm_cmplt_ps(distances1, zero)) << 4);
+#else
+        unsigned mask = 0;
+        for (unsigned i = 0; i < NUM_FRUSTUM_PLANES; ++i)
+        {
+            if (normalX_[i] * point.x_ + normalY_[i] * point.y_ + normalZ_[i] * point.z_ + d_[i] < 0.0f)
+                mask |= 1 << i;
+        }
+        return mask;
+#endif
+    }
+
+    /// Plane normal X components.
+    float normalX_[8];
+    /// Plane normal Y components.
+    float normalY_[8];
+    /// Plane normal Z components.
+    float normalZ_[8];
+    /// Plane constants.
+    float d_[8];
+};
+
+/// %Decal being built, possibly in a worker thread.
+struct PendingDecal : public WorkItem
+{
+    /// Construct.
+    PendingDecal() :
+        decalSet_(0),
+        target_(0),
+        normalCutoff_(0.0f)
+    {
+    }
+
+    /// Mutex held while building. Acquired by the main thread to cancel.
+    Mutex mutex_;
+    /// Decal set to build for. Null if cancelled.
+    DecalSet* decalSet_;
+    /// Target drawable for skinning. Only set when building in the main thread.
+    Drawable* target_;
+    /// Target geometries.
+    Vector<SharedPtr<Geometry> > geometries_;
+    /// Target batch indices of the geometries.
+    PODVector<unsigned> batchIndices_;
+    /// Decal frustum in the target's space.
+    Frustum frustum_;
+    /// Inverse of the decal frustum transform.
+    Matrix3x4 view_;
+    /// Decal projection.
+    Matrix4 projection_;
+    /// Transform from the target's space to the decal set's space.
+    Matrix3x4 decalTransform_;
+    /// Decal normal in the target's space.
+    Vector3 decalNormal_;
+    /// Normal cutoff.
+    float normalCutoff_;
+    /// Top left texture coordinate.
+    Vector2 topLeftUV_;
+    /// Bottom right texture coordinate.
+    Vector2 bottomRightUV_;
+    /// Built decal.
+    Decal decal_;
+};
+
+void BuildDecalWork(const WorkItem* item, unsigned threadIndex)
+{
+    PendingDecal* pending = const_cast<PendingDecal*>(static_cast<const PendingDecal*>(item));
+    MutexLock lock(pending->mutex_);
+    if (pending->decalSet_)
+        pending->decalSet_->BuildDecal(*pending);
+}
+
 static DecalVertex ClipEdge(const DecalVertex& v0, const DecalVertex& v1, float d0, float d1, bool skinned)
 {
     DecalVertex ret;
@@ -125,6 +237,19 @@ static void ClipPolygon(PODVector<DecalVertex>& dest, const PODVector<DecalVerte
         dest.Push(ClipEdge(src[last], src[0], lastDistance, distance, skinned));
 }
 
+static bool IsStaticGeometry(Geometry* geometry)
+{
+    // Vertex data in dynamic buffers may change, so cached triangle clusters can not be used for it
+    for (unsigned i = 0; i < geometry->GetNumVertexBuffers(); ++i)
+    {
+        VertexBuffer* vb = geometry->GetVertexBuffer(i);
+        if (vb && vb->IsDynamic())
+            return false;
+    }
+
+    return true;
+}
+
 void Decal::AddVertex(const DecalVertex& vertex)
 {
     for (unsigned i = 0; i < vertices_.Size(); ++i)
@@ -163,7 +288,8 @@ DecalSet::DecalSet(Context* context) :
     boundingBoxDirty_(true),
     skinningDirty_(false),
     assignBonesPending_(false),
-    subscribed_(false)
+    subscribed_(false),
+    asyncCreation_(false)
 {
     geometry_->SetIndexBuffer(indexBuffer_);
 
@@ -174,6 +300,7 @@ DecalSet::DecalSet(Context* context) :
 
 DecalSet::~DecalSet()
 {
+    CancelPendingDecals();
 }
 
 void DecalSet::RegisterObject(Context* context)
@@ -184,6 +311,7 @@ void DecalSet::RegisterObject(Context* context)
     MIXED_ACCESSOR_ATTRIBUTE("Material", GetMaterialAttr, SetMaterialAttr, ResourceRef, ResourceRef(Material::GetTypeStatic()), AM_DEFAULT);
     ACCESSOR_ATTRIBUTE("Max Vertices", GetMaxVertices, SetMaxVertices, unsigned, DEFAULT_MAX_VERTICES, AM_DEFAULT);
     ACCESSOR_ATTRIBUTE("Max Indices", GetMaxIndices, SetMaxIndices, unsigned, DEFAULT_MAX_INDICES, AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Async Creation", GetAsyncCreation, SetAsyncCreation, bool, false, AM_DEFAULT);
     ACCESSOR_ATTRIBUTE("Can Be Occluded", IsOccludee, SetOccludee, bool, true, AM_DEFAULT);
     ACCESSOR_ATTRIBUTE("Draw Distance", GetDrawDistance, SetDrawDistance, float, 0.0f, AM_DEFAULT);
     COPY_BASE_ATTRIBUTES(Drawable);
@@ -284,6 +412,12 @@ void DecalSet::SetMaxIndices(unsigned num)
     }
 }
 
+void DecalSet::SetAsyncCreation(bool enable)
+{
+    asyncCreation_ = enable;
+    MarkNetworkUpdate();
+}
+
 bool DecalSet::AddDecal(Drawable* target, const Vector3& worldPosition, const Quaternion& worldRotation, float size,
     float aspectRatio, float depth, const Vector2& topLeftUV, const Vector2& bottomRightUV, float timeToLive, float normalCutoff,
     unsigned subGeometry)
@@ -358,114 +492,71 @@ bool DecalSet::AddDecal(Drawable* target, const Vector3& worldPosition, const Qu
             targetTransform = (bestBone->node_->GetWorldTransform() * bestBone->offsetMatrix_).Inverse();
     }
 
+    SharedPtr<PendingDecal> pending(new PendingDecal());
+    pending->decal_.timeToLive_ = timeToLive;
+    pending->normalCutoff_ = normalCutoff;
+    pending->topLeftUV_ = topLeftUV;
+    pending->bottomRightUV_ = bottomRightUV;
+
     // Build the decal frustum
-    Frustum decalFrustum;
     Matrix3x4 frustumTransform = targetTransform * Matrix3x4(adjustedWorldPosition, worldRotation, 1.0f);
-    decalFrustum.DefineOrtho(size, aspectRatio, 1.0, 0.0f, depth, frustumTransform);
-
-    Vector3 decalNormal = (targetTransform * Vector4(worldRotation * Vector3::BACK, 0.0f)).Normalized();
+    pending->frustum_.DefineOrtho(size, aspectRatio, 1.0, 0.0f, depth, frustumTransform);
+    pending->view_ = frustumTransform.Inverse();
+    pending->decalNormal_ = (targetTransform * Vector4(worldRotation * Vector3::BACK, 0.0f)).Normalized();
 
-    decals_.Resize(decals_.Size() + 1);
-    Decal& newDecal = decals_.Back();
-    newDecal.timeToLive_ = timeToLive;
+    pending->projection_ = Matrix4::ZERO;
+    pending->projection_.m11_ = (1.0f / (size * 0.5f));
+    pending->projection_.m00_ = pending->projection_.m11_ / aspectRatio;
+    pending->projection_.m22_ = 1.0f / depth;
+    pending->projection_.m33_ = 1.0f;
 
-    Vector<PODVector<DecalVertex> > faces;
-    PODVector<DecalVertex> tempFace;
+    // Skinned decals stay in the bind pose, static decals are transformed to this node's local space
+    if (skinned_)
+        pending->decalTransform_ = Matrix3x4::IDENTITY;
+    else
+        pending->decalTransform_ = node_->GetWorldTransform().Inverse() * target->GetNode()->GetWorldTransform();
 
+    // Use either a specified subgeometry in the target, or all. Try to use the most accurate LOD level if possible
     unsigned numBatches = target->GetBatches().Size();
-
-    // Use either a specified subgeometry in the target, or all
-    if (subGeometry < numBatches)
-        GetFaces(faces, target, subGeometry, decalFrustum, decalNormal, normalCutoff);
-    else
+    for (unsigned i = 0; i < numBatches; ++i)
     {
-        for (unsigned i = 0; i < numBatches; ++i)
-            GetFaces(faces, target, i, decalFrustum, decalNormal, normalCutoff);
-    }
+        if (subGeometry < numBatches && i != subGeometry)
+            continue;
 
-    // Clip the acquired faces against all frustum planes
-    for (unsigned i = 0; i < NUM_FRUSTUM_PLANES; ++i)
-    {
-        for (unsigned j = 0; j < faces.Size(); ++j)
-        {
-            PODVector<DecalVertex>& face = faces[j];
-            if (face.Empty())
-                continue;
+        Geometry* geometry = target->GetLodGeometry(i, 0);
+        if (!geometry || geometry->GetPrimitiveType() != TRIANGLE_LIST)
+            continue;
 
-            ClipPolygon(tempFace, face, decalFrustum.planes_[i], skinned_);
-            face = tempFace;
-        }
+        pending->geometries_.Push(SharedPtr<Geometry>(geometry));
+        pending->batchIndices_.Push(i);
     }
 
-    // Now triangulate the resulting faces into decal vertices
-    for (unsigned i = 0; i < faces.Size(); ++i)
+    // Decals on static targets can be built in a worker thread. Skinned decals need to modify the bones, so they are
+    // always built immediately
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    if (asyncCreation_ && !skinned_ && queue)
     {
-        PODVector<DecalVertex>& face = faces[i];
-        if (face.Size() < 3)
-            continue;
-
-        for (unsigned j = 2; j < face.Size(); ++j)
+        // Make sure the triangle clusters exist before the worker thread reads them
+        for (unsigned i = 0; i < pending->geometries_.Size(); ++i)
         {
-            newDecal.AddVertex(face[0]);
-            newDecal.AddVertex(face[j - 1]);
-            newDecal.AddVertex(face[j]);
+            if (IsStaticGeometry(pending->geometries_[i]))
+                pending->geometries_[i]->GetTriangleClusters();
         }
-    }
 
-    // Check if resulted in no triangles
-    if (newDecal.vertices_.Empty())
-    {
-        decals_.Pop();
-        return true;
-    }
+        pending->decalSet_ = this;
+        pending->workFunction_ = BuildDecalWork;
+        pending->priority_ = 0;
+        pendingDecals_.Push(pending);
+        queue->AddWorkItem(SharedPtr<WorkItem>(pending.Get()));
 
-    if (newDecal.vertices_.Size() > maxVertices_)
-    {
-        LOGWARNING("Can not add decal, vertex count " + String(newDecal.vertices_.Size()) + " exceeds maximum " +
-            String(maxVertices_));
-        decals_.Pop();
-        return false;
-    }
-    if (newDecal.indices_.Size() > maxIndices_)
-    {
-        LOGWARNING("Can not add decal, index count " + String(newDecal.indices_.Size()) + " exceeds maximum " +
-            String(maxIndices_));
-        decals_.Pop();
-        return false;
+        if (!subscribed_)
+            UpdateEventSubscription(false);
+        return true;
     }
 
-    // Calculate UVs
-    Matrix4 projection(Matrix4::ZERO);
-    projection.m11_ = (1.0f / (size * 0.5f));
-    projection.m00_ = projection.m11_ / aspectRatio;
-    projection.m22_ = 1.0f / depth;
-    projection.m33_ = 1.0f;
-
-    CalculateUVs(newDecal, frustumTransform.Inverse(), projection, topLeftUV, bottomRightUV);
-
-    // Transform vertices to this node's local space and generate tangents
-    Matrix3x4 decalTransform = node_->GetWorldTransform().Inverse() * target->GetNode()->GetWorldTransform();
-    TransformVertices(newDecal, skinned_ ? Matrix3x4::IDENTITY : decalTransform);
-    GenerateTangents(&newDecal.vertices_[0], sizeof(DecalVertex), &newDecal.indices_[0], sizeof(unsigned short), 0,
-        newDecal.indices_.Size(), offsetof(DecalVertex, normal_), offsetof(DecalVertex, texCoord_), offsetof(DecalVertex,
-        tangent_));
-
-    newDecal.CalculateBoundingBox();
-    numVertices_ += newDecal.vertices_.Size();
-    numIndices_ += newDecal.indices_.Size();
-
-    // Remove oldest decals if total vertices exceeded
-    while (decals_.Size() && (numVertices_ > maxVertices_ || numIndices_ > maxIndices_))
-        RemoveDecals(1);
-
-    LOGDEBUG("Added decal with " + String(newDecal.vertices_.Size()) + " vertices");
-
-    // If new decal is time limited, subscribe to scene post-update
-    if (newDecal.timeToLive_ > 0.0f && !subscribed_)
-        UpdateEventSubscription(false);
-
-    MarkDecalsDirty();
-    return true;
+    pending->target_ = target;
+    BuildDecal(*pending);
+    return CommitDecal(*pending);
 }
 
 void DecalSet::RemoveDecals(unsigned num)
@@ -476,6 +567,8 @@ void DecalSet::RemoveDecals(unsigned num)
 
 void DecalSet::RemoveAllDecals()
 {
+    CancelPendingDecals();
+
     if (!decals_.Empty())
     {
         decals_.Clear();
@@ -681,14 +774,118 @@ void DecalSet::OnWorldBoundingBoxUpdate()
     }
 }
 
-void DecalSet::GetFaces(Vector<PODVector<DecalVertex> >& faces, Drawable* target, unsigned batchIndex, const Frustum& frustum,
-    const Vector3& decalNormal, float normalCutoff)
+void DecalSet::BuildDecal(PendingDecal& pending)
 {
-    // Try to use the most accurate LOD level if possible
-    Geometry* geometry = target->GetLodGeometry(batchIndex, 0);
-    if (!geometry || geometry->GetPrimitiveType() != TRIANGLE_LIST)
+    Vector<PODVector<DecalVertex> > faces;
+    PODVector<unsigned char> clipMasks;
+    PODVector<DecalVertex> tempFace;
+    DecalClipPlanes clipPlanes(pending.frustum_);
+
+    for (unsigned i = 0; i < pending.geometries_.Size(); ++i)
+    {
+        GetFaces(faces, clipMasks, pending.target_, pending.batchIndices_[i], pending.geometries_[i], pending.frustum_, clipPlanes,
+            pending.decalNormal_, pending.normalCutoff_);
+    }
+
+    // Clip the acquired faces against the frustum planes they intersect
+    for (unsigned i = 0; i < NUM_FRUSTUM_PLANES; ++i)
+    {
+        for (unsigned j = 0; j < faces.Size(); ++j)
+        {
+            PODVector<DecalVertex>& face = faces[j];
+            if (face.Empty() || !(clipMasks[j] & (1 << i)))
+                continue;
+
+            ClipPolygon(tempFace, face, pending.frustum_.planes_[i], skinned_);
+            face = tempFace;
+        }
+    }
+
+    // Now triangulate the resulting faces into decal vertices
+    Decal& newDecal = pending.decal_;
+    for (unsigned i = 0; i < faces.Size(); ++i)
+    {
+        PODVector<DecalVertex>& face = faces[i];
+        if (face.Size() < 3)
+            continue;
+
+        for (unsigned j = 2; j < face.Size(); ++j)
+        {
+            newDecal.AddVertex(face[0]);
+            newDecal.AddVertex(face[j - 1]);
+            newDecal.AddVertex(face[j]);
+        }
+    }
+
+    // Check if resulted in no triangles, or too many to be added
+    if (newDecal.vertices_.Empty() || newDecal.vertices_.Size() > maxVertices_ || newDecal.indices_.Size() > maxIndices_)
         return;
 
+    // Calculate UVs, transform vertices to the decal set's space and generate tangents
+    CalculateUVs(newDecal, pending.view_, pending.projection_, pending.topLeftUV_, pending.bottomRightUV_);
+    TransformVertices(newDecal, pending.decalTransform_);
+    GenerateTangents(&newDecal.vertices_[0], sizeof(DecalVertex), &newDecal.indices_[0], sizeof(unsigned short), 0,
+        newDecal.indices_.Size(), offsetof(DecalVertex, normal_), offsetof(DecalVertex, texCoord_), offsetof(DecalVertex,
+        tangent_));
+
+    newDecal.CalculateBoundingBox();
+}
+
+bool DecalSet::CommitDecal(PendingDecal& pending)
+{
+    const Decal& newDecal = pending.decal_;
+
+    // Check if resulted in no triangles
+    if (newDecal.vertices_.Empty())
+        return true;
+
+    if (newDecal.vertices_.Size() > maxVertices_)
+    {
+        LOGWARNING("Can not add decal, vertex count " + String(newDecal.vertices_.Size()) + " exceeds maximum " +
+            String(maxVertices_));
+        return false;
+    }
+    if (newDecal.indices_.Size() > maxIndices_)
+    {
+        LOGWARNING("Can not add decal, index count " + String(newDecal.indices_.Size()) + " exceeds maximum " +
+            String(maxIndices_));
+        return false;
+    }
+
+    decals_.Push(newDecal);
+    numVertices_ += newDecal.vertices_.Size();
+    numIndices_ += newDecal.indices_.Size();
+
+    // Remove oldest decals if total vertices exceeded
+    while (decals_.Size() && (numVertices_ > maxVertices_ || numIndices_ > maxIndices_))
+        RemoveDecals(1);
+
+    LOGDEBUG("Added decal with " + String(newDecal.vertices_.Size()) + " vertices");
+
+    // If new decal is time limited, subscribe to scene post-update
+    if (newDecal.timeToLive_ > 0.0f && !subscribed_)
+        UpdateEventSubscription(false);
+
+    MarkDecalsDirty();
+    return true;
+}
+
+void DecalSet::CancelPendingDecals()
+{
+    // If a decal is being built in a worker thread, this waits for it to finish
+    for (Vector<SharedPtr<PendingDecal> >::Iterator i = pendingDecals_.Begin(); i != pendingDecals_.End(); ++i)
+    {
+        MutexLock lock((*i)->mutex_);
+        (*i)->decalSet_ = 0;
+    }
+
+    pendingDecals_.Clear();
+}
+
+void DecalSet::GetFaces(Vector<PODVector<DecalVertex> >& faces, PODVector<unsigned char>& clipMasks, Drawable* target,
+    unsigned batchIndex, Geometry* geometry, const Frustum& frustum, const DecalClipPlanes& clipPlanes, const Vector3& decalNormal,
+    float normalCutoff)
+{
     const unsigned char* positionData = 0;
     const unsigned char* normalData = 0;
     const unsigned char* skinningData = 0;
@@ -717,12 +914,14 @@ void DecalSet::GetFaces(Vector<PODVector<DecalVertex> >& faces, Drawable* target
         if (!data)
             continue;
 
-        if (elementMask & MASK_POSITION)
+        // Packed positions and normals are skipped. Positions then come from the raw data and normals from the faces
+        unsigned packedMask = vb->GetElementMask();
+        if ((elementMask & MASK_POSITION) && !(packedMask & MASK_PACKED_POSITION))
         {
             positionData = data;
             positionStride = vb->GetVertexSize();
         }
-        if (elementMask & MASK_NORMAL)
+        if ((elementMask & MASK_NORMAL) && !(packedMask & MASK_PACKED_NORMAL))
         {
             normalData = data + vb->GetElementOffset(ELEMENT_NORMAL);
             normalStride = vb->GetVertexSize();
@@ -747,7 +946,31 @@ void DecalSet::GetFaces(Vector<PODVector<DecalVertex> >& faces, Drawable* target
         }
     }
 
-    if (indexData)
+    // For static geometry, use the cached triangle clusters to skip the triangles outside the decal frustum
+    const PODVector<TriangleCluster>* clusters = IsStaticGeometry(geometry) ? &geometry->GetTriangleClusters() :
+        (const PODVector<TriangleCluster>*)0;
+
+    if (clusters && !clusters->Empty())
+    {
+        const PODVector<unsigned>& clusterIndices = geometry->GetClusterIndices();
+
+        for (PODVector<TriangleCluster>::ConstIterator i = clusters->Begin(); i != clusters->End(); ++i)
+        {
+            if (frustum.IsInsideFast(i->boundingBox_) == OUTSIDE)
+                continue;
+
+            const unsigned* indices = &clusterIndices[i->indexStart_];
+            const unsigned* indicesEnd = indices + i->indexCount_;
+
+            while (indices < indicesEnd)
+            {
+                GetFace(faces, clipMasks, target, batchIndex, indices[0], indices[1], indices[2], positionData, normalData,
+                    skinningData, positionStride, normalStride, skinningStride, clipPlanes, decalNormal, normalCutoff);
+                indices += 3;
+            }
+        }
+    }
+    else if (indexData)
     {
         unsigned indexStart = geometry->GetIndexStart();
         unsigned indexCount = geometry->GetIndexCount();
@@ -760,8 +983,8 @@ void DecalSet::GetFaces(Vector<PODVector<DecalVertex> >& faces, Drawable* target
 
             while (indices < indicesEnd)
             {
-                GetFace(faces, target, batchIndex, indices[0], indices[1], indices[2], positionData, normalData, skinningData,
-                    positionStride, normalStride, skinningStride, frustum, decalNormal, normalCutoff);
+                GetFace(faces, clipMasks, target, batchIndex, indices[0], indices[1], indices[2], positionData, normalData,
+                    skinningData, positionStride, normalStride, skinningStride, clipPlanes, decalNormal, normalCutoff);
                 indices += 3;
             }
         }
@@ -773,8 +996,8 @@ void DecalSet::GetFaces(Vector<PODVector<DecalVertex> >& faces, Drawable* target
 
             while (indices < indicesEnd)
             {
-                GetFace(faces, target, batchIndex, indices[0], indices[1], indices[2], positionData, normalData, skinningData,
-                    positionStride, normalStride, skinningStride, frustum, decalNormal, normalCutoff);
+                GetFace(faces, clipMasks, target, batchIndex, indices[0], indices[1], indices[2], positionData, normalData,
+                    skinningData, positionStride, normalStride, skinningStride, clipPlanes, decalNormal, normalCutoff);
                 indices += 3;
             }
         }
@@ -787,17 +1010,17 @@ void DecalSet::GetFaces(Vector<PODVector<DecalVertex> >& faces, Drawable* target
 
         while (indices + 2 < indicesEnd)
         {
-            GetFace(faces, target, batchIndex, indices, indices + 1, indices + 2, positionData, normalData, skinningData,
-                positionStride, normalStride, skinningStride, frustum, decalNormal, normalCutoff);
+            GetFace(faces, clipMasks, target, batchIndex, indices, indices + 1, indices + 2, positionData, normalData, skinningData,
+                positionStride, normalStride, skinningStride, clipPlanes, decalNormal, normalCutoff);
             indices += 3;
         }
     }
 }
 
-void DecalSet::GetFace(Vector<PODVector<DecalVertex> >& faces, Drawable* target, unsigned batchIndex, unsigned i0, unsigned i1,
-    unsigned i2, const unsigned char* positionData, const unsigned char* normalData, const unsigned char* skinningData,
-    unsigned positionStride, unsigned normalStride, unsigned skinningStride, const Frustum& frustum, const Vector3& decalNormal,
-    float normalCutoff)
+void DecalSet::GetFace(Vector<PODVector<DecalVertex> >& faces, PODVector<unsigned char>& clipMasks, Drawable* target,
+    unsigned batchIndex, unsigned i0, unsigned i1, unsigned i2, const unsigned char* positionData, const unsigned char* normalData,
+    const unsigned char* skinningData, unsigned positionStride, unsigned normalStride, unsigned skinningStride,
+    const DecalClipPlanes& clipPlanes, const Vector3& decalNormal, float normalCutoff)
 {
     bool hasNormals = normalData != 0;
     bool hasSkinning = skinned_ && skinningData != 0;
@@ -827,15 +1050,16 @@ void DecalSet::GetFace(Vector<PODVector<DecalVertex> >& faces, Drawable* target,
     if (decalNormal.DotProduct((n0 + n1 + n2) / 3.0f) < normalCutoff)
         return;
 
-    // Check if face is culled completely by any of the planes
-    for (unsigned i = PLANE_FAR; i < NUM_FRUSTUM_PLANES; --i)
-    {
-        const Plane& plane = frustum.planes_[i];
-        if (plane.Distance(v0) < 0.0f && plane.Distance(v1) < 0.0f && plane.Distance(v2) < 0.0f)
-            return;
-    }
+    // Check if face is culled completely by any of the planes. The face only needs clipping against the planes some of
+    // its vertices are outside of
+    unsigned outside0 = clipPlanes.GetOutsidePlanes(v0);
+    unsigned outside1 = clipPlanes.GetOutsidePlanes(v1);
+    unsigned outside2 = clipPlanes.GetOutsidePlanes(v2);
+    if (outside0 & outside1 & outside2)
+        return;
 
     faces.Resize(faces.Size() + 1);
+    clipMasks.Push(outside0 | outside1 | outside2);
     PODVector<DecalVertex>& face = faces.Back();
     if (!hasSkinning)
     {
@@ -1128,8 +1352,8 @@ void DecalSet::UpdateEventSubscription(bool checkAllDecals)
             }
         }
 
-        // If no time limited decals, no need to subscribe to scene update
-        enabled = hasTimeLimitedDecals;
+        // If no time limited or pending decals, no need to subscribe to scene update
+        enabled = hasTimeLimitedDecals || !pendingDecals_.Empty();
     }
 
     if (enabled && !subscribed_)
@@ -1150,6 +1374,19 @@ void DecalSet::HandleScenePostUpdate(StringHash eventType, VariantMap& eventData
 
     float timeStep = eventData[P_TIMESTEP].GetFloat();
 
+    // Add the asynchronously built decals that have finished, in order
+    if (!pendingDecals_.Empty())
+    {
+        while (!pendingDecals_.Empty() && pendingDecals_.Front()->completed_)
+        {
+            CommitDecal(*pendingDecals_.Front());
+            pendingDecals_.Erase(pendingDecals_.Begin());
+        }
+
+        if (pendingDecals_.Empty())
+            UpdateEventSubscription(true);
+    }
+
     for (List<Decal>::Iterator i = decals_.Begin(); i != decals_.End();)
     {
         i->timer_ += timeStep;
@@ -32,6 +32,8 @@ namespace Urho3D
 
 class IndexBuffer;
 class VertexBuffer;
+struct DecalClipPlanes;
+struct PendingDecal;
 
 /// %Decal vertex.
 struct DecalVertex
@@ -104,6 +106,8 @@ struct Decal
 /// %Decal renderer component.
 class URHO3D_API DecalSet : public Drawable
 {
+    friend void BuildDecalWork(const WorkItem* item, unsigned threadIndex);
+
     OBJECT(DecalSet);
 
 public:
@@ -133,7 +137,9 @@ public:
     void SetMaxVertices(unsigned num);
     /// Set maximum number of decal vertex indices.
     void SetMaxIndices(unsigned num);
-    /// Add a decal at world coordinates, using a target drawable's geometry for reference. If the decal needs to move with the target, the decal component should be created to the target's node. Return true if successful.
+    /// Set whether to build decals on non-skinned targets in a worker thread and add them on the next scene update. The target geometry should not be modified while a decal is being built.
+    void SetAsyncCreation(bool enable);
+    /// Add a decal at world coordinates, using a target drawable's geometry for reference. If the decal needs to move with the target, the decal component should be created to the target's node. Return true if successful, or if the decal was queued for asynchronous creation.
     bool AddDecal(Drawable* target, const Vector3& worldPosition, const Quaternion& worldRotation, float size, float aspectRatio, float depth, const Vector2& topLeftUV, const Vector2& bottomRightUV, float timeToLive = 0.0f, float normalCutoff = 0.1f, unsigned subGeometry = M_MAX_UNSIGNED);
     /// Remove n oldest decals.
     void RemoveDecals(unsigned num);
@@ -152,6 +158,10 @@ public:
     unsigned GetMaxVertices() const { return maxVertices_; }
     /// Return maximum number of decal vertex indices.
     unsigned GetMaxIndices() const { return maxIndices_; }
+    /// Return whether decals on non-skinned targets are built in a worker thread.
+    bool GetAsyncCreation() const { return asyncCreation_; }
+    /// Return number of decals being built asynchronously.
+    unsigned GetNumPendingDecals() const { return pendingDecals_.Size(); }
 
     /// Set material attribute.
     void SetMaterialAttr(const ResourceRef& value);
@@ -169,10 +179,16 @@ protected:
     virtual void OnMarkedDirty(Node* node);
 
 private:
-    /// Get triangle faces from the target geometry.
-    void GetFaces(Vector<PODVector<DecalVertex> >& faces, Drawable* target, unsigned batchIndex, const Frustum& frustum, const Vector3& decalNormal, float normalCutoff);
+    /// Clip and triangulate the target geometry faces into a decal. May be called from a worker thread for non-skinned targets.
+    void BuildDecal(PendingDecal& pending);
+    /// Add a built decal. Return true if successful.
+    bool CommitDecal(PendingDecal& pending);
+    /// Stop and discard decals being built asynchronously.
+    void CancelPendingDecals();
+    /// Get triangle faces from the target geometry, along with the frustum planes that each face intersects.
+    void GetFaces(Vector<PODVector<DecalVertex> >& faces, PODVector<unsigned char>& clipMasks, Drawable* target, unsigned batchIndex, Geometry* geometry, const Frustum& frustum, const DecalClipPlanes& clipPlanes, const Vector3& decalNormal, float normalCutoff);
     /// Get triangle face from the target geometry.
-    void GetFace(Vector<PODVector<DecalVertex> >& faces, Drawable* target, unsigned batchIndex, unsigned i0, unsigned i1, unsigned i2, const unsigned char* positionData, const unsigned char* normalData, const unsigned char* skinningData, unsigned positionStride, unsigned normalStride, unsigned skinningStride, const Frustum& frustum, const Vector3& decalNormal, float normalCutoff);
+    void GetFace(Vector<PODVector<DecalVertex> >& faces, PODVector<unsigned char>& clipMasks, Drawable* target, unsigned batchIndex, unsigned i0, unsigned i1, unsigned i2, const unsigned char* positionData, const unsigned char* normalData, const unsigned char* skinningData, unsigned positionStride, unsigned normalStride, unsigned skinningStride, const DecalClipPlanes& clipPlanes, const Vector3& decalNormal, float normalCutoff);
     /// Get bones referenced by skinning data and remap the skinning indices. Return true if successful.
     bool GetBones(Drawable* target, unsigned batchIndex, const float* blendWeights, const unsigned char* blendIndices, unsigned char* newBlendIndices);
     /// Calculate UV coordinates for the decal.
@@ -208,6 +224,8 @@ private:
     SharedPtr<IndexBuffer> indexBuffer_;
     /// Decals.
     List<Decal> decals_;
+    /// Decals being built asynchronously, in the order they were added.
+    Vector<SharedPtr<PendingDecal> > pendingDecals_;
     /// Bones used for skinned decals.
     Vector<Bone> bones_;
     /// Skinning matrices.
@@ -234,6 +252,8 @@ private:
     bool assignBonesPending_;
     /// Subscribed to scene post update event flag.
     bool subscribed_;
+    /// Asynchronous creation flag.
+    bool asyncCreation_;
 };
 
 }
@@ -33,12 +33,14 @@
 #include "Graphics.h"
 #include "GraphicsEvents.h"
 #include "GraphicsImpl.h"
+#include "HLODCluster.h"
 #include "IndexBuffer.h"
 #include "Log.h"
 #include "Material.h"
 #include "Octree.h"
 #include "ParticleEffect.h"
 #include "ParticleEmitter.h"
+#include "PotentiallyVisibleSet.h"
 #include "ProcessUtils.h"
 #include "Profiler.h"
 #include "ResourceCache.h"
@@ -46,6 +48,7 @@
 #include "ShaderPrecache.h"
 #include "ShaderVariation.h"
 #include "Skybox.h"
+#include "StaticBatch.h"
 #include "StaticModelGroup.h"
 #include "Technique.h"
 #include "Terrain.h"
@@ -268,10 +271,15 @@ Graphics::Graphics(Context* context) :
     streamOffsetSupport_(false),
     sRGBSupport_(false),
     sRGBWriteSupport_(false),
+    packedVertexSupport_(false),
     hasSM3_(false),
     forceSM2_(false),
     numPrimitives_(0),
     numBatches_(0),
+    numStateChanges_(0),
+    numRedundantStateChanges_(0),
+    numParameterUpdates_(0),
+    numRedundantParameterUpdates_(0),
     maxScratchBufferRequest_(0),
     defaultTextureFilterMode_(FILTER_TRILINEAR),
     shaderPath_("Shaders/HLSL/"),
@@ -779,6 +787,10 @@ bool Graphics::BeginFrame()
     
     numPrimitives_ = 0;
     numBatches_ = 0;
+    numStateChanges_ = 0;
+    numRedundantStateChanges_ = 0;
+    numParameterUpdates_ = 0;
+    numRedundantParameterUpdates_ = 0;
     
     SendEvent(E_BEGINRENDERING);
     
@@ -1101,8 +1113,13 @@ void Graphics::SetIndexBuffer(IndexBuffer* buffer)
 void Graphics::SetShaders(ShaderVariation* vs, ShaderVariation* ps)
 {
     if (vs == vertexShader_ && ps == pixelShader_)
+    {
+        ++numRedundantStateChanges_;
         return;
+    }
     
+    // Constant registers are shared by all shaders, so the remembered parameter sources can not survive the switch
+    ++numStateChanges_;
     ClearParameterSources();
     
     if (vs != vertexShader_)
@@ -1432,10 +1449,14 @@ bool Graphics::NeedParameterUpdate(ShaderParameterGroup group, const void* sourc
     if ((unsigned)(size_t)shaderParameterSources_[group] == M_MAX_UNSIGNED || shaderParameterSources_[group] != source)
     {
         shaderParameterSources_[group] = source;
+        ++numParameterUpdates_;
         return true;
     }
     else
+    {
+        ++numRedundantParameterUpdates_;
         return false;
+    }
 }
 
 bool Graphics::HasShaderParameter(ShaderType type, StringHash param)
@@ -1488,7 +1509,10 @@ void Graphics::SetTexture(unsigned index, Texture* texture)
             impl_->device_->SetTexture(index, 0);
         
         textures_[index] = texture;
+        ++numStateChanges_;
     }
+    else
+        ++numRedundantStateChanges_;
     
     if (texture)
     {
@@ -1745,7 +1769,10 @@ void Graphics::SetBlendMode(BlendMode mode)
         }
         
         blendMode_ = mode;
+        ++numStateChanges_;
     }
+    else
+        ++numRedundantStateChanges_;
 }
 
 void Graphics::SetColorWrite(bool enable)
@@ -1764,7 +1791,10 @@ void Graphics::SetCullMode(CullMode mode)
     {
         impl_->device_->SetRenderState(D3DRS_CULLMODE, d3dCullMode[mode]);
         cullMode_ = mode;
+        ++numStateChanges_;
     }
+    else
+        ++numRedundantStateChanges_;
 }
 
 void Graphics::SetDepthBias(float constantBias, float slopeScaledBias)
@@ -1787,7 +1817,10 @@ void Graphics::SetDepthTest(CompareMode mode)
     {
         impl_->device_->SetRenderState(D3DRS_ZFUNC, d3dCmpFunc[mode]);
         depthTestMode_ = mode;
+        ++numStateChanges_;
     }
+    else
+        ++numRedundantStateChanges_;
 }
 
 void Graphics::SetDepthWrite(bool enable)
@@ -1796,7 +1829,10 @@ void Graphics::SetDepthWrite(bool enable)
     {
         impl_->device_->SetRenderState(D3DRS_ZWRITEENABLE, enable ? TRUE : FALSE);
         depthWrite_ = enable;
+        ++numStateChanges_;
     }
+    else
+        ++numRedundantStateChanges_;
 }
 
 void Graphics::SetDrawAntialiased(bool enable)
@@ -2687,6 +2723,10 @@ void Graphics::CheckFeatureSupport()
     sRGBSupport_ = impl_->CheckFormatSupport(D3DFMT_X8R8G8B8, D3DUSAGE_QUERY_SRGBREAD, D3DRTYPE_TEXTURE);
     sRGBWriteSupport_ = impl_->CheckFormatSupport(D3DFMT_X8R8G8B8, D3DUSAGE_QUERY_SRGBWRITE, D3DRTYPE_TEXTURE);
     
+    // Check for the vertex declaration types of packed vertex elements
+    packedVertexSupport_ = (impl_->deviceCaps_.DeclTypes & D3DDTCAPS_FLOAT16_2) && (impl_->deviceCaps_.DeclTypes &
+        D3DDTCAPS_SHORT4N);
+    
     SendEvent(E_GRAPHICSFEATURES);
 }
 
@@ -2854,6 +2894,8 @@ void RegisterGraphicsLibrary(Context* context)
     Light::RegisterObject(context);
     StaticModel::RegisterObject(context);
     StaticModelGroup::RegisterObject(context);
+    StaticBatch::RegisterObject(context);
+    HLODCluster::RegisterObject(context);
     Skybox::RegisterObject(context);
     AnimatedModel::RegisterObject(context);
     AnimationController::RegisterObject(context);
@@ -2866,6 +2908,7 @@ void RegisterGraphicsLibrary(Context* context)
     TerrainPatch::RegisterObject(context);
     DebugRenderer::RegisterObject(context);
     Octree::RegisterObject(context);
+    PotentiallyVisibleSet::RegisterObject(context);
     Zone::RegisterObject(context);
 }
 
@@ -265,6 +265,14 @@ public:
     unsigned GetNumPrimitives() const { return numPrimitives_; }
     /// Return number of batches drawn this frame.
     unsigned GetNumBatches() const { return numBatches_; }
+    /// Return number of effective shader, texture, blend, cull and depth state changes this frame.
+    unsigned GetNumStateChanges() const { return numStateChanges_; }
+    /// Return number of redundant shader, texture, blend, cull and depth state changes filtered this frame.
+    unsigned GetNumRedundantStateChanges() const { return numRedundantStateChanges_; }
+    /// Return number of shader parameter group updates this frame.
+    unsigned GetNumParameterUpdates() const { return numParameterUpdates_; }
+    /// Return number of redundant shader parameter group updates filtered this frame.
+    unsigned GetNumRedundantParameterUpdates() const { return numRedundantParameterUpdates_; }
     /// Return dummy color texture format for shadow maps. Is "NULL" (consume no video memory) if supported.
     unsigned GetDummyColorFormat() const { return dummyColorFormat_; }
     /// Return shadow map depth texture format, or 0 if not supported.
@@ -287,6 +295,8 @@ public:
     bool GetSRGBSupport() const { return sRGBSupport_; }
     /// Return whether sRGB conversion on rendertarget writing is supported.
     bool GetSRGBWriteSupport() const { return sRGBWriteSupport_; }
+    /// Return whether packed vertex formats (16-bit normalized and half float elements) are supported.
+    bool GetPackedVertexSupport() const { return packedVertexSupport_; }
     /// Return supported fullscreen resolutions.
     PODVector<IntVector2> GetResolutions() const;
     /// Return supported multisampling levels.
@@ -496,6 +506,8 @@ private:
     bool sRGBSupport_;
     /// sRGB conversion on write support flag.
     bool sRGBWriteSupport_;
+    /// Packed vertex format support flag.
+    bool packedVertexSupport_;
     /// Shader Model 3 flag.
     bool hasSM3_;
     /// Force Shader Model 2 flag.
@@ -504,6 +516,14 @@ private:
     unsigned numPrimitives_;
     /// Number of batches this frame.
     unsigned numBatches_;
+    /// Number of effective state changes this frame.
+    unsigned numStateChanges_;
+    /// Number of redundant state changes this frame.
+    unsigned numRedundantStateChanges_;
+    /// Number of shader parameter group updates this frame.
+    unsigned numParameterUpdates_;
+    /// Number of redundant shader parameter group updates this frame.
+    unsigned numRedundantParameterUpdates_;
     /// Largest scratch buffer request this frame.
     unsigned maxScratchBufferRequest_;
     /// GPU objects.
@@ -32,6 +32,7 @@
 #include "ResourceCache.h"
 #include "TextureCube.h"
 #include "XMLFile.h"
+#include "WorkQueue.h"
 
 #include "DebugNew.h"
 
@@ -616,7 +617,7 @@ bool TextureCube::SetData(CubeMapFace face, SharedPtr<Image> image, bool useAlph
             else
             {
                 unsigned char* rgbaData = new unsigned char[level.width_ * level.height_ * 4];
-                level.Decompress(rgbaData);
+                level.Decompress(rgbaData, GetSubsystem<WorkQueue>());
                 SetData(face, i, 0, 0, level.width_, level.height_, rgbaData);
                 memoryUse += level.width_ * level.height_ * 4;
                 delete[] rgbaData;
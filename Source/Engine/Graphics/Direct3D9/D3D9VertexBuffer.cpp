@@ -25,6 +25,7 @@
 #include "GraphicsImpl.h"
 #include "Log.h"
 #include "VertexBuffer.h"
+#include "VertexPacking.h"
 
 #include "DebugNew.h"
 
@@ -48,6 +49,23 @@ const unsigned VertexBuffer::elementSize[] =
     4 * sizeof(float) // Instancematrix3
 };
 
+const unsigned VertexBuffer::packedElementSize[] =
+{
+    4 * sizeof(short), // Position
+    4 * sizeof(short), // Normal
+    4 * sizeof(unsigned char), // Color
+    2 * sizeof(unsigned short), // Texcoord1
+    2 * sizeof(unsigned short), // Texcoord2
+    3 * sizeof(float), // Cubetexcoord1
+    3 * sizeof(float), // Cubetexcoord2
+    4 * sizeof(short), // Tangent
+    4 * sizeof(float), // Blendweights
+    4 * sizeof(unsigned char), // Blendindices
+    4 * sizeof(float), // Instancematrix1
+    4 * sizeof(float), // Instancematrix2
+    4 * sizeof(float) // Instancematrix3
+};
+
 VertexBuffer::VertexBuffer(Context* context) :
     Object(context),
     GPUObject(GetSubsystem<Graphics>()),
@@ -328,7 +346,7 @@ void VertexBuffer::UpdateOffsets()
         if (elementMask_ & (1 << i))
         {
             elementOffset_[i] = elementOffset;
-            elementOffset += elementSize[i];
+            elementOffset += GetElementSize(elementMask_, (VertexElement)i);
         }
         else
             elementOffset_[i] = NO_ELEMENT;
@@ -338,15 +356,17 @@ void VertexBuffer::UpdateOffsets()
 
 unsigned long long VertexBuffer::GetBufferHash(unsigned streamIndex, unsigned useMask)
 {
-    unsigned long long bufferHash = elementMask_;
+    unsigned long long bufferHash = elementMask_ & ~MASK_PACKED_ELEMENTS;
     unsigned long long maskHash;
     if (useMask == MASK_DEFAULT)
-        maskHash = ((unsigned long long)elementMask_) * 0x100000000ULL;
+        maskHash = ((unsigned long long)(elementMask_ & ~MASK_PACKED_ELEMENTS)) * 0x100000000ULL;
     else
         maskHash = ((unsigned long long)useMask) * 0x100000000ULL;
     
     bufferHash |= maskHash;
     bufferHash <<= streamIndex * MAX_VERTEX_ELEMENTS;
+    // Packed formats change the element types. Keep them clear of the shifted element bits
+    bufferHash |= ((unsigned long long)(elementMask_ & MASK_PACKED_ELEMENTS)) << 44;
     
     return bufferHash;
 }
@@ -358,12 +378,17 @@ unsigned VertexBuffer::GetVertexSize(unsigned elementMask)
     for (unsigned i = 0; i < MAX_VERTEX_ELEMENTS; ++i)
     {
         if (elementMask & (1 << i))
-            vertexSize += elementSize[i];
+            vertexSize += GetElementSize(elementMask, (VertexElement)i);
     }
     
     return vertexSize;
 }
 
+unsigned VertexBuffer::GetElementSize(unsigned elementMask, VertexElement element)
+{
+    return (elementMask & GetPackedElementMask(element)) ? packedElementSize[element] : elementSize[element];
+}
+
 unsigned VertexBuffer::GetElementOffset(unsigned elementMask, VertexElement element)
 {
     unsigned offset = 0;
@@ -374,7 +399,7 @@ unsigned VertexBuffer::GetElementOffset(unsigned elementMask, VertexElement elem
             break;
         
         if (elementMask & (1 << i))
-            offset += elementSize[i];
+            offset += GetElementSize(elementMask, (VertexElement)i);
     }
     
     return offset;
@@ -85,9 +85,13 @@ public:
     static unsigned GetVertexSize(unsigned elementMask);
     /// Return element offset from an element mask.
     static unsigned GetElementOffset(unsigned elementMask, VertexElement element);
+    /// Return element size in bytes from an element mask, which may select a packed format.
+    static unsigned GetElementSize(unsigned elementMask, VertexElement element);
     
     /// Vertex element sizes.
     static const unsigned elementSize[];
+    /// Vertex element sizes when packed.
+    static const unsigned packedElementSize[];
     
 private:
     /// Update offsets of vertex elements.
@@ -25,6 +25,7 @@
 #include "GraphicsImpl.h"
 #include "VertexBuffer.h"
 #include "VertexDeclaration.h"
+#include "VertexPacking.h"
 
 #include "DebugNew.h"
 
@@ -48,6 +49,23 @@ const BYTE d3dElementType[] =
     D3DDECLTYPE_FLOAT4 // Instancematrix3
 };
 
+const BYTE d3dPackedElementType[] =
+{
+    D3DDECLTYPE_SHORT4N, // Position
+    D3DDECLTYPE_SHORT4N, // Normal
+    D3DDECLTYPE_UBYTE4N, // Color
+    D3DDECLTYPE_FLOAT16_2, // Texcoord1
+    D3DDECLTYPE_FLOAT16_2, // Texcoord2
+    D3DDECLTYPE_FLOAT3, // Cubetexcoord1
+    D3DDECLTYPE_FLOAT3, // Cubetexcoord2
+    D3DDECLTYPE_SHORT4N, // Tangent
+    D3DDECLTYPE_FLOAT4, // Blendweights
+    D3DDECLTYPE_UBYTE4, // Blendindices
+    D3DDECLTYPE_FLOAT4, // Instancematrix1
+    D3DDECLTYPE_FLOAT4, // Instancematrix2
+    D3DDECLTYPE_FLOAT4 // Instancematrix3
+};
+
 const BYTE d3dElementUsage[] =
 {
     D3DDECLUSAGE_POSITION, // Position
@@ -98,7 +116,8 @@ VertexDeclaration::VertexDeclaration(Graphics* graphics, unsigned elementMask) :
             newElement.stream_ = 0;
             newElement.element_ = element;
             newElement.offset_ = offset;
-            offset += VertexBuffer::elementSize[i];
+            newElement.packed_ = (elementMask & GetPackedElementMask(element)) != 0;
+            offset += VertexBuffer::GetElementSize(elementMask, element);
             
             elements.Push(newElement);
         }
@@ -137,6 +156,7 @@ VertexDeclaration::VertexDeclaration(Graphics* graphics, const PODVector<VertexB
                     newElement.stream_ = i;
                     newElement.element_ = element;
                     newElement.offset_ = buffers[i]->GetElementOffset(element);
+                    newElement.packed_ = (buffers[i]->GetElementMask() & GetPackedElementMask(element)) != 0;
                     usedElementMask |= 1 << j;
                     
                     elements.Push(newElement);
@@ -178,6 +198,7 @@ VertexDeclaration::VertexDeclaration(Graphics* graphics, const Vector<SharedPtr<
                     newElement.stream_ = i;
                     newElement.element_ = element;
                     newElement.offset_ = buffers[i]->GetElementOffset(element);
+                    newElement.packed_ = (buffers[i]->GetElementMask() & GetPackedElementMask(element)) != 0;
                     usedElementMask |= 1 << j;
                     
                     elements.Push(newElement);
@@ -203,7 +224,7 @@ void VertexDeclaration::Create(Graphics* graphics, const PODVector<VertexDeclara
     {
         dest->Stream = i->stream_;
         dest->Offset = i->offset_;
-        dest->Type = d3dElementType[i->element_];
+        dest->Type = i->packed_ ? d3dPackedElementType[i->element_] : d3dElementType[i->element_];
         dest->Method = D3DDECLMETHOD_DEFAULT;
         dest->Usage = d3dElementUsage[i->element_];
         dest->UsageIndex = d3dElementUsageIndex[i->element_];
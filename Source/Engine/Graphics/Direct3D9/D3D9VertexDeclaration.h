@@ -43,6 +43,8 @@ struct VertexDeclarationElement
     VertexElement element_;
     /// Element offset.
     unsigned offset_;
+    /// Packed format flag.
+    bool packed_;
 };
 
 /// Vertex declaration.
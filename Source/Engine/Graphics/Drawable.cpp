@@ -31,6 +31,7 @@
 #include "Renderer.h"
 #include "Scene.h"
 #include "Sort.h"
+#include "StaticBatch.h"
 #include "Zone.h"
 
 #include "DebugNew.h"
@@ -67,6 +68,7 @@ Drawable::Drawable(Context* context, unsigned char drawableFlags) :
     shadowMask_(DEFAULT_SHADOWMASK),
     zoneMask_(DEFAULT_ZONEMASK),
     viewFrameNumber_(0),
+    batchRevision_(0),
     distance_(0.0f),
     lodDistance_(0.0f),
     drawDistance_(0.0f),
@@ -80,6 +82,9 @@ Drawable::Drawable(Context* context, unsigned char drawableFlags) :
     octant_(0),
     firstLight_(0),
     zone_(0),
+    hlodCluster_(0),
+    staticBatch_(0),
+    pvsIndex_(M_MAX_UNSIGNED),
     zoneDirty_(false)
 {
 }
@@ -87,6 +92,7 @@ Drawable::Drawable(Context* context, unsigned char drawableFlags) :
 Drawable::~Drawable()
 {
     RemoveFromOctree();
+    MarkStaticBatchDirty();
 }
 
 void Drawable::RegisterObject(Context* context)
@@ -98,6 +104,13 @@ void Drawable::RegisterObject(Context* context)
     ACCESSOR_ATTRIBUTE("Zone Mask", GetZoneMask, SetZoneMask, unsigned, DEFAULT_ZONEMASK, AM_DEFAULT);
 }
 
+void Drawable::OnSetAttribute(const AttributeInfo& attr, const Variant& src)
+{
+    Serializable::OnSetAttribute(attr, src);
+    MarkBatchesDirty();
+    MarkStaticBatchDirty();
+}
+
 void Drawable::OnSetEnabled()
 {
     bool enabled = IsEnabledEffective();
@@ -106,6 +119,8 @@ void Drawable::OnSetEnabled()
         AddToOctree();
     else if (!enabled && octant_)
         RemoveFromOctree();
+    
+    MarkStaticBatchDirty();
 }
 
 void Drawable::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQueryResult>& results)
@@ -174,42 +189,56 @@ void Drawable::DrawDebugGeometry(DebugRenderer* debug, bool depthTest)
 void Drawable::SetDrawDistance(float distance)
 {
     drawDistance_ = distance;
+    MarkBatchesDirty();
+    MarkStaticBatchDirty();
     MarkNetworkUpdate();
 }
 
 void Drawable::SetShadowDistance(float distance)
 {
     shadowDistance_ = distance;
+    MarkBatchesDirty();
+    MarkStaticBatchDirty();
     MarkNetworkUpdate();
 }
 
 void Drawable::SetLodBias(float bias)
 {
     lodBias_ = Max(bias, M_EPSILON);
+    MarkBatchesDirty();
     MarkNetworkUpdate();
 }
 
 void Drawable::SetViewMask(unsigned mask)
 {
     viewMask_ = mask;
+    MarkBatchesDirty();
+    MarkStaticBatchDirty();
+    if (octant_)
+        octant_->GetRoot()->MarkDrawablesDirty();
     MarkNetworkUpdate();
 }
 
 void Drawable::SetLightMask(unsigned mask)
 {
     lightMask_ = mask;
+    MarkBatchesDirty();
+    MarkStaticBatchDirty();
     MarkNetworkUpdate();
 }
 
 void Drawable::SetShadowMask(unsigned mask)
 {
     shadowMask_ = mask;
+    MarkBatchesDirty();
+    MarkStaticBatchDirty();
     MarkNetworkUpdate();
 }
 
 void Drawable::SetZoneMask(unsigned mask)
 {
     zoneMask_ = mask;
+    MarkStaticBatchDirty();
     // Mark dirty to reset cached zone
     OnMarkedDirty(node_);
     MarkNetworkUpdate();
@@ -218,18 +247,23 @@ void Drawable::SetZoneMask(unsigned mask)
 void Drawable::SetMaxLights(unsigned num)
 {
     maxLights_ = num;
+    MarkBatchesDirty();
     MarkNetworkUpdate();
 }
 
 void Drawable::SetCastShadows(bool enable)
 {
     castShadows_ = enable;
+    MarkBatchesDirty();
+    MarkStaticBatchDirty();
     MarkNetworkUpdate();
 }
 
 void Drawable::SetOccluder(bool enable)
 {
     occluder_ = enable;
+    if (octant_)
+        octant_->GetRoot()->MarkDrawablesDirty();
     MarkNetworkUpdate();
 }
 
@@ -245,6 +279,31 @@ void Drawable::SetOccludee(bool enable)
     }
 }
 
+void Drawable::SetHLODCluster(HLODCluster* cluster)
+{
+    if (cluster != hlodCluster_)
+    {
+        hlodCluster_ = cluster;
+        MarkStaticBatchDirty();
+    }
+}
+
+void Drawable::SetStaticBatch(StaticBatch* batch)
+{
+    staticBatch_ = batch;
+
+    if (batch && octant_)
+        RemoveFromOctree();
+    else if (!batch && !octant_)
+        AddToOctree();
+}
+
+void Drawable::MarkStaticBatchDirty()
+{
+    if (staticBatch_)
+        staticBatch_->MarkMembersDirty();
+}
+
 void Drawable::MarkForUpdate()
 {
     if (!updateQueued_ && octant_)
@@ -283,7 +342,11 @@ bool Drawable::IsInView(const FrameInfo& frame, bool anyCamera) const
 
 void Drawable::SetZone(Zone* zone, bool temporary)
 {
-    zone_ = zone;
+    if (zone != zone_)
+    {
+        zone_ = zone;
+        MarkBatchesDirty();
+    }
 
     // If the zone assignment was temporary (inconclusive) set the dirty flag so that it will be re-evaluated on the next frame
     zoneDirty_ = temporary;
@@ -360,12 +423,16 @@ void Drawable::OnNodeSet(Node* node)
         node->AddListener(this);
     }
     else
+    {
         RemoveFromOctree();
+        MarkStaticBatchDirty();
+    }
 }
 
 void Drawable::OnMarkedDirty(Node* node)
 {
     worldBoundingBoxDirty_ = true;
+    MarkBatchesDirty();
     if (!updateQueued_ && octant_)
         octant_->GetRoot()->QueueUpdate(this);
 
@@ -376,8 +443,8 @@ void Drawable::OnMarkedDirty(Node* node)
 
 void Drawable::AddToOctree()
 {
-    // Do not add to octree when disabled
-    if (!IsEnabledEffective())
+    // Do not add to octree when disabled, or when rendered by a static batch
+    if (!IsEnabledEffective() || staticBatch_)
         return;
 
     Scene* scene = GetScene();
@@ -385,7 +452,10 @@ void Drawable::AddToOctree()
     {
         Octree* octree = scene->GetComponent<Octree>();
         if (octree)
+        {
             octree->InsertDrawable(this);
+            octree->MarkDrawablesDirty();
+        }
         else
             LOGERROR("No Octree component in scene, drawable will not render");
     }
@@ -408,6 +478,7 @@ void Drawable::RemoveFromOctree()
         OnRemoveFromOctree();
         
         octant_->RemoveDrawable(this);
+        octree->MarkDrawablesDirty();
     }
 }
 
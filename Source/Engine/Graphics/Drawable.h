@@ -44,11 +44,13 @@ static const float ANIMATION_LOD_BASESCALE = 2500.0f;
 
 class Camera;
 class Geometry;
+class HLODCluster;
 class Light;
 class Material;
 class OcclusionBuffer;
 class Octant;
 class RayOctreeQuery;
+class StaticBatch;
 class Zone;
 struct RayQueryResult;
 struct WorkItem;
@@ -115,6 +117,8 @@ public:
     /// Register object attributes. Drawable must be registered first.
     static void RegisterObject(Context* context);
     
+    /// Handle attribute write access.
+    virtual void OnSetAttribute(const AttributeInfo& attr, const Variant& src);
     /// Handle enabled/disabled state change.
     virtual void OnSetEnabled();
     /// Process octree raycast. May be called from a worker thread.
@@ -125,7 +129,7 @@ public:
     virtual void UpdateBatches(const FrameInfo& frame);
     /// Prepare geometry for rendering.
     virtual void UpdateGeometry(const FrameInfo& frame);
-    /// Return whether a geometry update is necessary, and if it can happen in a worker thread.
+    /// Return whether a geometry update is necessary, and if it can happen in a worker thread. After a worker thread update, a main thread update is also performed if requested.
     virtual UpdateGeometryType GetUpdateGeometryType() { return UPDATE_NONE; }
     /// Return the geometry for a specific LOD level.
     virtual Geometry* GetLodGeometry(unsigned batchIndex, unsigned level);
@@ -160,6 +164,16 @@ public:
     void SetOccludee(bool enable);
     /// Mark for update and octree reinsertion. Update is automatically queued when the drawable's scene node moves or changes scale.
     void MarkForUpdate();
+    /// Increment the batch revision to signal that state affecting the view's batches has changed.
+    void MarkBatchesDirty() { ++batchRevision_; }
+    /// Set the HLOD cluster whose proxy replaces this drawable at a distance. Rebuilds the static batch rendering this drawable, as clustered drawables are not batched. Called by HLODCluster.
+    void SetHLODCluster(HLODCluster* cluster);
+    /// Set the static batch that renders this drawable's geometry. The drawable is kept out of the octree while batched. Called by StaticBatch.
+    void SetStaticBatch(StaticBatch* batch);
+    /// Mark the static batch rendering this drawable for rebuild after a change to the drawable.
+    void MarkStaticBatchDirty();
+    /// Set index into the potentially visible set's visibility bits. Called by PotentiallyVisibleSet.
+    void SetPVSIndex(unsigned index) { pvsIndex_ = index; }
     
     /// Return local space bounding box. May not be applicable or properly updated on all drawables.
     const BoundingBox& GetBoundingBox() const { return boundingBox_; }
@@ -195,6 +209,14 @@ public:
     bool IsInView(Camera* camera) const;
     /// Return draw call source data.
     const Vector<SourceBatch>& GetBatches() const { return batches_; }
+    /// Return batch revision. Is incremented when state affecting the view's batches, other than the source batches, changes.
+    unsigned GetBatchRevision() const { return batchRevision_; }
+    /// Return the HLOD cluster whose proxy replaces this drawable at a distance, or null if not clustered.
+    HLODCluster* GetHLODCluster() const { return hlodCluster_; }
+    /// Return the static batch that renders this drawable's geometry, or null if not batched.
+    StaticBatch* GetStaticBatch() const { return staticBatch_; }
+    /// Return index into the potentially visible set's visibility bits, or M_MAX_UNSIGNED if not baked into it.
+    unsigned GetPVSIndex() const { return pvsIndex_; }
     
     /// Set new zone. Zone assignment may optionally be temporary, meaning it needs to be re-evaluated on the next frame.
     void SetZone(Zone* zone, bool temporary = false);
@@ -306,6 +328,8 @@ protected:
     unsigned zoneMask_;
     /// Last visible frame number.
     unsigned viewFrameNumber_;
+    /// Batch revision.
+    unsigned batchRevision_;
     /// Current distance to camera.
     float distance_;
     /// LOD scaled distance.
@@ -336,6 +360,12 @@ protected:
     PODVector<Light*> vertexLights_;
     /// Current zone.
     Zone* zone_;
+    /// HLOD cluster.
+    HLODCluster* hlodCluster_;
+    /// Static batch.
+    StaticBatch* staticBatch_;
+    /// Potentially visible set index.
+    unsigned pvsIndex_;
     /// Zone inconclusive or dirtied flag.
     bool zoneDirty_;
     /// Set of cameras from which is seen on the current frame.
@@ -47,4 +47,13 @@ EVENT(E_TERRAINCREATED, TerrainCreated)
     PARAM(P_NODE, Node);                    // Node pointer
 }
 
+/// Terrain heights modified in a region.
+EVENT(E_TERRAINREGIONUPDATED, TerrainRegionUpdated)
+{
+    PARAM(P_NODE, Node);                    // Node pointer
+    PARAM(P_REGION, Region);                // IntRect, in height data coordinates
+    PARAM(P_MIN, Min);                      // Vector3, world space minimum of the old and new heights
+    PARAM(P_MAX, Max);                      // Vector3, world space maximum of the old and new heights
+}
+
 }
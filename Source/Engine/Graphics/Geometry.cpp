@@ -33,6 +33,8 @@
 namespace Urho3D
 {
 
+static const unsigned TRIANGLES_PER_CLUSTER = 32;
+
 Geometry::Geometry(Context* context) :
     Object(context),
     primitiveType_(TRIANGLE_LIST),
@@ -44,7 +46,12 @@ Geometry::Geometry(Context* context) :
     rawVertexSize_(0),
     rawElementMask_(0),
     rawIndexSize_(0),
-    lodDistance_(0.0f)
+    lodDistance_(0.0f),
+    positionOffset_(Vector3::ZERO),
+    positionScale_(1.0f),
+    positionTransform_(Matrix3x4::IDENTITY),
+    positionQuantized_(false),
+    triangleClustersDirty_(true)
 {
     SetNumVertexBuffers(1);
 }
@@ -69,6 +76,7 @@ bool Geometry::SetNumVertexBuffers(unsigned num)
         elementMasks_[i] = MASK_NONE;
     
     GetPositionBufferIndex();
+    triangleClustersDirty_ = true;
     return true;
 }
 
@@ -91,12 +99,14 @@ bool Geometry::SetVertexBuffer(unsigned index, VertexBuffer* buffer, unsigned el
     }
     
     GetPositionBufferIndex();
+    triangleClustersDirty_ = true;
     return true;
 }
 
 void Geometry::SetIndexBuffer(IndexBuffer* buffer)
 {
     indexBuffer_ = buffer;
+    triangleClustersDirty_ = true;
 }
 
 bool Geometry::SetDrawRange(PrimitiveType type, unsigned indexStart, unsigned indexCount, bool getUsedVertexRange)
@@ -132,6 +142,7 @@ bool Geometry::SetDrawRange(PrimitiveType type, unsigned indexStart, unsigned in
         vertexCount_ = 0;
     }
     
+    triangleClustersDirty_ = true;
     return true;
 }
 
@@ -158,6 +169,7 @@ bool Geometry::SetDrawRange(PrimitiveType type, unsigned indexStart, unsigned in
     indexCount_ = indexCount;
     vertexStart_ = minVertex;
     vertexCount_ = vertexCount;
+    triangleClustersDirty_ = true;
     
     return true;
 }
@@ -170,17 +182,27 @@ void Geometry::SetLodDistance(float distance)
     lodDistance_ = distance;
 }
 
+void Geometry::SetPositionQuantization(const Vector3& offset, float scale)
+{
+    positionOffset_ = offset;
+    positionScale_ = scale;
+    positionTransform_ = Matrix3x4(offset, Quaternion::IDENTITY, scale);
+    positionQuantized_ = offset != Vector3::ZERO || scale != 1.0f;
+}
+
 void Geometry::SetRawVertexData(SharedArrayPtr<unsigned char> data, unsigned vertexSize, unsigned elementMask)
 {
     rawVertexData_ = data;
     rawVertexSize_ = vertexSize;
     rawElementMask_ = elementMask;
+    triangleClustersDirty_ = true;
 }
 
 void Geometry::SetRawIndexData(SharedArrayPtr<unsigned char> data, unsigned indexSize)
 {
     rawIndexData_ = data;
     rawIndexSize_ = indexSize;
+    triangleClustersDirty_ = true;
 }
 
 void Geometry::Draw(Graphics* graphics)
@@ -372,6 +394,14 @@ bool Geometry::IsInside(const Ray& ray) const
         return false;
 }
 
+const PODVector<TriangleCluster>& Geometry::GetTriangleClusters()
+{
+    if (triangleClustersDirty_)
+        BuildTriangleClusters();
+    
+    return triangleClusters_;
+}
+
 void Geometry::GetPositionBufferIndex()
 {
     for (unsigned i = 0; i < vertexBuffers_.Size(); ++i)
@@ -387,4 +417,114 @@ void Geometry::GetPositionBufferIndex()
     positionBufferIndex_ = M_MAX_UNSIGNED;
 }
 
+void Geometry::BuildTriangleClusters()
+{
+    triangleClusters_.Clear();
+    clusterIndices_.Clear();
+    triangleClustersDirty_ = false;
+    
+    const unsigned char* vertexData;
+    const unsigned char* indexData;
+    unsigned vertexSize;
+    unsigned indexSize;
+    unsigned elementMask;
+    
+    GetRawData(vertexData, vertexSize, indexData, indexSize, elementMask);
+    if (!vertexData || primitiveType_ != TRIANGLE_LIST)
+        return;
+    
+    unsigned numTriangles = indexData ? indexCount_ / 3 : vertexCount_ / 3;
+    if (!numTriangles)
+        return;
+    
+    // Gather the triangles' vertex indices and centers
+    PODVector<unsigned> triangleIndices(numTriangles * 3);
+    for (unsigned i = 0; i < numTriangles * 3; ++i)
+    {
+        if (!indexData)
+            triangleIndices[i] = vertexStart_ + i;
+        else if (indexSize == sizeof(unsigned short))
+            triangleIndices[i] = ((const unsigned short*)indexData)[indexStart_ + i];
+        else
+            triangleIndices[i] = ((const unsigned*)indexData)[indexStart_ + i];
+    }
+    
+    PODVector<Vector3> centers(numTriangles);
+    PODVector<unsigned> order(numTriangles);
+    for (unsigned i = 0; i < numTriangles; ++i)
+    {
+        const Vector3& v0 = *((const Vector3*)(&vertexData[triangleIndices[i * 3] * vertexSize]));
+        const Vector3& v1 = *((const Vector3*)(&vertexData[triangleIndices[i * 3 + 1] * vertexSize]));
+        const Vector3& v2 = *((const Vector3*)(&vertexData[triangleIndices[i * 3 + 2] * vertexSize]));
+        centers[i] = (v0 + v1 + v2) / 3.0f;
+        order[i] = i;
+    }
+    
+    // Split the triangles recursively at the middle of the longest axis of their centers' bounds, until small enough
+    PODVector<unsigned> ranges;
+    ranges.Push(0);
+    ranges.Push(numTriangles);
+    clusterIndices_.Reserve(numTriangles * 3);
+    
+    while (!ranges.Empty())
+    {
+        unsigned end = ranges.Back();
+        ranges.Pop();
+        unsigned start = ranges.Back();
+        ranges.Pop();
+        
+        if (end - start > TRIANGLES_PER_CLUSTER)
+        {
+            BoundingBox bounds;
+            for (unsigned i = start; i < end; ++i)
+                bounds.Merge(centers[order[i]]);
+            
+            Vector3 size = bounds.Size();
+            unsigned axis = 0;
+            if (size.y_ > size.x_)
+                axis = 1;
+            if (size.z_ > size.Data()[axis])
+                axis = 2;
+            float split = bounds.Center().Data()[axis];
+            
+            unsigned middle = start;
+            unsigned last = end;
+            while (middle < last)
+            {
+                if (centers[order[middle]].Data()[axis] < split)
+                    ++middle;
+                else
+                    Swap(order[middle], order[--last]);
+            }
+            
+            // If all centers coincide on the axis, split by count instead
+            if (middle == start || middle == end)
+                middle = (start + end) / 2;
+            
+            ranges.Push(start);
+            ranges.Push(middle);
+            ranges.Push(middle);
+            ranges.Push(end);
+        }
+        else
+        {
+            TriangleCluster cluster;
+            cluster.indexStart_ = clusterIndices_.Size();
+            cluster.indexCount_ = (end - start) * 3;
+            
+            for (unsigned i = start; i < end; ++i)
+            {
+                for (unsigned j = 0; j < 3; ++j)
+                {
+                    unsigned index = triangleIndices[order[i] * 3 + j];
+                    clusterIndices_.Push(index);
+                    cluster.boundingBox_.Merge(*((const Vector3*)(&vertexData[index * vertexSize])));
+                }
+            }
+            
+            triangleClusters_.Push(cluster);
+        }
+    }
+}
+
 }
@@ -23,7 +23,9 @@
 #pragma once
 
 #include "ArrayPtr.h"
+#include "BoundingBox.h"
 #include "GraphicsDefs.h"
+#include "Matrix3x4.h"
 #include "Object.h"
 
 namespace Urho3D
@@ -34,6 +36,17 @@ class Ray;
 class Graphics;
 class VertexBuffer;
 
+/// Spatially coherent cluster of triangles for culling CPU-side triangle queries.
+struct TriangleCluster
+{
+    /// Bounding box of the triangles.
+    BoundingBox boundingBox_;
+    /// Start position in the cluster vertex indices.
+    unsigned indexStart_;
+    /// Number of cluster vertex indices.
+    unsigned indexCount_;
+};
+
 /// Defines one or more vertex buffers, an index buffer and a draw range.
 class URHO3D_API Geometry : public Object
 {
@@ -57,6 +70,8 @@ public:
     bool SetDrawRange(PrimitiveType type, unsigned indexStart, unsigned indexCount, unsigned vertexStart, unsigned vertexCount, bool checkIllegal = true);
     /// Set the LOD distance.
     void SetLodDistance(float distance);
+    /// Set the offset and uniform scale that dequantize packed vertex positions to model space. CPU-side operations need float positions set as raw vertex data.
+    void SetPositionQuantization(const Vector3& offset, float scale);
     /// Override raw vertex data to be returned for CPU-side operations.
     void SetRawVertexData(SharedArrayPtr<unsigned char> data, unsigned vertexSize, unsigned elementMask);
     /// Override raw index data to be returned for CPU-side operations.
@@ -88,6 +103,14 @@ public:
     unsigned GetVertexCount() const { return vertexCount_; }
     /// Return LOD distance.
     float GetLodDistance() const { return lodDistance_; }
+    /// Return packed vertex position offset.
+    const Vector3& GetPositionOffset() const { return positionOffset_; }
+    /// Return packed vertex position scale.
+    float GetPositionScale() const { return positionScale_; }
+    /// Return the transform from packed vertex positions to model space.
+    const Matrix3x4& GetPositionTransform() const { return positionTransform_; }
+    /// Return whether the vertex positions are packed and need the position transform.
+    bool IsPositionQuantized() const { return positionQuantized_; }
     /// Return buffers' combined hash value for state sorting.
     unsigned short GetBufferHash() const;
     /// Return raw vertex and index data for CPU operations, or null pointers if not available.
@@ -100,10 +123,16 @@ public:
     bool IsInside(const Ray& ray) const;
     /// Return whether has empty draw range.
     bool IsEmpty() const { return indexCount_ == 0 && vertexCount_ == 0; }
+    /// Return triangle clusters of the CPU-side data, or empty if not available. Built on first use and rebuilt after the buffers or draw range change. Building is not thread-safe.
+    const PODVector<TriangleCluster>& GetTriangleClusters();
+    /// Return the vertex indices of the triangle clusters.
+    const PODVector<unsigned>& GetClusterIndices() const { return clusterIndices_; }
     
 private:
     /// Locate vertex buffer with position data.
     void GetPositionBufferIndex();
+    /// Build the triangle clusters.
+    void BuildTriangleClusters();
     
     /// Vertex buffers.
     Vector<SharedPtr<VertexBuffer> > vertexBuffers_;
@@ -135,6 +164,20 @@ private:
     unsigned rawIndexSize_;
     /// LOD distance.
     float lodDistance_;
+    /// Packed vertex position offset.
+    Vector3 positionOffset_;
+    /// Packed vertex position scale.
+    float positionScale_;
+    /// Transform from packed vertex positions to model space.
+    Matrix3x4 positionTransform_;
+    /// Packed vertex positions flag.
+    bool positionQuantized_;
+    /// Triangle clusters.
+    PODVector<TriangleCluster> triangleClusters_;
+    /// Vertex indices of the triangle clusters.
+    PODVector<unsigned> clusterIndices_;
+    /// Triangle clusters need rebuild flag.
+    bool triangleClustersDirty_;
 };
 
 }
@@ -0,0 +1,227 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Precompiled.h"
+#include "Geometry.h"
+#include "GeometryMerger.h"
+#include "IndexBuffer.h"
+#include "VertexBuffer.h"
+#include "VertexPacking.h"
+
+#include <cstring>
+
+#include "DebugNew.h"
+
+namespace Urho3D
+{
+
+/// Vertex elements carried over from the source geometries.
+static const unsigned MERGED_ELEMENT_MASK = MASK_POSITION | MASK_NORMAL | MASK_COLOR | MASK_TEXCOORD1 | MASK_TEXCOORD2 |
+    MASK_TANGENT;
+
+/// Return the vertex buffer whose packed elements need decoding before merging, or null if the raw data can be used as is.
+static VertexBuffer* GetPackedBuffer(Geometry* geometry)
+{
+    VertexBuffer* buffer = geometry->GetVertexBuffer(0);
+    return buffer && buffer->GetShadowData() && buffer->GetVertexCount() && (buffer->GetElementMask() & MASK_PACKED_ELEMENTS) ?
+        buffer : 0;
+}
+
+GeometryMerger::GeometryMerger(Material* material, unsigned elementMask) :
+    material_(material),
+    elementMask_(elementMask),
+    vertexCount_(0)
+{
+}
+
+bool GeometryMerger::Append(Geometry* geometry, const Matrix3x4& transform)
+{
+    if (!geometry || !elementMask_ || (GetMergedElementMask(geometry) & elementMask_) != elementMask_)
+        return false;
+    
+    const unsigned char* vertexData;
+    unsigned vertexSize;
+    const unsigned char* indexData;
+    unsigned indexSize;
+    unsigned elementMask;
+    
+    geometry->GetRawData(vertexData, vertexSize, indexData, indexSize, elementMask);
+    
+    // Decode packed vertices to floats, as the raw data only has their positions
+    PODVector<unsigned char> unpackedData;
+    VertexBuffer* packedBuffer = GetPackedBuffer(geometry);
+    if (packedBuffer)
+    {
+        elementMask = packedBuffer->GetElementMask() & ~MASK_PACKED_ELEMENTS;
+        vertexSize = VertexBuffer::GetVertexSize(elementMask);
+        unpackedData.Resize(packedBuffer->GetVertexCount() * vertexSize);
+        ConvertVertexData(&unpackedData[0], elementMask, packedBuffer->GetShadowData(), packedBuffer->GetElementMask(),
+            packedBuffer->GetVertexCount(), geometry->GetPositionOffset(), geometry->GetPositionScale());
+        vertexData = &unpackedData[0];
+    }
+    
+    Matrix3 rotation = transform.ToMatrix3();
+    Matrix3 normalTransform = rotation.Inverse().Transpose();
+    // A mirroring transform flips the triangle winding and the tangent frame handedness
+    bool mirrored = rotation.m00_ * (rotation.m11_ * rotation.m22_ - rotation.m12_ * rotation.m21_) -
+        rotation.m01_ * (rotation.m10_ * rotation.m22_ - rotation.m12_ * rotation.m20_) +
+        rotation.m02_ * (rotation.m10_ * rotation.m21_ - rotation.m11_ * rotation.m20_) < 0.0f;
+    
+    unsigned sourceOffsets[MAX_VERTEX_ELEMENTS];
+    for (unsigned i = 0; i < MAX_VERTEX_ELEMENTS; ++i)
+        sourceOffsets[i] = VertexBuffer::GetElementOffset(elementMask, (VertexElement)i);
+    
+    unsigned vertexStart = geometry->GetVertexStart();
+    unsigned vertexCount = geometry->GetVertexCount();
+    unsigned mergedVertexSize = VertexBuffer::GetVertexSize(elementMask_);
+    unsigned baseVertex = vertexCount_;
+    
+    // Copy the vertices, transforming positions and directions
+    vertexData_.Resize((baseVertex + vertexCount) * mergedVertexSize);
+    unsigned char* dest = &vertexData_[baseVertex * mergedVertexSize];
+    for (unsigned i = vertexStart; i < vertexStart + vertexCount; ++i)
+    {
+        const unsigned char* src = vertexData + i * vertexSize;
+        
+        for (unsigned j = 0; j < MAX_VERTEX_ELEMENTS; ++j)
+        {
+            if (!(elementMask_ & (1 << j)))
+                continue;
+            
+            const unsigned char* srcElement = src + sourceOffsets[j];
+            switch (j)
+            {
+            case ELEMENT_POSITION:
+                {
+                    Vector3 position = transform * *reinterpret_cast<const Vector3*>(srcElement);
+                    memcpy(dest, &position, sizeof position);
+                    boundingBox_.Merge(position);
+                }
+                break;
+                
+            case ELEMENT_NORMAL:
+                {
+                    Vector3 normal = (normalTransform * *reinterpret_cast<const Vector3*>(srcElement)).Normalized();
+                    memcpy(dest, &normal, sizeof normal);
+                }
+                break;
+                
+            case ELEMENT_TANGENT:
+                {
+                    const Vector4& srcTangent = *reinterpret_cast<const Vector4*>(srcElement);
+                    Vector3 tangent = (rotation * Vector3(srcTangent.x_, srcTangent.y_, srcTangent.z_)).Normalized();
+                    Vector4 destTangent(tangent, mirrored ? -srcTangent.w_ : srcTangent.w_);
+                    memcpy(dest, &destTangent, sizeof destTangent);
+                }
+                break;
+                
+            default:
+                memcpy(dest, srcElement, VertexBuffer::elementSize[j]);
+                break;
+            }
+            
+            dest += VertexBuffer::elementSize[j];
+        }
+    }
+    
+    // Copy the indices, rebased to the merged vertex range
+    unsigned indexStart = geometry->GetIndexStart();
+    unsigned indexCount = geometry->GetIndexCount() / 3 * 3;
+    unsigned destIndex = indexData_.Size();
+    indexData_.Resize(destIndex + indexCount);
+    for (unsigned i = indexStart; i < indexStart + indexCount; i += 3)
+    {
+        unsigned triangle[3];
+        for (unsigned j = 0; j < 3; ++j)
+        {
+            unsigned index = indexSize == sizeof(unsigned) ? reinterpret_cast<const unsigned*>(indexData)[i + j] :
+                reinterpret_cast<const unsigned short*>(indexData)[i + j];
+            triangle[j] = index - vertexStart + baseVertex;
+        }
+        
+        indexData_[destIndex++] = triangle[0];
+        indexData_[destIndex++] = mirrored ? triangle[2] : triangle[1];
+        indexData_[destIndex++] = mirrored ? triangle[1] : triangle[2];
+    }
+    
+    vertexCount_ += vertexCount;
+    return true;
+}
+
+SharedPtr<Geometry> GeometryMerger::CreateGeometry(Context* context) const
+{
+    if (!vertexCount_ || indexData_.Empty())
+        return SharedPtr<Geometry>();
+    
+    unsigned indexCount = indexData_.Size();
+    bool largeIndices = vertexCount_ > 65535;
+    
+    // Keep shadow copies of the data for raycasts and occlusion
+    SharedPtr<VertexBuffer> vertexBuffer(new VertexBuffer(context));
+    vertexBuffer->SetShadowed(true);
+    vertexBuffer->SetSize(vertexCount_, elementMask_);
+    vertexBuffer->SetData(&vertexData_[0]);
+    
+    SharedPtr<IndexBuffer> indexBuffer(new IndexBuffer(context));
+    indexBuffer->SetShadowed(true);
+    indexBuffer->SetSize(indexCount, largeIndices);
+    if (largeIndices)
+        indexBuffer->SetData(&indexData_[0]);
+    else
+    {
+        PODVector<unsigned short> shortIndices(indexCount);
+        for (unsigned i = 0; i < indexCount; ++i)
+            shortIndices[i] = (unsigned short)indexData_[i];
+        indexBuffer->SetData(&shortIndices[0]);
+    }
+    
+    SharedPtr<Geometry> geometry(new Geometry(context));
+    geometry->SetVertexBuffer(0, vertexBuffer, elementMask_);
+    geometry->SetIndexBuffer(indexBuffer);
+    geometry->SetDrawRange(TRIANGLE_LIST, 0, indexCount, 0, vertexCount_);
+    return geometry;
+}
+
+unsigned GeometryMerger::GetMergedElementMask(Geometry* geometry)
+{
+    if (!geometry || geometry->GetPrimitiveType() != TRIANGLE_LIST || !geometry->GetVertexCount() ||
+        geometry->GetIndexCount() < 3)
+        return 0;
+    
+    const unsigned char* vertexData;
+    unsigned vertexSize;
+    const unsigned char* indexData;
+    unsigned indexSize;
+    unsigned elementMask;
+    
+    geometry->GetRawData(vertexData, vertexSize, indexData, indexSize, elementMask);
+    if (!vertexData || !indexData || !(elementMask & MASK_POSITION))
+        return 0;
+    
+    VertexBuffer* packedBuffer = GetPackedBuffer(geometry);
+    if (packedBuffer)
+        elementMask = packedBuffer->GetElementMask() & ~MASK_PACKED_ELEMENTS;
+    
+    return elementMask & MERGED_ELEMENT_MASK;
+}
+
+}
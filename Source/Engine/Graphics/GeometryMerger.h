@@ -0,0 +1,78 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "BoundingBox.h"
+#include "Ptr.h"
+#include "Vector.h"
+
+namespace Urho3D
+{
+
+class Context;
+class Geometry;
+class Material;
+class Matrix3x4;
+
+/// Merges triangle list geometries that share a material and vertex format into one vertex and index buffer on the CPU.
+class URHO3D_API GeometryMerger
+{
+public:
+    /// Construct with material and vertex element mask.
+    GeometryMerger(Material* material = 0, unsigned elementMask = 0);
+    
+    /// Append a geometry's draw range transformed into the merged space. Return false if the geometry can not be merged.
+    bool Append(Geometry* geometry, const Matrix3x4& transform);
+    /// Create a geometry with shadowed vertex and index buffers from the merged data. Return null if nothing was merged.
+    SharedPtr<Geometry> CreateGeometry(Context* context) const;
+    
+    /// Return material.
+    Material* GetMaterial() const { return material_; }
+    /// Return vertex element mask.
+    unsigned GetElementMask() const { return elementMask_; }
+    /// Return number of merged vertices.
+    unsigned GetVertexCount() const { return vertexCount_; }
+    /// Return number of merged indices.
+    unsigned GetIndexCount() const { return indexData_.Size(); }
+    /// Return bounding box of the merged vertices.
+    const BoundingBox& GetBoundingBox() const { return boundingBox_; }
+    
+    /// Return the vertex element mask a geometry would be merged with, or 0 if it can not be merged.
+    static unsigned GetMergedElementMask(Geometry* geometry);
+    
+private:
+    /// Material.
+    Material* material_;
+    /// Vertex element mask.
+    unsigned elementMask_;
+    /// Number of merged vertices.
+    unsigned vertexCount_;
+    /// Merged vertex data.
+    PODVector<unsigned char> vertexData_;
+    /// Merged index data.
+    PODVector<unsigned> indexData_;
+    /// Bounding box of the merged vertices.
+    BoundingBox boundingBox_;
+};
+
+}
@@ -0,0 +1,400 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Precompiled.h"
+#include "GeometryOptimizer.h"
+#include "Sort.h"
+#include "Vector.h"
+#include "Vector3.h"
+
+#include <cstring>
+
+namespace Urho3D
+{
+
+static const unsigned FORSYTH_CACHE_SIZE = 32;
+static const unsigned FORSYTH_MAX_VALENCE = 32;
+static const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+static const float FORSYTH_LAST_TRI_SCORE = 0.75f;
+static const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+static const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+static const unsigned CLUSTER_CACHE_SIZE = 16;
+
+/// Triangle cluster for overdraw ordering.
+struct OverdrawCluster
+{
+    /// First triangle.
+    unsigned start_;
+    /// Number of triangles.
+    unsigned count_;
+    /// Sort key: distance of the cluster plane from the mesh center along the cluster normal.
+    float sortKey_;
+};
+
+static bool CompareOverdrawClusters(const OverdrawCluster& lhs, const OverdrawCluster& rhs)
+{
+    // Tie-break on the original position to keep the result deterministic
+    if (lhs.sortKey_ != rhs.sortKey_)
+        return lhs.sortKey_ > rhs.sortKey_;
+    else
+        return lhs.start_ < rhs.start_;
+}
+
+static const Vector3& GetPosition(const void* vertexData, unsigned vertexSize, unsigned positionOffset, unsigned index)
+{
+    return *reinterpret_cast<const Vector3*>(reinterpret_cast<const unsigned char*>(vertexData) + index * vertexSize +
+        positionOffset);
+}
+
+void OptimizeVertexCache(unsigned* indices, unsigned indexCount, unsigned vertexCount)
+{
+    // Linear-speed vertex cache optimisation by Tom Forsyth
+    // https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+    // Triangle scores are updated incrementally from the vertices that enter or leave the cache, and the next triangle
+    // is searched for among the triangles of the cached vertices only
+    unsigned numTriangles = indexCount / 3;
+    if (!numTriangles || !vertexCount)
+        return;
+
+    float cacheScores[FORSYTH_CACHE_SIZE];
+    for (unsigned i = 0; i < FORSYTH_CACHE_SIZE; ++i)
+    {
+        if (i < 3)
+            cacheScores[i] = FORSYTH_LAST_TRI_SCORE;
+        else
+            cacheScores[i] = powf(1.0f - (float)(i - 3) / (float)(FORSYTH_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY_POWER);
+    }
+    float valenceScores[FORSYTH_MAX_VALENCE];
+    for (unsigned i = 0; i < FORSYTH_MAX_VALENCE; ++i)
+        valenceScores[i] = FORSYTH_VALENCE_BOOST_SCALE * powf((float)i, -FORSYTH_VALENCE_BOOST_POWER);
+
+    // Build the vertex to triangle adjacency. The remaining (not yet emitted) triangles of each vertex are kept at the
+    // start of its range
+    PODVector<unsigned> valences(vertexCount);
+    PODVector<unsigned> offsets(vertexCount);
+    PODVector<unsigned> adjacency(numTriangles * 3);
+    memset(&valences[0], 0, vertexCount * sizeof(unsigned));
+    for (unsigned i = 0; i < numTriangles * 3; ++i)
+        ++valences[indices[i]];
+    unsigned offset = 0;
+    for (unsigned i = 0; i < vertexCount; ++i)
+    {
+        offsets[i] = offset;
+        offset += valences[i];
+        valences[i] = 0;
+    }
+    for (unsigned i = 0; i < numTriangles * 3; ++i)
+    {
+        unsigned v = indices[i];
+        adjacency[offsets[v] + valences[v]++] = i / 3;
+    }
+
+    PODVector<float> vertexScores(vertexCount);
+    for (unsigned i = 0; i < vertexCount; ++i)
+    {
+        unsigned valence = valences[i];
+        vertexScores[i] = valence ? valenceScores[valence < FORSYTH_MAX_VALENCE ? valence : FORSYTH_MAX_VALENCE - 1] : 0.0f;
+    }
+
+    PODVector<float> triangleScores(numTriangles);
+    PODVector<bool> emitted(numTriangles);
+    unsigned bestTriangle = 0;
+    float bestScore = -1.0f;
+    for (unsigned i = 0; i < numTriangles; ++i)
+    {
+        const unsigned* tri = indices + i * 3;
+        triangleScores[i] = vertexScores[tri[0]] + vertexScores[tri[1]] + vertexScores[tri[2]];
+        emitted[i] = false;
+        if (triangleScores[i] > bestScore)
+        {
+            bestScore = triangleScores[i];
+            bestTriangle = i;
+        }
+    }
+
+    PODVector<unsigned> dest(numTriangles * 3);
+    unsigned cache[FORSYTH_CACHE_SIZE + 3];
+    unsigned newCache[FORSYTH_CACHE_SIZE + 3];
+    unsigned cacheSize = 0;
+    unsigned searchStart = 0;
+
+    for (unsigned outTriangle = 0; outTriangle < numTriangles; ++outTriangle)
+    {
+        // If no cached vertex has remaining triangles, continue from the first unemitted triangle in the source order
+        if (bestTriangle == M_MAX_UNSIGNED)
+        {
+            while (emitted[searchStart])
+                ++searchStart;
+            bestTriangle = searchStart;
+        }
+
+        const unsigned* tri = indices + bestTriangle * 3;
+        emitted[bestTriangle] = true;
+        unsigned newCacheSize = 0;
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            unsigned v = tri[i];
+            dest[outTriangle * 3 + i] = v;
+            newCache[newCacheSize++] = v;
+
+            // Move the emitted triangle past the remaining triangles of the vertex
+            unsigned* vertexTriangles = &adjacency[offsets[v]];
+            unsigned last = --valences[v];
+            for (unsigned j = 0; j <= last; ++j)
+            {
+                if (vertexTriangles[j] == bestTriangle)
+                {
+                    vertexTriangles[j] = vertexTriangles[last];
+                    vertexTriangles[last] = bestTriangle;
+                    break;
+                }
+            }
+        }
+
+        for (unsigned i = 0; i < cacheSize; ++i)
+        {
+            unsigned v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCacheSize++] = v;
+        }
+
+        // Rescore the vertices whose cache position or valence changed and propagate the difference to their triangles
+        bestTriangle = M_MAX_UNSIGNED;
+        bestScore = -1.0f;
+        for (unsigned i = 0; i < newCacheSize; ++i)
+        {
+            unsigned v = newCache[i];
+            unsigned valence = valences[v];
+            float score = 0.0f;
+            if (valence)
+            {
+                if (i < FORSYTH_CACHE_SIZE)
+                    score = cacheScores[i];
+                score += valenceScores[valence < FORSYTH_MAX_VALENCE ? valence : FORSYTH_MAX_VALENCE - 1];
+            }
+
+            float delta = score - vertexScores[v];
+            vertexScores[v] = score;
+            const unsigned* vertexTriangles = &adjacency[offsets[v]];
+            for (unsigned j = 0; j < valence; ++j)
+            {
+                unsigned t = vertexTriangles[j];
+                triangleScores[t] += delta;
+                if (i < FORSYTH_CACHE_SIZE && triangleScores[t] > bestScore)
+                {
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        cacheSize = newCacheSize < FORSYTH_CACHE_SIZE ? newCacheSize : FORSYTH_CACHE_SIZE;
+        memcpy(cache, newCache, cacheSize * sizeof(unsigned));
+    }
+
+    memcpy(indices, &dest[0], numTriangles * 3 * sizeof(unsigned));
+}
+
+void OptimizeOverdraw(unsigned* indices, unsigned indexCount, const void* vertexData, unsigned vertexSize, unsigned positionOffset,
+    unsigned vertexCount, float threshold)
+{
+    // Cluster ordering after Sander, Nehab & Barczak: "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+    // The cache optimized order is split into hard clusters where the cache restarts (a triangle misses on all its
+    // vertices), and those further into soft clusters wherever the miss ratio from a cold cache is already within the
+    // threshold of the hard cluster's. Clusters that face away from the mesh center are then drawn first, as they are
+    // likely to occlude the rest
+    unsigned numTriangles = indexCount / 3;
+    if (numTriangles < 2 || !vertexCount)
+        return;
+
+    PODVector<unsigned> timestamps(vertexCount);
+    memset(&timestamps[0], 0, vertexCount * sizeof(unsigned));
+    unsigned time = CLUSTER_CACHE_SIZE + 1;
+
+    PODVector<unsigned> triangleMisses(numTriangles);
+    PODVector<unsigned> hardBoundaries;
+    for (unsigned i = 0; i < numTriangles; ++i)
+    {
+        unsigned misses = 0;
+        for (unsigned j = 0; j < 3; ++j)
+        {
+            unsigned v = indices[i * 3 + j];
+            if (time - timestamps[v] > CLUSTER_CACHE_SIZE)
+            {
+                timestamps[v] = time++;
+                ++misses;
+            }
+        }
+        triangleMisses[i] = misses;
+        if (!i || misses == 3)
+            hardBoundaries.Push(i);
+    }
+    hardBoundaries.Push(numTriangles);
+
+    PODVector<OverdrawCluster> clusters;
+    for (unsigned i = 0; i + 1 < hardBoundaries.Size(); ++i)
+    {
+        unsigned start = hardBoundaries[i];
+        unsigned end = hardBoundaries[i + 1];
+        unsigned hardMisses = 0;
+        for (unsigned j = start; j < end; ++j)
+            hardMisses += triangleMisses[j];
+        float clusterThreshold = threshold * (float)hardMisses / (float)(end - start);
+
+        // Flush the cache at each soft cluster start, as the cluster may be drawn after any other
+        time += CLUSTER_CACHE_SIZE + 1;
+        unsigned softStart = start;
+        unsigned softMisses = 0;
+        for (unsigned j = start; j < end; ++j)
+        {
+            for (unsigned k = 0; k < 3; ++k)
+            {
+                unsigned v = indices[j * 3 + k];
+                if (time - timestamps[v] > CLUSTER_CACHE_SIZE)
+                {
+                    timestamps[v] = time++;
+                    ++softMisses;
+                }
+            }
+
+            if (j == end - 1 || (float)softMisses / (float)(j - softStart + 1) <= clusterThreshold)
+            {
+                OverdrawCluster cluster;
+                cluster.start_ = softStart;
+                cluster.count_ = j - softStart + 1;
+                cluster.sortKey_ = 0.0f;
+                clusters.Push(cluster);
+                softStart = j + 1;
+                softMisses = 0;
+                time += CLUSTER_CACHE_SIZE + 1;
+            }
+        }
+    }
+
+    if (clusters.Size() < 2)
+        return;
+
+    // Area-weighted centroids and normals: the unnormalized cross product of a triangle is its normal scaled by twice its area
+    PODVector<Vector3> clusterCenters(clusters.Size());
+    PODVector<Vector3> clusterNormals(clusters.Size());
+    Vector3 meshCenter(Vector3::ZERO);
+    float meshArea = 0.0f;
+
+    for (unsigned i = 0; i < clusters.Size(); ++i)
+    {
+        const OverdrawCluster& cluster = clusters[i];
+        Vector3 center(Vector3::ZERO);
+        Vector3 normal(Vector3::ZERO);
+        float area = 0.0f;
+
+        for (unsigned j = cluster.start_; j < cluster.start_ + cluster.count_; ++j)
+        {
+            const Vector3& v0 = GetPosition(vertexData, vertexSize, positionOffset, indices[j * 3]);
+            const Vector3& v1 = GetPosition(vertexData, vertexSize, positionOffset, indices[j * 3 + 1]);
+            const Vector3& v2 = GetPosition(vertexData, vertexSize, positionOffset, indices[j * 3 + 2]);
+            Vector3 cross = (v1 - v0).CrossProduct(v2 - v0);
+            float triangleArea = cross.Length();
+            center += (v0 + v1 + v2) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+
+        meshCenter += center;
+        meshArea += area;
+        clusterCenters[i] = area > 0.0f ? center / area : Vector3::ZERO;
+        clusterNormals[i] = normal.Normalized();
+    }
+
+    if (meshArea <= 0.0f)
+        return;
+    meshCenter /= meshArea;
+
+    for (unsigned i = 0; i < clusters.Size(); ++i)
+        clusters[i].sortKey_ = (clusterCenters[i] - meshCenter).DotProduct(clusterNormals[i]);
+
+    Sort(clusters.Begin(), clusters.End(), CompareOverdrawClusters);
+
+    PODVector<unsigned> dest(numTriangles * 3);
+    unsigned outIndex = 0;
+    for (unsigned i = 0; i < clusters.Size(); ++i)
+    {
+        const OverdrawCluster& cluster = clusters[i];
+        memcpy(&dest[outIndex], indices + cluster.start_ * 3, cluster.count_ * 3 * sizeof(unsigned));
+        outIndex += cluster.count_ * 3;
+    }
+
+    memcpy(indices, &dest[0], numTriangles * 3 * sizeof(unsigned));
+}
+
+void OptimizeVertexFetch(unsigned* remap, unsigned* indices, unsigned indexCount, unsigned vertexCount)
+{
+    for (unsigned i = 0; i < vertexCount; ++i)
+        remap[i] = M_MAX_UNSIGNED;
+
+    unsigned nextVertex = 0;
+    for (unsigned i = 0; i < indexCount; ++i)
+    {
+        unsigned& newIndex = remap[indices[i]];
+        if (newIndex == M_MAX_UNSIGNED)
+            newIndex = nextVertex++;
+        indices[i] = newIndex;
+    }
+
+    for (unsigned i = 0; i < vertexCount; ++i)
+    {
+        if (remap[i] == M_MAX_UNSIGNED)
+            remap[i] = nextVertex++;
+    }
+}
+
+VertexCacheStatistics AnalyzeVertexCache(const unsigned* indices, unsigned indexCount, unsigned vertexCount, unsigned cacheSize)
+{
+    VertexCacheStatistics ret;
+    unsigned numTriangles = indexCount / 3;
+    if (!numTriangles || !vertexCount)
+        return ret;
+
+    // A vertex is in the FIFO cache if fewer than cacheSize misses have happened since it was last loaded
+    PODVector<unsigned> timestamps(vertexCount);
+    memset(&timestamps[0], 0, vertexCount * sizeof(unsigned));
+    unsigned time = cacheSize + 1;
+    unsigned misses = 0;
+    unsigned uniqueVertices = 0;
+
+    for (unsigned i = 0; i < numTriangles * 3; ++i)
+    {
+        unsigned v = indices[i];
+        if (!timestamps[v])
+            ++uniqueVertices;
+        if (time - timestamps[v] > cacheSize)
+        {
+            timestamps[v] = time++;
+            ++misses;
+        }
+    }
+
+    ret.acmr_ = (float)misses / (float)numTriangles;
+    ret.atvr_ = (float)misses / (float)uniqueVertices;
+    return ret;
+}
+
+}
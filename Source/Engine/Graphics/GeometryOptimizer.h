@@ -0,0 +1,55 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "Urho3D.h"
+
+namespace Urho3D
+{
+
+/// Vertex cache efficiency of a triangle list.
+struct VertexCacheStatistics
+{
+    /// Construct with zero ratios.
+    VertexCacheStatistics() :
+        acmr_(0.0f),
+        atvr_(0.0f)
+    {
+    }
+
+    /// Average cache miss ratio: transformed vertices per triangle.
+    float acmr_;
+    /// Average transformed vertex ratio: transformed vertices per referenced vertex. 1.0 is optimal.
+    float atvr_;
+};
+
+/// Reorder the triangles of an indexed triangle list for the post-transform vertex cache in linear time.
+URHO3D_API void OptimizeVertexCache(unsigned* indices, unsigned indexCount, unsigned vertexCount);
+/// Reorder the triangle clusters of a vertex cache optimized triangle list so that outward facing clusters are drawn first to reduce overdraw. The threshold limits how much the cache miss ratio of a cluster may grow.
+URHO3D_API void OptimizeOverdraw(unsigned* indices, unsigned indexCount, const void* vertexData, unsigned vertexSize, unsigned positionOffset, unsigned vertexCount, float threshold = 1.05f);
+/// Renumber vertices in the order of first use for the pre-transform vertex fetch. Unused vertices are placed last. Fill remap with the new index of each old vertex.
+URHO3D_API void OptimizeVertexFetch(unsigned* remap, unsigned* indices, unsigned indexCount, unsigned vertexCount);
+/// Simulate a FIFO post-transform vertex cache on an indexed triangle list and return its efficiency.
+URHO3D_API VertexCacheStatistics AnalyzeVertexCache(const unsigned* indices, unsigned indexCount, unsigned vertexCount, unsigned cacheSize = 16);
+
+}
@@ -350,6 +350,12 @@ static const unsigned MASK_BLENDINDICES = 0x200;
 static const unsigned MASK_INSTANCEMATRIX1 = 0x400;
 static const unsigned MASK_INSTANCEMATRIX2 = 0x800;
 static const unsigned MASK_INSTANCEMATRIX3 = 0x1000;
+/// Packed element formats. Combined with the element bits they select a smaller format for that element: 16-bit normalized positions dequantized by the geometry's position transform, normals and tangents, and half float texture coordinates.
+static const unsigned MASK_PACKED_POSITION = 0x10000;
+static const unsigned MASK_PACKED_NORMAL = 0x20000;
+static const unsigned MASK_PACKED_TEXCOORD = 0x40000;
+static const unsigned MASK_PACKED_TANGENT = 0x80000;
+static const unsigned MASK_PACKED_ELEMENTS = 0xf0000;
 static const unsigned MASK_DEFAULT = 0xffffffff;
 static const unsigned NO_ELEMENT = 0xffffffff;
 
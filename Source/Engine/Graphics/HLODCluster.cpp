@@ -0,0 +1,366 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Precompiled.h"
+#include "Camera.h"
+#include "Context.h"
+#include "Geometry.h"
+#include "GeometryMerger.h"
+#include "HLODCluster.h"
+#include "Material.h"
+#include "Model.h"
+#include "Profiler.h"
+#include "Scene.h"
+
+#include "DebugNew.h"
+
+namespace Urho3D
+{
+
+extern const char* GEOMETRY_CATEGORY;
+
+HLODCluster::HLODCluster(Context* context) :
+    StaticModel(context),
+    switchDistance_(0.0f),
+    proxyLodLevel_(M_MAX_UNSIGNED),
+    nodeIDsDirty_(false)
+{
+    // The proxy is hidden by the same switch as its members, just inverted
+    hlodCluster_ = this;
+
+    // Initialize the default node IDs attribute
+    UpdateNodeIDs();
+}
+
+HLODCluster::~HLODCluster()
+{
+    ReleaseMembers();
+}
+
+void HLODCluster::RegisterObject(Context* context)
+{
+    context->RegisterFactory<HLODCluster>(GEOMETRY_CATEGORY);
+
+    COPY_BASE_ATTRIBUTES(StaticModel);
+    // The proxy geometry and its materials are rebuilt from the members, so they are not serialized
+    REMOVE_ATTRIBUTE("Model");
+    REMOVE_ATTRIBUTE("Material");
+    ACCESSOR_ATTRIBUTE("Switch Distance", GetSwitchDistance, SetSwitchDistance, float, 0.0f, AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Proxy LOD Level", GetProxyLodLevel, SetProxyLodLevel, unsigned, M_MAX_UNSIGNED, AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Cluster Nodes", GetNodeIDsAttr, SetNodeIDsAttr, VariantVector, Variant::emptyVariantVector, AM_DEFAULT | AM_NODEIDVECTOR);
+}
+
+void HLODCluster::ApplyAttributes()
+{
+    if (!nodeIDsDirty_)
+        return;
+
+    clusterNodes_.Clear();
+
+    Scene* scene = GetScene();
+
+    if (scene)
+    {
+        // The first index stores the number of IDs redundantly. This is for editing
+        for (unsigned i = 1; i < nodeIDsAttr_.Size(); ++i)
+        {
+            Node* node = scene->GetNode(nodeIDsAttr_[i].GetUInt());
+            if (node)
+                clusterNodes_.Push(WeakPtr<Node>(node));
+        }
+    }
+
+    nodeIDsDirty_ = false;
+    Build();
+}
+
+void HLODCluster::AddClusterNode(Node* node)
+{
+    if (!node)
+        return;
+
+    WeakPtr<Node> clusterWeak(node);
+    if (clusterNodes_.Contains(clusterWeak))
+        return;
+
+    clusterNodes_.Push(clusterWeak);
+
+    UpdateNodeIDs();
+    Build();
+    MarkNetworkUpdate();
+}
+
+void HLODCluster::RemoveClusterNode(Node* node)
+{
+    if (!node)
+        return;
+
+    clusterNodes_.Remove(WeakPtr<Node>(node));
+
+    UpdateNodeIDs();
+    Build();
+    MarkNetworkUpdate();
+}
+
+void HLODCluster::RemoveAllClusterNodes()
+{
+    clusterNodes_.Clear();
+
+    UpdateNodeIDs();
+    Build();
+    MarkNetworkUpdate();
+}
+
+void HLODCluster::SetSwitchDistance(float distance)
+{
+    switchDistance_ = Max(distance, 0.0f);
+    MarkNetworkUpdate();
+}
+
+void HLODCluster::SetProxyLodLevel(unsigned level)
+{
+    if (level != proxyLodLevel_)
+    {
+        proxyLodLevel_ = level;
+        Build();
+        MarkNetworkUpdate();
+    }
+}
+
+void HLODCluster::Build()
+{
+    PROFILE(BuildHLODCluster);
+
+    ReleaseMembers();
+
+    Vector<GeometryMerger> mergers;
+
+    if (node_)
+    {
+        Matrix3x4 inverseWorldTransform = node_->GetWorldTransform().Inverse();
+        PODVector<StaticModel*> models;
+
+        for (unsigned i = 0; i < clusterNodes_.Size(); ++i)
+        {
+            Node* clusterNode = clusterNodes_[i];
+            if (!clusterNode)
+                continue;
+
+            // Only exact StaticModels are gathered, as the subclasses can not be represented by a single static mesh
+            clusterNode->GetComponents<StaticModel>(models);
+            Matrix3x4 transform = inverseWorldTransform * clusterNode->GetWorldTransform();
+
+            for (unsigned j = 0; j < models.Size(); ++j)
+            {
+                StaticModel* member = models[j];
+                Model* model = member->GetModel();
+                if (!model || !member->IsEnabledEffective() || (member->GetHLODCluster() && member->GetHLODCluster() != this))
+                    continue;
+
+                bool merged = false;
+
+                for (unsigned k = 0; k < model->GetNumGeometries(); ++k)
+                {
+                    unsigned numLodLevels = model->GetNumGeometryLodLevels(k);
+                    if (!numLodLevels)
+                        continue;
+
+                    Geometry* geometry = model->GetGeometry(k, proxyLodLevel_ < numLodLevels ? proxyLodLevel_ : numLodLevels - 1);
+                    unsigned elementMask = GeometryMerger::GetMergedElementMask(geometry);
+                    if (!elementMask)
+                        continue;
+
+                    // Find or create the proxy geometry for this material and vertex format
+                    Material* material = member->GetMaterial(k);
+                    GeometryMerger* merger = 0;
+                    for (unsigned l = 0; l < mergers.Size(); ++l)
+                    {
+                        if (mergers[l].GetMaterial() == material && mergers[l].GetElementMask() == elementMask)
+                        {
+                            merger = &mergers[l];
+                            break;
+                        }
+                    }
+                    if (!merger)
+                    {
+                        mergers.Push(GeometryMerger(material, elementMask));
+                        merger = &mergers.Back();
+                    }
+
+                    merged |= merger->Append(geometry, transform);
+                }
+
+                if (merged)
+                {
+                    member->SetHLODCluster(this);
+                    members_.Push(WeakPtr<StaticModel>(member));
+                }
+            }
+        }
+    }
+
+    BoundingBox box;
+    SetNumGeometries(mergers.Size());
+
+    for (unsigned i = 0; i < mergers.Size(); ++i)
+    {
+        geometries_[i].Resize(1);
+        geometries_[i][0] = mergers[i].CreateGeometry(context_);
+        geometryData_[i].center_ = mergers[i].GetBoundingBox().Center();
+        batches_[i].material_ = mergers[i].GetMaterial();
+        box.Merge(mergers[i].GetBoundingBox());
+    }
+
+    SetBoundingBox(box);
+    ResetLodLevels();
+}
+
+Node* HLODCluster::GetClusterNode(unsigned index) const
+{
+    return index < clusterNodes_.Size() ? clusterNodes_[index] : (Node*)0;
+}
+
+bool HLODCluster::IsProxyActive(Camera* camera)
+{
+    if (switchDistance_ <= 0.0f || batches_.Empty() || !camera || !IsEnabledEffective())
+        return false;
+
+    // The world bounding box has been updated during the octree update, so this is safe to call from worker threads
+    const BoundingBox& worldBoundingBox = GetWorldBoundingBox();
+    float distance = camera->GetDistance(worldBoundingBox.Center());
+    float scale = worldBoundingBox.Size().DotProduct(DOT_SCALE);
+    return camera->GetLodDistance(distance, scale, lodBias_) > switchDistance_;
+}
+
+void HLODCluster::SetNodeIDsAttr(const VariantVector& value)
+{
+    // Just remember the node IDs. They need to go through the SceneResolver, and we actually find the nodes during
+    // ApplyAttributes()
+    if (value.Size())
+    {
+        nodeIDsAttr_.Clear();
+
+        unsigned index = 0;
+        unsigned numNodes = value[index++].GetUInt();
+        // Prevent crash on entering negative value in the editor
+        if (numNodes > M_MAX_INT)
+            numNodes = 0;
+
+        nodeIDsAttr_.Push(numNodes);
+        while (numNodes--)
+        {
+            // If vector contains less IDs than should, fill the rest with zeroes
+            if (index < value.Size())
+                nodeIDsAttr_.Push(value[index++].GetUInt());
+            else
+                nodeIDsAttr_.Push(0);
+        }
+    }
+    else
+    {
+        nodeIDsAttr_.Clear();
+        nodeIDsAttr_.Push(0);
+    }
+    nodeIDsDirty_ = true;
+}
+
+unsigned HLODCluster::CreateClusters(Node* root, float cellSize, float switchDistance)
+{
+    if (!root || cellSize <= 0.0f)
+        return 0;
+
+    PODVector<StaticModel*> models;
+    root->GetComponents<StaticModel>(models, true);
+
+    // Bucket the model nodes by the horizontal grid cell of their world bounding box center
+    HashMap<Pair<int, int>, PODVector<Node*> > cells;
+    for (unsigned i = 0; i < models.Size(); ++i)
+    {
+        StaticModel* model = models[i];
+        Node* node = model->GetNode();
+        if (!model->GetModel() || model->GetHLODCluster() || node == root)
+            continue;
+
+        Vector3 center = model->GetWorldBoundingBox().Center();
+        Pair<int, int> cell((int)floorf(center.x_ / cellSize), (int)floorf(center.z_ / cellSize));
+        PODVector<Node*>& cellNodes = cells[cell];
+        if (!cellNodes.Contains(node))
+            cellNodes.Push(node);
+    }
+
+    unsigned numClusters = 0;
+
+    for (HashMap<Pair<int, int>, PODVector<Node*> >::ConstIterator i = cells.Begin(); i != cells.End(); ++i)
+    {
+        const PODVector<Node*>& cellNodes = i->second_;
+        if (cellNodes.Size() < 2)
+            continue;
+
+        Node* clusterNode = root->CreateChild("HLODCluster");
+        HLODCluster* cluster = clusterNode->CreateComponent<HLODCluster>();
+        cluster->SetSwitchDistance(switchDistance);
+
+        // Add the nodes directly to build the proxy only once
+        for (unsigned j = 0; j < cellNodes.Size(); ++j)
+            cluster->clusterNodes_.Push(WeakPtr<Node>(cellNodes[j]));
+        cluster->UpdateNodeIDs();
+        cluster->Build();
+
+        // Cast shadows if any of the members does
+        bool castShadows = false;
+        for (unsigned j = 0; j < cluster->members_.Size(); ++j)
+            castShadows |= cluster->members_[j]->GetCastShadows();
+        cluster->SetCastShadows(castShadows);
+
+        ++numClusters;
+    }
+
+    return numClusters;
+}
+
+void HLODCluster::UpdateNodeIDs()
+{
+    unsigned numNodes = clusterNodes_.Size();
+
+    nodeIDsAttr_.Clear();
+    nodeIDsAttr_.Push(numNodes);
+
+    for (unsigned i = 0; i < numNodes; ++i)
+    {
+        Node* node = clusterNodes_[i];
+        nodeIDsAttr_.Push(node ? node->GetID() : 0);
+    }
+}
+
+void HLODCluster::ReleaseMembers()
+{
+    for (unsigned i = 0; i < members_.Size(); ++i)
+    {
+        StaticModel* member = members_[i];
+        if (member && member->GetHLODCluster() == this)
+            member->SetHLODCluster(0);
+    }
+
+    members_.Clear();
+}
+
+}
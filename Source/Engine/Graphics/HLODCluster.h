@@ -0,0 +1,100 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "StaticModel.h"
+
+namespace Urho3D
+{
+
+/// Hierarchical LOD proxy for a cluster of static models. Merges the members' geometry into one mesh per material and replaces the members with it when the cluster is small enough on the screen. The members must not move after the proxy has been built. The cluster takes precedence over StaticBatch: its members are removed from static batches.
+class URHO3D_API HLODCluster : public StaticModel
+{
+    OBJECT(HLODCluster);
+
+public:
+    /// Construct.
+    HLODCluster(Context* context);
+    /// Destruct.
+    virtual ~HLODCluster();
+    /// Register object factory. StaticModel must be registered first.
+    static void RegisterObject(Context* context);
+
+    /// Apply attribute changes that can not be applied immediately. Called after scene load or a network update.
+    void ApplyAttributes();
+
+    /// Add a member scene node. Its StaticModel components will be replaced by the proxy.
+    void AddClusterNode(Node* node);
+    /// Remove a member scene node.
+    void RemoveClusterNode(Node* node);
+    /// Remove all member scene nodes.
+    void RemoveAllClusterNodes();
+    /// Set LOD distance beyond which the proxy replaces the members. The LOD distance grows as the cluster's screen size shrinks. Default 0 never switches.
+    void SetSwitchDistance(float distance);
+    /// Set member model LOD level to build the proxy from. By default (M_MAX_UNSIGNED) the coarsest level.
+    void SetProxyLodLevel(unsigned level);
+    /// Rebuild the proxy geometry from the members. Is called automatically when the members or the proxy LOD level change.
+    void Build();
+
+    /// Return number of member nodes.
+    unsigned GetNumClusterNodes() const { return clusterNodes_.Size(); }
+    /// Return member node by index.
+    Node* GetClusterNode(unsigned index) const;
+    /// Return number of member drawables included in the proxy.
+    unsigned GetNumMembers() const { return members_.Size(); }
+    /// Return switch distance.
+    float GetSwitchDistance() const { return switchDistance_; }
+    /// Return proxy LOD level.
+    unsigned GetProxyLodLevel() const { return proxyLodLevel_; }
+    /// Return whether the proxy replaces the members when seen from a camera. May be called from worker threads.
+    bool IsProxyActive(Camera* camera);
+
+    /// Set node IDs attribute.
+    void SetNodeIDsAttr(const VariantVector& value);
+    /// Return node IDs attribute.
+    const VariantVector& GetNodeIDsAttr() const { return nodeIDsAttr_; }
+
+    /// Group the static models below a root node into a horizontal grid of the given cell size and create a cluster child node for each cell with at least two models. Return number of clusters created.
+    static unsigned CreateClusters(Node* root, float cellSize, float switchDistance);
+
+private:
+    /// Update node IDs attribute.
+    void UpdateNodeIDs();
+    /// Detach the proxy from its current members.
+    void ReleaseMembers();
+
+    /// Member nodes.
+    Vector<WeakPtr<Node> > clusterNodes_;
+    /// Member drawables included in the proxy.
+    Vector<WeakPtr<StaticModel> > members_;
+    /// IDs of member nodes for serialization.
+    mutable VariantVector nodeIDsAttr_;
+    /// Switch LOD distance.
+    float switchDistance_;
+    /// Member LOD level to build the proxy from.
+    unsigned proxyLodLevel_;
+    /// Whether node IDs have been set and nodes should be searched for during ApplyAttributes.
+    bool nodeIDsDirty_;
+};
+
+}
@@ -146,7 +146,7 @@ void Light::RegisterObject(Context* context)
 
 void Light::OnSetAttribute(const AttributeInfo& attr, const Variant& src)
 {
-    Serializable::OnSetAttribute(attr, src);
+    Drawable::OnSetAttribute(attr, src);
 
     // Validate the bias, cascade & focus parameters
     if (attr.offset_ >= offsetof(Light, shadowBias_) && attr.offset_ < (offsetof(Light, shadowBias_) + sizeof(BiasParameters)))
@@ -267,24 +267,28 @@ void Light::SetLightType(LightType type)
 void Light::SetPerVertex(bool enable)
 {
     perVertex_ = enable;
+    MarkBatchesDirty();
     MarkNetworkUpdate();
 }
 
 void Light::SetColor(const Color& color)
 {
     color_ = Color(color.r_, color.g_, color.b_, 1.0f);
+    MarkBatchesDirty();
     MarkNetworkUpdate();
 }
 
 void Light::SetSpecularIntensity(float intensity)
 {
     specularIntensity_ = Max(intensity, 0.0f);
+    MarkBatchesDirty();
     MarkNetworkUpdate();
 }
 
 void Light::SetBrightness(float brightness)
 {
     brightness_ = brightness;
+    MarkBatchesDirty();
     MarkNetworkUpdate();
 }
 
@@ -351,6 +355,7 @@ void Light::SetShadowFadeDistance(float distance)
 void Light::SetShadowIntensity(float intensity)
 {
     shadowIntensity_ = Clamp(intensity, 0.0f, 1.0f);
+    MarkBatchesDirty();
     MarkNetworkUpdate();
 }
 
@@ -369,6 +374,7 @@ void Light::SetRampTexture(Texture* texture)
 void Light::SetShapeTexture(Texture* texture)
 {
     shapeTexture_ = texture;
+    MarkBatchesDirty();
     MarkNetworkUpdate();
 }
 
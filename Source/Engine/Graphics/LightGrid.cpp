@@ -0,0 +1,244 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "Precompiled.h"
+#include "Camera.h"
+#include "Light.h"
+#include "LightGrid.h"
+#include "Node.h"
+
+#include "DebugNew.h"
+
+namespace Urho3D
+{
+
+LightGrid::LightGrid() :
+    nearZ_(0.0f),
+    farZ_(0.0f),
+    sliceScale_(0.0f),
+    orthographic_(false)
+{
+    clusters_.Resize(LIGHTGRID_CLUSTERS);
+}
+
+void LightGrid::Define(Camera* camera, float minZ, float maxZ)
+{
+    view_ = camera->GetView();
+    projection_ = camera->GetProjection(false);
+    orthographic_ = camera->IsOrthographic();
+    
+    // Restrict the slices to the visible scene depth range. Anything outside is clamped to the first or last slice
+    nearZ_ = Max(minZ, camera->GetNearClip());
+    farZ_ = Max(maxZ, nearZ_ * 1.001f + M_EPSILON);
+    
+    if (orthographic_)
+        sliceScale_ = (float)LIGHTGRID_SLICES / (farZ_ - nearZ_);
+    else
+        sliceScale_ = (float)LIGHTGRID_SLICES / logf(farZ_ / nearZ_);
+    
+    ClearLights();
+}
+
+void LightGrid::ClearLights()
+{
+    lights_.Clear();
+    lightSpheres_.Clear();
+    lightFrustums_.Clear();
+    lightRanges_.Clear();
+    
+    for (unsigned i = 0; i < clusters_.Size(); ++i)
+        clusters_[i].Clear();
+}
+
+bool LightGrid::AddLight(Light* light)
+{
+    BoundingBox viewBox;
+    
+    switch (light->GetLightType())
+    {
+    case LIGHT_POINT:
+        {
+            Sphere sphere(light->GetNode()->GetWorldPosition(), light->GetRange());
+            Vector3 viewCenter = view_ * sphere.center_;
+            Vector3 radius(sphere.radius_, sphere.radius_, sphere.radius_);
+            viewBox.Define(viewCenter - radius, viewCenter + radius);
+            lightSpheres_.Push(sphere);
+            lightFrustums_.Push(Frustum());
+        }
+        break;
+        
+    case LIGHT_SPOT:
+        {
+            Frustum frustum = light->GetFrustum();
+            viewBox.Define(frustum.Transformed(view_));
+            lightSpheres_.Push(Sphere());
+            lightFrustums_.Push(frustum);
+        }
+        break;
+        
+    default:
+        return false;
+    }
+    
+    LightGridRange range;
+    GetRange(viewBox, range);
+    lights_.Push(light);
+    lightRanges_.Push(range);
+    return true;
+}
+
+void LightGrid::BuildSlice(unsigned slice)
+{
+    if (slice >= LIGHTGRID_SLICES)
+        return;
+    
+    for (unsigned i = 0; i < lightRanges_.Size(); ++i)
+    {
+        const LightGridRange& range = lightRanges_[i];
+        if (slice < range.minZ_ || slice > range.maxZ_)
+            continue;
+        
+        for (unsigned y = range.minY_; y <= range.maxY_; ++y)
+        {
+            PODVector<unsigned>* row = &clusters_[(slice * LIGHTGRID_TILES_Y + y) * LIGHTGRID_TILES_X];
+            for (unsigned x = range.minX_; x <= range.maxX_; ++x)
+                row[x].Push(i);
+        }
+    }
+}
+
+void LightGrid::GetLights(const BoundingBox& worldBox, PODVector<unsigned>& dest, PODVector<unsigned char>& visited) const
+{
+    dest.Clear();
+    if (lights_.Empty())
+        return;
+    
+    LightGridRange range;
+    GetRange(worldBox.Transformed(view_), range);
+    
+    unsigned numClusters = (range.maxX_ - range.minX_ + 1) * (range.maxY_ - range.minY_ + 1) * (range.maxZ_ - range.minZ_ + 1);
+    
+    // If the box covers more clusters than there are lights, it is cheaper to test all lights directly
+    if (numClusters >= lights_.Size())
+    {
+        for (unsigned i = 0; i < lights_.Size(); ++i)
+        {
+            if (IsLit(i, worldBox))
+                dest.Push(i);
+        }
+        return;
+    }
+    
+    for (unsigned z = range.minZ_; z <= range.maxZ_; ++z)
+    {
+        for (unsigned y = range.minY_; y <= range.maxY_; ++y)
+        {
+            const PODVector<unsigned>* row = &clusters_[(z * LIGHTGRID_TILES_Y + y) * LIGHTGRID_TILES_X];
+            for (unsigned x = range.minX_; x <= range.maxX_; ++x)
+            {
+                const PODVector<unsigned>& cluster = row[x];
+                for (PODVector<unsigned>::ConstIterator i = cluster.Begin(); i != cluster.End(); ++i)
+                {
+                    if (!visited[*i])
+                    {
+                        visited[*i] = 1;
+                        dest.Push(*i);
+                    }
+                }
+            }
+        }
+    }
+    
+    // Reset the visited flags and perform the exact intersection test for the candidates
+    unsigned numLit = 0;
+    for (unsigned i = 0; i < dest.Size(); ++i)
+    {
+        unsigned index = dest[i];
+        visited[index] = 0;
+        if (IsLit(index, worldBox))
+            dest[numLit++] = index;
+    }
+    dest.Resize(numLit);
+}
+
+void LightGrid::GetRange(const BoundingBox& viewBox, LightGridRange& range) const
+{
+    range.minZ_ = GetSlice(viewBox.min_.z_);
+    range.maxZ_ = GetSlice(viewBox.max_.z_);
+    
+    // If the box reaches behind the camera plane, the perspective projection is not usable; cover the whole screen
+    if (!orthographic_ && viewBox.min_.z_ <= M_EPSILON)
+    {
+        range.minX_ = 0;
+        range.maxX_ = LIGHTGRID_TILES_X - 1;
+        range.minY_ = 0;
+        range.maxY_ = LIGHTGRID_TILES_Y - 1;
+        return;
+    }
+    
+    float minX = M_INFINITY;
+    float maxX = -M_INFINITY;
+    float minY = M_INFINITY;
+    float maxY = -M_INFINITY;
+    
+    for (unsigned i = 0; i < 8; ++i)
+    {
+        Vector4 corner((i & 1) ? viewBox.max_.x_ : viewBox.min_.x_, (i & 2) ? viewBox.max_.y_ : viewBox.min_.y_,
+            (i & 4) ? viewBox.max_.z_ : viewBox.min_.z_, 1.0f);
+        Vector4 projected = projection_ * corner;
+        float invW = 1.0f / projected.w_;
+        float x = projected.x_ * invW;
+        float y = projected.y_ * invW;
+        minX = Min(minX, x);
+        maxX = Max(maxX, x);
+        minY = Min(minY, y);
+        maxY = Max(maxY, y);
+    }
+    
+    // Convert from normalized device coordinates to tiles, clamping to the screen edges
+    range.minX_ = (unsigned)Clamp((int)((minX * 0.5f + 0.5f) * LIGHTGRID_TILES_X), 0, (int)LIGHTGRID_TILES_X - 1);
+    range.maxX_ = (unsigned)Clamp((int)((maxX * 0.5f + 0.5f) * LIGHTGRID_TILES_X), 0, (int)LIGHTGRID_TILES_X - 1);
+    range.minY_ = (unsigned)Clamp((int)((minY * 0.5f + 0.5f) * LIGHTGRID_TILES_Y), 0, (int)LIGHTGRID_TILES_Y - 1);
+    range.maxY_ = (unsigned)Clamp((int)((maxY * 0.5f + 0.5f) * LIGHTGRID_TILES_Y), 0, (int)LIGHTGRID_TILES_Y - 1);
+}
+
+unsigned LightGrid::GetSlice(float z) const
+{
+    if (z <= nearZ_)
+        return 0;
+    if (z >= farZ_)
+        return LIGHTGRID_SLICES - 1;
+    
+    unsigned slice = (unsigned)(orthographic_ ? (z - nearZ_) * sliceScale_ : logf(z / nearZ_) * sliceScale_);
+    return slice < LIGHTGRID_SLICES ? slice : LIGHTGRID_SLICES - 1;
+}
+
+bool LightGrid::IsLit(unsigned index, const BoundingBox& worldBox) const
+{
+    if (lights_[index]->GetLightType() == LIGHT_POINT)
+        return lightSpheres_[index].IsInsideFast(worldBox) != OUTSIDE;
+    else
+        return lightFrustums_[index].IsInsideFast(worldBox) != OUTSIDE;
+}
+
+}
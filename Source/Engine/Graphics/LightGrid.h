@@ -0,0 +1,120 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "Frustum.h"
+#include "Matrix4.h"
+#include "Sphere.h"
+#include "Vector.h"
+
+namespace Urho3D
+{
+
+class Camera;
+class Light;
+
+static const unsigned LIGHTGRID_TILES_X = 16;
+static const unsigned LIGHTGRID_TILES_Y = 8;
+static const unsigned LIGHTGRID_SLICES = 24;
+static const unsigned LIGHTGRID_CLUSTERS = LIGHTGRID_TILES_X * LIGHTGRID_TILES_Y * LIGHTGRID_SLICES;
+
+/// Inclusive cluster coordinate range of a view-space volume.
+struct LightGridRange
+{
+    /// Minimum tile X coordinate.
+    unsigned minX_;
+    /// Maximum tile X coordinate.
+    unsigned maxX_;
+    /// Minimum tile Y coordinate.
+    unsigned minY_;
+    /// Maximum tile Y coordinate.
+    unsigned maxY_;
+    /// Minimum depth slice.
+    unsigned minZ_;
+    /// Maximum depth slice.
+    unsigned maxZ_;
+};
+
+/// Clustered (froxel) grid over a camera's view volume for assigning point and spot lights to drawables on the CPU.
+class URHO3D_API LightGrid
+{
+public:
+    /// Construct.
+    LightGrid();
+    
+    /// Define the grid from a camera and the view-space depth range of the visible scene. Must be called from the main thread.
+    void Define(Camera* camera, float minZ, float maxZ);
+    /// Remove all lights and clear the clusters.
+    void ClearLights();
+    /// Add a point or spot light. Return false if the light type can not be assigned through the grid.
+    bool AddLight(Light* light);
+    /// Insert the added lights into the clusters of one depth slice. Different slices may be built from worker threads in parallel.
+    void BuildSlice(unsigned slice);
+    /// Collect indices of lights whose volume intersects a world-space bounding box. The visited flags must have been resized to the number of lights and zero-filled; they are left zero-filled on return. Is thread-safe once the grid has been built.
+    void GetLights(const BoundingBox& worldBox, PODVector<unsigned>& dest, PODVector<unsigned char>& visited) const;
+    
+    /// Return number of lights.
+    unsigned GetNumLights() const { return lights_.Size(); }
+    /// Return light by index.
+    Light* GetLight(unsigned index) const { return index < lights_.Size() ? lights_[index] : (Light*)0; }
+    /// Return light indices of a cluster.
+    const PODVector<unsigned>& GetCluster(unsigned x, unsigned y, unsigned z) const { return clusters_[(z * LIGHTGRID_TILES_Y + y) * LIGHTGRID_TILES_X + x]; }
+    /// Return near depth of the grid.
+    float GetNearZ() const { return nearZ_; }
+    /// Return far depth of the grid.
+    float GetFarZ() const { return farZ_; }
+    
+private:
+    /// Calculate the cluster range of a view-space bounding box.
+    void GetRange(const BoundingBox& viewBox, LightGridRange& range) const;
+    /// Return the depth slice of a view-space depth.
+    unsigned GetSlice(float z) const;
+    /// Return whether a light intersects a world-space bounding box.
+    bool IsLit(unsigned index, const BoundingBox& worldBox) const;
+    
+    /// Camera view matrix.
+    Matrix3x4 view_;
+    /// Camera projection matrix.
+    Matrix4 projection_;
+    /// Near depth of the first slice.
+    float nearZ_;
+    /// Far depth of the last slice.
+    float farZ_;
+    /// Depth to slice conversion factor.
+    float sliceScale_;
+    /// Orthographic camera flag. Determines linear instead of exponential slicing.
+    bool orthographic_;
+    /// Lights.
+    PODVector<Light*> lights_;
+    /// Light bounding spheres, used for point lights.
+    Vector<Sphere> lightSpheres_;
+    /// Light frustums, used for spot lights.
+    Vector<Frustum> lightFrustums_;
+    /// Light cluster ranges.
+    PODVector<LightGridRange> lightRanges_;
+    /// Light indices per cluster.
+    Vector<PODVector<unsigned> > clusters_;
+};
+
+}
@@ -153,6 +153,7 @@ void ShaderParameterAnimationInfo::ApplyValue(const Variant& newValue)
 Material::Material(Context* context) :
     Resource(context),
     auxViewFrameNumber_(0),
+    revision_(0),
     numUsedTextureUnits_(0),
     occlusion_(true),
     specular_(false),
@@ -427,6 +428,7 @@ void Material::SetNumTechniques(unsigned num)
         return;
 
     techniques_.Resize(num);
+    ++revision_;
     RefreshMemoryUse();
 }
 
@@ -436,6 +438,7 @@ void Material::SetTechnique(unsigned index, Technique* tech, unsigned qualityLev
         return;
 
     techniques_[index] = TechniqueEntry(tech, qualityLevel, lodDistance);
+    ++revision_;
     CheckOcclusion();
 }
 
@@ -607,6 +610,8 @@ void Material::ReleaseShaders()
         if (tech)
             tech->ReleaseShaders();
     }
+
+    ++revision_;
 }
 
 SharedPtr<Material> Material::Clone(const String& cloneName) const
@@ -631,6 +636,7 @@ SharedPtr<Material> Material::Clone(const String& cloneName) const
 void Material::SortTechniques()
 {
     Sort(techniques_.Begin(), techniques_.End(), CompareTechniqueEntries);
+    ++revision_;
 }
 
 void Material::MarkForAuxView(unsigned frameNumber)
@@ -183,6 +183,8 @@ public:
     const BiasParameters& GetDepthBias() const { return depthBias_; }
     /// Return last auxiliary view rendered frame number.
     unsigned GetAuxViewFrameNumber() const { return auxViewFrameNumber_; }
+    /// Return revision. Is incremented when the techniques change.
+    unsigned GetRevision() const { return revision_; }
     /// Return whether should render occlusion.
     bool GetOcclusion() const { return occlusion_; }
     /// Return whether should render specular.
@@ -227,6 +229,8 @@ private:
     BiasParameters depthBias_;
     /// Last auxiliary view rendered frame number.
     unsigned auxViewFrameNumber_;
+    /// Technique revision.
+    unsigned revision_;
     /// Number of maximum non-null texture unit + 1.
     unsigned numUsedTextureUnits_;
     /// Render occlusion flag.
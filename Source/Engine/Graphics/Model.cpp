@@ -31,6 +31,7 @@
 #include "Graphics.h"
 #include "Serializer.h"
 #include "VertexBuffer.h"
+#include "VertexPacking.h"
 
 #include <cstring>
 
@@ -91,12 +92,16 @@ bool Model::BeginLoad(Deserializer& source)
     
     unsigned memoryUse = sizeof(Model);
     bool async = GetAsyncLoadState() == ASYNC_LOADING;
+    Graphics* graphics = GetSubsystem<Graphics>();
+    bool packedVertexSupport = graphics && graphics->GetPackedVertexSupport();
 
     // Read vertex buffers
     unsigned numVertexBuffers = source.ReadUInt();
     vertexBuffers_.Reserve(numVertexBuffers);
     morphRangeStarts_.Resize(numVertexBuffers);
     morphRangeCounts_.Resize(numVertexBuffers);
+    positionOffsets_.Resize(numVertexBuffers);
+    positionScales_.Resize(numVertexBuffers);
     loadVBData_.Resize(numVertexBuffers);
     for (unsigned i = 0; i < numVertexBuffers; ++i)
     {
@@ -104,29 +109,76 @@ bool Model::BeginLoad(Deserializer& source)
         unsigned elementMask = source.ReadUInt();
         morphRangeStarts_[i] = source.ReadUInt();
         morphRangeCounts_[i] = source.ReadUInt();
+        positionOffsets_[i] = Vector3::ZERO;
+        positionScales_[i] = 1.0f;
+        if (elementMask & MASK_PACKED_POSITION)
+        {
+            positionOffsets_[i] = source.ReadVector3();
+            positionScales_[i] = source.ReadFloat();
+        }
+        
+        // Unpack all elements if the GPU can not read them or if the buffer is morphed. Skinning needs float positions
+        unsigned unpackMask = 0;
+        if (!packedVertexSupport || morphRangeCounts_[i])
+            unpackMask = elementMask & MASK_PACKED_ELEMENTS;
+        else if (elementMask & MASK_BLENDWEIGHTS)
+            unpackMask = elementMask & MASK_PACKED_POSITION;
         
+        SharedArrayPtr<unsigned char> packedData;
+        if (unpackMask)
+        {
+            unsigned packedDataSize = vertexCount * VertexBuffer::GetVertexSize(elementMask);
+            packedData = new unsigned char[packedDataSize];
+            source.Read(packedData.Get(), packedDataSize);
+        }
+        
+        unsigned bufferMask = elementMask & ~unpackMask;
         SharedPtr<VertexBuffer> buffer(new VertexBuffer(context_));
-        unsigned vertexSize = VertexBuffer::GetVertexSize(elementMask);
+        unsigned vertexSize = VertexBuffer::GetVertexSize(bufferMask);
 
         // Prepare vertex buffer data to be uploaded during EndLoad()
         if (async)
         {
             loadVBData_[i].vertexCount_ = vertexCount;
-            loadVBData_[i].elementMask_ = elementMask;
+            loadVBData_[i].elementMask_ = bufferMask;
             loadVBData_[i].dataSize_ = vertexCount * vertexSize;
             loadVBData_[i].data_ = new unsigned char[loadVBData_[i].dataSize_];
-            source.Read(loadVBData_[i].data_.Get(), loadVBData_[i].dataSize_);
+            if (unpackMask)
+            {
+                ConvertVertexData(loadVBData_[i].data_.Get(), bufferMask, packedData.Get(), elementMask, vertexCount,
+                    positionOffsets_[i], positionScales_[i]);
+            }
+            else
+                source.Read(loadVBData_[i].data_.Get(), loadVBData_[i].dataSize_);
         }
         else
         {
             // If not async loading, use locking to avoid extra allocation & copy
             loadVBData_[i].data_.Reset(); // Make sure no previous data
             buffer->SetShadowed(true);
-            buffer->SetSize(vertexCount, elementMask);
+            buffer->SetSize(vertexCount, bufferMask);
             void* dest = buffer->Lock(0, vertexCount);
-            source.Read(dest, vertexCount * vertexSize);
+            if (unpackMask)
+                ConvertVertexData(dest, bufferMask, packedData.Get(), elementMask, vertexCount, positionOffsets_[i], positionScales_[i]);
+            else
+                source.Read(dest, vertexCount * vertexSize);
             buffer->Unlock();
         }
+        
+        // Keep float positions of packed buffers for raycasts, occlusion, physics and navigation
+        loadVBData_[i].positionData_.Reset();
+        if (bufferMask & MASK_PACKED_POSITION)
+        {
+            loadVBData_[i].positionData_ = new unsigned char[vertexCount * sizeof(Vector3)];
+            ConvertVertexData(loadVBData_[i].positionData_.Get(), MASK_POSITION, async ? loadVBData_[i].data_.Get() :
+                buffer->GetShadowData(), bufferMask, vertexCount, positionOffsets_[i], positionScales_[i]);
+            memoryUse += vertexCount * sizeof(Vector3);
+        }
+        else
+        {
+            positionOffsets_[i] = Vector3::ZERO;
+            positionScales_[i] = 1.0f;
+        }
 
         memoryUse += sizeof(VertexBuffer) + vertexCount * vertexSize;
         vertexBuffers_.Push(buffer);
@@ -273,6 +325,8 @@ bool Model::BeginLoad(Deserializer& source)
         memoryUse += sizeof(ModelMorph);
     }
     
+    memoryUse += BuildMorphStreams();
+    
     // Read skeleton
     skeleton_.Load(source);
     memoryUse += skeleton_.GetNumBones() * sizeof(Bone);
@@ -329,6 +383,13 @@ bool Model::EndLoad()
             geometry->SetVertexBuffer(0, vertexBuffers_[desc.vbRef_]);
             geometry->SetIndexBuffer(indexBuffers_[desc.ibRef_]);
             geometry->SetDrawRange(desc.type_, desc.indexStart_, desc.indexCount_);
+            
+            VertexBufferDesc& vbDesc = loadVBData_[desc.vbRef_];
+            if (vbDesc.positionData_)
+            {
+                geometry->SetPositionQuantization(positionOffsets_[desc.vbRef_], positionScales_[desc.vbRef_]);
+                geometry->SetRawVertexData(vbDesc.positionData_, sizeof(Vector3), MASK_POSITION);
+            }
         }
     }
 
@@ -353,6 +414,11 @@ bool Model::Save(Serializer& dest) const
         dest.WriteUInt(buffer->GetElementMask());
         dest.WriteUInt(morphRangeStarts_[i]);
         dest.WriteUInt(morphRangeCounts_[i]);
+        if (buffer->GetElementMask() & MASK_PACKED_POSITION)
+        {
+            dest.WriteVector3(positionOffsets_[i]);
+            dest.WriteFloat(positionScales_[i]);
+        }
         dest.Write(buffer->GetShadowData(), buffer->GetVertexCount() * buffer->GetVertexSize());
     }
     // Write index buffers
@@ -453,14 +519,19 @@ bool Model::SetVertexBuffers(const Vector<SharedPtr<VertexBuffer> >& buffers, co
     vertexBuffers_ = buffers;
     morphRangeStarts_.Resize(buffers.Size());
     morphRangeCounts_.Resize(buffers.Size());
+    positionOffsets_.Resize(buffers.Size());
+    positionScales_.Resize(buffers.Size());
     
     // If morph ranges are not specified for buffers, assume to be zero
     for (unsigned i = 0; i < buffers.Size(); ++i)
     {
         morphRangeStarts_[i] = i < morphRangeStarts.Size() ? morphRangeStarts[i] : 0;
         morphRangeCounts_[i] = i < morphRangeCounts.Size() ? morphRangeCounts[i] : 0;
+        positionOffsets_[i] = Vector3::ZERO;
+        positionScales_[i] = 1.0f;
     }
     
+    BuildMorphStreams();
     return true;
 }
 
@@ -557,6 +628,20 @@ void Model::SetGeometryBoneMappings(const Vector<PODVector<unsigned> >& geometry
 void Model::SetMorphs(const Vector<ModelMorph>& morphs)
 {
     morphs_ = morphs;
+    BuildMorphStreams();
+}
+
+bool Model::SetPositionQuantization(unsigned bufferIndex, const Vector3& offset, float scale)
+{
+    if (bufferIndex >= vertexBuffers_.Size())
+    {
+        LOGERROR("Vertex buffer index out of bounds");
+        return false;
+    }
+    
+    positionOffsets_[bufferIndex] = offset;
+    positionScales_[bufferIndex] = scale;
+    return true;
 }
 
 SharedPtr<Model> Model::Clone(const String& cloneName) const
@@ -568,9 +653,12 @@ SharedPtr<Model> Model::Clone(const String& cloneName) const
     ret->skeleton_ = skeleton_;
     ret->geometryBoneMappings_ = geometryBoneMappings_;
     ret->geometryCenters_ = geometryCenters_;
+    ret->morphStreams_ = morphStreams_;
     ret->morphs_ = morphs_;
     ret->morphRangeStarts_ = morphRangeStarts_;
     ret->morphRangeCounts_ = morphRangeCounts_;
+    ret->positionOffsets_ = positionOffsets_;
+    ret->positionScales_ = positionScales_;
     
     // Deep copy vertex/index buffers
     HashMap<VertexBuffer*, VertexBuffer*> vbMapping;
@@ -650,6 +738,19 @@ SharedPtr<Model> Model::Clone(const String& cloneName) const
                 cloneGeometry->SetDrawRange(origGeometry->GetPrimitiveType(), origGeometry->GetIndexStart(),
                     origGeometry->GetIndexCount(), origGeometry->GetVertexStart(), origGeometry->GetVertexCount(), false);
                 cloneGeometry->SetLodDistance(origGeometry->GetLodDistance());
+                
+                // Packed positions share the float copy for CPU-side operations
+                if (origGeometry->IsPositionQuantized())
+                {
+                    SharedArrayPtr<unsigned char> vertexData;
+                    SharedArrayPtr<unsigned char> indexData;
+                    unsigned vertexSize;
+                    unsigned indexSize;
+                    unsigned elementMask;
+                    origGeometry->GetRawDataShared(vertexData, vertexSize, indexData, indexSize, elementMask);
+                    cloneGeometry->SetPositionQuantization(origGeometry->GetPositionOffset(), origGeometry->GetPositionScale());
+                    cloneGeometry->SetRawVertexData(vertexData, vertexSize, elementMask);
+                }
             }
             
             ret->geometries_[i][j] = cloneGeometry;
@@ -725,4 +826,116 @@ unsigned Model::GetMorphRangeCount(unsigned bufferIndex) const
     return bufferIndex < vertexBuffers_.Size() ? morphRangeCounts_[bufferIndex] : 0;
 }
 
+Vector3 Model::GetPositionOffset(unsigned bufferIndex) const
+{
+    return bufferIndex < vertexBuffers_.Size() ? positionOffsets_[bufferIndex] : Vector3::ZERO;
+}
+
+float Model::GetPositionScale(unsigned bufferIndex) const
+{
+    return bufferIndex < vertexBuffers_.Size() ? positionScales_[bufferIndex] : 1.0f;
+}
+
+unsigned Model::BuildMorphStreams()
+{
+    unsigned memoryUse = 0;
+    morphStreams_.Clear();
+    morphStreams_.Resize(vertexBuffers_.Size());
+    
+    for (unsigned i = 0; i < morphStreams_.Size(); ++i)
+    {
+        VertexBufferMorphStream& stream = morphStreams_[i];
+        stream.elementMask_ = 0;
+        unsigned rangeStart = morphRangeStarts_[i];
+        unsigned rangeCount = morphRangeCounts_[i];
+        if (!rangeCount || morphs_.Empty())
+            continue;
+        
+        // Count the deltas of each vertex in the morph range
+        PODVector<unsigned> vertexDeltas(rangeCount);
+        memset(&vertexDeltas[0], 0, rangeCount * sizeof(unsigned));
+        for (unsigned j = 0; j < morphs_.Size(); ++j)
+        {
+            HashMap<unsigned, VertexBufferMorph>::ConstIterator k = morphs_[j].buffers_.Find(i);
+            if (k == morphs_[j].buffers_.End())
+                continue;
+            
+            const VertexBufferMorph& morph = k->second_;
+            unsigned morphVertexSize = sizeof(unsigned) + CountSetBits(morph.elementMask_ & (MASK_POSITION | MASK_NORMAL |
+                MASK_TANGENT)) * sizeof(Vector3);
+            const unsigned char* morphData = morph.morphData_.Get();
+            for (unsigned l = 0; l < morph.vertexCount_; ++l)
+            {
+                unsigned vertexIndex = *((const unsigned*)(morphData + l * morphVertexSize)) - rangeStart;
+                if (vertexIndex < rangeCount)
+                    ++vertexDeltas[vertexIndex];
+            }
+            
+            stream.elementMask_ |= morph.elementMask_ & (MASK_POSITION | MASK_NORMAL | MASK_TANGENT);
+        }
+        
+        // Assign each morphed vertex its range of deltas. Reuse the counts as write positions
+        unsigned numDeltas = 0;
+        for (unsigned j = 0; j < rangeCount; ++j)
+        {
+            if (!vertexDeltas[j])
+                continue;
+            
+            stream.vertices_.Push(j);
+            stream.deltaStarts_.Push(numDeltas);
+            numDeltas += vertexDeltas[j];
+            vertexDeltas[j] = stream.deltaStarts_.Back();
+        }
+        if (!numDeltas)
+            continue;
+        stream.deltaStarts_.Push(numDeltas);
+        stream.deltaMorphs_.Resize(numDeltas);
+        stream.deltaData_.Resize(numDeltas * 3);
+        
+        for (unsigned j = 0; j < morphs_.Size(); ++j)
+        {
+            HashMap<unsigned, VertexBufferMorph>::ConstIterator k = morphs_[j].buffers_.Find(i);
+            if (k == morphs_[j].buffers_.End())
+                continue;
+            
+            const VertexBufferMorph& morph = k->second_;
+            const unsigned char* morphData = morph.morphData_.Get();
+            for (unsigned l = 0; l < morph.vertexCount_; ++l)
+            {
+                unsigned vertexIndex = *((const unsigned*)morphData) - rangeStart;
+                morphData += sizeof(unsigned);
+                
+                Vector3 offsets[3];
+                if (morph.elementMask_ & MASK_POSITION)
+                {
+                    offsets[0] = *((const Vector3*)morphData);
+                    morphData += sizeof(Vector3);
+                }
+                if (morph.elementMask_ & MASK_NORMAL)
+                {
+                    offsets[1] = *((const Vector3*)morphData);
+                    morphData += sizeof(Vector3);
+                }
+                if (morph.elementMask_ & MASK_TANGENT)
+                {
+                    offsets[2] = *((const Vector3*)morphData);
+                    morphData += sizeof(Vector3);
+                }
+                
+                if (vertexIndex >= rangeCount)
+                    continue;
+                
+                unsigned delta = vertexDeltas[vertexIndex]++;
+                stream.deltaMorphs_[delta] = j;
+                for (unsigned m = 0; m < 3; ++m)
+                    stream.deltaData_[delta * 3 + m] = Vector4(offsets[m], 0.0f);
+            }
+        }
+        
+        memoryUse += stream.vertices_.Size() * 2 * sizeof(unsigned) + numDeltas * (sizeof(unsigned) + 3 * sizeof(Vector4));
+    }
+    
+    return memoryUse;
+}
+
 }
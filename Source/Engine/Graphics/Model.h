@@ -28,6 +28,7 @@
 #include "Skeleton.h"
 #include "Resource.h"
 #include "Ptr.h"
+#include "Vector4.h"
 
 namespace Urho3D
 {
@@ -50,6 +51,21 @@ struct VertexBufferMorph
     SharedArrayPtr<unsigned char> morphData_;
 };
 
+/// Sparse deltas of all morphs affecting one vertex buffer, sorted by vertex so that several morphs can be applied in one pass.
+struct VertexBufferMorphStream
+{
+    /// Union of the morphed vertex elements.
+    unsigned elementMask_;
+    /// Morphed vertex indices relative to the morph range start, in ascending order.
+    PODVector<unsigned> vertices_;
+    /// Index of the first delta of each morphed vertex, followed by the total number of deltas.
+    PODVector<unsigned> deltaStarts_;
+    /// Morph index of each delta.
+    PODVector<unsigned> deltaMorphs_;
+    /// Position, normal and tangent offsets of each delta, padded to four components.
+    PODVector<Vector4> deltaData_;
+};
+
 /// Definition of a model's vertex morph.
 struct ModelMorph
 {
@@ -74,6 +90,8 @@ struct VertexBufferDesc
     unsigned dataSize_;
     /// Vertex data.
     SharedArrayPtr<unsigned char> data_;
+    /// Float positions for CPU-side operations when the vertex positions are packed.
+    SharedArrayPtr<unsigned char> positionData_;
 };
 
 /// Description of index buffer data for asynchronous loading.
@@ -144,6 +162,8 @@ public:
     void SetGeometryBoneMappings(const Vector<PODVector<unsigned> >& mappings);
     /// Set vertex morphs.
     void SetMorphs(const Vector<ModelMorph>& morphs);
+    /// Set the offset and uniform scale of a vertex buffer's packed positions for saving. The geometries using the buffer need the same quantization set.
+    bool SetPositionQuantization(unsigned bufferIndex, const Vector3& offset, float scale);
     /// Clone the model. The geometry data is deep-copied and can be modified in the clone without affecting the original.
     SharedPtr<Model> Clone(const String& cloneName = String::EMPTY) const;
     
@@ -177,12 +197,21 @@ public:
     const ModelMorph* GetMorph(const String& name) const;
     /// Return vertex morph by name hash.
     const ModelMorph* GetMorph(StringHash nameHash) const;
+    /// Return vertex-sorted morph deltas per vertex buffer.
+    const Vector<VertexBufferMorphStream>& GetMorphStreams() const { return morphStreams_; }
     /// Return vertex buffer morph range start.
     unsigned GetMorphRangeStart(unsigned bufferIndex) const;
     /// Return vertex buffer morph range vertex count.
     unsigned GetMorphRangeCount(unsigned bufferIndex) const;
+    /// Return vertex buffer packed position offset.
+    Vector3 GetPositionOffset(unsigned bufferIndex) const;
+    /// Return vertex buffer packed position scale.
+    float GetPositionScale(unsigned bufferIndex) const;
     
 private:
+    /// Rebuild the vertex-sorted morph deltas. Return memory use.
+    unsigned BuildMorphStreams();
+    
     /// Bounding box.
     BoundingBox boundingBox_;
     /// Skeleton.
@@ -199,10 +228,16 @@ private:
     PODVector<Vector3> geometryCenters_;
     /// Vertex morphs.
     Vector<ModelMorph> morphs_;
+    /// Vertex-sorted morph deltas per vertex buffer.
+    Vector<VertexBufferMorphStream> morphStreams_;
     /// Vertex buffer morph range start.
     PODVector<unsigned> morphRangeStarts_;
     /// Vertex buffer morph range vertex count.
     PODVector<unsigned> morphRangeCounts_;
+    /// Vertex buffer packed position offsets.
+    PODVector<Vector3> positionOffsets_;
+    /// Vertex buffer packed position scales.
+    PODVector<float> positionScales_;
     /// Vertex buffer data for asynchronous loading.
     Vector<VertexBufferDesc> loadVBData_;
     /// Index buffer data for asynchronous loading.
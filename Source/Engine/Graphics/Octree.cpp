@@ -332,7 +332,9 @@ void Octant::GetDrawablesOnlyInternal(RayOctreeQuery& query, PODVector<Drawable*
 Octree::Octree(Context* context) :
     Component(context),
     Octant(BoundingBox(-DEFAULT_OCTREE_SIZE, DEFAULT_OCTREE_SIZE), 0, 0, this),
-    numLevels_(DEFAULT_OCTREE_LEVELS)
+    numLevels_(DEFAULT_OCTREE_LEVELS),
+    drawablesRevision_(0),
+    updateNumber_(0)
 {
     // Resize threaded ray query intermediate result vector according to number of worker threads
     WorkQueue* workQueue = GetSubsystem<WorkQueue>();
@@ -396,6 +398,11 @@ void Octree::SetSize(const BoundingBox& box, unsigned numLevels)
 
 void Octree::Update(const FrameInfo& frame)
 {
+    // Animation poses shared by models are only valid during one update
+    animationPoseCache_.Clear();
+    movedDrawables_.Clear();
+    ++updateNumber_;
+    
     // Let drawables update themselves before reinsertion. This can be used for animation
     if (!drawableUpdates_.Empty())
     {
@@ -434,6 +441,10 @@ void Octree::Update(const FrameInfo& frame)
         scene->EndThreadedUpdate();
     }
     
+    // Report the pose cache counters every frame, also when there was nothing to update
+    PROFILE_COUNT(AnimationPoseCacheHits, animationPoseCache_.GetNumHits());
+    PROFILE_COUNT(AnimationPoseCacheMisses, animationPoseCache_.GetNumMisses());
+    
     // Notify drawable update being finished. Custom animation (eg. IK) can be done at this point
     Scene* scene = GetScene();
     if (scene)
@@ -462,6 +473,9 @@ void Octree::Update(const FrameInfo& frame)
             // Skip if no octant or does not belong to this octree anymore
             if (!octant || octant->GetRoot() != this)
                 continue;
+            // Record moved geometry for views that cache light volume queries
+            if (drawable->GetDrawableFlags() & DRAWABLE_GEOMETRY)
+                movedDrawables_.Push(drawable);
             // Skip if still fits the current octant
             if (drawable->IsOccludee() && octant->GetCullingBox().IsInside(box) == INSIDE && octant->CheckDrawableFit(box))
                 continue;
@@ -489,6 +503,7 @@ void Octree::AddManualDrawable(Drawable* drawable)
         return;
 
     AddDrawable(drawable);
+    MarkDrawablesDirty();
 }
 
 void Octree::RemoveManualDrawable(Drawable* drawable)
@@ -498,7 +513,10 @@ void Octree::RemoveManualDrawable(Drawable* drawable)
 
     Octant* octant = drawable->GetOctant();
     if (octant && octant->GetRoot() == this)
+    {
         octant->RemoveDrawable(drawable);
+        MarkDrawablesDirty();
+    }
 }
 
 void Octree::GetDrawables(OctreeQuery& query) const
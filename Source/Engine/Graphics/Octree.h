@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include "AnimationPoseCache.h"
 #include "Drawable.h"
 #include "List.h"
 #include "Mutex.h"
@@ -187,11 +188,21 @@ public:
     void RaycastSingle(RayOctreeQuery& query) const;
     /// Return subdivision levels.
     unsigned GetNumLevels() const { return numLevels_; }
+    /// Return drawable revision. Is incremented when drawables are inserted, removed, or change their query visibility.
+    unsigned GetDrawablesRevision() const { return drawablesRevision_; }
+    /// Return update number. Is incremented on each update.
+    unsigned GetUpdateNumber() const { return updateNumber_; }
+    /// Return geometry drawables that were updated, and so possibly moved, during the latest update.
+    const PODVector<Drawable*>& GetMovedDrawables() const { return movedDrawables_; }
+    /// Return the animation pose cache, which is cleared on each update.
+    AnimationPoseCache& GetAnimationPoseCache() { return animationPoseCache_; }
     
     /// Mark drawable object as requiring an update and a reinsertion.
     void QueueUpdate(Drawable* drawable);
     /// Cancel drawable object's update.
     void CancelUpdate(Drawable* drawable);
+    /// Increment the drawable revision.
+    void MarkDrawablesDirty() { ++drawablesRevision_; }
     /// Visualize the component as debug geometry.
     void DrawDebugGeometry(bool depthTest);
     
@@ -203,6 +214,8 @@ private:
     PODVector<Drawable*> drawableUpdates_;
     /// Drawable objects that require reinsertion.
     PODVector<Drawable*> drawableReinsertions_;
+    /// Geometry drawables updated during the latest update.
+    PODVector<Drawable*> movedDrawables_;
     /// Mutex for octree reinsertions.
     Mutex octreeMutex_;
     /// Current threaded ray query.
@@ -211,8 +224,14 @@ private:
     mutable PODVector<Drawable*> rayQueryDrawables_;
     /// Threaded ray query intermediate results.
     mutable Vector<PODVector<RayQueryResult> > rayQueryResults_;
+    /// Animation pose cache for the current update.
+    AnimationPoseCache animationPoseCache_;
     /// Subdivision level.
     unsigned numLevels_;
+    /// Drawable revision.
+    unsigned drawablesRevision_;
+    /// Update number.
+    unsigned updateNumber_;
 };
 
 }
@@ -34,6 +34,7 @@
 #include "Graphics.h"
 #include "GraphicsEvents.h"
 #include "GraphicsImpl.h"
+#include "HLODCluster.h"
 #include "IndexBuffer.h"
 #include "Log.h"
 #include "Material.h"
@@ -41,6 +42,7 @@
 #include "Octree.h"
 #include "ParticleEffect.h"
 #include "ParticleEmitter.h"
+#include "PotentiallyVisibleSet.h"
 #include "ProcessUtils.h"
 #include "Profiler.h"
 #include "RenderSurface.h"
@@ -50,6 +52,7 @@
 #include "ShaderProgram.h"
 #include "ShaderVariation.h"
 #include "Skybox.h"
+#include "StaticBatch.h"
 #include "StaticModelGroup.h"
 #include "Technique.h"
 #include "Terrain.h"
@@ -58,6 +61,7 @@
 #include "Texture3D.h"
 #include "TextureCube.h"
 #include "VertexBuffer.h"
+#include "VertexPacking.h"
 #include "Zone.h"
 
 #include <stdio.h>
@@ -239,8 +243,13 @@ Graphics::Graphics(Context* context_) :
     pvrtcTextureSupport_(false),
     sRGBSupport_(false),
     sRGBWriteSupport_(false),
+    packedVertexSupport_(false),
     numPrimitives_(0),
     numBatches_(0),
+    numStateChanges_(0),
+    numRedundantStateChanges_(0),
+    numParameterUpdates_(0),
+    numRedundantParameterUpdates_(0),
     maxScratchBufferRequest_(0),
     dummyColorFormat_(0),
     shadowMapFormat_(GL_DEPTH_COMPONENT16),
@@ -251,6 +260,9 @@ Graphics::Graphics(Context* context_) :
     shaderExtension_(".glsl"),
     orientations_("LandscapeLeft LandscapeRight")
 {
+    for (unsigned i = 0; i < MAX_SHADER_PARAMETER_GROUPS; ++i)
+        shaderParameterVersions_[i] = 1;
+    
     SetTextureUnitMappings();
     ResetCachedState();
     
@@ -512,6 +524,7 @@ bool Graphics::SetMode(int width, int height, bool fullscreen, bool borderless,
         anisotropySupport_ = GLEW_EXT_texture_filter_anisotropic != 0;
         sRGBSupport_ = GLEW_EXT_texture_sRGB != 0;
         sRGBWriteSupport_ = GLEW_EXT_framebuffer_sRGB != 0;
+        packedVertexSupport_ = GLEW_VERSION_3_0 || GLEW_ARB_half_float_vertex;
         
         // Set up instancing divisors if supported
         if (instancingSupport_)
@@ -525,6 +538,7 @@ bool Graphics::SetMode(int width, int height, bool fullscreen, bool borderless,
         dxtTextureSupport_ = CheckExtension(extensions, "EXT_texture_compression_dxt1");
         etcTextureSupport_ = CheckExtension(extensions, "OES_compressed_ETC1_RGB8_texture");
         pvrtcTextureSupport_ = CheckExtension(extensions, "IMG_texture_compression_pvrtc");
+        packedVertexSupport_ = CheckExtension(extensions, "OES_vertex_half_float");
         #endif
     }
     
@@ -662,6 +676,10 @@ bool Graphics::BeginFrame()
     
     numPrimitives_ = 0;
     numBatches_ = 0;
+    numStateChanges_ = 0;
+    numRedundantStateChanges_ = 0;
+    numParameterUpdates_ = 0;
+    numRedundantParameterUpdates_ = 0;
     
     SendEvent(E_BEGINRENDERING);
     
@@ -894,6 +912,7 @@ bool Graphics::SetVertexBuffers(const PODVector<VertexBuffer*>& buffers, const P
         
         glBindBuffer(GL_ARRAY_BUFFER, buffer->GetGPUObject());
         unsigned vertexSize = buffer->GetVertexSize();
+        unsigned bufferMask = buffer->GetElementMask();
         
         for (unsigned j = 0; j < MAX_VERTEX_ELEMENTS; ++j)
         {
@@ -913,9 +932,18 @@ bool Graphics::SetVertexBuffers(const PODVector<VertexBuffer*>& buffers, const P
                 
                 // Set the attribute pointer. Add instance offset for the instance matrix pointers
                 unsigned offset = j >= ELEMENT_INSTANCEMATRIX1 ? instanceOffset * vertexSize : 0;
-                glVertexAttribPointer(attrIndex, VertexBuffer::elementComponents[j], VertexBuffer::elementType[j],
-                    VertexBuffer::elementNormalize[j], vertexSize, reinterpret_cast<const GLvoid*>(buffer->GetElementOffset((VertexElement)j)
-                    + offset));
+                if (bufferMask & GetPackedElementMask((VertexElement)j))
+                {
+                    glVertexAttribPointer(attrIndex, VertexBuffer::packedElementComponents[j], VertexBuffer::packedElementType[j],
+                        VertexBuffer::packedElementNormalize[j], vertexSize, reinterpret_cast<const GLvoid*>(buffer->GetElementOffset(
+                        (VertexElement)j) + offset));
+                }
+                else
+                {
+                    glVertexAttribPointer(attrIndex, VertexBuffer::elementComponents[j], VertexBuffer::elementType[j],
+                        VertexBuffer::elementNormalize[j], vertexSize, reinterpret_cast<const GLvoid*>(buffer->GetElementOffset(
+                        (VertexElement)j) + offset));
+                }
             }
         }
     }
@@ -992,6 +1020,7 @@ bool Graphics::SetVertexBuffers(const Vector<SharedPtr<VertexBuffer> >& buffers,
         
         glBindBuffer(GL_ARRAY_BUFFER, buffer->GetGPUObject());
         unsigned vertexSize = buffer->GetVertexSize();
+        unsigned bufferMask = buffer->GetElementMask();
         
         for (unsigned j = 0; j < MAX_VERTEX_ELEMENTS; ++j)
         {
@@ -1011,9 +1040,18 @@ bool Graphics::SetVertexBuffers(const Vector<SharedPtr<VertexBuffer> >& buffers,
                 
                 // Set the attribute pointer. Add instance offset for the instance matrix pointers
                 unsigned offset = j >= ELEMENT_INSTANCEMATRIX1 ? instanceOffset * vertexSize : 0;
-                glVertexAttribPointer(attrIndex, VertexBuffer::elementComponents[j], VertexBuffer::elementType[j],
-                    VertexBuffer::elementNormalize[j], vertexSize, reinterpret_cast<const GLvoid*>(buffer->GetElementOffset((VertexElement)j)
-                    + offset));
+                if (bufferMask & GetPackedElementMask((VertexElement)j))
+                {
+                    glVertexAttribPointer(attrIndex, VertexBuffer::packedElementComponents[j], VertexBuffer::packedElementType[j],
+                        VertexBuffer::packedElementNormalize[j], vertexSize, reinterpret_cast<const GLvoid*>(buffer->GetElementOffset(
+                        (VertexElement)j) + offset));
+                }
+                else
+                {
+                    glVertexAttribPointer(attrIndex, VertexBuffer::elementComponents[j], VertexBuffer::elementType[j],
+                        VertexBuffer::elementNormalize[j], vertexSize, reinterpret_cast<const GLvoid*>(buffer->GetElementOffset(
+                        (VertexElement)j) + offset));
+                }
             }
         }
     }
@@ -1057,9 +1095,13 @@ void Graphics::SetIndexBuffer(IndexBuffer* buffer)
 void Graphics::SetShaders(ShaderVariation* vs, ShaderVariation* ps)
 {
     if (vs == vertexShader_ && ps == pixelShader_)
+    {
+        ++numRedundantStateChanges_;
         return;
+    }
     
-    ClearParameterSources();
+    // Uniforms are per-program state, so the parameter sources remembered by the programs stay valid across the switch
+    ++numStateChanges_;
 
     // Compile the shaders now if not yet compiled. If already attempted, do not retry
     if (vs && !vs->GetGPUObject())
@@ -1392,13 +1434,16 @@ void Graphics::SetShaderParameter(StringHash param, const Variant& value)
 
 bool Graphics::NeedParameterUpdate(ShaderParameterGroup group, const void* source)
 {
-    if ((unsigned)(size_t)shaderParameterSources_[group] == M_MAX_UNSIGNED || shaderParameterSources_[group] != source)
+    if (!shaderProgram_ || shaderProgram_->NeedParameterUpdate(group, source, shaderParameterVersions_[group]))
     {
-        shaderParameterSources_[group] = source;
+        ++numParameterUpdates_;
         return true;
     }
     else
+    {
+        ++numRedundantParameterUpdates_;
         return false;
+    }
 }
 
 bool Graphics::HasShaderParameter(ShaderType type, StringHash param)
@@ -1413,19 +1458,19 @@ bool Graphics::HasTextureUnit(TextureUnit unit)
 
 void Graphics::ClearParameterSource(ShaderParameterGroup group)
 {
-    shaderParameterSources_[group] = (const void*)M_MAX_UNSIGNED;
+    ++shaderParameterVersions_[group];
 }
 
 void Graphics::ClearParameterSources()
 {
     for (unsigned i = 0; i < MAX_SHADER_PARAMETER_GROUPS; ++i)
-        shaderParameterSources_[i] = (const void*)M_MAX_UNSIGNED;
+        ++shaderParameterVersions_[i];
 }
 
 void Graphics::ClearTransformSources()
 {
-    shaderParameterSources_[SP_CAMERA] = (const void*)M_MAX_UNSIGNED;
-    shaderParameterSources_[SP_OBJECTTRANSFORM] = (const void*)M_MAX_UNSIGNED;
+    ++shaderParameterVersions_[SP_CAMERA];
+    ++shaderParameterVersions_[SP_OBJECTTRANSFORM];
 }
 
 void Graphics::CleanupShaderPrograms()
@@ -1492,6 +1537,7 @@ void Graphics::SetTexture(unsigned index, Texture* texture)
         }
         
         textures_[index] = texture;
+        ++numStateChanges_;
     }
     else
     {
@@ -1506,6 +1552,8 @@ void Graphics::SetTexture(unsigned index, Texture* texture)
             glBindTexture(texture->GetTarget(), texture->GetGPUObject());
             texture->UpdateParameters();
         }
+        
+        ++numRedundantStateChanges_;
     }
 }
 
@@ -1686,7 +1734,10 @@ void Graphics::SetBlendMode(BlendMode mode)
         }
         
         blendMode_ = mode;
+        ++numStateChanges_;
     }
+    else
+        ++numRedundantStateChanges_;
 }
 
 void Graphics::SetColorWrite(bool enable)
@@ -1716,7 +1767,10 @@ void Graphics::SetCullMode(CullMode mode)
         }
         
         cullMode_ = mode;
+        ++numStateChanges_;
     }
+    else
+        ++numRedundantStateChanges_;
 }
 
 void Graphics::SetDepthBias(float constantBias, float slopeScaledBias)
@@ -1737,7 +1791,7 @@ void Graphics::SetDepthBias(float constantBias, float slopeScaledBias)
         
         constantDepthBias_ = constantBias;
         slopeScaledDepthBias_ = slopeScaledBias;
-        shaderParameterSources_[SP_CAMERA] = (const void*)M_MAX_UNSIGNED;
+        ++shaderParameterVersions_[SP_CAMERA];
     }
 }
 
@@ -1747,7 +1801,10 @@ void Graphics::SetDepthTest(CompareMode mode)
     {
         glDepthFunc(glCmpFunc[mode]);
         depthTestMode_ = mode;
+        ++numStateChanges_;
     }
+    else
+        ++numRedundantStateChanges_;
 }
 
 void Graphics::SetDepthWrite(bool enable)
@@ -1756,7 +1813,10 @@ void Graphics::SetDepthWrite(bool enable)
     {
         glDepthMask(enable ? GL_TRUE : GL_FALSE);
         depthWrite_ = enable;
+        ++numStateChanges_;
     }
+    else
+        ++numRedundantStateChanges_;
 }
 
 void Graphics::SetDrawAntialiased(bool enable)
@@ -3039,6 +3099,8 @@ void RegisterGraphicsLibrary(Context* context)
     Light::RegisterObject(context);
     StaticModel::RegisterObject(context);
     StaticModelGroup::RegisterObject(context);
+    StaticBatch::RegisterObject(context);
+    HLODCluster::RegisterObject(context);
     Skybox::RegisterObject(context);
     AnimatedModel::RegisterObject(context);
     AnimationController::RegisterObject(context);
@@ -3051,6 +3113,7 @@ void RegisterGraphicsLibrary(Context* context)
     TerrainPatch::RegisterObject(context);
     DebugRenderer::RegisterObject(context);
     Octree::RegisterObject(context);
+    PotentiallyVisibleSet::RegisterObject(context);
     Zone::RegisterObject(context);
 }
 
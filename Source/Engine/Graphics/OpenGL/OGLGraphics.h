@@ -154,7 +154,7 @@ public:
     void SetShaderParameter(StringHash param, const Matrix3x4& matrix);
     /// Set shader constant from a variant. Supported variant types: bool, float, vector2, vector3, vector4, color.
     void SetShaderParameter(StringHash param, const Variant& value);
-    /// Check whether a shader parameter group needs update. Does not actually check whether parameters exist in the shaders.
+    /// Check whether a shader parameter group needs update. Sources are remembered per shader program, so switching back to a program does not re-push unchanged groups. Does not actually check whether parameters exist in the shaders.
     bool NeedParameterUpdate(ShaderParameterGroup group, const void* source);
     /// Check whether a shader parameter exists on the currently set shaders.
     bool HasShaderParameter(ShaderType type, StringHash param);
@@ -269,6 +269,14 @@ public:
     unsigned GetNumPrimitives() const { return numPrimitives_; }
     /// Return number of batches drawn this frame.
     unsigned GetNumBatches() const { return numBatches_; }
+    /// Return number of effective shader, texture, blend, cull and depth state changes this frame.
+    unsigned GetNumStateChanges() const { return numStateChanges_; }
+    /// Return number of redundant shader, texture, blend, cull and depth state changes filtered this frame.
+    unsigned GetNumRedundantStateChanges() const { return numRedundantStateChanges_; }
+    /// Return number of shader parameter group updates this frame.
+    unsigned GetNumParameterUpdates() const { return numParameterUpdates_; }
+    /// Return number of redundant shader parameter group updates filtered this frame.
+    unsigned GetNumRedundantParameterUpdates() const { return numRedundantParameterUpdates_; }
     /// Return dummy color texture format for shadow maps. 0 if not needed, may be nonzero on OS X to work around an Intel driver issue.
     unsigned GetDummyColorFormat() const { return dummyColorFormat_; }
     /// Return shadow map depth texture format, or 0 if not supported.
@@ -293,6 +301,8 @@ public:
     bool GetSRGBSupport() const { return sRGBSupport_; }
     /// Return whether sRGB conversion on rendertarget writing is supported.
     bool GetSRGBWriteSupport() const { return sRGBWriteSupport_; }
+    /// Return whether packed vertex formats (16-bit normalized and half float elements) are supported.
+    bool GetPackedVertexSupport() const { return packedVertexSupport_; }
     /// Return supported fullscreen resolutions.
     PODVector<IntVector2> GetResolutions() const;
     /// Return supported multisampling levels.
@@ -504,10 +514,20 @@ private:
     bool sRGBSupport_;
     /// sRGB conversion on write support flag.
     bool sRGBWriteSupport_;
+    /// Packed vertex format support flag.
+    bool packedVertexSupport_;
     /// Number of primitives this frame.
     unsigned numPrimitives_;
     /// Number of batches this frame.
     unsigned numBatches_;
+    /// Number of effective state changes this frame.
+    unsigned numStateChanges_;
+    /// Number of redundant state changes this frame.
+    unsigned numRedundantStateChanges_;
+    /// Number of shader parameter group updates this frame.
+    unsigned numParameterUpdates_;
+    /// Number of redundant shader parameter group updates this frame.
+    unsigned numRedundantParameterUpdates_;
     /// Largest scratch buffer request this frame.
     unsigned maxScratchBufferRequest_;
     /// GPU objects.
@@ -596,8 +616,8 @@ private:
     TextureFilterMode defaultTextureFilterMode_;
     /// Map for additional depth textures, to emulate Direct3D9 ability to mix render texture and backbuffer rendering.
     HashMap<int, SharedPtr<Texture2D> > depthTextures_;
-    /// Remembered shader parameter sources.
-    const void* shaderParameterSources_[MAX_SHADER_PARAMETER_GROUPS];
+    /// Shader parameter group versions. Incremented to invalidate the sources remembered by the shader programs.
+    unsigned shaderParameterVersions_[MAX_SHADER_PARAMETER_GROUPS];
     /// Temp matrices for transposing shader parameters.
     Matrix3 tempMatrices3_[NUM_TEMP_MATRICES];
     /// Temp matrices for transposing shader parameters.
@@ -38,6 +38,8 @@ ShaderProgram::ShaderProgram(Graphics* graphics, ShaderVariation* vertexShader,
 {
     for (unsigned i = 0; i < MAX_TEXTURE_UNITS; ++i)
         useTextureUnit_[i] = false;
+    
+    ClearParameterSources();
 }
 
 ShaderProgram::~ShaderProgram()
@@ -54,6 +56,7 @@ void ShaderProgram::OnDeviceLost()
     
 
     linkerOutput_.Clear();
+    ClearParameterSources();
 }
 
 void ShaderProgram::Release()
@@ -77,6 +80,8 @@ void ShaderProgram::Release()
         
         for (unsigned i = 0; i < MAX_TEXTURE_UNITS; ++i)
             useTextureUnit_[i] = false;
+        
+        ClearParameterSources();
     }
 }
 
@@ -230,4 +235,26 @@ const ShaderParameter* ShaderProgram::GetParameter(StringHash param) const
         return 0;
 }
 
+bool ShaderProgram::NeedParameterUpdate(ShaderParameterGroup group, const void* source, unsigned version)
+{
+    if ((unsigned)(size_t)parameterSources_[group] == M_MAX_UNSIGNED || parameterSources_[group] != source ||
+        parameterVersions_[group] != version)
+    {
+        parameterSources_[group] = source;
+        parameterVersions_[group] = version;
+        return true;
+    }
+    else
+        return false;
+}
+
+void ShaderProgram::ClearParameterSources()
+{
+    for (unsigned i = 0; i < MAX_SHADER_PARAMETER_GROUPS; ++i)
+    {
+        parameterSources_[i] = (const void*)M_MAX_UNSIGNED;
+        parameterVersions_[i] = 0;
+    }
+}
+
 }
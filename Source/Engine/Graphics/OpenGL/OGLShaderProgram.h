@@ -72,6 +72,11 @@ public:
     /// Return linker output.
     const String& GetLinkerOutput() const { return linkerOutput_; }
     
+    /// Check whether a shader parameter group needs update on this program. Remember the source and version if it does.
+    bool NeedParameterUpdate(ShaderParameterGroup group, const void* source, unsigned version);
+    /// Clear remembered shader parameter sources.
+    void ClearParameterSources();
+    
 private:
     /// Vertex shader.
     WeakPtr<ShaderVariation> vertexShader_;
@@ -81,6 +86,10 @@ private:
     HashMap<StringHash, ShaderParameter> shaderParameters_;
     /// Texture unit use.
     bool useTextureUnit_[MAX_TEXTURE_UNITS];
+    /// Remembered shader parameter sources. Uniform values are retained by the program while it is not in use.
+    const void* parameterSources_[MAX_SHADER_PARAMETER_GROUPS];
+    /// Versions of the remembered shader parameter sources.
+    unsigned parameterVersions_[MAX_SHADER_PARAMETER_GROUPS];
     /// Shader link error string.
     String linkerOutput_;
 };
@@ -33,6 +33,7 @@
 #include "ResourceCache.h"
 #include "Texture2D.h"
 #include "XMLFile.h"
+#include "WorkQueue.h"
 
 #include "DebugNew.h"
 
@@ -369,7 +370,7 @@ bool Texture2D::SetData(SharedPtr<Image> image, bool useAlpha)
             else
             {
                 unsigned char* rgbaData = new unsigned char[level.width_ * level.height_ * 4];
-                level.Decompress(rgbaData);
+                level.Decompress(rgbaData, GetSubsystem<WorkQueue>());
                 SetData(i, 0, 0, level.width_, level.height_, rgbaData);
                 memoryUse += level.width_ * level.height_ * 4;
                 delete[] rgbaData;
@@ -32,6 +32,7 @@
 #include "ResourceCache.h"
 #include "Texture3D.h"
 #include "XMLFile.h"
+#include "WorkQueue.h"
 
 #include "DebugNew.h"
 
@@ -422,7 +423,7 @@ bool Texture3D::SetData(SharedPtr<Image> image, bool useAlpha)
             else
             {
                 unsigned char* rgbaData = new unsigned char[level.width_ * level.height_ * level.depth_ * 4];
-                level.Decompress(rgbaData);
+                level.Decompress(rgbaData, GetSubsystem<WorkQueue>());
                 SetData(i, 0, 0, 0, level.width_, level.height_, level.depth_, rgbaData);
                 memoryUse += level.width_ * level.height_ * level.depth_ * 4;
                 delete[] rgbaData;
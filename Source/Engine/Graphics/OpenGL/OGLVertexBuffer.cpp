@@ -25,6 +25,7 @@
 #include "GraphicsImpl.h"
 #include "Log.h"
 #include "VertexBuffer.h"
+#include "VertexPacking.h"
 
 #include <cstring>
 
@@ -50,6 +51,23 @@ const unsigned VertexBuffer::elementSize[] =
     4 * sizeof(float) // Instancematrix3
 };
 
+const unsigned VertexBuffer::packedElementSize[] =
+{
+    4 * sizeof(short), // Position
+    4 * sizeof(short), // Normal
+    4 * sizeof(unsigned char), // Color
+    2 * sizeof(unsigned short), // Texcoord1
+    2 * sizeof(unsigned short), // Texcoord2
+    3 * sizeof(float), // Cubetexcoord1
+    3 * sizeof(float), // Cubetexcoord2
+    4 * sizeof(short), // Tangent
+    4 * sizeof(float), // Blendweights
+    4 * sizeof(unsigned char), // Blendindices
+    4 * sizeof(float), // Instancematrix1
+    4 * sizeof(float), // Instancematrix2
+    4 * sizeof(float) // Instancematrix3
+};
+
 const unsigned VertexBuffer::elementType[] =
 {
     GL_FLOAT, // Position
@@ -101,6 +119,62 @@ const unsigned VertexBuffer::elementNormalize[] =
     GL_FALSE // Instancematrix3
 };
 
+const unsigned VertexBuffer::packedElementType[] =
+{
+    GL_SHORT, // Position
+    GL_SHORT, // Normal
+    GL_UNSIGNED_BYTE, // Color
+    #ifndef GL_ES_VERSION_2_0
+    GL_HALF_FLOAT, // Texcoord1
+    GL_HALF_FLOAT, // Texcoord2
+    #else
+    GL_HALF_FLOAT_OES, // Texcoord1
+    GL_HALF_FLOAT_OES, // Texcoord2
+    #endif
+    GL_FLOAT, // Cubetexcoord1
+    GL_FLOAT, // Cubetexcoord2
+    GL_SHORT, // Tangent
+    GL_FLOAT, // Blendweights
+    GL_UNSIGNED_BYTE, // Blendindices
+    GL_FLOAT, // Instancematrix1
+    GL_FLOAT, // Instancematrix2
+    GL_FLOAT // Instancematrix3
+};
+
+const unsigned VertexBuffer::packedElementComponents[] =
+{
+    4, // Position
+    4, // Normal
+    4, // Color
+    2, // Texcoord1
+    2, // Texcoord2
+    3, // Cubetexcoord1
+    3, // Cubetexcoord2
+    4, // Tangent
+    4, // Blendweights
+    4, // Blendindices
+    4, // Instancematrix1
+    4, // Instancematrix2
+    4 // Instancematrix3
+};
+
+const unsigned VertexBuffer::packedElementNormalize[] =
+{
+    GL_TRUE, // Position
+    GL_TRUE, // Normal
+    GL_TRUE, // Color
+    GL_FALSE, // Texcoord1
+    GL_FALSE, // Texcoord2
+    GL_FALSE, // Cubetexcoord1
+    GL_FALSE, // Cubetexcoord2
+    GL_TRUE, // Tangent
+    GL_FALSE, // Blendweights
+    GL_FALSE, // Blendindices
+    GL_FALSE, // Instancematrix1
+    GL_FALSE, // Instancematrix2
+    GL_FALSE // Instancematrix3
+};
+
 VertexBuffer::VertexBuffer(Context* context) :
     Object(context),
     GPUObject(GetSubsystem<Graphics>()),
@@ -352,7 +426,7 @@ void VertexBuffer::UpdateOffsets()
         if (elementMask_ & (1 << i))
         {
             elementOffset_[i] = elementOffset;
-            elementOffset += elementSize[i];
+            elementOffset += GetElementSize(elementMask_, (VertexElement)i);
         }
         else
             elementOffset_[i] = NO_ELEMENT;
@@ -367,12 +441,17 @@ unsigned VertexBuffer::GetVertexSize(unsigned elementMask)
     for (unsigned i = 0; i < MAX_VERTEX_ELEMENTS; ++i)
     {
         if (elementMask & (1 << i))
-            vertexSize += elementSize[i];
+            vertexSize += GetElementSize(elementMask, (VertexElement)i);
     }
     
     return vertexSize;
 }
 
+unsigned VertexBuffer::GetElementSize(unsigned elementMask, VertexElement element)
+{
+    return (elementMask & GetPackedElementMask(element)) ? packedElementSize[element] : elementSize[element];
+}
+
 unsigned VertexBuffer::GetElementOffset(unsigned elementMask, VertexElement element)
 {
     unsigned offset = 0;
@@ -380,7 +459,7 @@ unsigned VertexBuffer::GetElementOffset(unsigned elementMask, VertexElement elem
     for (unsigned i = 0; i != element; ++i)
     {
         if (elementMask & (1 << i))
-            offset += elementSize[i];
+            offset += GetElementSize(elementMask, (VertexElement)i);
     }
     
     return offset;
@@ -81,15 +81,25 @@ public:
     static unsigned GetVertexSize(unsigned elementMask);
     /// Return element offset from an element mask.
     static unsigned GetElementOffset(unsigned elementMask, VertexElement element);
+    /// Return element size in bytes from an element mask, which may select a packed format.
+    static unsigned GetElementSize(unsigned elementMask, VertexElement element);
     
     /// Vertex element sizes in bytes.
     static const unsigned elementSize[];
+    /// Vertex element sizes in bytes when packed.
+    static const unsigned packedElementSize[];
     /// Vertex element OpenGL types.
     static const unsigned elementType[];
     /// Vertex element OpenGL component counts.
     static const unsigned elementComponents[];
     /// Vertex element OpenGL normalization.
     static const unsigned elementNormalize[];
+    /// Vertex element OpenGL types when packed.
+    static const unsigned packedElementType[];
+    /// Vertex element OpenGL component counts when packed.
+    static const unsigned packedElementComponents[];
+    /// Vertex element OpenGL normalization when packed.
+    static const unsigned packedElementNormalize[];
 
 private:
     /// Update offsets of vertex elements.
@@ -30,6 +30,10 @@
 #include "Scene.h"
 #include "SceneEvents.h"
 
+#ifdef URHO3D_SSE
+#include <xmmintrin.h>
+#endif
+
 #include "DebugNew.h"
 
 namespace Urho3D
@@ -39,6 +43,47 @@ extern const char* GEOMETRY_CATEGORY;
 extern const char* faceCameraModeNames[];
 static const unsigned MAX_PARTICLES_IN_FRAME = 100;
 
+template <class T> static void ResizeParticleArray(PODVector<T>& array, unsigned size)
+{
+    unsigned oldSize = array.Size();
+    array.Resize(size);
+    if (size > oldSize)
+        memset(&array[oldSize], 0, (size - oldSize) * sizeof(T));
+}
+
+ParticleArrays::ParticleArrays() :
+    size_(0)
+{
+}
+
+void ParticleArrays::Resize(unsigned num)
+{
+    unsigned paddedNum = (num + 3) & ~3;
+
+    ResizeParticleArray(active_, paddedNum);
+    ResizeParticleArray(timer_, paddedNum);
+    ResizeParticleArray(timeToLive_, paddedNum);
+    ResizeParticleArray(positionX_, paddedNum);
+    ResizeParticleArray(positionY_, paddedNum);
+    ResizeParticleArray(positionZ_, paddedNum);
+    ResizeParticleArray(velocityX_, paddedNum);
+    ResizeParticleArray(velocityY_, paddedNum);
+    ResizeParticleArray(velocityZ_, paddedNum);
+    ResizeParticleArray(sizeX_, paddedNum);
+    ResizeParticleArray(sizeY_, paddedNum);
+    ResizeParticleArray(scale_, paddedNum);
+    ResizeParticleArray(rotation_, paddedNum);
+    ResizeParticleArray(rotationSpeed_, paddedNum);
+    ResizeParticleArray(colorIndex_, num);
+    ResizeParticleArray(texIndex_, num);
+
+    // When shrinking, the padding may contain particles that were active
+    for (unsigned i = num; i < paddedNum; ++i)
+        active_[i] = 0.0f;
+
+    size_ = num;
+}
+
 ParticleEmitter::ParticleEmitter(Context* context) :
     BillboardSet(context),
     periodTimer_(0.0f),
@@ -71,7 +116,7 @@ void ParticleEmitter::RegisterObject(Context* context)
     ATTRIBUTE("Emission Timer", float, emissionTimer_, 0.0f, AM_FILE | AM_NOEDIT);
     COPY_BASE_ATTRIBUTES(Drawable);
     MIXED_ACCESSOR_ATTRIBUTE("Particles", GetParticlesAttr, SetParticlesAttr, VariantVector, Variant::emptyVariantVector, AM_FILE | AM_NOEDIT);
-    MIXED_ACCESSOR_ATTRIBUTE("Billboards", GetParticleBillboardsAttr, SetBillboardsAttr, VariantVector, Variant::emptyVariantVector, AM_FILE | AM_NOEDIT);
+    MIXED_ACCESSOR_ATTRIBUTE("Billboards", GetParticleBillboardsAttr, SetParticleBillboardsAttr, VariantVector, Variant::emptyVariantVector, AM_FILE | AM_NOEDIT);
     ATTRIBUTE("Serialize Particles", bool, serializeParticles_, true, AM_FILE);
 }
 
@@ -156,90 +201,19 @@ void ParticleEmitter::Update(const FrameInfo& frame)
     }
 
     // Update existing particles
-    Vector3 relativeConstantForce = node_->GetWorldRotation().Inverse() * effect_->GetConstantForce();
+    Vector3 constantForce = effect_->GetConstantForce();
+    if (relative_)
+        constantForce = node_->GetWorldRotation().Inverse() * constantForce;
     // If billboards are not relative, apply scaling to the position update
     Vector3 scaleVector = Vector3::ONE;
     if (scaled_ && !relative_)
         scaleVector = node_->GetWorldScale();
 
-    for (unsigned i = 0; i < particles_.Size(); ++i)
-    {
-        Particle& particle = particles_[i];
-        Billboard& billboard = billboards_[i];
-
-        if (billboard.enabled_)
-        {
-            needCommit = true;
-
-            // Time to live
-            if (particle.timer_ >= particle.timeToLive_)
-            {
-                billboard.enabled_ = false;
-                continue;
-            }
-            particle.timer_ += lastTimeStep_;
-
-            // Velocity & position
-            const Vector3& constantForce = effect_->GetConstantForce();
-            if (constantForce != Vector3::ZERO)
-            {
-                if (relative_)
-                    particle.velocity_ += lastTimeStep_ * relativeConstantForce;
-                else
-                    particle.velocity_ += lastTimeStep_ * constantForce;
-            }
-
-            float dampingForce = effect_->GetDampingForce();
-            if (dampingForce != 0.0f)
-            {
-                Vector3 force = -dampingForce * particle.velocity_;
-                particle.velocity_ += lastTimeStep_ * force;
-            }
-            billboard.position_ += lastTimeStep_ * particle.velocity_ * scaleVector;
-
-            // Rotation
-            billboard.rotation_ += lastTimeStep_ * particle.rotationSpeed_;
-
-            // Scaling
-            float sizeAdd = effect_->GetSizeAdd();
-            float sizeMul = effect_->GetSizeMul();
-            if (sizeAdd != 0.0f || sizeMul != 1.0f)
-            {
-                particle.scale_ += lastTimeStep_ * sizeAdd;
-                if (sizeMul != 1.0f)
-                    particle.scale_ *= (lastTimeStep_ * (sizeMul - 1.0f)) + 1.0f;
-                billboard.size_ = particle.size_ * particle.scale_;
-            }
-
-            // Color interpolation
-            unsigned& index = particle.colorIndex_;
-            const Vector<ColorFrame>& colorFrames_ = effect_->GetColorFrames();
-            if (index < colorFrames_.Size())
-            {
-                if (index < colorFrames_.Size() - 1)
-                {
-                    if (particle.timer_ >= colorFrames_[index + 1].time_)
-                        ++index;
-                }
-                if (index < colorFrames_.Size() - 1)
-                    billboard.color_ = colorFrames_[index].Interpolate(colorFrames_[index + 1], particle.timer_);
-                else
-                    billboard.color_ = colorFrames_[index].color_;
-            }
-
-            // Texture animation
-            unsigned& texIndex = particle.texIndex_;
-            const Vector<TextureFrame>& textureFrames_ = effect_->GetTextureFrames();
-            if (textureFrames_.Size() && texIndex < textureFrames_.Size() - 1)
-            {
-                if (particle.timer_ >= textureFrames_[texIndex + 1].time_)
-                {
-                    billboard.uv_ = textureFrames_[texIndex + 1].uv_;
-                    ++texIndex;
-                }
-            }
-        }
-    }
+    if (billboardsModified_)
+        GatherBillboards();
+    SimulateParticles(constantForce, scaleVector);
+    if (UpdateBillboards())
+        needCommit = true;
 
     if (needCommit)
         Commit();
@@ -304,6 +278,8 @@ void ParticleEmitter::RemoveAllParticles()
 {
     for (PODVector<Billboard>::Iterator i = billboards_.Begin(); i != billboards_.End(); ++i)
         i->enabled_ = false;
+    for (PODVector<float>::Iterator i = particles_.active_.Begin(); i != particles_.active_.End(); ++i)
+        *i = 0.0f;
 
     Commit();
 }
@@ -344,16 +320,21 @@ void ParticleEmitter::SetParticlesAttr(const VariantVector& value)
     unsigned index = 0;
     SetNumParticles(index < value.Size() ? value[index++].GetUInt() : 0);
 
-    for (PODVector<Particle>::Iterator i = particles_.Begin(); i != particles_.End() && index < value.Size(); ++i)
+    for (unsigned i = 0; i < particles_.Size() && index < value.Size(); ++i)
     {
-        i->velocity_ = value[index++].GetVector3();
-        i->size_ = value[index++].GetVector2();
-        i->timer_ = value[index++].GetFloat();
-        i->timeToLive_ = value[index++].GetFloat();
-        i->scale_ = value[index++].GetFloat();
-        i->rotationSpeed_ = value[index++].GetFloat();
-        i->colorIndex_ = value[index++].GetInt();
-        i->texIndex_ = value[index++].GetInt();
+        Vector3 velocity = value[index++].GetVector3();
+        Vector2 size = value[index++].GetVector2();
+        particles_.velocityX_[i] = velocity.x_;
+        particles_.velocityY_[i] = velocity.y_;
+        particles_.velocityZ_[i] = velocity.z_;
+        particles_.sizeX_[i] = size.x_;
+        particles_.sizeY_[i] = size.y_;
+        particles_.timer_[i] = value[index++].GetFloat();
+        particles_.timeToLive_[i] = value[index++].GetFloat();
+        particles_.scale_[i] = value[index++].GetFloat();
+        particles_.rotationSpeed_[i] = value[index++].GetFloat();
+        particles_.colorIndex_[i] = value[index++].GetInt();
+        particles_.texIndex_[i] = value[index++].GetInt();
     }
 }
 
@@ -368,20 +349,36 @@ VariantVector ParticleEmitter::GetParticlesAttr() const
 
     ret.Reserve(particles_.Size() * 8 + 1);
     ret.Push(particles_.Size());
-    for (PODVector<Particle>::ConstIterator i = particles_.Begin(); i != particles_.End(); ++i)
+    for (unsigned i = 0; i < particles_.Size(); ++i)
     {
-        ret.Push(i->velocity_);
-        ret.Push(i->size_);
-        ret.Push(i->timer_);
-        ret.Push(i->timeToLive_);
-        ret.Push(i->scale_);
-        ret.Push(i->rotationSpeed_);
-        ret.Push(i->colorIndex_);
-        ret.Push(i->texIndex_);
+        ret.Push(Vector3(particles_.velocityX_[i], particles_.velocityY_[i], particles_.velocityZ_[i]));
+        ret.Push(Vector2(particles_.sizeX_[i], particles_.sizeY_[i]));
+        ret.Push(particles_.timer_[i]);
+        ret.Push(particles_.timeToLive_[i]);
+        ret.Push(particles_.scale_[i]);
+        ret.Push(particles_.rotationSpeed_[i]);
+        ret.Push(particles_.colorIndex_[i]);
+        ret.Push(particles_.texIndex_[i]);
     }
     return ret;
 }
 
+void ParticleEmitter::SetParticleBillboardsAttr(const VariantVector& value)
+{
+    SetBillboardsAttr(value);
+
+    // The simulation state holds the positions and rotations, so copy them from the loaded billboards
+    for (unsigned i = 0; i < particles_.Size() && i < billboards_.Size(); ++i)
+    {
+        const Billboard& billboard = billboards_[i];
+        particles_.active_[i] = billboard.enabled_ ? 1.0f : 0.0f;
+        particles_.positionX_[i] = billboard.position_.x_;
+        particles_.positionY_[i] = billboard.position_.y_;
+        particles_.positionZ_[i] = billboard.position_.z_;
+        particles_.rotation_[i] = billboard.rotation_;
+    }
+}
+
 VariantVector ParticleEmitter::GetParticleBillboardsAttr() const
 {
     VariantVector ret;
@@ -425,7 +422,6 @@ bool ParticleEmitter::EmitNewParticle()
     if (index == M_MAX_UNSIGNED)
         return false;
     assert(index < particles_.Size());
-    Particle& particle = particles_[index];
     Billboard& billboard = billboards_[index];
 
     Vector3 startPos;
@@ -467,20 +463,32 @@ bool ParticleEmitter::EmitNewParticle()
         startDir = node_->GetWorldRotation() * startDir;
     };
 
-    particle.velocity_ = effect_->GetRandomVelocity() * startDir;
-    particle.size_ = effect_->GetRandomSize();
-    particle.timer_ = 0.0f;
-    particle.timeToLive_ = effect_->GetRandomTimeToLive();
-    particle.scale_ = 1.0f;
-    particle.rotationSpeed_ = effect_->GetRandomRotationSpeed();
-    particle.colorIndex_ = 0;
-    particle.texIndex_ = 0;
+    Vector3 velocity = effect_->GetRandomVelocity() * startDir;
+    Vector2 size = effect_->GetRandomSize();
+    float rotation = effect_->GetRandomRotation();
+
+    particles_.active_[index] = 1.0f;
+    particles_.timer_[index] = 0.0f;
+    particles_.timeToLive_[index] = effect_->GetRandomTimeToLive();
+    particles_.positionX_[index] = startPos.x_;
+    particles_.positionY_[index] = startPos.y_;
+    particles_.positionZ_[index] = startPos.z_;
+    particles_.velocityX_[index] = velocity.x_;
+    particles_.velocityY_[index] = velocity.y_;
+    particles_.velocityZ_[index] = velocity.z_;
+    particles_.sizeX_[index] = size.x_;
+    particles_.sizeY_[index] = size.y_;
+    particles_.scale_[index] = 1.0f;
+    particles_.rotation_[index] = rotation;
+    particles_.rotationSpeed_[index] = effect_->GetRandomRotationSpeed();
+    particles_.colorIndex_[index] = 0;
+    particles_.texIndex_[index] = 0;
 
     billboard.position_ = startPos;
-    billboard.size_ = particles_[index].size_;
+    billboard.size_ = size;
     const Vector<TextureFrame>& textureFrames_ = effect_->GetTextureFrames();
     billboard.uv_ = textureFrames_.Size() ? textureFrames_[0].uv_ : Rect::POSITIVE;
-    billboard.rotation_ = effect_->GetRandomRotation();
+    billboard.rotation_ = rotation;
     const Vector<ColorFrame>& colorFrames_ = effect_->GetColorFrames();
     billboard.color_ = colorFrames_[0].color_;
     billboard.enabled_ = true;
@@ -488,11 +496,191 @@ bool ParticleEmitter::EmitNewParticle()
     return true;
 }
 
+void ParticleEmitter::GatherBillboards()
+{
+    // The particle arrays are the authoritative state, and are only synced from the billboards after they have been returned
+    // for modification, so that edits made through GetBillboards() continue to move the particles. Color, size and texture
+    // coordinates are animated from the effect and overwritten as before
+    billboardsModified_ = false;
+    
+    for (unsigned i = 0; i < billboards_.Size() && i < particles_.Size(); ++i)
+    {
+        const Billboard& billboard = billboards_[i];
+        if (!billboard.enabled_)
+        {
+            particles_.active_[i] = 0.0f;
+            continue;
+        }
+
+        particles_.positionX_[i] = billboard.position_.x_;
+        particles_.positionY_[i] = billboard.position_.y_;
+        particles_.positionZ_[i] = billboard.position_.z_;
+        particles_.rotation_[i] = billboard.rotation_;
+    }
+}
+
+void ParticleEmitter::SimulateParticles(const Vector3& constantForce, const Vector3& scaleVector)
+{
+    float timeStep = lastTimeStep_;
+    float dampingForce = effect_->GetDampingForce();
+    float sizeAdd = effect_->GetSizeAdd();
+    float sizeMul = effect_->GetSizeMul() - 1.0f;
+    unsigned numParticles = particles_.active_.Size();
+    if (!numParticles)
+        return;
+
+    float* active = &particles_.active_[0];
+    float* timer = &particles_.timer_[0];
+    const float* timeToLive = &particles_.timeToLive_[0];
+    float* positionX = &particles_.positionX_[0];
+    float* positionY = &particles_.positionY_[0];
+    float* positionZ = &particles_.positionZ_[0];
+    float* velocityX = &particles_.velocityX_[0];
+    float* velocityY = &particles_.velocityY_[0];
+    float* velocityZ = &particles_.velocityZ_[0];
+    float* scale = &particles_.scale_[0];
+    float* rotation = &particles_.rotation_[0];
+    const float* rotationSpeed = &particles_.rotationSpeed_[0];
+
+    // Expired particles are deactivated, and inactive particles are advanced with zero timestep so that their state
+    // stays unchanged. The velocity is first accelerated by the constant force, then damped
+#ifdef URHO3D_SSE
+    __m128 timeStepVec = _mm_set1_ps(timeStep);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 forceX = _mm_set1_ps(constantForce.x_);
+    __m128 forceY = _mm_set1_ps(constantForce.y_);
+    __m128 forceZ = _mm_set1_ps(constantForce.z_);
+    __m128 scaleX = _mm_set1_ps(scaleVector.x_);
+    __m128 scaleY = _mm_set1_ps(scaleVector.y_);
+    __m128 scaleZ = _mm_set1_ps(scaleVector.z_);
+    __m128 damping = _mm_set1_ps(dampingForce);
+    __m128 sizeAddVec = _mm_set1_ps(sizeAdd);
+    __m128 sizeMulVec = _mm_set1_ps(sizeMul);
+
+    for (unsigned i = 0; i < numParticles; i += 4)
+    {
+        __m128 time = _mm_loadu_ps(timer + i);
+        __m128 activeVec = _mm_and_ps(_mm_loadu_ps(active + i), _mm_cmplt_ps(time, _mm_loadu_ps(timeToLive + i)));
+        _mm_storeu_ps(active + i, activeVec);
+        __m128 step = _mm_mul_ps(timeStepVec, activeVec);
+        _mm_storeu_ps(timer + i, _mm_add_ps(time, step));
+
+        __m128 dampingScale = _mm_sub_ps(one, _mm_mul_ps(step, damping));
+        __m128 vx = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(velocityX + i), _mm_mul_ps(step, forceX)), dampingScale);
+        __m128 vy = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(velocityY + i), _mm_mul_ps(step, forceY)), dampingScale);
+        __m128 vz = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(velocityZ + i), _mm_mul_ps(step, forceZ)), dampingScale);
+        _mm_storeu_ps(velocityX + i, vx);
+        _mm_storeu_ps(velocityY + i, vy);
+        _mm_storeu_ps(velocityZ + i, vz);
+
+        _mm_storeu_ps(positionX + i, _mm_add_ps(_mm_loadu_ps(positionX + i), _mm_mul_ps(_mm_mul_ps(step, vx), scaleX)));
+        _mm_storeu_ps(positionY + i, _mm_add_ps(_mm_loadu_ps(positionY + i), _mm_mul_ps(_mm_mul_ps(step, vy), scaleY)));
+        _mm_storeu_ps(positionZ + i, _mm_add_ps(_mm_loadu_ps(positionZ + i), _mm_mul_ps(_mm_mul_ps(step, vz), scaleZ)));
+
+        _mm_storeu_ps(rotation + i, _mm_add_ps(_mm_loadu_ps(rotation + i), _mm_mul_ps(step, _mm_loadu_ps(rotationSpeed + i))));
+
+        __m128 newScale = _mm_add_ps(_mm_loadu_ps(scale + i), _mm_mul_ps(step, sizeAddVec));
+        _mm_storeu_ps(scale + i, _mm_mul_ps(newScale, _mm_add_ps(_mm_mul_ps(step, sizeMulVec), one)));
+    }
+#else
+    for (unsigned i = 0; i < numParticles; ++i)
+    {
+        if (timer[i] >= timeToLive[i])
+            active[i] = 0.0f;
+        float step = timeStep * active[i];
+        timer[i] += step;
+
+        float dampingScale = 1.0f - step * dampingForce;
+        velocityX[i] = (velocityX[i] + step * constantForce.x_) * dampingScale;
+        velocityY[i] = (velocityY[i] + step * constantForce.y_) * dampingScale;
+        velocityZ[i] = (velocityZ[i] + step * constantForce.z_) * dampingScale;
+
+        positionX[i] += step * velocityX[i] * scaleVector.x_;
+        positionY[i] += step * velocityY[i] * scaleVector.y_;
+        positionZ[i] += step * velocityZ[i] * scaleVector.z_;
+
+        rotation[i] += step * rotationSpeed[i];
+
+        scale[i] = (scale[i] + step * sizeAdd) * (step * sizeMul + 1.0f);
+    }
+#endif
+}
+
+bool ParticleEmitter::UpdateBillboards()
+{
+    bool changed = false;
+    bool scaling = effect_->GetSizeAdd() != 0.0f || effect_->GetSizeMul() != 1.0f;
+    const Vector<ColorFrame>& colorFrames = effect_->GetColorFrames();
+    const Vector<TextureFrame>& textureFrames = effect_->GetTextureFrames();
+
+    for (unsigned i = 0; i < billboards_.Size() && i < particles_.Size(); ++i)
+    {
+        Billboard& billboard = billboards_[i];
+        if (!billboard.enabled_)
+            continue;
+
+        changed = true;
+        if (particles_.active_[i] == 0.0f)
+        {
+            billboard.enabled_ = false;
+            continue;
+        }
+
+        billboard.position_ = Vector3(particles_.positionX_[i], particles_.positionY_[i], particles_.positionZ_[i]);
+        billboard.rotation_ = particles_.rotation_[i];
+        if (scaling)
+            billboard.size_ = Vector2(particles_.sizeX_[i], particles_.sizeY_[i]) * particles_.scale_[i];
+
+        float timer = particles_.timer_[i];
+
+        // Color interpolation. All four channels are interpolated at once with SSE
+        unsigned& index = particles_.colorIndex_[i];
+        if (index < colorFrames.Size())
+        {
+            if (index < colorFrames.Size() - 1)
+            {
+                if (timer >= colorFrames[index + 1].time_)
+                    ++index;
+            }
+            if (index < colorFrames.Size() - 1)
+            {
+                const ColorFrame& frame = colorFrames[index];
+                const ColorFrame& nextFrame = colorFrames[index + 1];
+                float timeInterval = nextFrame.time_ - frame.time_;
+                float t = timeInterval > 0.0f ? (timer - frame.time_) / timeInterval : 1.0f;
+#ifdef URHO3D_SSE
+                __m128 color = _mm_loadu_ps(frame.color_.Data());
+                __m128 nextColor = _mm_loadu_ps(nextFrame.color_.Data());
+                color = _mm_add_ps(color, _mm_mul_ps(_mm_sub_ps(nextColor, color), _mm_set1_ps(t)));
+                _mm_storeu_ps(&billboard.color_.r_, color);
+#else
+                billboard.color_ = frame.color_.Lerp(nextFrame.color_, t);
+#endif
+            }
+            else
+                billboard.color_ = colorFrames[index].color_;
+        }
+
+        // Texture animation
+        unsigned& texIndex = particles_.texIndex_[i];
+        if (textureFrames.Size() && texIndex < textureFrames.Size() - 1)
+        {
+            if (timer >= textureFrames[texIndex + 1].time_)
+            {
+                billboard.uv_ = textureFrames[texIndex + 1].uv_;
+                ++texIndex;
+            }
+        }
+    }
+
+    return changed;
+}
+
 unsigned ParticleEmitter::GetFreeParticle() const
 {
-    for (unsigned i = 0; i < billboards_.Size(); ++i)
+    for (unsigned i = 0; i < particles_.Size() && i < billboards_.Size(); ++i)
     {
-        if (!billboards_[i].enabled_)
+        if (particles_.active_[i] == 0.0f)
             return i;
     }
 
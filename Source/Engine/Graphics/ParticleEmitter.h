@@ -29,25 +29,53 @@ namespace Urho3D
 
 class ParticleEffect;
 
-/// One particle in the particle system.
-struct Particle
+/// Particle system state stored as one array per component, so that several particles can be simulated at once with SIMD instructions. The float arrays are padded to a multiple of four particles.
+struct URHO3D_API ParticleArrays
 {
-    /// Velocity.
-    Vector3 velocity_;
-    /// Original billboard size.
-    Vector2 size_;
+    /// Construct empty.
+    ParticleArrays();
+    
+    /// Set number of particles. Existing particles are kept and new particles are inactive.
+    void Resize(unsigned num);
+    /// Return number of particles.
+    unsigned Size() const { return size_; }
+    
+    /// Active flag (1 or 0.)
+    PODVector<float> active_;
     /// Time elapsed from creation.
-    float timer_;
+    PODVector<float> timer_;
     /// Lifetime.
-    float timeToLive_;
+    PODVector<float> timeToLive_;
+    /// Position X coordinate.
+    PODVector<float> positionX_;
+    /// Position Y coordinate.
+    PODVector<float> positionY_;
+    /// Position Z coordinate.
+    PODVector<float> positionZ_;
+    /// Velocity X coordinate.
+    PODVector<float> velocityX_;
+    /// Velocity Y coordinate.
+    PODVector<float> velocityY_;
+    /// Velocity Z coordinate.
+    PODVector<float> velocityZ_;
+    /// Original billboard width.
+    PODVector<float> sizeX_;
+    /// Original billboard height.
+    PODVector<float> sizeY_;
     /// Size scaling value.
-    float scale_;
+    PODVector<float> scale_;
+    /// Rotation.
+    PODVector<float> rotation_;
     /// Rotation speed.
-    float rotationSpeed_;
+    PODVector<float> rotationSpeed_;
     /// Current color animation index.
-    unsigned colorIndex_;
+    PODVector<unsigned> colorIndex_;
     /// Current texture animation index.
-    unsigned texIndex_;
+    PODVector<unsigned> texIndex_;
+    
+private:
+    /// Number of particles.
+    unsigned size_;
 };
 
 /// %Particle emitter component.
@@ -89,6 +117,8 @@ public:
     ParticleEffect* GetEffect() const { return effect_; }
     /// Return maximum number of particles.
     unsigned GetNumParticles() const { return particles_.Size(); }
+    /// Return particle simulation state.
+    const ParticleArrays& GetParticles() const { return particles_; }
     /// Return whether is currently emitting.
     bool IsEmitting() const { return emitting_; }
     /// Return whether particles are to be serialized.
@@ -102,6 +132,8 @@ public:
     void SetParticlesAttr(const VariantVector& value);
     /// Return particles attribute. Returns particle amount only if particles are not to be serialized.
     VariantVector GetParticlesAttr() const;
+    /// Set billboards attribute.
+    void SetParticleBillboardsAttr(const VariantVector& value);
     /// Return billboards attribute. Returns billboard amount only if particles are not to be serialized.
     VariantVector GetParticleBillboardsAttr() const;
 
@@ -115,6 +147,12 @@ protected:
     unsigned GetFreeParticle() const;
 
 private:
+    /// Copy billboard position, rotation and enabled state changes made through GetBillboards() or GetBillboard(), for example from scripts, back to the particles. The particles are otherwise authoritative.
+    void GatherBillboards();
+    /// Advance the time, velocity, position, rotation and scale of all particles, and deactivate expired particles.
+    void SimulateParticles(const Vector3& constantForce, const Vector3& scaleVector);
+    /// Copy the simulated particles to the billboards and animate their color and texture. Return true if any billboard changed.
+    bool UpdateBillboards();
     /// Handle scene post-update event.
     void HandleScenePostUpdate(StringHash eventType, VariantMap& eventData);
     /// Handle live reload of the particle effect.
@@ -123,7 +161,7 @@ private:
     /// Particle effect.
     SharedPtr<ParticleEffect> effect_;
     /// Particles.
-    PODVector<Particle> particles_;
+    ParticleArrays particles_;
     /// Active/inactive period timer.
     float periodTimer_;
     /// New particle emission timer.
@@ -0,0 +1,592 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Precompiled.h"
+#include "Camera.h"
+#include "Compression.h"
+#include "Context.h"
+#include "DebugRenderer.h"
+#include "HLODCluster.h"
+#include "Log.h"
+#include "OcclusionBuffer.h"
+#include "Octree.h"
+#include "PotentiallyVisibleSet.h"
+#include "Profiler.h"
+#include "Scene.h"
+#include "Sort.h"
+#include "StaticBatch.h"
+#include "StaticModelGroup.h"
+#include "TerrainPatch.h"
+#include "VectorBuffer.h"
+#include "WorkQueue.h"
+
+#include <cstring>
+
+#include "DebugNew.h"
+
+namespace Urho3D
+{
+
+static const Vector3 DEFAULT_BOUNDING_BOX_MIN(-10.0f, -10.0f, -10.0f);
+static const Vector3 DEFAULT_BOUNDING_BOX_MAX(10.0f, 10.0f, 10.0f);
+static const Vector3 DEFAULT_CELL_SIZE(2.0f, 2.0f, 2.0f);
+static const int DEFAULT_BAKE_RESOLUTION = 128;
+static const int DEFAULT_CELL_SAMPLES = 2;
+static const float BAKE_NEAR_CLIP = 0.05f;
+static const Vector3 CUBE_FACE_DIRECTIONS[] =
+{
+    Vector3::RIGHT,
+    Vector3::LEFT,
+    Vector3::UP,
+    Vector3::DOWN,
+    Vector3::FORWARD,
+    Vector3::BACK
+};
+
+extern const char* SUBSYSTEM_CATEGORY;
+
+/// Drawable sorted by distance from a bake sample point.
+struct PVSDrawableDistance
+{
+    /// Distance to the drawable's bounding box.
+    float distance_;
+    /// Drawable index.
+    unsigned index_;
+};
+
+/// Shared data for baking a potentially visible set in worker threads.
+struct PVSBakeData
+{
+    /// Set being baked.
+    PotentiallyVisibleSet* pvs_;
+    /// Baked drawables.
+    PODVector<Drawable*> drawables_;
+    /// World bounding boxes of the baked drawables.
+    PODVector<BoundingBox> boxes_;
+    /// Occlusion buffers per thread.
+    Vector<SharedPtr<OcclusionBuffer> > buffers_;
+    /// Cube face camera nodes per thread.
+    Vector<SharedPtr<Node> > cameraNodes_;
+};
+
+static bool CompareDrawableDistances(const PVSDrawableDistance& lhs, const PVSDrawableDistance& rhs)
+{
+    return lhs.distance_ < rhs.distance_;
+}
+
+/// Return whether a component is a drawable type with static geometry, which can be baked into the set.
+static bool IsStaticDrawable(Component* component)
+{
+    if (!component)
+        return false;
+    
+    StringHash type = component->GetType();
+    return type == StaticModel::GetTypeStatic() || type == StaticModelGroup::GetTypeStatic() ||
+        type == StaticBatch::GetTypeStatic() || type == HLODCluster::GetTypeStatic() || type == TerrainPatch::GetTypeStatic();
+}
+
+void BakePotentiallyVisibleSetWork(const WorkItem* item, unsigned threadIndex)
+{
+    PVSBakeData* data = reinterpret_cast<PVSBakeData*>(item->aux_);
+    PotentiallyVisibleSet* pvs = data->pvs_;
+    OcclusionBuffer* buffer = data->buffers_[threadIndex];
+    Node* cameraNode = data->cameraNodes_[threadIndex];
+    Camera* camera = cameraNode->GetComponent<Camera>();
+    const unsigned* start = reinterpret_cast<const unsigned*>(item->start_);
+    const unsigned* end = reinterpret_cast<const unsigned*>(item->end_);
+    
+    unsigned numDrawables = data->drawables_.Size();
+    int samples = pvs->cellSamples_;
+    PODVector<PVSDrawableDistance> order(numDrawables);
+    
+    while (start != end)
+    {
+        unsigned cellIndex = *start++;
+        unsigned x = cellIndex % pvs->cellCounts_[0];
+        unsigned y = (cellIndex / pvs->cellCounts_[0]) % pvs->cellCounts_[1];
+        unsigned z = cellIndex / (pvs->cellCounts_[0] * pvs->cellCounts_[1]);
+        
+        Vector3 cellMin = pvs->bakedBox_.min_ + pvs->bakedCellSize_ * Vector3((float)x, (float)y, (float)z);
+        Vector3 cellMax = cellMin + pvs->bakedCellSize_;
+        cellMax.x_ = Min(cellMax.x_, pvs->bakedBox_.max_.x_);
+        cellMax.y_ = Min(cellMax.y_, pvs->bakedBox_.max_.y_);
+        cellMax.z_ = Min(cellMax.z_, pvs->bakedBox_.max_.z_);
+        Vector3 cellSize = cellMax - cellMin;
+        
+        unsigned char* visibility = &pvs->visibility_[cellIndex * pvs->cellStride_];
+        
+        for (int sz = 0; sz < samples; ++sz)
+        {
+            for (int sy = 0; sy < samples; ++sy)
+            {
+                for (int sx = 0; sx < samples; ++sx)
+                {
+                    Vector3 samplePos = cellMin + cellSize * Vector3((sx + 0.5f) / samples, (sy + 0.5f) / samples,
+                        (sz + 0.5f) / samples);
+                    
+                    // Sort the drawables front to back, so that drawables hidden by nearer ones need not be drawn
+                    for (unsigned i = 0; i < numDrawables; ++i)
+                    {
+                        const BoundingBox& box = data->boxes_[i];
+                        Vector3 closest(Clamp(samplePos.x_, box.min_.x_, box.max_.x_), Clamp(samplePos.y_, box.min_.y_,
+                            box.max_.y_), Clamp(samplePos.z_, box.min_.z_, box.max_.z_));
+                        order[i].distance_ = (closest - samplePos).LengthSquared();
+                        order[i].index_ = i;
+                    }
+                    Sort(order.Begin(), order.End(), CompareDrawableDistances);
+                    
+                    cameraNode->SetWorldPosition(samplePos);
+                    
+                    for (unsigned face = 0; face < MAX_CUBEMAP_FACES; ++face)
+                    {
+                        cameraNode->SetWorldRotation(Quaternion(Vector3::FORWARD, CUBE_FACE_DIRECTIONS[face]));
+                        buffer->SetView(camera);
+                        buffer->Clear();
+                        const Frustum& frustum = camera->GetFrustum();
+                        
+                        for (unsigned i = 0; i < numDrawables; ++i)
+                        {
+                            unsigned index = order[i].index_;
+                            const BoundingBox& box = data->boxes_[index];
+                            if (frustum.IsInsideFast(box) == OUTSIDE)
+                                continue;
+                            
+                            // A drawable surrounding the sample point is visible, and must be drawn as it may enclose the cell
+                            if (order[i].distance_ > 0.0f && !buffer->IsVisible(box))
+                                continue;
+                            
+                            visibility[index >> 3] |= (unsigned char)(1 << (index & 7));
+                            data->drawables_[index]->DrawOcclusion(buffer);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+PotentiallyVisibleSet::PotentiallyVisibleSet(Context* context) :
+    Component(context),
+    boundingBox_(DEFAULT_BOUNDING_BOX_MIN, DEFAULT_BOUNDING_BOX_MAX),
+    cellSize_(DEFAULT_CELL_SIZE),
+    viewMask_(DEFAULT_VIEWMASK),
+    bakeResolution_(DEFAULT_BAKE_RESOLUTION),
+    cellSamples_(DEFAULT_CELL_SAMPLES),
+    numCells_(0),
+    cellStride_(0),
+    drawableIDsDirty_(false)
+{
+    cellCounts_[0] = cellCounts_[1] = cellCounts_[2] = 0;
+}
+
+PotentiallyVisibleSet::~PotentiallyVisibleSet()
+{
+    ReleaseIndices();
+}
+
+void PotentiallyVisibleSet::RegisterObject(Context* context)
+{
+    context->RegisterFactory<PotentiallyVisibleSet>(SUBSYSTEM_CATEGORY);
+    
+    ATTRIBUTE("Bounding Box Min", Vector3, boundingBox_.min_, DEFAULT_BOUNDING_BOX_MIN, AM_DEFAULT);
+    ATTRIBUTE("Bounding Box Max", Vector3, boundingBox_.max_, DEFAULT_BOUNDING_BOX_MAX, AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Cell Size", GetCellSize, SetCellSize, Vector3, DEFAULT_CELL_SIZE, AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("View Mask", GetViewMask, SetViewMask, unsigned, DEFAULT_VIEWMASK, AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Bake Resolution", GetBakeResolution, SetBakeResolution, int, DEFAULT_BAKE_RESOLUTION, AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Cell Samples", GetCellSamples, SetCellSamples, int, DEFAULT_CELL_SAMPLES, AM_DEFAULT);
+    MIXED_ACCESSOR_ATTRIBUTE("Visibility Data", GetDataAttr, SetDataAttr, PODVector<unsigned char>, Variant::emptyBuffer, AM_FILE | AM_NOEDIT);
+}
+
+void PotentiallyVisibleSet::ApplyAttributes()
+{
+    if (!drawableIDsDirty_)
+        return;
+    
+    ReleaseIndices();
+    
+    // Resolve the baked drawables. Drawables that no longer exist keep their place so that the visibility bits stay valid
+    Scene* scene = GetScene();
+    drawables_.Resize(drawableIDs_.Size());
+    for (unsigned i = 0; i < drawableIDs_.Size(); ++i)
+    {
+        Component* component = scene ? scene->GetComponent(drawableIDs_[i]) : 0;
+        drawables_[i] = IsStaticDrawable(component) ? static_cast<Drawable*>(component) : (Drawable*)0;
+    }
+    
+    AssignIndices();
+    drawableIDsDirty_ = false;
+}
+
+void PotentiallyVisibleSet::DrawDebugGeometry(DebugRenderer* debug, bool depthTest)
+{
+    if (debug)
+        debug->AddBoundingBox(boundingBox_, Color::CYAN, depthTest);
+}
+
+void PotentiallyVisibleSet::SetBoundingBox(const BoundingBox& box)
+{
+    boundingBox_ = box;
+    MarkNetworkUpdate();
+}
+
+void PotentiallyVisibleSet::SetCellSize(const Vector3& size)
+{
+    cellSize_ = Vector3(Max(size.x_, M_EPSILON), Max(size.y_, M_EPSILON), Max(size.z_, M_EPSILON));
+    MarkNetworkUpdate();
+}
+
+void PotentiallyVisibleSet::SetViewMask(unsigned mask)
+{
+    viewMask_ = mask;
+    MarkNetworkUpdate();
+}
+
+void PotentiallyVisibleSet::SetBakeResolution(int size)
+{
+    bakeResolution_ = Max(size, OCCLUSION_MIN_SIZE);
+    MarkNetworkUpdate();
+}
+
+void PotentiallyVisibleSet::SetCellSamples(int samples)
+{
+    cellSamples_ = Max(samples, 1);
+    MarkNetworkUpdate();
+}
+
+bool PotentiallyVisibleSet::Bake()
+{
+    Scene* scene = GetScene();
+    Octree* octree = scene ? scene->GetComponent<Octree>() : 0;
+    if (!octree)
+    {
+        LOGERROR("No Octree component in scene, can not bake potentially visible set");
+        return false;
+    }
+    if (!boundingBox_.defined_ || boundingBox_.Size().x_ <= 0.0f || boundingBox_.Size().y_ <= 0.0f ||
+        boundingBox_.Size().z_ <= 0.0f)
+    {
+        LOGERROR("Empty region, can not bake potentially visible set");
+        return false;
+    }
+    
+    unsigned numBakeCells = GetNumBakeCells();
+    if (numBakeCells > MAX_PVS_CELLS)
+    {
+        LOGERROR("Region would have " + String(numBakeCells) + " cells, more than the maximum " + String(MAX_PVS_CELLS) +
+            ". Increase the cell size or reduce the region to bake potentially visible set");
+        return false;
+    }
+    
+    PROFILE(BakePotentiallyVisibleSet);
+    
+    Clear();
+    
+    // Gather the static drawables from the whole octree, as also drawables outside the region can be seen from inside it
+    PVSBakeData data;
+    data.pvs_ = this;
+    {
+        PODVector<Drawable*> result;
+        GetStaticDrawables(octree, viewMask_, result);
+        
+        for (unsigned i = 0; i < result.Size(); ++i)
+        {
+            Drawable* drawable = result[i];
+            
+            // Getting the world bounding box here also ensures the world transforms are up to date for the worker threads
+            data.drawables_.Push(drawable);
+            data.boxes_.Push(drawable->GetWorldBoundingBox());
+            drawables_.Push(WeakPtr<Drawable>(drawable));
+            drawableIDs_.Push(drawable->GetID());
+        }
+    }
+    
+    bakedBox_ = boundingBox_;
+    bakedCellSize_ = cellSize_;
+    Vector3 regionSize = bakedBox_.Size();
+    cellCounts_[0] = (unsigned)Max((int)ceilf(regionSize.x_ / bakedCellSize_.x_), 1);
+    cellCounts_[1] = (unsigned)Max((int)ceilf(regionSize.y_ / bakedCellSize_.y_), 1);
+    cellCounts_[2] = (unsigned)Max((int)ceilf(regionSize.z_ / bakedCellSize_.z_), 1);
+    numCells_ = cellCounts_[0] * cellCounts_[1] * cellCounts_[2];
+    cellStride_ = (drawables_.Size() + 7) >> 3;
+    visibility_.Resize(numCells_ * cellStride_);
+    if (visibility_.Size())
+        memset(&visibility_[0], 0, visibility_.Size());
+    
+    AssignIndices();
+    
+    if (!drawables_.Empty())
+    {
+        WorkQueue* queue = GetSubsystem<WorkQueue>();
+        float farClip = octree->GetWorldBoundingBox().Size().Length();
+        
+        // Create an occlusion buffer and a cube face camera for each thread
+        unsigned numThreads = queue->GetNumThreads() + 1;
+        for (unsigned i = 0; i < numThreads; ++i)
+        {
+            SharedPtr<OcclusionBuffer> buffer(new OcclusionBuffer(context_));
+            buffer->SetSize(bakeResolution_, bakeResolution_);
+            buffer->SetMaxTriangles(M_MAX_UNSIGNED);
+            data.buffers_.Push(buffer);
+            
+            SharedPtr<Node> cameraNode(new Node(context_));
+            Camera* camera = cameraNode->CreateComponent<Camera>();
+            camera->SetFov(90.0f);
+            camera->SetAspectRatio(1.0f);
+            camera->SetNearClip(BAKE_NEAR_CLIP);
+            camera->SetFarClip(Max(farClip, BAKE_NEAR_CLIP * 2.0f));
+            data.cameraNodes_.Push(cameraNode);
+        }
+        
+        PODVector<unsigned> cellIndices(numCells_);
+        for (unsigned i = 0; i < numCells_; ++i)
+            cellIndices[i] = i;
+        
+        for (unsigned i = 0; i < numCells_; ++i)
+        {
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = BakePotentiallyVisibleSetWork;
+            item->aux_ = &data;
+            item->start_ = &cellIndices[i];
+            item->end_ = &cellIndices[i] + 1;
+            queue->AddWorkItem(item);
+        }
+        
+        queue->Complete(M_MAX_UNSIGNED);
+        
+        DilateVisibility();
+    }
+    
+    LOGINFO("Baked potentially visible set with " + String(numCells_) + " cells and " + String(drawables_.Size()) +
+        " drawables");
+    
+    MarkNetworkUpdate();
+    return true;
+}
+
+void PotentiallyVisibleSet::Clear()
+{
+    ReleaseIndices();
+    
+    drawables_.Clear();
+    drawableIDs_.Clear();
+    visibility_.Clear();
+    cellCounts_[0] = cellCounts_[1] = cellCounts_[2] = 0;
+    numCells_ = 0;
+    cellStride_ = 0;
+    drawableIDsDirty_ = false;
+}
+
+unsigned PotentiallyVisibleSet::GetNumBakeCells() const
+{
+    if (!boundingBox_.defined_)
+        return 0;
+    
+    // Calculate in floating point to not overflow on huge regions
+    Vector3 regionSize = boundingBox_.Size();
+    float numCells = Max(ceilf(regionSize.x_ / cellSize_.x_), 1.0f) * Max(ceilf(regionSize.y_ / cellSize_.y_), 1.0f) *
+        Max(ceilf(regionSize.z_ / cellSize_.z_), 1.0f);
+    return numCells < (float)M_MAX_UNSIGNED ? (unsigned)numCells : M_MAX_UNSIGNED;
+}
+
+unsigned PotentiallyVisibleSet::GetCellIndex(const Vector3& position) const
+{
+    if (!numCells_)
+        return M_MAX_UNSIGNED;
+    
+    Vector3 cellPos = (position - bakedBox_.min_) / bakedCellSize_;
+    if (cellPos.x_ < 0.0f || cellPos.y_ < 0.0f || cellPos.z_ < 0.0f)
+        return M_MAX_UNSIGNED;
+    
+    unsigned x = (unsigned)cellPos.x_;
+    unsigned y = (unsigned)cellPos.y_;
+    unsigned z = (unsigned)cellPos.z_;
+    if (x >= cellCounts_[0] || y >= cellCounts_[1] || z >= cellCounts_[2] || !bakedBox_.IsInside(position))
+        return M_MAX_UNSIGNED;
+    
+    return (z * cellCounts_[1] + y) * cellCounts_[0] + x;
+}
+
+const unsigned char* PotentiallyVisibleSet::GetCellVisibility(const Vector3& position) const
+{
+    unsigned cellIndex = GetCellIndex(position);
+    return cellIndex != M_MAX_UNSIGNED && cellStride_ ? &visibility_[cellIndex * cellStride_] : 0;
+}
+
+bool PotentiallyVisibleSet::IsVisible(unsigned cellIndex, Drawable* drawable) const
+{
+    if (cellIndex >= numCells_ || !drawable)
+        return true;
+    
+    unsigned index = drawable->GetPVSIndex();
+    if (index >= drawables_.Size() || drawables_[index] != drawable)
+        return true;
+    
+    return (visibility_[cellIndex * cellStride_ + (index >> 3)] & (1 << (index & 7))) != 0;
+}
+
+void PotentiallyVisibleSet::SetDataAttr(const PODVector<unsigned char>& value)
+{
+    Clear();
+    
+    if (value.Empty())
+        return;
+    
+    VectorBuffer compressed(value);
+    VectorBuffer buffer = DecompressVectorBuffer(compressed);
+    
+    bakedBox_ = buffer.ReadBoundingBox();
+    bakedCellSize_ = buffer.ReadVector3();
+    for (unsigned i = 0; i < 3; ++i)
+        cellCounts_[i] = buffer.ReadUInt();
+    numCells_ = cellCounts_[0] * cellCounts_[1] * cellCounts_[2];
+    
+    unsigned numDrawables = buffer.ReadUInt();
+    drawableIDs_.Resize(numDrawables);
+    for (unsigned i = 0; i < numDrawables; ++i)
+        drawableIDs_[i] = buffer.ReadUInt();
+    
+    cellStride_ = (numDrawables + 7) >> 3;
+    visibility_.Resize(numCells_ * cellStride_);
+    if (visibility_.Size() && buffer.Read(&visibility_[0], visibility_.Size()) != visibility_.Size())
+    {
+        LOGERROR("Truncated potentially visible set data");
+        Clear();
+        return;
+    }
+    
+    drawableIDsDirty_ = true;
+}
+
+PODVector<unsigned char> PotentiallyVisibleSet::GetDataAttr() const
+{
+    if (!numCells_)
+        return Variant::emptyBuffer;
+    
+    VectorBuffer buffer;
+    buffer.WriteBoundingBox(bakedBox_);
+    buffer.WriteVector3(bakedCellSize_);
+    for (unsigned i = 0; i < 3; ++i)
+        buffer.WriteUInt(cellCounts_[i]);
+    
+    buffer.WriteUInt(drawableIDs_.Size());
+    for (unsigned i = 0; i < drawableIDs_.Size(); ++i)
+        buffer.WriteUInt(drawableIDs_[i]);
+    
+    if (visibility_.Size())
+        buffer.Write(&visibility_[0], visibility_.Size());
+    
+    // The visibility bits are mostly runs of zeroes or ones, so they compress well
+    return CompressVectorBuffer(buffer).GetBuffer();
+}
+
+void PotentiallyVisibleSet::GetStaticDrawables(Octree* octree, unsigned viewMask, PODVector<Drawable*>& dest)
+{
+    dest.Clear();
+    if (!octree)
+        return;
+    
+    PODVector<Drawable*> result;
+    BoxOctreeQuery query(result, octree->GetWorldBoundingBox(), DRAWABLE_GEOMETRY, viewMask);
+    octree->GetDrawables(query);
+    
+    for (unsigned i = 0; i < result.Size(); ++i)
+    {
+        if (IsStaticDrawable(result[i]))
+            dest.Push(result[i]);
+    }
+}
+
+BoundingBox PotentiallyVisibleSet::GetStaticBoundingBox(Octree* octree, unsigned viewMask)
+{
+    PODVector<Drawable*> drawables;
+    GetStaticDrawables(octree, viewMask, drawables);
+    
+    BoundingBox box;
+    for (unsigned i = 0; i < drawables.Size(); ++i)
+        box.Merge(drawables[i]->GetWorldBoundingBox());
+    return box;
+}
+
+void PotentiallyVisibleSet::DilateVisibility()
+{
+    // Sampling a few points per cell is not conservative. Merge the visibility sampled in the face neighbours into each cell,
+    // so that drawables seen from near the cell borders are not culled
+    if (!cellStride_)
+        return;
+    
+    PODVector<unsigned char> sampled(visibility_);
+    for (unsigned z = 0; z < cellCounts_[2]; ++z)
+    {
+        for (unsigned y = 0; y < cellCounts_[1]; ++y)
+        {
+            for (unsigned x = 0; x < cellCounts_[0]; ++x)
+            {
+                unsigned cellIndex = (z * cellCounts_[1] + y) * cellCounts_[0] + x;
+                unsigned char* dest = &visibility_[cellIndex * cellStride_];
+                unsigned neighbours[6];
+                unsigned numNeighbours = 0;
+                if (x > 0)
+                    neighbours[numNeighbours++] = cellIndex - 1;
+                if (x + 1 < cellCounts_[0])
+                    neighbours[numNeighbours++] = cellIndex + 1;
+                if (y > 0)
+                    neighbours[numNeighbours++] = cellIndex - cellCounts_[0];
+                if (y + 1 < cellCounts_[1])
+                    neighbours[numNeighbours++] = cellIndex + cellCounts_[0];
+                if (z > 0)
+                    neighbours[numNeighbours++] = cellIndex - cellCounts_[0] * cellCounts_[1];
+                if (z + 1 < cellCounts_[2])
+                    neighbours[numNeighbours++] = cellIndex + cellCounts_[0] * cellCounts_[1];
+                
+                for (unsigned i = 0; i < numNeighbours; ++i)
+                {
+                    const unsigned char* src = &sampled[neighbours[i] * cellStride_];
+                    for (unsigned j = 0; j < cellStride_; ++j)
+                        dest[j] |= src[j];
+                }
+            }
+        }
+    }
+}
+
+void PotentiallyVisibleSet::AssignIndices()
+{
+    for (unsigned i = 0; i < drawables_.Size(); ++i)
+    {
+        Drawable* drawable = drawables_[i];
+        if (drawable)
+            drawable->SetPVSIndex(i);
+    }
+}
+
+void PotentiallyVisibleSet::ReleaseIndices()
+{
+    for (unsigned i = 0; i < drawables_.Size(); ++i)
+    {
+        Drawable* drawable = drawables_[i];
+        if (drawable && drawable->GetPVSIndex() == i)
+            drawable->SetPVSIndex(M_MAX_UNSIGNED);
+    }
+}
+
+}
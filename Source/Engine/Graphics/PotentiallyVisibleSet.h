@@ -0,0 +1,146 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "BoundingBox.h"
+#include "Component.h"
+
+namespace Urho3D
+{
+
+class Drawable;
+class Octree;
+struct WorkItem;
+
+/// Maximum number of cells in a potentially visible set.
+static const unsigned MAX_PVS_CELLS = 262144;
+
+/// Precomputed potentially visible set for static geometry. Divides a world-space region into cells and stores which static drawables can be seen from each cell, so that views can cull the rest before occlusion testing. Create into the scene root node.
+class URHO3D_API PotentiallyVisibleSet : public Component
+{
+    OBJECT(PotentiallyVisibleSet);
+    
+    friend void BakePotentiallyVisibleSetWork(const WorkItem* item, unsigned threadIndex);
+    
+public:
+    /// Construct.
+    PotentiallyVisibleSet(Context* context);
+    /// Destruct.
+    virtual ~PotentiallyVisibleSet();
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+    
+    /// Apply attribute changes that can not be applied immediately. Called after scene load or a network update.
+    virtual void ApplyAttributes();
+    /// Visualize the component as debug geometry.
+    virtual void DrawDebugGeometry(DebugRenderer* debug, bool depthTest);
+    
+    /// Set world-space region to divide into cells. Takes effect on the next bake.
+    void SetBoundingBox(const BoundingBox& box);
+    /// Set cell size. Takes effect on the next bake.
+    void SetCellSize(const Vector3& size);
+    /// Set view mask for selecting the static drawables to bake. Drawables not selected, for example moving objects, are never culled by the set.
+    void SetViewMask(unsigned mask);
+    /// Set width and height of the occlusion buffer used for each cube face when baking.
+    void SetBakeResolution(int size);
+    /// Set number of sample points per cell axis when baking. Sampling is not conservative: after baking, each cell's visibility is merged with its face neighbours' to cover positions between the sample points, but drawables seen only through small gaps may still be culled. Increase the samples or decrease the cell size if this happens.
+    void SetCellSamples(int samples);
+    /// Bake the visibility of the static drawables from each cell using all worker threads. Works also in headless mode. Fails if the region would have more than MAX_PVS_CELLS cells. Return true if successful.
+    bool Bake();
+    /// Clear the baked visibility.
+    void Clear();
+    
+    /// Return world-space region.
+    const BoundingBox& GetBoundingBox() const { return boundingBox_; }
+    /// Return cell size.
+    const Vector3& GetCellSize() const { return cellSize_; }
+    /// Return view mask for selecting the static drawables.
+    unsigned GetViewMask() const { return viewMask_; }
+    /// Return bake occlusion buffer resolution.
+    int GetBakeResolution() const { return bakeResolution_; }
+    /// Return number of sample points per cell axis.
+    int GetCellSamples() const { return cellSamples_; }
+    /// Return number of cells the region would be divided into on the next bake.
+    unsigned GetNumBakeCells() const;
+    /// Return whether visibility has been baked.
+    bool IsBaked() const { return numCells_ > 0; }
+    /// Return number of baked cells.
+    unsigned GetNumCells() const { return numCells_; }
+    /// Return number of baked drawables.
+    unsigned GetNumDrawables() const { return drawables_.Size(); }
+    /// Return index of the baked cell containing a world-space position, or M_MAX_UNSIGNED if outside the baked region.
+    unsigned GetCellIndex(const Vector3& position) const;
+    /// Return visibility bits of the baked cell containing a world-space position, indexed by the drawables' PVS index. Return null if outside the baked region.
+    const unsigned char* GetCellVisibility(const Vector3& position) const;
+    /// Return whether a drawable is potentially visible from a cell. Drawables not included in the bake are always visible.
+    bool IsVisible(unsigned cellIndex, Drawable* drawable) const;
+    
+    /// Set baked data attribute.
+    void SetDataAttr(const PODVector<unsigned char>& value);
+    /// Return baked data attribute.
+    PODVector<unsigned char> GetDataAttr() const;
+    
+    /// Gather the static drawables of an octree that can be baked, selected by view mask.
+    static void GetStaticDrawables(Octree* octree, unsigned viewMask, PODVector<Drawable*>& dest);
+    /// Return the union of the world bounding boxes of an octree's static drawables, selected by view mask. Useful as the region to bake.
+    static BoundingBox GetStaticBoundingBox(Octree* octree, unsigned viewMask);
+    
+private:
+    /// Merge the visibility of each cell's face neighbours into it.
+    void DilateVisibility();
+    /// Assign PVS indices to the baked drawables.
+    void AssignIndices();
+    /// Reset the PVS indices of the baked drawables.
+    void ReleaseIndices();
+    
+    /// World-space region for baking.
+    BoundingBox boundingBox_;
+    /// Cell size for baking.
+    Vector3 cellSize_;
+    /// View mask for selecting the static drawables.
+    unsigned viewMask_;
+    /// Bake occlusion buffer resolution.
+    int bakeResolution_;
+    /// Sample points per cell axis.
+    int cellSamples_;
+    /// Baked region.
+    BoundingBox bakedBox_;
+    /// Baked cell size.
+    Vector3 bakedCellSize_;
+    /// Baked cell counts on each axis.
+    unsigned cellCounts_[3];
+    /// Total number of baked cells.
+    unsigned numCells_;
+    /// Bytes of visibility bits per cell.
+    unsigned cellStride_;
+    /// Visibility bits for all cells.
+    PODVector<unsigned char> visibility_;
+    /// Baked drawables.
+    Vector<WeakPtr<Drawable> > drawables_;
+    /// Component IDs of the baked drawables, to be resolved in ApplyAttributes.
+    PODVector<unsigned> drawableIDs_;
+    /// Whether drawable IDs have been loaded and need resolving.
+    bool drawableIDsDirty_;
+};
+
+}
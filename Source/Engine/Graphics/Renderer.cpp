@@ -21,6 +21,7 @@
 //
 
 #include "Precompiled.h"
+#include "BillboardSet.h"
 #include "Camera.h"
 #include "CoreEvents.h"
 #include "DebugRenderer.h"
@@ -42,8 +43,10 @@
 #include "Technique.h"
 #include "Texture2D.h"
 #include "TextureCube.h"
+#include "TransientBuffer.h"
 #include "VertexBuffer.h"
 #include "View.h"
+#include "WorkQueue.h"
 #include "XMLFile.h"
 #include "Zone.h"
 
@@ -247,6 +250,19 @@ static const char* heightFogVariations[] =
     "HEIGHTFOG "
 };
 
+void QueryDrawablesWork(const WorkItem* item, unsigned threadIndex)
+{
+    View* view = reinterpret_cast<View*>(item->aux_);
+    view->ExecuteQuery();
+}
+
+void UpdateViewWork(const WorkItem* item, unsigned threadIndex)
+{
+    View* view = reinterpret_cast<View*>(item->aux_);
+    const FrameInfo& frame = *(reinterpret_cast<FrameInfo*>(item->start_));
+    view->BeginUpdate(frame, true);
+}
+
 static const unsigned INSTANCING_BUFFER_MASK = MASK_INSTANCEMATRIX1 | MASK_INSTANCEMATRIX2 | MASK_INSTANCEMATRIX3;
 static const unsigned MAX_BUFFER_AGE = 1000;
 
@@ -260,6 +276,7 @@ Renderer::Renderer(Context* context) :
     shadowMapSize_(1024),
     shadowQuality_(SHADOWQUALITY_HIGH_16BIT),
     maxShadowMaps_(1),
+    shadowAtlasSize_(4096),
     minInstances_(2),
     maxInstanceTriangles_(500),
     maxSortedInstances_(1000),
@@ -275,7 +292,10 @@ Renderer::Renderer(Context* context) :
     specularLighting_(true),
     drawShadows_(true),
     reuseShadowMaps_(true),
+    shadowAtlas_(false),
     dynamicInstancing_(true),
+    clusteredLighting_(false),
+    retainedBatches_(false),
     shadersDirty_(true),
     initialized_(false),
     resetViews_(false)
@@ -426,6 +446,26 @@ void Renderer::SetMaxShadowMaps(int shadowMaps)
     }
 }
 
+void Renderer::SetShadowAtlas(bool enable)
+{
+    if (enable == shadowAtlas_)
+        return;
+    
+    shadowAtlas_ = enable;
+    if (!shadowAtlas_)
+        shadowAtlasTexture_.Reset();
+}
+
+void Renderer::SetShadowAtlasSize(int size)
+{
+    size = NextPowerOfTwo(Max(size, SHADOW_MIN_PIXELS));
+    if (size != shadowAtlasSize_)
+    {
+        shadowAtlasSize_ = size;
+        shadowAtlasTexture_.Reset();
+    }
+}
+
 void Renderer::SetDynamicInstancing(bool enable)
 {
     if (!instancingBuffer_)
@@ -460,6 +500,16 @@ void Renderer::SetOcclusionBufferSize(int size)
     occlusionBuffers_.Clear();
 }
 
+void Renderer::SetClusteredLighting(bool enable)
+{
+    clusteredLighting_ = enable;
+}
+
+void Renderer::SetRetainedBatches(bool enable)
+{
+    retainedBatches_ = enable;
+}
+
 void Renderer::SetMobileShadowBiasMul(float mul)
 {
     mobileShadowBiasMul_ = mul;
@@ -554,6 +604,38 @@ unsigned Renderer::GetNumOccluders(bool allViews) const
     return numOccluders;
 }
 
+unsigned Renderer::GetTransientBytesUploaded() const
+{
+    unsigned bytes = 0;
+    
+    for (HashMap<unsigned, SharedPtr<TransientBuffer> >::ConstIterator i = transientVertexBuffers_.Begin(); i !=
+        transientVertexBuffers_.End(); ++i)
+        bytes += i->second_->GetBytesUploaded();
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        if (transientIndexBuffers_[i])
+            bytes += transientIndexBuffers_[i]->GetBytesUploaded();
+    }
+    
+    return bytes;
+}
+
+unsigned Renderer::GetNumTransientReallocations() const
+{
+    unsigned reallocations = 0;
+    
+    for (HashMap<unsigned, SharedPtr<TransientBuffer> >::ConstIterator i = transientVertexBuffers_.Begin(); i !=
+        transientVertexBuffers_.End(); ++i)
+        reallocations += i->second_->GetNumReallocations();
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        if (transientIndexBuffers_[i])
+            reallocations += transientIndexBuffers_[i]->GetNumReallocations();
+    }
+    
+    return reallocations;
+}
+
 void Renderer::Update(float timeStep)
 {
     PROFILE(UpdateViews);
@@ -573,6 +655,16 @@ void Renderer::Update(float timeStep)
     numOcclusionBuffers_ = 0;
     updatedOctrees_.Clear();
     
+    // Release the transient geometry of the previous frame
+    for (HashMap<unsigned, SharedPtr<TransientBuffer> >::Iterator i = transientVertexBuffers_.Begin(); i !=
+        transientVertexBuffers_.End(); ++i)
+        i->second_->BeginFrame();
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        if (transientIndexBuffers_[i])
+            transientIndexBuffers_[i]->BeginFrame();
+    }
+    
     // Reload shaders now if needed
     if (shadersDirty_)
         LoadShaders();
@@ -585,67 +677,16 @@ void Renderer::Update(float timeStep)
     // Gather other render surfaces that are autoupdated
     SendEvent(E_RENDERSURFACEUPDATE);
     
-    // Process gathered views. This may queue further views (render surfaces that are only updated when visible)
-    for (unsigned i = 0; i < queuedViewports_.Size(); ++i)
+    // Process gathered views. Prepare and update all views queued so far at once, so that their octree queries and
+    // scene views can be processed in parallel. Updating may queue further views (render surfaces that are only updated
+    // when visible)
+    unsigned numPreparedViewports = 0;
+    while (numPreparedViewports < queuedViewports_.Size())
     {
-        WeakPtr<RenderSurface>& renderTarget = queuedViewports_[i].first_;
-        WeakPtr<Viewport>& viewport = queuedViewports_[i].second_;
-        
-        // Null pointer means backbuffer view. Differentiate between that and an expired rendersurface
-        if ((renderTarget.NotNull() && renderTarget.Expired()) || viewport.Expired())
-            continue;
-        
-        // (Re)allocate the view structure if necessary
-        if (!viewport->GetView() || resetViews_)
-            viewport->AllocateView();
-        
-        View* view = viewport->GetView();
-        assert(view);
-        // Check if view can be defined successfully (has either valid scene, camera and octree, or no scene passes)
-        if (!view->Define(renderTarget, viewport))
-            continue;
-        
-        views_.Push(WeakPtr<View>(view));
-        
-        const IntRect& viewRect = viewport->GetRect();
-        Scene* scene = viewport->GetScene();
-        if (!scene)
-            continue;
-        
-        Octree* octree = scene->GetComponent<Octree>();
-        
-        // Update octree (perform early update for drawables which need that, and reinsert moved drawables.)
-        // However, if the same scene is viewed from multiple cameras, update the octree only once
-        if (!updatedOctrees_.Contains(octree))
-        {
-            frame_.camera_ = viewport->GetCamera();
-            frame_.viewSize_ = viewRect.Size();
-            if (frame_.viewSize_ == IntVector2::ZERO)
-                frame_.viewSize_ = IntVector2(graphics_->GetWidth(), graphics_->GetHeight());
-            octree->Update(frame_);
-            updatedOctrees_.Insert(octree);
-            
-            // Set also the view for the debug renderer already here, so that it can use culling
-            /// \todo May result in incorrect debug geometry culling if the same scene is drawn from multiple viewports
-            DebugRenderer* debug = scene->GetComponent<DebugRenderer>();
-            if (debug)
-                debug->SetView(viewport->GetCamera());
-        }
-        
-        // Update view. This may queue further views
-        using namespace BeginViewUpdate;
-        
-        VariantMap& eventData = GetEventDataMap();
-        eventData[P_SURFACE] = renderTarget.Get();
-        eventData[P_TEXTURE] = (renderTarget ? renderTarget->GetParentTexture() : 0);
-        eventData[P_SCENE] = scene;
-        eventData[P_CAMERA] = viewport->GetCamera();
-        SendEvent(E_BEGINVIEWUPDATE, eventData);
-        
-        ResetShadowMapAllocations(); // Each view can reuse the same shadow maps
-        view->Update(frame_);
-        
-        SendEvent(E_ENDVIEWUPDATE, eventData);
+        unsigned start = numPreparedViewports;
+        numPreparedViewports = queuedViewports_.Size();
+        PrepareViews(start);
+        UpdateViews();
     }
     
     // Reset update flag from queued render surfaces. At this point no new views can be added on this frame
@@ -675,6 +716,17 @@ void Renderer::Render()
     graphics_->SetTextureAnisotropy(textureAnisotropy_);
     graphics_->ClearParameterSources();
     
+    // Upload the transient geometry written during the view updates and at the start of rendering (UI, debug geometry)
+    // once for the whole frame
+    for (HashMap<unsigned, SharedPtr<TransientBuffer> >::Iterator i = transientVertexBuffers_.Begin(); i !=
+        transientVertexBuffers_.End(); ++i)
+        i->second_->Upload();
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        if (transientIndexBuffers_[i])
+            transientIndexBuffers_[i]->Upload();
+    }
+    
     // If no views, just clear the screen
     if (views_.Empty())
     {
@@ -810,39 +862,7 @@ Geometry* Renderer::GetQuadGeometry()
 Texture2D* Renderer::GetShadowMap(Light* light, Camera* camera, unsigned viewWidth, unsigned viewHeight)
 {
     LightType type = light->GetLightType();
-    const FocusParameters& parameters = light->GetShadowFocus();
-    float size = (float)shadowMapSize_ * light->GetShadowResolution();
-    // Automatically reduce shadow map size when far away
-    if (parameters.autoSize_ && type != LIGHT_DIRECTIONAL)
-    {
-        const Matrix3x4& view = camera->GetView();
-        const Matrix4& projection = camera->GetProjection();
-        BoundingBox lightBox;
-        float lightPixels;
-        
-        if (type == LIGHT_POINT)
-        {
-            // Calculate point light pixel size from the projection of its diagonal
-            Vector3 center = view * light->GetNode()->GetWorldPosition();
-            float extent = 0.58f * light->GetRange();
-            lightBox.Define(center + Vector3(extent, extent, extent), center - Vector3(extent, extent, extent));
-        }
-        else
-        {
-            // Calculate spot light pixel size from the projection of its frustum far vertices
-            Frustum lightFrustum = light->GetFrustum().Transformed(view);
-            lightBox.Define(&lightFrustum.vertices_[4], 4);
-        }
-        
-        Vector2 projectionSize = lightBox.Projected(projection).Size();
-        lightPixels = Max(0.5f * (float)viewWidth * projectionSize.x_, 0.5f * (float)viewHeight * projectionSize.y_);
-        
-        // Clamp pixel amount to a sufficient minimum to avoid self-shadowing artifacts due to loss of precision
-        if (lightPixels < SHADOW_MIN_PIXELS)
-            lightPixels = SHADOW_MIN_PIXELS;
-        
-        size = Min(size, lightPixels);
-    }
+    float size = GetShadowMapPixels(light, camera, viewWidth, viewHeight);
     
     /// \todo Allow to specify maximum shadow maps per resolution, as smaller shadow maps take less memory
     int width = NextPowerOfTwo((unsigned)size);
@@ -883,10 +903,84 @@ Texture2D* Renderer::GetShadowMap(Light* light, Camera* camera, unsigned viewWid
         }
     }
     
+    if (!graphics_->GetShadowMapFormat())
+        return 0;
+    
+    // If failed to create, store a null pointer so that we will not retry
+    SharedPtr<Texture2D> newShadowMap = CreateShadowMap(width, height);
+    shadowMaps_[searchKey].Push(newShadowMap);
+    if (!reuseShadowMaps_)
+        shadowMapAllocations_[searchKey].Push(light);
+    
+    return newShadowMap;
+}
+
+Texture2D* Renderer::GetShadowAtlasTexture()
+{
+    if (!shadowAtlas_ || !drawShadows_ || !graphics_->GetShadowMapFormat())
+        return 0;
+    
+    if (!shadowAtlasTexture_)
+    {
+        shadowAtlasTexture_ = CreateShadowMap(shadowAtlasSize_, shadowAtlasSize_);
+        // If the atlas could not be created, fall back to separate shadow maps
+        if (!shadowAtlasTexture_)
+        {
+            LOGERROR("Failed to create shadow map atlas, disabling");
+            shadowAtlas_ = false;
+        }
+    }
+    
+    return shadowAtlasTexture_;
+}
+
+float Renderer::GetShadowMapPixels(Light* light, Camera* camera, unsigned viewWidth, unsigned viewHeight) const
+{
+    LightType type = light->GetLightType();
+    const FocusParameters& parameters = light->GetShadowFocus();
+    float size = (float)shadowMapSize_ * light->GetShadowResolution();
+    // Automatically reduce shadow map size when far away
+    if (parameters.autoSize_ && type != LIGHT_DIRECTIONAL)
+    {
+        const Matrix3x4& view = camera->GetView();
+        const Matrix4& projection = camera->GetProjection();
+        BoundingBox lightBox;
+        float lightPixels;
+        
+        if (type == LIGHT_POINT)
+        {
+            // Calculate point light pixel size from the projection of its diagonal
+            Vector3 center = view * light->GetNode()->GetWorldPosition();
+            float extent = 0.58f * light->GetRange();
+            lightBox.Define(center + Vector3(extent, extent, extent), center - Vector3(extent, extent, extent));
+        }
+        else
+        {
+            // Calculate spot light pixel size from the projection of its frustum far vertices
+            Frustum lightFrustum = light->GetFrustum().Transformed(view);
+            lightBox.Define(&lightFrustum.vertices_[4], 4);
+        }
+        
+        Vector2 projectionSize = lightBox.Projected(projection).Size();
+        lightPixels = Max(0.5f * (float)viewWidth * projectionSize.x_, 0.5f * (float)viewHeight * projectionSize.y_);
+        
+        // Clamp pixel amount to a sufficient minimum to avoid self-shadowing artifacts due to loss of precision
+        if (lightPixels < SHADOW_MIN_PIXELS)
+            lightPixels = SHADOW_MIN_PIXELS;
+        
+        size = Min(size, lightPixels);
+    }
+    
+    return size;
+}
+
+SharedPtr<Texture2D> Renderer::CreateShadowMap(int width, int height)
+{
+    int searchKey = (width << 16) | height;
     unsigned shadowMapFormat = (shadowQuality_ & SHADOWQUALITY_LOW_24BIT) ? graphics_->GetHiresShadowMapFormat() :
         graphics_->GetShadowMapFormat();
     if (!shadowMapFormat)
-        return 0;
+        return SharedPtr<Texture2D>();
     
     SharedPtr<Texture2D> newShadowMap(new Texture2D(context_));
     int retries = 3;
@@ -930,14 +1024,9 @@ Texture2D* Renderer::GetShadowMap(Light* light, Camera* camera, unsigned viewWid
         }
     }
     
-    // If failed to set size, store a null pointer so that we will not retry
     if (!retries)
         newShadowMap.Reset();
     
-    shadowMaps_[searchKey].Push(newShadowMap);
-    if (!reuseShadowMaps_)
-        shadowMapAllocations_[searchKey].Push(light);
-    
     return newShadowMap;
 }
 
@@ -1012,8 +1101,35 @@ RenderSurface* Renderer::GetDepthStencil(int width, int height)
         return GetScreenBuffer(width, height, Graphics::GetDepthStencilFormat(), false, false)->GetRenderSurface();
 }
 
+TransientBuffer* Renderer::GetTransientVertexBuffer(unsigned elementMask)
+{
+    SharedPtr<TransientBuffer>& buffer = transientVertexBuffers_[elementMask];
+    if (!buffer)
+    {
+        buffer = new TransientBuffer(context_);
+        buffer->SetVertexFormat(elementMask);
+    }
+    
+    return buffer;
+}
+
+TransientBuffer* Renderer::GetTransientIndexBuffer(bool largeIndices)
+{
+    SharedPtr<TransientBuffer>& buffer = transientIndexBuffers_[largeIndices ? 1 : 0];
+    if (!buffer)
+    {
+        buffer = new TransientBuffer(context_);
+        buffer->SetIndexFormat(largeIndices);
+    }
+    
+    return buffer;
+}
+
 OcclusionBuffer* Renderer::GetOcclusionBuffer(Camera* camera)
 {
+    // Views of different scenes may request occlusion buffers from worker threads
+    MutexLock lock(rendererMutex_);
+    
     assert(numOcclusionBuffers_ <= occlusionBuffers_.Size());
     if (numOcclusionBuffers_ == occlusionBuffers_.Size())
     {
@@ -1366,6 +1482,195 @@ void Renderer::PrepareViewRender()
     lightStencilValue_ = 1;
 }
 
+void Renderer::PrepareViews(unsigned start)
+{
+    queryViews_.Clear();
+    sharedQueryViews_.Clear();
+    
+    for (unsigned i = start; i < queuedViewports_.Size(); ++i)
+    {
+        WeakPtr<RenderSurface>& renderTarget = queuedViewports_[i].first_;
+        WeakPtr<Viewport>& viewport = queuedViewports_[i].second_;
+        
+        if ((renderTarget.NotNull() && renderTarget.Expired()) || viewport.Expired())
+            continue;
+        
+        // (Re)allocate the view structure if necessary
+        if (!viewport->GetView() || resetViews_)
+            viewport->AllocateView();
+        
+        View* view = viewport->GetView();
+        assert(view);
+        // Check if view can be defined successfully (has either valid scene, camera and octree, or no scene passes)
+        if (!view->Define(renderTarget, viewport))
+            continue;
+        
+        views_.Push(WeakPtr<View>(view));
+        
+        const IntRect& viewRect = viewport->GetRect();
+        Scene* scene = viewport->GetScene();
+        if (!scene)
+            continue;
+        
+        updateViews_.Push(view);
+        
+        Octree* octree = scene->GetComponent<Octree>();
+        
+        // Update octree (perform early update for drawables which need that, and reinsert moved drawables.)
+        // However, if the same scene is viewed from multiple cameras, update the octree only once
+        if (!updatedOctrees_.Contains(octree))
+        {
+            frame_.camera_ = viewport->GetCamera();
+            frame_.viewSize_ = viewRect.Size();
+            if (frame_.viewSize_ == IntVector2::ZERO)
+                frame_.viewSize_ = IntVector2(graphics_->GetWidth(), graphics_->GetHeight());
+            octree->Update(frame_);
+            updatedOctrees_.Insert(octree);
+            
+            // Set also the view for the debug renderer already here, so that it can use culling
+            /// \todo May result in incorrect debug geometry culling if the same scene is drawn from multiple viewports
+            DebugRenderer* debug = scene->GetComponent<DebugRenderer>();
+            if (debug)
+                debug->SetView(viewport->GetCamera());
+        }
+        
+        if (!view->GetOctree() || !view->GetCamera())
+            continue;
+        
+        // If the same camera is already used by a preceding view, share its query results if the view size matches.
+        // Otherwise the camera's aspect ratio may differ, so leave the query to be performed during the view update
+        View* sourceView = 0;
+        bool cameraInUse = false;
+        for (unsigned j = 0; j < queryViews_.Size(); ++j)
+        {
+            View* queryView = queryViews_[j];
+            if (queryView->GetCamera() == view->GetCamera())
+            {
+                cameraInUse = true;
+                if (queryView->GetOctree() == view->GetOctree() && queryView->GetViewSize() == view->GetViewSize())
+                    sourceView = queryView;
+                break;
+            }
+        }
+        
+        if (sourceView)
+            sharedQueryViews_.Push(MakePair(view, sourceView));
+        else if (!cameraInUse)
+        {
+            view->PrepareQuery(frame_);
+            queryViews_.Push(view);
+        }
+    }
+    
+    if (queryViews_.Empty())
+        return;
+    
+    PROFILE(QueryViewDrawables);
+    
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    for (unsigned i = 0; i < queryViews_.Size(); ++i)
+    {
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = QueryDrawablesWork;
+        item->aux_ = queryViews_[i];
+        queue->AddWorkItem(item);
+    }
+    queue->Complete(M_MAX_UNSIGNED);
+    
+    for (unsigned i = 0; i < sharedQueryViews_.Size(); ++i)
+        sharedQueryViews_[i].first_->ShareQuery(sharedQueryViews_[i].second_);
+}
+
+void Renderer::UpdateViews()
+{
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    
+    unsigned i = 0;
+    while (i < updateViews_.Size())
+    {
+        // Culling does not modify the drawables, so a contiguous group of views with distinct cameras, also of the same
+        // scene, is culled in parallel
+        unsigned end = i + 1;
+        while (end < updateViews_.Size())
+        {
+            View* view = updateViews_[end];
+            if (!view->GetOctree() || !view->GetCamera())
+                break;
+            bool conflict = false;
+            for (unsigned j = i; j < end; ++j)
+            {
+                if (updateViews_[j]->GetCamera() == view->GetCamera())
+                {
+                    conflict = true;
+                    break;
+                }
+            }
+            if (conflict)
+                break;
+            ++end;
+        }
+        
+        if (end - i > 1 && queue->GetNumThreads())
+        {
+            PROFILE(UpdateViewsThreaded);
+            
+            for (unsigned j = i; j < end; ++j)
+            {
+                SharedPtr<WorkItem> item = queue->GetFreeItem();
+                item->priority_ = M_MAX_UNSIGNED;
+                item->workFunction_ = UpdateViewWork;
+                item->start_ = &frame_;
+                item->aux_ = updateViews_[j];
+                queue->AddWorkItem(item);
+            }
+            queue->Complete(M_MAX_UNSIGNED);
+        }
+        else
+        {
+            for (unsigned j = i; j < end; ++j)
+                updateViews_[j]->BeginUpdate(frame_);
+        }
+        
+        // Update the visible drawables, lights and batches in order on the main thread, as the drawables hold per-view
+        // state, and the batches allocate shadow maps and load shaders. This may queue further views
+        for (unsigned j = i; j < end; ++j)
+        {
+            View* view = updateViews_[j];
+            RenderSurface* renderTarget = view->GetRenderTarget();
+            
+            {
+                // Send the begin event right before the view's drawables are updated, as its handlers may write
+                // per-view geometry
+                using namespace BeginViewUpdate;
+                
+                VariantMap& eventData = GetEventDataMap();
+                eventData[P_SURFACE] = renderTarget;
+                eventData[P_TEXTURE] = (renderTarget ? renderTarget->GetParentTexture() : 0);
+                eventData[P_SCENE] = view->GetScene();
+                eventData[P_CAMERA] = view->GetCamera();
+                SendEvent(E_BEGINVIEWUPDATE, eventData);
+            }
+            
+            ResetShadowMapAllocations(); // Each view can reuse the same shadow maps
+            view->EndUpdate();
+            
+            using namespace EndViewUpdate;
+            
+            VariantMap& eventData = GetEventDataMap();
+            eventData[P_SURFACE] = renderTarget;
+            eventData[P_TEXTURE] = (renderTarget ? renderTarget->GetParentTexture() : 0);
+            eventData[P_SCENE] = view->GetScene();
+            eventData[P_CAMERA] = view->GetCamera();
+            SendEvent(E_ENDVIEWUPDATE, eventData);
+        }
+        
+        i = end;
+    }
+    
+    updateViews_.Clear();
+}
+
 void Renderer::RemoveUnusedBuffers()
 {
     for (unsigned i = occlusionBuffers_.Size() - 1; i < occlusionBuffers_.Size(); --i)
@@ -1437,6 +1742,11 @@ void Renderer::Initialize()
     CreateGeometries();
     CreateInstancingBuffer();
     
+    // Create the transient buffers that billboards allocate from, as they may first need them in a worker thread
+    GetTransientVertexBuffer(MASK_BILLBOARD);
+    GetTransientIndexBuffer(false);
+    GetTransientIndexBuffer(true);
+    
     viewports_.Resize(1);
     ResetShadowMaps();
     ResetBuffers();
@@ -1717,6 +2027,7 @@ void Renderer::ResetShadowMaps()
     shadowMaps_.Clear();
     shadowMapAllocations_.Clear();
     colorShadowMaps_.Clear();
+    shadowAtlasTexture_.Reset();
 }
 
 void Renderer::ResetBuffers()
@@ -47,6 +47,7 @@ class Skeleton;
 class OcclusionBuffer;
 class Texture2D;
 class TextureCube;
+class TransientBuffer;
 class View;
 class Zone;
 
@@ -187,6 +188,10 @@ public:
     void SetReuseShadowMaps(bool enable);
     /// Set maximum number of shadow maps created for one resolution. Only has effect if reuse of shadow maps is disabled.
     void SetMaxShadowMaps(int shadowMaps);
+    /// Set shadow map atlas on/off. When on, the shadow maps of directional and spot lights are packed into one atlas texture, with each light's resolution chosen by its screen size. Point lights still use their own shadow maps. Default off.
+    void SetShadowAtlas(bool enable);
+    /// Set shadow map atlas resolution. Default 4096.
+    void SetShadowAtlasSize(int size);
     /// Set dynamic instancing on/off.
     void SetDynamicInstancing(bool enable);
     /// Set minimum number of instances required in a batch group to render as instanced.
@@ -201,6 +206,10 @@ public:
     void SetOcclusionBufferSize(int size);
     /// Set required screen size (1.0 = full screen) for occluders.
     void SetOccluderSizeThreshold(float screenSize);
+    /// Set clustered light assignment on/off. When on, unshadowed point and spot lights are assigned to drawables through a view-space light grid instead of per-light octree queries.
+    void SetClusteredLighting(bool enable);
+    /// Set retained batches on/off. When on, views reuse the previous frame's batch queues if the camera, visible objects and their batch state are unchanged and no shadowed lights are visible.
+    void SetRetainedBatches(bool enable);
     /// Set shadow depth bias multiplier for mobile platforms (OpenGL ES.) No effect on desktops. Default 2.
     void SetMobileShadowBiasMul(float mul);
     /// Set shadow depth bias addition for mobile platforms (OpenGL ES.)  No effect on desktops. Default 0.0001.
@@ -236,6 +245,10 @@ public:
     bool GetReuseShadowMaps() const { return reuseShadowMaps_; }
     /// Return maximum number of shadow maps per resolution.
     int GetMaxShadowMaps() const { return maxShadowMaps_; }
+    /// Return whether the shadow map atlas is in use.
+    bool GetShadowAtlas() const { return shadowAtlas_; }
+    /// Return shadow map atlas resolution.
+    int GetShadowAtlasSize() const { return shadowAtlasSize_; }
     /// Return whether dynamic instancing is in use.
     bool GetDynamicInstancing() const { return dynamicInstancing_; }
     /// Return minimum number of instances required in a batch group to render as instanced.
@@ -250,6 +263,10 @@ public:
     int GetOcclusionBufferSize() const { return occlusionBufferSize_; }
     /// Return occluder screen size threshold.
     float GetOccluderSizeThreshold() const { return occluderSizeThreshold_; }
+    /// Return whether clustered light assignment is in use.
+    bool GetClusteredLighting() const { return clusteredLighting_; }
+    /// Return whether retained batches are in use.
+    bool GetRetainedBatches() const { return retainedBatches_; }
     /// Return shadow depth bias multiplier for mobile platforms.
     float GetMobileShadowBiasMul() const { return mobileShadowBiasMul_; }
     /// Return shadow depth bias addition for mobile platforms.
@@ -268,6 +285,10 @@ public:
     unsigned GetNumShadowMaps(bool allViews = false) const;
     /// Return number of occluders rendered.
     unsigned GetNumOccluders(bool allViews = false) const;
+    /// Return bytes of transient vertex and index data uploaded on the current frame.
+    unsigned GetTransientBytesUploaded() const;
+    /// Return number of transient buffer reallocations since startup.
+    unsigned GetNumTransientReallocations() const;
     /// Return the default zone.
     Zone* GetDefaultZone() const { return defaultZone_; }
     /// Return the default material.
@@ -284,6 +305,8 @@ public:
     VertexBuffer* GetInstancingBuffer() const { return dynamicInstancing_ ? instancingBuffer_ : (VertexBuffer*)0; }
     /// Return the frame update parameters.
     const FrameInfo& GetFrameInfo() const { return frame_; }
+    /// Return the frame number on which shaders last changed.
+    unsigned GetShadersChangedFrameNumber() const { return shadersChangedFrameNumber_; }
     
     /// Update for rendering. Called by HandleRenderUpdate().
     void Update(float timeStep);
@@ -302,12 +325,20 @@ public:
     Geometry* GetQuadGeometry();
     /// Allocate a shadow map. If shadow map reuse is disabled, a different map is returned each time.
     Texture2D* GetShadowMap(Light* light, Camera* camera, unsigned viewWidth, unsigned viewHeight);
+    /// Allocate the shadow map atlas if not allocated yet and return it. Return null if the atlas is not in use or could not be created.
+    Texture2D* GetShadowAtlasTexture();
+    /// Return the desired shadow map size of a light in pixels, reduced by the light's screen size when auto size is enabled.
+    float GetShadowMapPixels(Light* light, Camera* camera, unsigned viewWidth, unsigned viewHeight) const;
     /// Allocate a rendertarget or depth-stencil texture for deferred rendering or postprocessing. Should only be called during actual rendering, not before.
     Texture2D* GetScreenBuffer(int width, int height, unsigned format, bool filtered, bool srgb, unsigned persistentKey = 0);
     /// Allocate a depth-stencil surface that does not need to be readable. Should only be called during actual rendering, not before.
     RenderSurface* GetDepthStencil(int width, int height);
     /// Allocate an occlusion buffer.
     OcclusionBuffer* GetOcclusionBuffer(Camera* camera);
+    /// Return the shared transient vertex buffer for a vertex format, creating it if necessary. Should be called from the main thread unless the buffer already exists, but allocation from it is thread-safe.
+    TransientBuffer* GetTransientVertexBuffer(unsigned elementMask);
+    /// Return the shared transient index buffer for 16-bit or 32-bit indices, creating it if necessary. Should be called from the main thread unless the buffer already exists, but allocation from it is thread-safe.
+    TransientBuffer* GetTransientIndexBuffer(bool largeIndices);
     /// Allocate a temporary shadow camera and a scene node for it. Is thread-safe.
     Camera* GetShadowCamera();
     /// Choose shaders for a forward rendering batch.
@@ -348,12 +379,18 @@ private:
     void SetIndirectionTextureData();
     /// Prepare for rendering of a new view.
     void PrepareViewRender();
+    /// Define queued views starting from index, update their octrees and perform their octree queries in parallel.
+    void PrepareViews(unsigned start);
+    /// Update the prepared scene views. Views with different cameras are culled in parallel, while their drawables and batches are updated in order.
+    void UpdateViews();
     /// Remove unused occlusion and screen buffers.
     void RemoveUnusedBuffers();
     /// Reset shadow map allocation counts.
     void ResetShadowMapAllocations();
     /// Reset screem buffer allocation counts.
     void ResetScreenBufferAllocations();
+    /// Create a shadow map texture. Return null if failed.
+    SharedPtr<Texture2D> CreateShadowMap(int width, int height);
     /// Remove all shadow maps. Called when global shadow map resolution or format is changed.
     void ResetShadowMaps();
     /// Remove all occlusion and screen buffers.
@@ -399,6 +436,12 @@ private:
     HashMap<int, SharedPtr<Texture2D> > colorShadowMaps_;
     /// Shadow map allocations by resolution.
     HashMap<int, PODVector<Light*> > shadowMapAllocations_;
+    /// Shadow map atlas.
+    SharedPtr<Texture2D> shadowAtlasTexture_;
+    /// Transient vertex buffers by vertex element mask.
+    HashMap<unsigned, SharedPtr<TransientBuffer> > transientVertexBuffers_;
+    /// Transient index buffers for 16-bit and 32-bit indices.
+    SharedPtr<TransientBuffer> transientIndexBuffers_[2];
     /// Screen buffers by resolution and format.
     HashMap<long long, Vector<SharedPtr<Texture2D> > > screenBuffers_;
     /// Current screen buffer allocations by resolution and format.
@@ -415,6 +458,12 @@ private:
     Vector<WeakPtr<View> > views_;
     /// Octrees that have been updated during the frame.
     HashSet<Octree*> updatedOctrees_;
+    /// Views whose octree queries are performed in parallel.
+    PODVector<View*> queryViews_;
+    /// Views which share the octree query results of a preceding view.
+    PODVector<Pair<View*, View*> > sharedQueryViews_;
+    /// Scene views to update after preparing.
+    PODVector<View*> updateViews_;
     /// Techniques for which missing shader error has been displayed.
     HashSet<Technique*> shaderErrorDisplayed_;
     /// Mutex for shadow camera allocation.
@@ -437,6 +486,8 @@ private:
     int shadowQuality_;
     /// Maximum number of shadow maps per resolution.
     int maxShadowMaps_;
+    /// Shadow map atlas resolution.
+    int shadowAtlasSize_;
     /// Minimum number of instances required in a batch group to render as instanced.
     int minInstances_;
     /// Maximum triangles per object for instancing.
@@ -473,8 +524,14 @@ private:
     bool drawShadows_;
     /// Shadow map reuse flag.
     bool reuseShadowMaps_;
+    /// Shadow map atlas flag.
+    bool shadowAtlas_;
     /// Dynamic instancing flag.
     bool dynamicInstancing_;
+    /// Clustered light assignment flag.
+    bool clusteredLighting_;
+    /// Retained batches flag.
+    bool retainedBatches_;
     /// Shaders need reloading flag.
     bool shadersDirty_;
     /// Initialized flag.
@@ -0,0 +1,190 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Precompiled.h"
+#include "AreaAllocator.h"
+#include "Light.h"
+#include "MathDefs.h"
+#include "ShadowAtlas.h"
+
+#include "DebugNew.h"
+
+namespace Urho3D
+{
+
+static const int DEFAULT_MIN_SPLIT_SIZE = 64;
+/// Ratio of the desired size to the current split size below which a light's split is halved. Lower than 0.5 to avoid a light switching back and forth between two sizes.
+static const float SHRINK_THRESHOLD = 0.4f;
+
+ShadowAtlas::ShadowAtlas() :
+    width_(0),
+    height_(0),
+    minSplitSize_(DEFAULT_MIN_SPLIT_SIZE),
+    packingReused_(false)
+{
+}
+
+void ShadowAtlas::SetSize(int width, int height)
+{
+    if (width == width_ && height == height_)
+        return;
+    
+    width_ = Max(width, 0);
+    height_ = Max(height, 0);
+    splitSizes_.Clear();
+    areas_.Clear();
+    packedLights_.Clear();
+    packedSizes_.Clear();
+}
+
+void ShadowAtlas::SetMinSplitSize(int size)
+{
+    minSplitSize_ = Max(size, 1);
+}
+
+void ShadowAtlas::Allocate(const PODVector<ShadowAtlasRequest>& requests)
+{
+    PODVector<int> splitSizes(requests.Size());
+    
+    // Choose the power of two split sizes. When a light's desired size shrinks only slightly, keep its current size
+    for (unsigned i = 0; i < requests.Size(); ++i)
+    {
+        const ShadowAtlasRequest& request = requests[i];
+        int maxSplitSize = Min(width_ / Max(request.splitsX_, 1), height_ / Max(request.splitsY_, 1));
+        int size = (int)NextPowerOfTwo((unsigned)Max((int)request.size_, 1));
+        
+        HashMap<Light*, int>::ConstIterator j = splitSizes_.Find(request.light_);
+        if (j != splitSizes_.End() && size < j->second_ && request.size_ > SHRINK_THRESHOLD * (float)j->second_)
+            size = j->second_;
+        
+        while (size > maxSplitSize && size > 1)
+            size >>= 1;
+        splitSizes[i] = Max(size, Min(minSplitSize_, maxSplitSize));
+    }
+    
+    // If the total area exceeds the atlas, halve the light which has the most pixels in relation to its importance. This
+    // reduces all lights in proportion to their importance, and the less important lights first
+    long long atlasArea = (long long)width_ * height_;
+    for (;;)
+    {
+        long long totalArea = 0;
+        for (unsigned i = 0; i < requests.Size(); ++i)
+            totalArea += (long long)requests[i].splitsX_ * requests[i].splitsY_ * splitSizes[i] * splitSizes[i];
+        if (totalArea <= atlasArea)
+            break;
+        
+        unsigned reduceIndex = M_MAX_UNSIGNED;
+        float maxRatio = 0.0f;
+        for (unsigned i = 0; i < requests.Size(); ++i)
+        {
+            if (splitSizes[i] <= minSplitSize_)
+                continue;
+            
+            float ratio = (float)splitSizes[i] / Max(requests[i].size_, 1.0f);
+            if (reduceIndex == M_MAX_UNSIGNED || ratio > maxRatio || (ratio == maxRatio && requests[i].size_ <
+                requests[reduceIndex].size_))
+            {
+                reduceIndex = i;
+                maxRatio = ratio;
+            }
+        }
+        if (reduceIndex == M_MAX_UNSIGNED)
+            break;
+        
+        splitSizes[reduceIndex] >>= 1;
+    }
+    
+    // Pack larger areas first. Order equal areas by light, so that the packing does not depend on the request order
+    PODVector<unsigned> order(requests.Size());
+    for (unsigned i = 0; i < order.Size(); ++i)
+        order[i] = i;
+    for (unsigned i = 1; i < order.Size(); ++i)
+    {
+        unsigned index = order[i];
+        long long area = (long long)requests[index].splitsX_ * requests[index].splitsY_ * splitSizes[index] * splitSizes[index];
+        unsigned j = i;
+        while (j > 0)
+        {
+            unsigned prev = order[j - 1];
+            long long prevArea = (long long)requests[prev].splitsX_ * requests[prev].splitsY_ * splitSizes[prev] *
+                splitSizes[prev];
+            if (prevArea > area || (prevArea == area && requests[prev].light_ <= requests[index].light_))
+                break;
+            order[j] = prev;
+            --j;
+        }
+        order[j] = index;
+    }
+    
+    // If the lights and their sizes are unchanged, keep the previous packing
+    packingReused_ = packedLights_.Size() == order.Size();
+    for (unsigned i = 0; i < order.Size() && packingReused_; ++i)
+    {
+        const ShadowAtlasRequest& request = requests[order[i]];
+        int splitSize = splitSizes[order[i]];
+        if (packedLights_[i] != request.light_ || packedSizes_[i] != IntVector2(request.splitsX_ * splitSize,
+            request.splitsY_ * splitSize))
+            packingReused_ = false;
+    }
+    if (packingReused_)
+        return;
+    
+    AreaAllocator allocator;
+    allocator.Reset(width_, height_, 0, 0, false);
+    splitSizes_.Clear();
+    areas_.Clear();
+    packedLights_.Resize(order.Size());
+    packedSizes_.Resize(order.Size());
+    
+    for (unsigned i = 0; i < order.Size(); ++i)
+    {
+        const ShadowAtlasRequest& request = requests[order[i]];
+        int splitSize = splitSizes[order[i]];
+        packedLights_[i] = request.light_;
+        packedSizes_[i] = IntVector2(request.splitsX_ * splitSize, request.splitsY_ * splitSize);
+        
+        // If the area does not fit due to fragmentation, retry with smaller sizes
+        for (;;)
+        {
+            int x, y;
+            int width = request.splitsX_ * splitSize;
+            int height = request.splitsY_ * splitSize;
+            if (allocator.Allocate(width, height, x, y))
+            {
+                splitSizes_[request.light_] = splitSize;
+                areas_[request.light_] = IntRect(x, y, x + width, y + height);
+                break;
+            }
+            if (splitSize <= minSplitSize_)
+                break;
+            splitSize >>= 1;
+        }
+    }
+}
+
+IntRect ShadowAtlas::GetArea(Light* light) const
+{
+    HashMap<Light*, IntRect>::ConstIterator i = areas_.Find(light);
+    return i != areas_.End() ? i->second_ : IntRect::ZERO;
+}
+
+}
@@ -0,0 +1,104 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "HashMap.h"
+#include "Rect.h"
+
+namespace Urho3D
+{
+
+class Light;
+
+/// Shadow atlas space request of one light.
+struct ShadowAtlasRequest
+{
+    /// Construct undefined.
+    ShadowAtlasRequest()
+    {
+    }
+    
+    /// Construct with values.
+    ShadowAtlasRequest(Light* light, float size, int splitsX, int splitsY) :
+        light_(light),
+        size_(size),
+        splitsX_(splitsX),
+        splitsY_(splitsY)
+    {
+    }
+    
+    /// Light. Is only used as a key and never dereferenced.
+    Light* light_;
+    /// Desired size of one shadow split in pixels, chosen from the light's screen-space size. Is also used as the light's importance.
+    float size_;
+    /// Number of shadow splits horizontally.
+    int splitsX_;
+    /// Number of shadow splits vertically.
+    int splitsY_;
+};
+
+/// Packs the shadow maps of several lights into one atlas texture. Lights are sized by their importance, and the less important lights are downscaled first when the atlas runs out of space. The packing is kept unchanged from frame to frame while the requests do not change. Does not depend on the graphics subsystem.
+class URHO3D_API ShadowAtlas
+{
+public:
+    /// Construct.
+    ShadowAtlas();
+    
+    /// Set atlas size. Resets the packing if changed.
+    void SetSize(int width, int height);
+    /// Set minimum shadow split size. Lights that do not fit into the atlas even with the minimum size are left without an area.
+    void SetMinSplitSize(int size);
+    /// Allocate atlas areas for the requests of one frame.
+    void Allocate(const PODVector<ShadowAtlasRequest>& requests);
+    
+    /// Return atlas width.
+    int GetWidth() const { return width_; }
+    /// Return atlas height.
+    int GetHeight() const { return height_; }
+    /// Return minimum shadow split size.
+    int GetMinSplitSize() const { return minSplitSize_; }
+    /// Return the allocated area of a light, or an empty rect if the light did not fit.
+    IntRect GetArea(Light* light) const;
+    /// Return whether the previous packing was reused on the latest allocation.
+    bool IsPackingReused() const { return packingReused_; }
+    
+private:
+    /// Allocated split sizes of the lights on the latest allocation.
+    HashMap<Light*, int> splitSizes_;
+    /// Allocated areas of the lights on the latest allocation.
+    HashMap<Light*, IntRect> areas_;
+    /// Lights of the latest packing in packing order.
+    PODVector<Light*> packedLights_;
+    /// Requested area sizes of the latest packing in packing order.
+    PODVector<IntVector2> packedSizes_;
+    /// Atlas width.
+    int width_;
+    /// Atlas height.
+    int height_;
+    /// Minimum shadow split size.
+    int minSplitSize_;
+    /// Previous packing reused flag.
+    bool packingReused_;
+};
+
+}
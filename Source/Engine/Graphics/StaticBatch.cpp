@@ -0,0 +1,635 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Precompiled.h"
+#include "Camera.h"
+#include "Context.h"
+#include "Geometry.h"
+#include "GeometryMerger.h"
+#include "Material.h"
+#include "Model.h"
+#include "OctreeQuery.h"
+#include "Profiler.h"
+#include "Scene.h"
+#include "SceneEvents.h"
+#include "Sort.h"
+#include "StaticBatch.h"
+
+#include "DebugNew.h"
+
+namespace Urho3D
+{
+
+extern const char* GEOMETRY_CATEGORY;
+
+/// Source model gathered for building a static batch.
+struct StaticBatchMember
+{
+    /// Source model.
+    StaticModel* model_;
+    /// Transform into the batch node's space.
+    Matrix3x4 transform_;
+    /// Bounding box in the batch node's space.
+    BoundingBox boundingBox_;
+    /// Culling cell index.
+    unsigned cell_;
+};
+
+/// Grouping key of the static models batched together by CreateBatches().
+struct StaticBatchKey
+{
+    /// Construct undefined.
+    StaticBatchKey()
+    {
+    }
+
+    /// Construct from a static model and its grid cell.
+    StaticBatchKey(StaticModel* model, int x, int y, int z) :
+        x_(x),
+        y_(y),
+        z_(z),
+        viewMask_(model->GetViewMask()),
+        lightMask_(model->GetLightMask()),
+        shadowMask_(model->GetShadowMask()),
+        zoneMask_(model->GetZoneMask()),
+        drawDistance_(model->GetDrawDistance()),
+        shadowDistance_(model->GetShadowDistance()),
+        castShadows_(model->GetCastShadows())
+    {
+    }
+
+    /// Test for equality with another key.
+    bool operator == (const StaticBatchKey& rhs) const
+    {
+        return x_ == rhs.x_ && y_ == rhs.y_ && z_ == rhs.z_ && viewMask_ == rhs.viewMask_ && lightMask_ == rhs.lightMask_ &&
+            shadowMask_ == rhs.shadowMask_ && zoneMask_ == rhs.zoneMask_ && drawDistance_ == rhs.drawDistance_ &&
+            shadowDistance_ == rhs.shadowDistance_ && castShadows_ == rhs.castShadows_;
+    }
+
+    /// Return hash value for HashSet & HashMap.
+    unsigned ToHash() const
+    {
+        unsigned hash = (unsigned)x_ * 73856093 ^ (unsigned)y_ * 19349663 ^ (unsigned)z_ * 83492791;
+        return hash ^ viewMask_ ^ (lightMask_ << 8) ^ (shadowMask_ << 16) ^ (zoneMask_ << 24) ^ (castShadows_ ? 1 : 0);
+    }
+
+    /// Grid cell X coordinate.
+    int x_;
+    /// Grid cell Y coordinate.
+    int y_;
+    /// Grid cell Z coordinate.
+    int z_;
+    /// View mask.
+    unsigned viewMask_;
+    /// Light mask.
+    unsigned lightMask_;
+    /// Shadow mask.
+    unsigned shadowMask_;
+    /// Zone mask.
+    unsigned zoneMask_;
+    /// Draw distance.
+    float drawDistance_;
+    /// Shadow distance.
+    float shadowDistance_;
+    /// Shadow casting flag.
+    bool castShadows_;
+};
+
+static bool CompareStaticBatchMembers(const StaticBatchMember& lhs, const StaticBatchMember& rhs)
+{
+    return lhs.cell_ < rhs.cell_;
+}
+
+StaticBatch::StaticBatch(Context* context) :
+    StaticModel(context),
+    nodeIDsDirty_(false),
+    membersDirty_(false)
+{
+    // Initialize the default node IDs attribute
+    UpdateNodeIDs();
+}
+
+StaticBatch::~StaticBatch()
+{
+    ReleaseMembers();
+}
+
+void StaticBatch::RegisterObject(Context* context)
+{
+    context->RegisterFactory<StaticBatch>(GEOMETRY_CATEGORY);
+
+    COPY_BASE_ATTRIBUTES(StaticModel);
+    // The batch geometry and its materials are rebuilt from the source models, so they are not serialized
+    REMOVE_ATTRIBUTE("Model");
+    REMOVE_ATTRIBUTE("Material");
+    ACCESSOR_ATTRIBUTE("Batch Nodes", GetNodeIDsAttr, SetNodeIDsAttr, VariantVector, Variant::emptyVariantVector, AM_DEFAULT | AM_NODEIDVECTOR);
+}
+
+void StaticBatch::ApplyAttributes()
+{
+    if (!nodeIDsDirty_)
+        return;
+
+    batchNodes_.Clear();
+
+    Scene* scene = GetScene();
+
+    if (scene)
+    {
+        // The first index stores the number of IDs redundantly. This is for editing
+        for (unsigned i = 1; i < nodeIDsAttr_.Size(); ++i)
+        {
+            Node* node = scene->GetNode(nodeIDsAttr_[i].GetUInt());
+            if (node)
+                batchNodes_.Push(WeakPtr<Node>(node));
+        }
+    }
+
+    nodeIDsDirty_ = false;
+    Build();
+}
+
+void StaticBatch::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQueryResult>& results)
+{
+    // Check ray hit distance to AABB before proceeding with the source model ranges
+    if (query.ray_.HitDistance(GetWorldBoundingBox()) >= query.maxDistance_)
+        return;
+
+    RayQueryLevel level = query.level_;
+    const Matrix3x4& worldTransform = node_->GetWorldTransform();
+    Ray localRay = query.ray_.Transformed(worldTransform.Inverse());
+
+    for (unsigned i = 0; i < ranges_.Size(); ++i)
+    {
+        const StaticBatchRange& range = ranges_[i];
+        StaticModel* member = range.member_;
+        if (!member || !(member->GetViewMask() & query.viewMask_))
+            continue;
+
+        float distance;
+        Vector3 normal = -query.ray_.direction_;
+
+        if (level == RAY_AABB)
+            distance = query.ray_.HitDistance(range.boundingBox_.Transformed(worldTransform));
+        else
+        {
+            distance = localRay.HitDistance(range.boundingBox_);
+
+            // Test only the source model's triangles in the batch geometry
+            if (level == RAY_TRIANGLE && distance < query.maxDistance_)
+            {
+                const unsigned char* vertexData;
+                unsigned vertexSize;
+                const unsigned char* indexData;
+                unsigned indexSize;
+                unsigned elementMask;
+
+                geometries_[range.geometryIndex_][0]->GetRawData(vertexData, vertexSize, indexData, indexSize, elementMask);
+                Vector3 geometryNormal;
+                distance = localRay.HitDistance(vertexData, vertexSize, indexData, indexSize, range.indexStart_, range.indexCount_,
+                    &geometryNormal);
+                if (distance < query.maxDistance_)
+                    normal = (worldTransform * Vector4(geometryNormal, 0.0f)).Normalized();
+            }
+        }
+
+        if (distance < query.maxDistance_)
+        {
+            RayQueryResult result;
+            result.position_ = query.ray_.origin_ + distance * query.ray_.direction_;
+            result.normal_ = normal;
+            result.distance_ = distance;
+            result.drawable_ = member;
+            result.node_ = member->GetNode();
+            result.subObject_ = M_MAX_UNSIGNED;
+            results.Push(result);
+        }
+    }
+}
+
+void StaticBatch::UpdateBatches(const FrameInfo& frame)
+{
+    StaticModel::UpdateBatches(frame);
+
+    // Draw the index span from the first to the last visible cell of each geometry. The cells are not frustum culled when
+    // casting shadows, as the same batches are rendered into the shadow maps
+    const Matrix3x4& worldTransform = node_->GetWorldTransform();
+    const Frustum& frustum = frame.camera_->GetFrustum();
+
+    for (unsigned i = 0; i < batches_.Size(); ++i)
+    {
+        const PODVector<StaticBatchCell>& geometryCells = cells_[i];
+        unsigned numCells = geometryCells.Size();
+        if (numCells < 2)
+            continue;
+
+        unsigned first = M_MAX_UNSIGNED;
+        unsigned last = 0;
+        for (unsigned j = 0; j < numCells; ++j)
+        {
+            const BoundingBox& box = geometryCells[j].boundingBox_;
+            if (drawDistance_ > 0.0f && frame.camera_->GetDistance(worldTransform * box.Center()) > drawDistance_)
+                continue;
+            if (!castShadows_ && frustum.IsInsideFast(box.Transformed(worldTransform)) == OUTSIDE)
+                continue;
+
+            if (first == M_MAX_UNSIGNED)
+                first = j;
+            last = j;
+        }
+
+        if (first == M_MAX_UNSIGNED)
+            batches_[i].numWorldTransforms_ = 0;
+        else
+        {
+            batches_[i].geometry_ = spanGeometries_[i][first * numCells + last];
+            batches_[i].numWorldTransforms_ = 1;
+        }
+    }
+}
+
+void StaticBatch::AddBatchNode(Node* node)
+{
+    if (!node)
+        return;
+
+    WeakPtr<Node> batchWeak(node);
+    if (batchNodes_.Contains(batchWeak))
+        return;
+
+    batchNodes_.Push(batchWeak);
+
+    UpdateNodeIDs();
+    Build();
+    MarkNetworkUpdate();
+}
+
+void StaticBatch::RemoveBatchNode(Node* node)
+{
+    if (!node)
+        return;
+
+    batchNodes_.Remove(WeakPtr<Node>(node));
+
+    UpdateNodeIDs();
+    Build();
+    MarkNetworkUpdate();
+}
+
+void StaticBatch::RemoveAllBatchNodes()
+{
+    batchNodes_.Clear();
+
+    UpdateNodeIDs();
+    Build();
+    MarkNetworkUpdate();
+}
+
+void StaticBatch::Build()
+{
+    PROFILE(BuildStaticBatch);
+
+    ReleaseMembers();
+
+    if (membersDirty_)
+    {
+        UnsubscribeFromEvent(E_SCENEDRAWABLEUPDATEFINISHED);
+        membersDirty_ = false;
+    }
+
+    Vector<GeometryMerger> mergers;
+    PODVector<unsigned> lastCells;
+
+    if (node_)
+    {
+        Matrix3x4 inverseWorldTransform = node_->GetWorldTransform().Inverse();
+        PODVector<StaticModel*> models;
+        PODVector<StaticBatchMember> batchMembers;
+        BoundingBox membersBox;
+
+        for (unsigned i = 0; i < batchNodes_.Size(); ++i)
+        {
+            Node* batchNode = batchNodes_[i];
+            if (!batchNode)
+                continue;
+
+            // Only exact StaticModels are gathered, as the subclasses do their own geometry processing
+            batchNode->GetComponents<StaticModel>(models);
+            Matrix3x4 transform = inverseWorldTransform * batchNode->GetWorldTransform();
+
+            for (unsigned j = 0; j < models.Size(); ++j)
+            {
+                StaticModel* member = models[j];
+                Model* model = member->GetModel();
+                // Models in an HLOD cluster are left to the cluster, as batching them too would render them twice
+                if (!model || !member->IsEnabledEffective() || (member->GetStaticBatch() && member->GetStaticBatch() != this) ||
+                    member->GetHLODCluster() || !IsCompatible(member))
+                    continue;
+
+                StaticBatchMember batchMember;
+                batchMember.model_ = member;
+                batchMember.transform_ = transform;
+                batchMember.boundingBox_ = model->GetBoundingBox().Transformed(transform);
+                batchMember.cell_ = 0;
+                batchMembers.Push(batchMember);
+                membersBox.Merge(batchMember.boundingBox_);
+            }
+        }
+
+        // Order the source models by the octant of the members' bounding box their center is in, so that each octant
+        // forms a contiguous index range in the batch geometries for culling
+        Vector3 cellCenter = membersBox.Center();
+        for (unsigned i = 0; i < batchMembers.Size(); ++i)
+        {
+            Vector3 center = batchMembers[i].boundingBox_.Center();
+            batchMembers[i].cell_ = (center.x_ > cellCenter.x_ ? 1 : 0) | (center.y_ > cellCenter.y_ ? 2 : 0) |
+                (center.z_ > cellCenter.z_ ? 4 : 0);
+        }
+        Sort(batchMembers.Begin(), batchMembers.End(), CompareStaticBatchMembers);
+
+        for (unsigned i = 0; i < batchMembers.Size(); ++i)
+        {
+            const StaticBatchMember& batchMember = batchMembers[i];
+            StaticModel* member = batchMember.model_;
+            Model* model = member->GetModel();
+            bool merged = false;
+
+            for (unsigned j = 0; j < model->GetNumGeometries(); ++j)
+            {
+                Geometry* geometry = model->GetGeometry(j, 0);
+                unsigned elementMask = GeometryMerger::GetMergedElementMask(geometry);
+                if (!elementMask)
+                    continue;
+
+                // Find or create the batch geometry for this material and vertex format
+                Material* material = member->GetMaterial(j);
+                unsigned mergerIndex = 0;
+                while (mergerIndex < mergers.Size() && (mergers[mergerIndex].GetMaterial() != material ||
+                    mergers[mergerIndex].GetElementMask() != elementMask))
+                    ++mergerIndex;
+                if (mergerIndex == mergers.Size())
+                {
+                    mergers.Push(GeometryMerger(material, elementMask));
+                    cells_.Resize(mergers.Size());
+                    lastCells.Push(M_MAX_UNSIGNED);
+                }
+
+                GeometryMerger& merger = mergers[mergerIndex];
+                unsigned indexStart = merger.GetIndexCount();
+                if (merger.Append(geometry, batchMember.transform_))
+                {
+                    // Remember the index range to map ray queries back to the source model
+                    StaticBatchRange range;
+                    range.member_ = member;
+                    range.geometryIndex_ = mergerIndex;
+                    range.indexStart_ = indexStart;
+                    range.indexCount_ = merger.GetIndexCount() - indexStart;
+                    range.boundingBox_ = batchMember.boundingBox_;
+                    ranges_.Push(range);
+                    merged = true;
+
+                    // Extend the current culling cell of the batch geometry, or start a new one
+                    PODVector<StaticBatchCell>& geometryCells = cells_[mergerIndex];
+                    if (lastCells[mergerIndex] != batchMember.cell_)
+                    {
+                        StaticBatchCell cell;
+                        cell.indexStart_ = indexStart;
+                        cell.indexCount_ = 0;
+                        geometryCells.Push(cell);
+                        lastCells[mergerIndex] = batchMember.cell_;
+                    }
+                    StaticBatchCell& cell = geometryCells.Back();
+                    cell.indexCount_ += range.indexCount_;
+                    cell.boundingBox_.Merge(range.boundingBox_);
+                }
+            }
+
+            if (merged)
+            {
+                member->SetStaticBatch(this);
+                members_.Push(WeakPtr<StaticModel>(member));
+            }
+        }
+    }
+
+    BoundingBox box;
+    SetNumGeometries(mergers.Size());
+    cells_.Resize(mergers.Size());
+    spanGeometries_.Resize(mergers.Size());
+
+    for (unsigned i = 0; i < mergers.Size(); ++i)
+    {
+        geometries_[i].Resize(1);
+        geometries_[i][0] = mergers[i].CreateGeometry(context_);
+        Geometry* geometry = geometries_[i][0];
+        geometryData_[i].center_ = mergers[i].GetBoundingBox().Center();
+        batches_[i].material_ = mergers[i].GetMaterial();
+        box.Merge(mergers[i].GetBoundingBox());
+
+        // Create the geometries for drawing a partial span of the cells. They share the vertex and index buffers
+        const PODVector<StaticBatchCell>& geometryCells = cells_[i];
+        unsigned numCells = geometryCells.Size();
+        Vector<SharedPtr<Geometry> >& spans = spanGeometries_[i];
+        spans.Resize(numCells * numCells);
+        if (!geometry)
+            continue;
+
+        for (unsigned first = 0; first < numCells; ++first)
+        {
+            for (unsigned last = first; last < numCells; ++last)
+            {
+                if (!first && last == numCells - 1)
+                {
+                    spans[first * numCells + last] = geometry;
+                    continue;
+                }
+
+                SharedPtr<Geometry> span(new Geometry(context_));
+                span->SetVertexBuffer(0, geometry->GetVertexBuffer(0), geometry->GetVertexElementMask(0));
+                span->SetIndexBuffer(geometry->GetIndexBuffer());
+                unsigned indexStart = geometryCells[first].indexStart_;
+                span->SetDrawRange(TRIANGLE_LIST, indexStart, geometryCells[last].indexStart_ + geometryCells[last].indexCount_ -
+                    indexStart);
+                spans[first * numCells + last] = span;
+            }
+        }
+    }
+
+    SetBoundingBox(box);
+    ResetLodLevels();
+}
+
+void StaticBatch::MarkMembersDirty()
+{
+    if (membersDirty_)
+        return;
+
+    membersDirty_ = true;
+
+    // Rebuild on the main thread after the octree's drawable update, before the views are updated
+    Scene* scene = GetScene();
+    if (scene)
+        SubscribeToEvent(scene, E_SCENEDRAWABLEUPDATEFINISHED, HANDLER(StaticBatch, HandleSceneDrawableUpdateFinished));
+}
+
+Node* StaticBatch::GetBatchNode(unsigned index) const
+{
+    return index < batchNodes_.Size() ? batchNodes_[index] : (Node*)0;
+}
+
+void StaticBatch::SetNodeIDsAttr(const VariantVector& value)
+{
+    // Just remember the node IDs. They need to go through the SceneResolver, and we actually find the nodes during
+    // ApplyAttributes()
+    if (value.Size())
+    {
+        nodeIDsAttr_.Clear();
+
+        unsigned index = 0;
+        unsigned numNodes = value[index++].GetUInt();
+        // Prevent crash on entering negative value in the editor
+        if (numNodes > M_MAX_INT)
+            numNodes = 0;
+
+        nodeIDsAttr_.Push(numNodes);
+        while (numNodes--)
+        {
+            // If vector contains less IDs than should, fill the rest with zeroes
+            if (index < value.Size())
+                nodeIDsAttr_.Push(value[index++].GetUInt());
+            else
+                nodeIDsAttr_.Push(0);
+        }
+    }
+    else
+    {
+        nodeIDsAttr_.Clear();
+        nodeIDsAttr_.Push(0);
+    }
+    nodeIDsDirty_ = true;
+}
+
+unsigned StaticBatch::CreateBatches(Node* root, float cellSize)
+{
+    if (!root || cellSize <= 0.0f)
+        return 0;
+
+    PODVector<StaticModel*> models;
+    root->GetComponents<StaticModel>(models, true);
+
+    // Bucket the model nodes by the grid cell of their world bounding box center, and by the rendering settings that the
+    // batch has only one of: shadow casting, masks and draw and shadow distances
+    HashMap<StaticBatchKey, PODVector<Node*> > groups;
+    for (unsigned i = 0; i < models.Size(); ++i)
+    {
+        StaticModel* model = models[i];
+        Node* node = model->GetNode();
+        if (!model->GetModel() || !model->IsEnabledEffective() || model->GetStaticBatch() || node == root)
+            continue;
+
+        Vector3 center = model->GetWorldBoundingBox().Center();
+        StaticBatchKey key(model, (int)floorf(center.x_ / cellSize), (int)floorf(center.y_ / cellSize), (int)floorf(center.z_ /
+            cellSize));
+        PODVector<Node*>& groupNodes = groups[key];
+        if (!groupNodes.Contains(node))
+            groupNodes.Push(node);
+    }
+
+    unsigned numBatches = 0;
+
+    for (HashMap<StaticBatchKey, PODVector<Node*> >::ConstIterator i = groups.Begin(); i != groups.End(); ++i)
+    {
+        const StaticBatchKey& key = i->first_;
+        const PODVector<Node*>& groupNodes = i->second_;
+        if (groupNodes.Size() < 2)
+            continue;
+
+        Node* batchNode = root->CreateChild("StaticBatch");
+        StaticBatch* batch = batchNode->CreateComponent<StaticBatch>();
+        batch->SetViewMask(key.viewMask_);
+        batch->SetLightMask(key.lightMask_);
+        batch->SetShadowMask(key.shadowMask_);
+        batch->SetZoneMask(key.zoneMask_);
+        batch->SetDrawDistance(key.drawDistance_);
+        batch->SetShadowDistance(key.shadowDistance_);
+        batch->SetCastShadows(key.castShadows_);
+
+        // Add the nodes directly to build the batch only once
+        for (unsigned j = 0; j < groupNodes.Size(); ++j)
+            batch->batchNodes_.Push(WeakPtr<Node>(groupNodes[j]));
+        batch->UpdateNodeIDs();
+        batch->Build();
+
+        // Occlude if any of the source models does
+        bool occluder = false;
+        for (unsigned j = 0; j < batch->members_.Size(); ++j)
+            occluder |= batch->members_[j]->IsOccluder();
+        batch->SetOccluder(occluder);
+
+        ++numBatches;
+    }
+
+    return numBatches;
+}
+
+void StaticBatch::UpdateNodeIDs()
+{
+    unsigned numNodes = batchNodes_.Size();
+
+    nodeIDsAttr_.Clear();
+    nodeIDsAttr_.Push(numNodes);
+
+    for (unsigned i = 0; i < numNodes; ++i)
+    {
+        Node* node = batchNodes_[i];
+        nodeIDsAttr_.Push(node ? node->GetID() : 0);
+    }
+}
+
+void StaticBatch::ReleaseMembers()
+{
+    for (unsigned i = 0; i < members_.Size(); ++i)
+    {
+        StaticModel* member = members_[i];
+        if (member && member->GetStaticBatch() == this)
+            member->SetStaticBatch(0);
+    }
+
+    members_.Clear();
+    ranges_.Clear();
+    cells_.Clear();
+    spanGeometries_.Clear();
+}
+
+bool StaticBatch::IsCompatible(StaticModel* model) const
+{
+    return model->GetViewMask() == viewMask_ && model->GetLightMask() == lightMask_ && model->GetShadowMask() == shadowMask_ &&
+        model->GetZoneMask() == zoneMask_ && model->GetDrawDistance() == drawDistance_ && model->GetShadowDistance() ==
+        shadowDistance_ && model->GetCastShadows() == castShadows_;
+}
+
+void StaticBatch::HandleSceneDrawableUpdateFinished(StringHash eventType, VariantMap& eventData)
+{
+    Build();
+}
+
+}
@@ -0,0 +1,134 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "StaticModel.h"
+
+namespace Urho3D
+{
+
+/// Index range of a source model in a static batch geometry.
+struct StaticBatchRange
+{
+    /// Source model.
+    WeakPtr<StaticModel> member_;
+    /// Batch geometry index.
+    unsigned geometryIndex_;
+    /// Index start.
+    unsigned indexStart_;
+    /// Index count.
+    unsigned indexCount_;
+    /// Bounding box in the batch node's space.
+    BoundingBox boundingBox_;
+};
+
+/// Culling cell of a static batch geometry. Holds the contiguous index range of the source models whose bounding box center is inside the cell.
+struct StaticBatchCell
+{
+    /// Index start.
+    unsigned indexStart_;
+    /// Index count.
+    unsigned indexCount_;
+    /// Bounding box of the source models in the batch node's space.
+    BoundingBox boundingBox_;
+};
+
+/// Renders the static models of several scene nodes merged by material into shared geometry buffers. The source models are kept out of the octree while batched and must not move. Only models whose masks, draw and shadow distances and shadow casting match the batch are merged, and disabling, removing or changing a model rebuilds the batch. Models in an HLOD cluster are not batched, and adding a batched model to a cluster removes it from the batch. Ray queries report the source models.
+class URHO3D_API StaticBatch : public StaticModel
+{
+    OBJECT(StaticBatch);
+
+public:
+    /// Construct.
+    StaticBatch(Context* context);
+    /// Destruct.
+    virtual ~StaticBatch();
+    /// Register object factory. StaticModel must be registered first.
+    static void RegisterObject(Context* context);
+
+    /// Apply attribute changes that can not be applied immediately. Called after scene load or a network update.
+    void ApplyAttributes();
+    /// Process octree raycast. May be called from a worker thread.
+    virtual void ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQueryResult>& results);
+    /// Calculate distance and prepare batches for rendering. Culls the cells of each batch geometry. May be called from worker thread(s), possibly re-entrantly.
+    virtual void UpdateBatches(const FrameInfo& frame);
+
+    /// Add a batched scene node. Its StaticModel components will be rendered by the batch.
+    void AddBatchNode(Node* node);
+    /// Remove a batched scene node.
+    void RemoveBatchNode(Node* node);
+    /// Remove all batched scene nodes.
+    void RemoveAllBatchNodes();
+    /// Rebuild the batch geometry from the source models. Is called automatically when the batched nodes change.
+    void Build();
+    /// Mark the source models changed, so that the batch is rebuilt before the next octree reinsertion. Called by the source models.
+    void MarkMembersDirty();
+
+    /// Return number of batched nodes.
+    unsigned GetNumBatchNodes() const { return batchNodes_.Size(); }
+    /// Return batched node by index.
+    Node* GetBatchNode(unsigned index) const;
+    /// Return number of source models rendered by the batch.
+    unsigned GetNumMembers() const { return members_.Size(); }
+    /// Return source model index ranges.
+    const Vector<StaticBatchRange>& GetRanges() const { return ranges_; }
+    /// Return culling cells of a batch geometry.
+    const PODVector<StaticBatchCell>& GetCells(unsigned index) const { return cells_[index]; }
+
+    /// Set node IDs attribute.
+    void SetNodeIDsAttr(const VariantVector& value);
+    /// Return node IDs attribute.
+    const VariantVector& GetNodeIDsAttr() const { return nodeIDsAttr_; }
+
+    /// Group the static models below a root node into a grid of the given cell size by shadow casting, masks and draw and shadow distances, and create a batch child node for each group with at least two models. Return number of batches created.
+    static unsigned CreateBatches(Node* root, float cellSize);
+
+private:
+    /// Update node IDs attribute.
+    void UpdateNodeIDs();
+    /// Return the source models to their own rendering.
+    void ReleaseMembers();
+    /// Return whether a source model's rendering settings match the batch.
+    bool IsCompatible(StaticModel* model) const;
+    /// Handle the scene's drawable update having finished. Rebuild the batch if the source models changed.
+    void HandleSceneDrawableUpdateFinished(StringHash eventType, VariantMap& eventData);
+
+    /// Batched nodes.
+    Vector<WeakPtr<Node> > batchNodes_;
+    /// Source models rendered by the batch.
+    Vector<WeakPtr<StaticModel> > members_;
+    /// Source model index ranges.
+    Vector<StaticBatchRange> ranges_;
+    /// Culling cells of each batch geometry, in index order.
+    Vector<PODVector<StaticBatchCell> > cells_;
+    /// Geometries drawing the index span from the first to the last visible cell of each batch geometry, indexed by first * number of cells + last.
+    Vector<Vector<SharedPtr<Geometry> > > spanGeometries_;
+    /// IDs of batched nodes for serialization.
+    mutable VariantVector nodeIDsAttr_;
+    /// Whether node IDs have been set and nodes should be searched for during ApplyAttributes.
+    bool nodeIDsDirty_;
+    /// Whether the source models have changed and the batch should be rebuilt.
+    bool membersDirty_;
+};
+
+}
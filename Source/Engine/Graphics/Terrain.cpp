@@ -37,6 +37,7 @@
 #include "Terrain.h"
 #include "TerrainPatch.h"
 #include "VertexBuffer.h"
+#include "WorkQueue.h"
 
 #include "DebugNew.h"
 
@@ -54,6 +55,37 @@ static const unsigned STITCH_NORTH = 1;
 static const unsigned STITCH_SOUTH = 2;
 static const unsigned STITCH_WEST = 4;
 static const unsigned STITCH_EAST = 8;
+static const unsigned PATCH_VERTEX_FLOATS = 12;
+
+/// Patch rebuild data for a terrain region update.
+struct TerrainPatchUpdate
+{
+    /// Patch.
+    TerrainPatch* patch_;
+    /// Vertex data destination.
+    float* vertexData_;
+    /// CPU-side positions.
+    SharedArrayPtr<unsigned char> positionData_;
+    /// Bounding box.
+    BoundingBox boundingBox_;
+    /// Whether LOD errors need recalculation.
+    bool lodErrors_;
+};
+
+void UpdateTerrainPatchesWork(const WorkItem* item, unsigned threadIndex)
+{
+    Terrain* terrain = reinterpret_cast<Terrain*>(item->aux_);
+    TerrainPatchUpdate* start = reinterpret_cast<TerrainPatchUpdate*>(item->start_);
+    TerrainPatchUpdate* end = reinterpret_cast<TerrainPatchUpdate*>(item->end_);
+
+    while (start != end)
+    {
+        terrain->GetPatchVertices(start->patch_, start->vertexData_, (float*)start->positionData_.Get(), start->boundingBox_);
+        if (start->lodErrors_)
+            terrain->CalculateLodErrors(start->patch_);
+        ++start;
+    }
+}
 
 Terrain::Terrain(Context* context) :
     Component(context),
@@ -333,6 +365,81 @@ void Terrain::ApplyHeightMap()
         CreateGeometry();
 }
 
+bool Terrain::SetHeights(const IntRect& rect, const float* heights)
+{
+    if (!heightData_ || !node_)
+    {
+        LOGERROR("No terrain height data, can not set heights");
+        return false;
+    }
+    if (!heights)
+    {
+        LOGERROR("Null source for terrain heights");
+        return false;
+    }
+    if (rect.left_ < 0 || rect.top_ < 0 || rect.right_ > numVertices_.x_ || rect.bottom_ > numVertices_.y_ || rect.left_ >=
+        rect.right_ || rect.top_ >= rect.bottom_)
+    {
+        LOGERROR("Illegal terrain height region " + rect.ToString());
+        return false;
+    }
+
+    PROFILE(SetTerrainHeights);
+
+    // When smoothing, the source data is modified and the smoothed heights change one vertex further out
+    IntRect heightRect = rect;
+    if (smoothing_)
+    {
+        heightRect = IntRect(Max(rect.left_ - 1, 0), Max(rect.top_ - 1, 0), Min(rect.right_ + 1, numVertices_.x_),
+            Min(rect.bottom_ + 1, numVertices_.y_));
+    }
+
+    float oldMinHeight, oldMaxHeight;
+    GetHeightRange(heightRect, oldMinHeight, oldMaxHeight);
+
+    float* dest = smoothing_ ? sourceHeightData_ : heightData_;
+    int width = rect.Width();
+    for (int z = rect.top_; z < rect.bottom_; ++z)
+    {
+        for (int x = rect.left_; x < rect.right_; ++x)
+            dest[z * numVertices_.x_ + x] = heights[(z - rect.top_) * width + x - rect.left_];
+    }
+
+    if (smoothing_)
+    {
+        for (int z = heightRect.top_; z < heightRect.bottom_; ++z)
+        {
+            for (int x = heightRect.left_; x < heightRect.right_; ++x)
+                heightData_[z * numVertices_.x_ + x] = GetSmoothedHeight(x, z);
+        }
+    }
+
+    // Normals depend on the neighboring heights, so the vertex data changes one vertex further out than the heights
+    IntRect vertexRect(Max(heightRect.left_ - 1, 0), Max(heightRect.top_ - 1, 0), Min(heightRect.right_ + 1, numVertices_.x_),
+        Min(heightRect.bottom_ + 1, numVertices_.y_));
+    UpdatePatches(vertexRect, heightRect);
+
+    float newMinHeight, newMaxHeight;
+    GetHeightRange(heightRect, newMinHeight, newMaxHeight);
+
+    // Notify of the change, for example to update the physics heightfield
+    BoundingBox box(Vector3(patchWorldOrigin_.x_ + (float)heightRect.left_ * spacing_.x_, Min(oldMinHeight, newMinHeight),
+        patchWorldOrigin_.y_ + (float)heightRect.top_ * spacing_.z_), Vector3(patchWorldOrigin_.x_ + (float)(heightRect.right_ - 1) *
+        spacing_.x_, Max(oldMaxHeight, newMaxHeight), patchWorldOrigin_.y_ + (float)(heightRect.bottom_ - 1) * spacing_.z_));
+    box = box.Transformed(node_->GetWorldTransform());
+
+    using namespace TerrainRegionUpdated;
+
+    VariantMap& eventData = GetEventDataMap();
+    eventData[P_NODE] = node_;
+    eventData[P_REGION] = heightRect;
+    eventData[P_MIN] = box.min_;
+    eventData[P_MAX] = box.max_;
+    node_->SendEvent(E_TERRAINREGIONUPDATED, eventData);
+
+    return true;
+}
+
 Image* Terrain::GetHeightMap() const
 {
     return heightMap_;
@@ -443,9 +550,6 @@ void Terrain::CreatePatchGeometry(TerrainPatch* patch)
 
     unsigned row = patchSize_ + 1;
     VertexBuffer* vertexBuffer = patch->GetVertexBuffer();
-    Geometry* geometry = patch->GetGeometry();
-    Geometry* maxLodGeometry = patch->GetMaxLodGeometry();
-    Geometry* minLodGeometry = patch->GetMinLodGeometry();
 
     if (vertexBuffer->GetVertexCount() != row * row)
         vertexBuffer->SetSize(row * row, MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1 | MASK_TANGENT);
@@ -453,75 +557,17 @@ void Terrain::CreatePatchGeometry(TerrainPatch* patch)
     SharedArrayPtr<unsigned char> cpuVertexData(new unsigned char[row * row * sizeof(Vector3)]);
 
     float* vertexData = (float*)vertexBuffer->Lock(0, vertexBuffer->GetVertexCount());
-    float* positionData = (float*)cpuVertexData.Get();
     BoundingBox box;
 
     if (vertexData)
     {
-        const IntVector2& coords = patch->GetCoordinates();
-
-        for (int z = 0; z <= patchSize_; ++z)
-        {
-            for (int x = 0; x <= patchSize_; ++x)
-            {
-                int xPos = coords.x_ * patchSize_ + x;
-                int zPos = coords.y_ * patchSize_ + z;
-
-                // Position
-                Vector3 position((float)x * spacing_.x_, GetRawHeight(xPos, zPos), (float)z * spacing_.z_);
-                *vertexData++ = position.x_;
-                *vertexData++ = position.y_;
-                *vertexData++ = position.z_;
-                *positionData++ = position.x_;
-                *positionData++ = position.y_;
-                *positionData++ = position.z_;
-
-                box.Merge(position);
-
-                // Normal
-                Vector3 normal = GetRawNormal(xPos, zPos);
-                *vertexData++ = normal.x_;
-                *vertexData++ = normal.y_;
-                *vertexData++ = normal.z_;
-
-                // Texture coordinate
-                Vector2 texCoord((float)xPos / (float)numVertices_.x_, 1.0f - (float)zPos / (float)numVertices_.y_);
-                *vertexData++ = texCoord.x_;
-                *vertexData++ = texCoord.y_;
-
-                // Tangent
-                Vector3 xyz = (Vector3::RIGHT - normal * normal.DotProduct(Vector3::RIGHT)).Normalized();
-                *vertexData++ = xyz.x_;
-                *vertexData++ = xyz.y_;
-                *vertexData++ = xyz.z_;
-                *vertexData++ = 1.0f;
-            }
-        }
+        GetPatchVertices(patch, vertexData, (float*)cpuVertexData.Get(), box);
 
         vertexBuffer->Unlock();
         vertexBuffer->ClearDataLost();
     }
 
-    patch->SetBoundingBox(box);
-
-    if (drawRanges_.Size())
-    {
-        unsigned lastDrawRange = drawRanges_.Size() - 1;
-
-        geometry->SetIndexBuffer(indexBuffer_);
-        geometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[0].first_, drawRanges_[0].second_, false);
-        geometry->SetRawVertexData(cpuVertexData, sizeof(Vector3), MASK_POSITION);
-        maxLodGeometry->SetIndexBuffer(indexBuffer_);
-        maxLodGeometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[0].first_, drawRanges_[0].second_, false);
-        maxLodGeometry->SetRawVertexData(cpuVertexData, sizeof(Vector3), MASK_POSITION);
-        minLodGeometry->SetIndexBuffer(indexBuffer_);
-        minLodGeometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[lastDrawRange].first_, drawRanges_[lastDrawRange].second_, false);
-        minLodGeometry->SetRawVertexData(cpuVertexData, sizeof(Vector3), MASK_POSITION);
-    }
-
-    // Offset the occlusion geometry by vertex spacing to reduce possibility of over-aggressive occlusion
-    patch->SetOcclusionOffset(-0.5f * (spacing_.x_ + spacing_.z_));
-    patch->ResetLod();
+    SetPatchGeometry(patch, cpuVertexData, box);
 }
 
 void Terrain::UpdatePatchLod(TerrainPatch* patch)
@@ -832,15 +878,7 @@ void Terrain::CreateGeometry()
                     for (int z = startZ; z <= endZ; ++z)
                     {
                         for (int x = startX; x <= endX; ++x)
-                        {
-                            float smoothedHeight = (
-                                GetSourceHeight(x - 1, z - 1) + GetSourceHeight(x, z - 1) * 2.0f + GetSourceHeight(x + 1, z - 1) +
-                                GetSourceHeight(x - 1, z) * 2.0f + GetSourceHeight(x, z) * 4.0f + GetSourceHeight(x + 1, z) * 2.0f +
-                                GetSourceHeight(x - 1, z + 1) + GetSourceHeight(x, z + 1) * 2.0f + GetSourceHeight(x + 1, z + 1)
-                            ) / 16.0f;
-
-                            heightData_[z * numVertices_.x_ + x] = smoothedHeight;
-                        }
+                            heightData_[z * numVertices_.x_ + x] = GetSmoothedHeight(x, z);
                     }
                 }
             }
@@ -853,6 +891,8 @@ void Terrain::CreateGeometry()
             if (dirtyPatches[i])
             {
                 CreatePatchGeometry(patch);
+
+                PROFILE(CalculateLodErrors);
                 CalculateLodErrors(patch);
             }
 
@@ -1051,6 +1091,15 @@ float Terrain::GetSourceHeight(int x, int z) const
     return sourceHeightData_[z * numVertices_.x_ + x];
 }
 
+float Terrain::GetSmoothedHeight(int x, int z) const
+{
+    return (
+        GetSourceHeight(x - 1, z - 1) + GetSourceHeight(x, z - 1) * 2.0f + GetSourceHeight(x + 1, z - 1) +
+        GetSourceHeight(x - 1, z) * 2.0f + GetSourceHeight(x, z) * 4.0f + GetSourceHeight(x + 1, z) * 2.0f +
+        GetSourceHeight(x - 1, z + 1) + GetSourceHeight(x, z + 1) * 2.0f + GetSourceHeight(x + 1, z + 1)
+    ) / 16.0f;
+}
+
 float Terrain::GetLodHeight(int x, int z, unsigned lodLevel) const
 {
     unsigned offset = 1 << lodLevel;
@@ -1102,8 +1151,6 @@ Vector3 Terrain::GetRawNormal(int x, int z) const
 
 void Terrain::CalculateLodErrors(TerrainPatch* patch)
 {
-    PROFILE(CalculateLodErrors);
-
     const IntVector2& coords = patch->GetCoordinates();
     PODVector<float>& lodErrors = patch->GetLodErrors();
     lodErrors.Clear();
@@ -1141,6 +1188,181 @@ void Terrain::CalculateLodErrors(TerrainPatch* patch)
     }
 }
 
+void Terrain::GetPatchVertices(TerrainPatch* patch, float* vertexData, float* positionData, BoundingBox& box) const
+{
+    const IntVector2& coords = patch->GetCoordinates();
+
+    for (int z = 0; z <= patchSize_; ++z)
+    {
+        for (int x = 0; x <= patchSize_; ++x)
+        {
+            int xPos = coords.x_ * patchSize_ + x;
+            int zPos = coords.y_ * patchSize_ + z;
+
+            // Position
+            Vector3 position((float)x * spacing_.x_, GetRawHeight(xPos, zPos), (float)z * spacing_.z_);
+            *vertexData++ = position.x_;
+            *vertexData++ = position.y_;
+            *vertexData++ = position.z_;
+            *positionData++ = position.x_;
+            *positionData++ = position.y_;
+            *positionData++ = position.z_;
+
+            box.Merge(position);
+
+            // Normal
+            Vector3 normal = GetRawNormal(xPos, zPos);
+            *vertexData++ = normal.x_;
+            *vertexData++ = normal.y_;
+            *vertexData++ = normal.z_;
+
+            // Texture coordinate
+            Vector2 texCoord((float)xPos / (float)numVertices_.x_, 1.0f - (float)zPos / (float)numVertices_.y_);
+            *vertexData++ = texCoord.x_;
+            *vertexData++ = texCoord.y_;
+
+            // Tangent
+            Vector3 xyz = (Vector3::RIGHT - normal * normal.DotProduct(Vector3::RIGHT)).Normalized();
+            *vertexData++ = xyz.x_;
+            *vertexData++ = xyz.y_;
+            *vertexData++ = xyz.z_;
+            *vertexData++ = 1.0f;
+        }
+    }
+}
+
+void Terrain::SetPatchGeometry(TerrainPatch* patch, SharedArrayPtr<unsigned char> positionData, const BoundingBox& box)
+{
+    Geometry* geometry = patch->GetGeometry();
+    Geometry* maxLodGeometry = patch->GetMaxLodGeometry();
+    Geometry* minLodGeometry = patch->GetMinLodGeometry();
+
+    patch->SetBoundingBox(box);
+
+    if (drawRanges_.Size())
+    {
+        unsigned lastDrawRange = drawRanges_.Size() - 1;
+
+        geometry->SetIndexBuffer(indexBuffer_);
+        geometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[0].first_, drawRanges_[0].second_, false);
+        geometry->SetRawVertexData(positionData, sizeof(Vector3), MASK_POSITION);
+        maxLodGeometry->SetIndexBuffer(indexBuffer_);
+        maxLodGeometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[0].first_, drawRanges_[0].second_, false);
+        maxLodGeometry->SetRawVertexData(positionData, sizeof(Vector3), MASK_POSITION);
+        minLodGeometry->SetIndexBuffer(indexBuffer_);
+        minLodGeometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[lastDrawRange].first_, drawRanges_[lastDrawRange].second_, false);
+        minLodGeometry->SetRawVertexData(positionData, sizeof(Vector3), MASK_POSITION);
+    }
+
+    // Offset the occlusion geometry by vertex spacing to reduce possibility of over-aggressive occlusion
+    patch->SetOcclusionOffset(-0.5f * (spacing_.x_ + spacing_.z_));
+    patch->ResetLod();
+}
+
+void Terrain::UpdatePatches(const IntRect& rect, const IntRect& lodRect)
+{
+    unsigned row = patchSize_ + 1;
+    unsigned patchVertexFloats = row * row * PATCH_VERTEX_FLOATS;
+
+    // Find the patches whose vertices are inside the region. A vertex on a patch border belongs to both patches
+    int startX = Max((rect.left_ + patchSize_ - 1) / patchSize_ - 1, 0);
+    int endX = Min((rect.right_ - 1) / patchSize_, numPatches_.x_ - 1);
+    int startZ = Max((rect.top_ + patchSize_ - 1) / patchSize_ - 1, 0);
+    int endZ = Min((rect.bottom_ - 1) / patchSize_, numPatches_.y_ - 1);
+
+    Vector<TerrainPatchUpdate> updates;
+    for (int z = startZ; z <= endZ; ++z)
+    {
+        for (int x = startX; x <= endX; ++x)
+        {
+            TerrainPatch* patch = GetPatch(x, z);
+            if (!patch)
+                continue;
+
+            TerrainPatchUpdate update;
+            update.patch_ = patch;
+            update.vertexData_ = 0;
+            update.positionData_ = new unsigned char[row * row * sizeof(Vector3)];
+            // LOD errors only change for the patches whose heights changed
+            update.lodErrors_ = x * patchSize_ < lodRect.right_ && (x + 1) * patchSize_ >= lodRect.left_ && z * patchSize_ <
+                lodRect.bottom_ && (z + 1) * patchSize_ >= lodRect.top_;
+            updates.Push(update);
+        }
+    }
+
+    if (updates.Empty())
+        return;
+
+    PODVector<float> vertexData(updates.Size() * patchVertexFloats);
+    for (unsigned i = 0; i < updates.Size(); ++i)
+        updates[i].vertexData_ = &vertexData[i * patchVertexFloats];
+
+    // Calculate the vertex data and LOD errors in worker threads if available
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    unsigned numWorkItems = queue ? Min((int)updates.Size(), (int)queue->GetNumThreads() + 1) : 1;
+    if (numWorkItems > 1)
+    {
+        unsigned patchesPerItem = updates.Size() / numWorkItems;
+        TerrainPatchUpdate* start = &updates[0];
+        for (unsigned i = 0; i < numWorkItems; ++i)
+        {
+            TerrainPatchUpdate* end = i < numWorkItems - 1 ? start + patchesPerItem : &updates[0] + updates.Size();
+
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = UpdateTerrainPatchesWork;
+            item->aux_ = this;
+            item->start_ = start;
+            item->end_ = end;
+            queue->AddWorkItem(item);
+
+            start = end;
+        }
+
+        queue->Complete(M_MAX_UNSIGNED);
+    }
+    else
+    {
+        for (unsigned i = 0; i < updates.Size(); ++i)
+        {
+            TerrainPatchUpdate& update = updates[i];
+            GetPatchVertices(update.patch_, update.vertexData_, (float*)update.positionData_.Get(), update.boundingBox_);
+            if (update.lodErrors_)
+                CalculateLodErrors(update.patch_);
+        }
+    }
+
+    // Upload the vertex data in the main thread
+    for (unsigned i = 0; i < updates.Size(); ++i)
+    {
+        TerrainPatchUpdate& update = updates[i];
+        VertexBuffer* vertexBuffer = update.patch_->GetVertexBuffer();
+
+        if (vertexBuffer->GetVertexCount() != row * row)
+            vertexBuffer->SetSize(row * row, MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1 | MASK_TANGENT);
+        vertexBuffer->SetData(update.vertexData_);
+        vertexBuffer->ClearDataLost();
+
+        SetPatchGeometry(update.patch_, update.positionData_, update.boundingBox_);
+    }
+}
+
+void Terrain::GetHeightRange(const IntRect& rect, float& minHeight, float& maxHeight) const
+{
+    minHeight = M_INFINITY;
+    maxHeight = -M_INFINITY;
+
+    for (int z = rect.top_; z < rect.bottom_; ++z)
+    {
+        for (int x = rect.left_; x < rect.right_; ++x)
+        {
+            float height = heightData_[z * numVertices_.x_ + x];
+            minHeight = Min(minHeight, height);
+            maxHeight = Max(maxHeight, height);
+        }
+    }
+}
+
 void Terrain::SetNeighbors(TerrainPatch* patch)
 {
     const IntVector2& coords = patch->GetCoordinates();
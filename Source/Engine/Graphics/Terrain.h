@@ -27,15 +27,19 @@
 namespace Urho3D
 {
 
+class BoundingBox;
 class Image;
 class IndexBuffer;
 class Material;
 class Node;
 class TerrainPatch;
+struct WorkItem;
 
 /// Heightmap terrain component.
 class URHO3D_API Terrain : public Component
 {
+    friend void UpdateTerrainPatchesWork(const WorkItem* item, unsigned threadIndex);
+
     OBJECT(Terrain);
 
 public:
@@ -87,6 +91,8 @@ public:
     void SetOccludee(bool enable);
     /// Apply changes from the heightmap image.
     void ApplyHeightMap();
+    /// Set heights of a rectangular region in height data coordinates, from row-major data of the region's size. Only the affected patches are rebuilt, and the heightmap image is not modified. Return true if successful.
+    bool SetHeights(const IntRect& rect, const float* heights);
 
     /// Return patch quads per side.
     int GetPatchSize() const { return patchSize_; }
@@ -163,12 +169,22 @@ private:
     float GetRawHeight(int x, int z) const;
     /// Return a source terrain height value, clamping to edges. The source data is used for smoothing.
     float GetSourceHeight(int x, int z) const;
+    /// Return a smoothed height value from the source data.
+    float GetSmoothedHeight(int x, int z) const;
     /// Return interpolated height for a specific LOD level.
     float GetLodHeight(int x, int z, unsigned lodLevel) const;
     /// Get slope-based terrain normal at position.
     Vector3 GetRawNormal(int x, int z) const;
-    /// Calculate LOD errors for a patch.
+    /// Calculate LOD errors for a patch. May be called from a worker thread.
     void CalculateLodErrors(TerrainPatch* patch);
+    /// Calculate vertex data, CPU-side positions and bounding box for a patch. May be called from a worker thread.
+    void GetPatchVertices(TerrainPatch* patch, float* vertexData, float* positionData, BoundingBox& box) const;
+    /// Assign CPU-side positions and draw ranges to the patch geometries after the vertex data has changed.
+    void SetPatchGeometry(TerrainPatch* patch, SharedArrayPtr<unsigned char> positionData, const BoundingBox& box);
+    /// Rebuild the patches whose vertices are within a region of the height data, using worker threads if available.
+    void UpdatePatches(const IntRect& rect, const IntRect& lodRect);
+    /// Return the range of the height data in a region.
+    void GetHeightRange(const IntRect& rect, float& minHeight, float& maxHeight) const;
     /// Set neighbors for a patch.
     void SetNeighbors(TerrainPatch* patch);
     /// Set heightmap image and optionally recreate the geometry immediately. Return true if successful.
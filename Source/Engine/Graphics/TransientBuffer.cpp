@@ -0,0 +1,203 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Precompiled.h"
+#include "Context.h"
+#include "IndexBuffer.h"
+#include "TransientBuffer.h"
+#include "VertexBuffer.h"
+
+#include "DebugNew.h"
+
+namespace Urho3D
+{
+
+static const unsigned MIN_TRANSIENT_ELEMENTS = 1024;
+
+TransientBuffer::TransientBuffer(Context* context) :
+    Object(context),
+    elementMask_(0),
+    elementSize_(0),
+    frameIndex_(0),
+    usedCount_(0),
+    uploadedCount_(0),
+    bytesUploaded_(0),
+    numReallocations_(0)
+{
+}
+
+TransientBuffer::~TransientBuffer()
+{
+}
+
+void TransientBuffer::SetVertexFormat(unsigned elementMask)
+{
+    Release();
+    
+    elementMask_ = elementMask;
+    elementSize_ = VertexBuffer::GetVertexSize(elementMask);
+    for (unsigned i = 0; i < NUM_TRANSIENT_FRAMES; ++i)
+        vertexBuffers_[i] = new VertexBuffer(context_);
+}
+
+void TransientBuffer::SetIndexFormat(bool largeIndices)
+{
+    Release();
+    
+    elementSize_ = largeIndices ? sizeof(unsigned) : sizeof(unsigned short);
+    for (unsigned i = 0; i < NUM_TRANSIENT_FRAMES; ++i)
+        indexBuffers_[i] = new IndexBuffer(context_);
+}
+
+void* TransientBuffer::Allocate(unsigned count, unsigned& start)
+{
+    start = 0;
+    if (!count || !elementSize_)
+        return 0;
+    
+    MutexLock lock(allocationMutex_);
+    
+    TransientBlock* block = blocks_.Size() ? &blocks_.Back() : 0;
+    if (!block || block->used_ + count > block->capacity_)
+    {
+        // Start a new block. The existing blocks must not move, as other threads may still be writing to them
+        TransientBlock newBlock;
+        newBlock.capacity_ = block ? block->capacity_ * 2 : MIN_TRANSIENT_ELEMENTS;
+        if (newBlock.capacity_ < count)
+            newBlock.capacity_ = count;
+        newBlock.data_ = new unsigned char[newBlock.capacity_ * elementSize_];
+        newBlock.start_ = usedCount_;
+        newBlock.used_ = 0;
+        blocks_.Push(newBlock);
+        block = &blocks_.Back();
+        ++numReallocations_;
+    }
+    
+    void* dest = block->data_.Get() + block->used_ * elementSize_;
+    start = usedCount_;
+    block->used_ += count;
+    usedCount_ += count;
+    return dest;
+}
+
+void TransientBuffer::Upload()
+{
+    VertexBuffer* vertexBuffer = vertexBuffers_[frameIndex_];
+    IndexBuffer* indexBuffer = indexBuffers_[frameIndex_];
+    if (!vertexBuffer && !indexBuffer)
+        return;
+    
+    // If the GPU buffer lost its contents, upload the whole frame again from the staging memory
+    if (vertexBuffer ? vertexBuffer->IsDataLost() : indexBuffer->IsDataLost())
+    {
+        uploadedCount_ = 0;
+        if (vertexBuffer)
+            vertexBuffer->ClearDataLost();
+        else
+            indexBuffer->ClearDataLost();
+    }
+    
+    if (usedCount_ == uploadedCount_)
+        return;
+    
+    // Grow the GPU buffer if necessary. This loses the earlier uploads of the frame
+    unsigned capacity = vertexBuffer ? vertexBuffer->GetVertexCount() : indexBuffer->GetIndexCount();
+    if (usedCount_ > capacity)
+    {
+        capacity = NextPowerOfTwo(usedCount_ > MIN_TRANSIENT_ELEMENTS ? usedCount_ : MIN_TRANSIENT_ELEMENTS);
+        bool success = vertexBuffer ? vertexBuffer->SetSize(capacity, elementMask_, true) : indexBuffer->SetSize(capacity,
+            elementSize_ > sizeof(unsigned short), true);
+        if (!success)
+            return;
+        
+        uploadedCount_ = 0;
+        ++numReallocations_;
+    }
+    
+    for (unsigned i = 0; i < blocks_.Size(); ++i)
+    {
+        const TransientBlock& block = blocks_[i];
+        unsigned begin = uploadedCount_ > block.start_ ? uploadedCount_ : block.start_;
+        unsigned end = block.start_ + block.used_;
+        if (begin >= end)
+            continue;
+        
+        const unsigned char* data = block.data_.Get() + (begin - block.start_) * elementSize_;
+        if (vertexBuffer)
+            vertexBuffer->SetDataRange(data, begin, end - begin);
+        else
+            indexBuffer->SetDataRange(data, begin, end - begin);
+        bytesUploaded_ += (end - begin) * elementSize_;
+    }
+    
+    uploadedCount_ = usedCount_;
+}
+
+void TransientBuffer::BeginFrame()
+{
+    // If the previous frame needed several staging blocks, replace them with one that is large enough
+    if (blocks_.Size() > 1)
+    {
+        unsigned capacity = NextPowerOfTwo(usedCount_);
+        blocks_.Resize(1);
+        blocks_[0].data_ = new unsigned char[capacity * elementSize_];
+        blocks_[0].capacity_ = capacity;
+        ++numReallocations_;
+    }
+    if (blocks_.Size())
+    {
+        blocks_[0].start_ = 0;
+        blocks_[0].used_ = 0;
+    }
+    
+    frameIndex_ = (frameIndex_ + 1) % NUM_TRANSIENT_FRAMES;
+    usedCount_ = 0;
+    uploadedCount_ = 0;
+    bytesUploaded_ = 0;
+}
+
+VertexBuffer* TransientBuffer::GetVertexBuffer() const
+{
+    return vertexBuffers_[frameIndex_];
+}
+
+IndexBuffer* TransientBuffer::GetIndexBuffer() const
+{
+    return indexBuffers_[frameIndex_];
+}
+
+void TransientBuffer::Release()
+{
+    for (unsigned i = 0; i < NUM_TRANSIENT_FRAMES; ++i)
+    {
+        vertexBuffers_[i].Reset();
+        indexBuffers_[i].Reset();
+    }
+    
+    blocks_.Clear();
+    elementMask_ = 0;
+    elementSize_ = 0;
+    usedCount_ = 0;
+    uploadedCount_ = 0;
+}
+
+}
@@ -0,0 +1,114 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "ArrayPtr.h"
+#include "Mutex.h"
+#include "Object.h"
+
+namespace Urho3D
+{
+
+class IndexBuffer;
+class VertexBuffer;
+
+/// Number of GPU buffers a transient buffer cycles through, so that the data of the previous frame is not overwritten while the GPU may still be reading it.
+static const unsigned NUM_TRANSIENT_FRAMES = 2;
+
+/// Block of CPU-side staging memory in a transient buffer.
+struct TransientBlock
+{
+    /// Element data.
+    SharedArrayPtr<unsigned char> data_;
+    /// Index of the first element in the GPU buffer.
+    unsigned start_;
+    /// Number of elements allocated.
+    unsigned used_;
+    /// Number of elements that fit.
+    unsigned capacity_;
+};
+
+/// Frame-fenced ring allocator for vertex or index data that is regenerated on the CPU every frame. Producers allocate ranges that are valid until the end of the frame, possibly from worker threads, and the data written since the previous upload is uploaded at once from the main thread.
+class URHO3D_API TransientBuffer : public Object
+{
+    OBJECT(TransientBuffer);
+    
+public:
+    /// Construct.
+    TransientBuffer(Context* context);
+    /// Destruct.
+    virtual ~TransientBuffer();
+    
+    /// Define as vertex data with the given vertex elements. Should be called before allocating.
+    void SetVertexFormat(unsigned elementMask);
+    /// Define as 16-bit or 32-bit index data. Should be called before allocating.
+    void SetIndexFormat(bool largeIndices);
+    /// Allocate space for a number of vertices or indices. Return a pointer to write them to, and the index of the first one in the GPU buffer of the current frame. Return null if count is zero. May be called from worker threads.
+    void* Allocate(unsigned count, unsigned& start);
+    /// Upload the data allocated since the previous upload. Must be called from the main thread after the producers have finished writing, and before rendering.
+    void Upload();
+    /// Release the allocations of the previous frame and switch to the next GPU buffer. Called by Renderer.
+    void BeginFrame();
+    
+    /// Return vertex buffer of the current frame, or null if defined as index data.
+    VertexBuffer* GetVertexBuffer() const;
+    /// Return index buffer of the current frame, or null if defined as vertex data.
+    IndexBuffer* GetIndexBuffer() const;
+    /// Return size of one vertex or index in bytes.
+    unsigned GetElementSize() const { return elementSize_; }
+    /// Return number of vertices or indices allocated on the current frame.
+    unsigned GetUsedCount() const { return usedCount_; }
+    /// Return bytes uploaded on the current frame.
+    unsigned GetBytesUploaded() const { return bytesUploaded_; }
+    /// Return number of GPU buffer or staging memory reallocations since creation.
+    unsigned GetNumReallocations() const { return numReallocations_; }
+    
+private:
+    /// Release all buffers and staging memory.
+    void Release();
+    
+    /// GPU vertex buffers, one per frame in flight.
+    SharedPtr<VertexBuffer> vertexBuffers_[NUM_TRANSIENT_FRAMES];
+    /// GPU index buffers, one per frame in flight.
+    SharedPtr<IndexBuffer> indexBuffers_[NUM_TRANSIENT_FRAMES];
+    /// Staging memory blocks of the current frame.
+    Vector<TransientBlock> blocks_;
+    /// Allocation mutex.
+    Mutex allocationMutex_;
+    /// Vertex element mask.
+    unsigned elementMask_;
+    /// Vertex or index size.
+    unsigned elementSize_;
+    /// Current GPU buffer index.
+    unsigned frameIndex_;
+    /// Number of elements allocated on the current frame.
+    unsigned usedCount_;
+    /// Number of elements uploaded on the current frame.
+    unsigned uploadedCount_;
+    /// Bytes uploaded on the current frame.
+    unsigned bytesUploaded_;
+    /// Number of reallocations.
+    unsigned numReallocations_;
+};
+
+}
@@ -0,0 +1,252 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Precompiled.h"
+#include "BoundingBox.h"
+#include "Graphics.h"
+#include "VertexBuffer.h"
+#include "VertexPacking.h"
+
+#include <cstring>
+
+#include "DebugNew.h"
+
+namespace Urho3D
+{
+
+static const float SNORM16_MAX = 32767.0f;
+
+inline short PackSnorm16(float value)
+{
+    value = Clamp(value, -1.0f, 1.0f) * SNORM16_MAX;
+    return (short)(value >= 0.0f ? value + 0.5f : value - 0.5f);
+}
+
+inline float UnpackSnorm16(short value)
+{
+    return Max((float)value / SNORM16_MAX, -1.0f);
+}
+
+unsigned GetPackedElementMask(VertexElement element)
+{
+    switch (element)
+    {
+    case ELEMENT_POSITION:
+        return MASK_PACKED_POSITION;
+        
+    case ELEMENT_NORMAL:
+        return MASK_PACKED_NORMAL;
+        
+    case ELEMENT_TEXCOORD1:
+    case ELEMENT_TEXCOORD2:
+        return MASK_PACKED_TEXCOORD;
+        
+    case ELEMENT_TANGENT:
+        return MASK_PACKED_TANGENT;
+        
+    default:
+        return 0;
+    }
+}
+
+unsigned short FloatToHalf(float value)
+{
+    unsigned bits;
+    memcpy(&bits, &value, sizeof bits);
+    
+    unsigned sign = (bits >> 16) & 0x8000;
+    unsigned exponent = (bits >> 23) & 0xff;
+    unsigned mantissa = bits & 0x7fffff;
+    
+    // Infinity and NaN
+    if (exponent == 0xff)
+        return (unsigned short)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    
+    int halfExponent = (int)exponent - 127 + 15;
+    // Overflow to infinity
+    if (halfExponent >= 31)
+        return (unsigned short)(sign | 0x7c00);
+    
+    // Denormal or underflow to zero
+    if (halfExponent <= 0)
+    {
+        if (halfExponent < -10)
+            return (unsigned short)sign;
+        
+        mantissa |= 0x800000;
+        unsigned shift = (unsigned)(14 - halfExponent);
+        unsigned half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1)
+            ++half;
+        return (unsigned short)(sign | half);
+    }
+    
+    // Rounding may carry into the exponent, which still gives the correct result
+    unsigned half = sign | ((unsigned)halfExponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000)
+        ++half;
+    return (unsigned short)half;
+}
+
+float HalfToFloat(unsigned short value)
+{
+    unsigned sign = ((unsigned)value & 0x8000) << 16;
+    unsigned exponent = ((unsigned)value >> 10) & 0x1f;
+    unsigned mantissa = (unsigned)value & 0x3ff;
+    unsigned bits;
+    
+    if (!exponent)
+    {
+        // Zero or denormal
+        float result = (float)mantissa * (1.0f / 16777216.0f);
+        return sign ? -result : result;
+    }
+    else if (exponent == 31)
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    else
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    
+    float result;
+    memcpy(&result, &bits, sizeof result);
+    return result;
+}
+
+void GetPositionQuantization(const BoundingBox& box, Vector3& offset, float& scale)
+{
+    offset = box.Center();
+    Vector3 halfSize = box.HalfSize();
+    scale = Max(Max(halfSize.x_, halfSize.y_), halfSize.z_);
+    if (scale <= 0.0f)
+        scale = 1.0f;
+}
+
+void ConvertVertexData(void* dest, unsigned destElementMask, const void* src, unsigned srcElementMask, unsigned count,
+    const Vector3& positionOffset, float positionScale)
+{
+    unsigned char* destBytes = (unsigned char*)dest;
+    const unsigned char* srcBytes = (const unsigned char*)src;
+    unsigned destVertexSize = VertexBuffer::GetVertexSize(destElementMask);
+    unsigned srcVertexSize = VertexBuffer::GetVertexSize(srcElementMask);
+    float invPositionScale = positionScale != 0.0f ? 1.0f / positionScale : 0.0f;
+    
+    for (unsigned i = 0; i < MAX_VERTEX_ELEMENTS; ++i)
+    {
+        if (!(destElementMask & (1 << i)))
+            continue;
+        
+        VertexElement element = (VertexElement)i;
+        unsigned packedMask = GetPackedElementMask(element);
+        bool destPacked = (destElementMask & packedMask) != 0;
+        bool srcPacked = (srcElementMask & packedMask) != 0;
+        unsigned destOffset = VertexBuffer::GetElementOffset(destElementMask, element);
+        unsigned srcOffset = VertexBuffer::GetElementOffset(srcElementMask, element);
+        unsigned char* d = destBytes + destOffset;
+        const unsigned char* s = srcBytes + srcOffset;
+        
+        // Same format: copy as is
+        if (destPacked == srcPacked)
+        {
+            unsigned size = VertexBuffer::GetElementSize(destElementMask, element);
+            for (unsigned j = 0; j < count; ++j)
+            {
+                memcpy(d, s, size);
+                d += destVertexSize;
+                s += srcVertexSize;
+            }
+            continue;
+        }
+        
+        for (unsigned j = 0; j < count; ++j)
+        {
+            switch (element)
+            {
+            case ELEMENT_POSITION:
+                if (srcPacked)
+                {
+                    const short* packed = (const short*)s;
+                    Vector3 position(UnpackSnorm16(packed[0]), UnpackSnorm16(packed[1]), UnpackSnorm16(packed[2]));
+                    *((Vector3*)d) = positionOffset + position * positionScale;
+                }
+                else
+                {
+                    short* packed = (short*)d;
+                    Vector3 position = (*((const Vector3*)s) - positionOffset) * invPositionScale;
+                    packed[0] = PackSnorm16(position.x_);
+                    packed[1] = PackSnorm16(position.y_);
+                    packed[2] = PackSnorm16(position.z_);
+                    packed[3] = (short)SNORM16_MAX;
+                }
+                break;
+                
+            case ELEMENT_NORMAL:
+            case ELEMENT_TANGENT:
+                {
+                    // Normals are packed with a zero fourth component, tangents keep their handedness in it
+                    unsigned components = element == ELEMENT_TANGENT ? 4 : 3;
+                    if (srcPacked)
+                    {
+                        const short* packed = (const short*)s;
+                        float* unpacked = (float*)d;
+                        for (unsigned k = 0; k < components; ++k)
+                            unpacked[k] = UnpackSnorm16(packed[k]);
+                    }
+                    else
+                    {
+                        const float* unpacked = (const float*)s;
+                        short* packed = (short*)d;
+                        for (unsigned k = 0; k < components; ++k)
+                            packed[k] = PackSnorm16(unpacked[k]);
+                        if (components == 3)
+                            packed[3] = 0;
+                    }
+                }
+                break;
+                
+            case ELEMENT_TEXCOORD1:
+            case ELEMENT_TEXCOORD2:
+                if (srcPacked)
+                {
+                    const unsigned short* packed = (const unsigned short*)s;
+                    float* unpacked = (float*)d;
+                    unpacked[0] = HalfToFloat(packed[0]);
+                    unpacked[1] = HalfToFloat(packed[1]);
+                }
+                else
+                {
+                    const float* unpacked = (const float*)s;
+                    unsigned short* packed = (unsigned short*)d;
+                    packed[0] = FloatToHalf(unpacked[0]);
+                    packed[1] = FloatToHalf(unpacked[1]);
+                }
+                break;
+                
+            default:
+                break;
+            }
+            
+            d += destVertexSize;
+            s += srcVertexSize;
+        }
+    }
+}
+
+}
@@ -0,0 +1,44 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "GraphicsDefs.h"
+
+namespace Urho3D
+{
+
+class BoundingBox;
+class Vector3;
+
+/// Return the packing bit of a vertex element, or zero if the element has no packed format.
+URHO3D_API unsigned GetPackedElementMask(VertexElement element);
+/// Convert a float to a half float, rounding to nearest.
+URHO3D_API unsigned short FloatToHalf(float value);
+/// Convert a half float to a float.
+URHO3D_API float HalfToFloat(unsigned short value);
+/// Return the offset and uniform scale that map positions inside a bounding box to the packed position range.
+URHO3D_API void GetPositionQuantization(const BoundingBox& box, Vector3& offset, float& scale);
+/// Convert the elements of destination vertices from source vertices, packing or unpacking elements whose packing bits differ. All destination elements must exist in the source. Packed positions are dequantized as offset + scale * position.
+URHO3D_API void ConvertVertexData(void* dest, unsigned destElementMask, const void* src, unsigned srcElementMask, unsigned count, const Vector3& positionOffset, float positionScale);
+
+}
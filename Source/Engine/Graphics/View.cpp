@@ -27,10 +27,12 @@
 #include "Geometry.h"
 #include "Graphics.h"
 #include "GraphicsImpl.h"
+#include "HLODCluster.h"
 #include "Log.h"
 #include "Material.h"
 #include "OcclusionBuffer.h"
 #include "Octree.h"
+#include "PotentiallyVisibleSet.h"
 #include "Renderer.h"
 #include "RenderPath.h"
 #include "ResourceCache.h"
@@ -61,6 +63,17 @@ static const Vector3* directions[] =
     &Vector3::BACK
 };
 
+/// Minimum total instance count for writing the instancing buffer in worker threads.
+static const unsigned MIN_THREADED_INSTANCES = 1024;
+
+/// Combine a value into a hash code.
+template <class T> void CombineHash(unsigned& hash, const T& value)
+{
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(&value);
+    for (unsigned i = 0; i < sizeof(T); ++i)
+        hash = SDBMHash(hash, data[i]);
+}
+
 /// %Frustum octree query for shadowcasters.
 class ShadowCasterOctreeQuery : public FrustumOctreeQuery
 {
@@ -163,12 +176,52 @@ public:
     OcclusionBuffer* buffer_;
 };
 
-void CheckVisibilityWork(const WorkItem* item, unsigned threadIndex)
+/// Return whether a drawable is hidden by HLOD switching: cluster members while the cluster proxy is active, and the proxy itself while it is not.
+static inline bool IsHiddenByHLOD(Drawable* drawable, Camera* camera)
+{
+    HLODCluster* cluster = drawable->GetHLODCluster();
+    if (!cluster)
+        return false;
+    
+    bool proxyActive = cluster->IsProxyActive(camera);
+    return static_cast<Drawable*>(cluster) == drawable ? !proxyActive : proxyActive;
+}
+
+/// Return whether a drawable is culled by the potentially visible set of the camera's cell. Drawables not baked into the set are never culled.
+static inline bool IsCulledByPVS(Drawable* drawable, const unsigned char* visibility)
+{
+    unsigned index = drawable->GetPVSIndex();
+    return visibility && index != M_MAX_UNSIGNED && !(visibility[index >> 3] & (1 << (index & 7)));
+}
+
+void CullDrawablesWork(const WorkItem* item, unsigned threadIndex)
 {
     View* view = reinterpret_cast<View*>(item->aux_);
     Drawable** start = reinterpret_cast<Drawable**>(item->start_);
     Drawable** end = reinterpret_cast<Drawable**>(item->end_);
     OcclusionBuffer* buffer = view->occlusionBuffer_;
+    const unsigned char* pvsVisibility = view->pvsVisibility_;
+    PODVector<Drawable*>& result = view->sceneResults_[threadIndex].drawables_;
+    
+    // Only test the drawables here, without modifying them, so that several views of the same scene can be culled at once
+    while (start != end)
+    {
+        Drawable* drawable = *start++;
+        
+        // Skip drawables that can not be seen from the camera's cell, and HLOD cluster members replaced by their proxy
+        if (IsCulledByPVS(drawable, pvsVisibility) || IsHiddenByHLOD(drawable, view->camera_))
+            continue;
+        
+        if (!buffer || !drawable->IsOccludee() || buffer->IsVisible(drawable->GetWorldBoundingBox()))
+            result.Push(drawable);
+    }
+}
+
+void CheckVisibilityWork(const WorkItem* item, unsigned threadIndex)
+{
+    View* view = reinterpret_cast<View*>(item->aux_);
+    Drawable** start = reinterpret_cast<Drawable**>(item->start_);
+    Drawable** end = reinterpret_cast<Drawable**>(item->end_);
     const Matrix3x4& viewMatrix = view->camera_->GetView();
     Vector3 viewZ = Vector3(viewMatrix.m20_, viewMatrix.m21_, viewMatrix.m22_);
     Vector3 absViewZ = viewZ.Abs();
@@ -179,59 +232,49 @@ void CheckVisibilityWork(const WorkItem* item, unsigned threadIndex)
     while (start != end)
     {
         Drawable* drawable = *start++;
-        bool batchesUpdated = false;
         
-        // If draw distance non-zero, update and check it
+        // Update the drawable's batches for this camera. If draw distance non-zero, check it
+        drawable->UpdateBatches(view->frame_);
         float maxDistance = drawable->GetDrawDistance();
-        if (maxDistance > 0.0f)
-        {
-            drawable->UpdateBatches(view->frame_);
-            batchesUpdated = true;
-            if (drawable->GetDistance() > maxDistance)
-                continue;
-        }
+        if (maxDistance > 0.0f && drawable->GetDistance() > maxDistance)
+            continue;
         
-        if (!buffer || !drawable->IsOccludee() || buffer->IsVisible(drawable->GetWorldBoundingBox()))
+        drawable->MarkInView(view->frame_);
+        
+        // For geometries, find zone, clear lights and calculate view space Z range
+        if (drawable->GetDrawableFlags() & DRAWABLE_GEOMETRY)
         {
-            if (!batchesUpdated)
-                drawable->UpdateBatches(view->frame_);
-            drawable->MarkInView(view->frame_);
+            Zone* drawableZone = drawable->GetZone();
+            if (!cameraZoneOverride && (drawable->IsZoneDirty() || !drawableZone || (drawableZone->GetViewMask() &
+                cameraViewMask) == 0))
+                view->FindZone(drawable);
             
-            // For geometries, find zone, clear lights and calculate view space Z range
-            if (drawable->GetDrawableFlags() & DRAWABLE_GEOMETRY)
-            {
-                Zone* drawableZone = drawable->GetZone();
-                if (!cameraZoneOverride && (drawable->IsZoneDirty() || !drawableZone || (drawableZone->GetViewMask() &
-                    cameraViewMask) == 0))
-                    view->FindZone(drawable);
-                
-                const BoundingBox& geomBox = drawable->GetWorldBoundingBox();
-                Vector3 center = geomBox.Center();
-                float viewCenterZ = viewZ.DotProduct(center) + viewMatrix.m23_;
-                Vector3 edge = geomBox.Size() * 0.5f;
-                float viewEdgeZ = absViewZ.DotProduct(edge);
-                float minZ = viewCenterZ - viewEdgeZ;
-                float maxZ = viewCenterZ + viewEdgeZ;
-                
-                drawable->SetMinMaxZ(viewCenterZ - viewEdgeZ, viewCenterZ + viewEdgeZ);
-                drawable->ClearLights();
-                
-                // Expand the scene bounding box and Z range (skybox not included because of infinite size) and store the drawawble
-                if (drawable->GetType() != Skybox::GetTypeStatic())
-                {
-                    result.minZ_ = Min(result.minZ_, minZ);
-                    result.maxZ_ = Max(result.maxZ_, maxZ);
-                }
-                
-                result.geometries_.Push(drawable);
-            }
-            else if (drawable->GetDrawableFlags() & DRAWABLE_LIGHT)
+            const BoundingBox& geomBox = drawable->GetWorldBoundingBox();
+            Vector3 center = geomBox.Center();
+            float viewCenterZ = viewZ.DotProduct(center) + viewMatrix.m23_;
+            Vector3 edge = geomBox.Size() * 0.5f;
+            float viewEdgeZ = absViewZ.DotProduct(edge);
+            float minZ = viewCenterZ - viewEdgeZ;
+            float maxZ = viewCenterZ + viewEdgeZ;
+            
+            drawable->SetMinMaxZ(viewCenterZ - viewEdgeZ, viewCenterZ + viewEdgeZ);
+            drawable->ClearLights();
+            
+            // Expand the scene bounding box and Z range (skybox not included because of infinite size) and store the drawawble
+            if (drawable->GetType() != Skybox::GetTypeStatic())
             {
-                Light* light = static_cast<Light*>(drawable);
-                // Skip lights with zero brightness or black color
-                if (!light->GetEffectiveColor().Equals(Color::BLACK))
-                    result.lights_.Push(light);
+                result.minZ_ = Min(result.minZ_, minZ);
+                result.maxZ_ = Max(result.maxZ_, maxZ);
             }
+            
+            result.geometries_.Push(drawable);
+        }
+        else if (drawable->GetDrawableFlags() & DRAWABLE_LIGHT)
+        {
+            Light* light = static_cast<Light*>(drawable);
+            // Skip lights with zero brightness or black color
+            if (!light->GetEffectiveColor().Equals(Color::BLACK))
+                result.lights_.Push(light);
         }
     }
 }
@@ -244,6 +287,38 @@ void ProcessLightWork(const WorkItem* item, unsigned threadIndex)
     view->ProcessLight(*query, threadIndex);
 }
 
+void BuildLightGridWork(const WorkItem* item, unsigned threadIndex)
+{
+    LightGrid* grid = reinterpret_cast<LightGrid*>(item->aux_);
+    unsigned* start = reinterpret_cast<unsigned*>(item->start_);
+    unsigned* end = reinterpret_cast<unsigned*>(item->end_);
+    
+    while (start != end)
+        grid->BuildSlice(*start++);
+}
+
+void AssignLightGridWork(const WorkItem* item, unsigned threadIndex)
+{
+    View* view = reinterpret_cast<View*>(item->aux_);
+    Drawable** start = reinterpret_cast<Drawable**>(item->start_);
+    Drawable** end = reinterpret_cast<Drawable**>(item->end_);
+    const LightGrid& grid = view->lightGrid_;
+    PerThreadLightGridResult& result = view->lightGridResults_[threadIndex];
+    
+    while (start != end)
+    {
+        Drawable* drawable = *start++;
+        unsigned lightMask = view->GetLightMask(drawable);
+        
+        grid.GetLights(drawable->GetWorldBoundingBox(), result.lights_, result.visited_);
+        for (PODVector<unsigned>::ConstIterator i = result.lights_.Begin(); i != result.lights_.End(); ++i)
+        {
+            if (lightMask & grid.GetLight(*i)->GetLightMask())
+                result.litGeometries_[*i].Push(drawable);
+        }
+    }
+}
+
 void UpdateDrawableGeometriesWork(const WorkItem* item, unsigned threadIndex)
 {
     const FrameInfo& frame = *(reinterpret_cast<FrameInfo*>(item->aux_));
@@ -287,6 +362,20 @@ void SortShadowQueueWork(const WorkItem* item, unsigned threadIndex)
         start->shadowSplits_[i].shadowBatches_.SortFrontToBack();
 }
 
+void WriteInstanceTransformsWork(const WorkItem* item, unsigned threadIndex)
+{
+    BatchGroup** start = reinterpret_cast<BatchGroup**>(item->start_);
+    BatchGroup** end = reinterpret_cast<BatchGroup**>(item->end_);
+    
+    while (start != end)
+    {
+        (*start)->WriteTransforms(item->aux_);
+        ++start;
+    }
+    
+    BatchGroup::FinishTransforms();
+}
+
 View::View(Context* context) :
     Object(context),
     graphics_(GetSubsystem<Graphics>()),
@@ -296,13 +385,34 @@ View::View(Context* context) :
     camera_(0),
     cameraZone_(0),
     farClipZone_(0),
+    pvsVisibility_(0),
     renderTarget_(0),
-    substituteRenderTarget_(0)
+    substituteRenderTarget_(0),
+    lightQueuesRevision_(0),
+    retainedCamera_(0),
+    retainedCameraRevision_(0),
+    retainedSettingsHash_(0),
+    retainedBatchesValid_(false),
+    batchesRetained_(false),
+    retainBatchQueues_(false),
+    threadedUpdate_(false),
+    queryCamera_(0),
+    queryOctree_(0),
+    queryFrameNumber_(M_MAX_UNSIGNED),
+    queryCameraRevision_(0),
+    queryOctreeRevision_(0),
+    queryHasDrawables_(false)
 {
     // Create octree query and scene results vector for each thread
     unsigned numThreads = GetSubsystem<WorkQueue>()->GetNumThreads() + 1; // Worker threads + main thread
     tempDrawables_.Resize(numThreads);
     sceneResults_.Resize(numThreads);
+    lightGridResults_.Resize(numThreads);
+    
+    lightGridSlices_.Resize(LIGHTGRID_SLICES);
+    for (unsigned i = 0; i < LIGHTGRID_SLICES; ++i)
+        lightGridSlices_[i] = i;
+    
     frame_.camera_ = 0;
 }
 
@@ -477,24 +587,73 @@ bool View::Define(RenderSurface* renderTarget, Viewport* viewport)
     return true;
 }
 
+void View::PrepareQuery(const FrameInfo& frame)
+{
+    queryFrameNumber_ = M_MAX_UNSIGNED;
+    if (!camera_ || !octree_)
+        return;
+    
+    // Set automatic aspect ratio already here, and make sure the frustum is up to date before querying from a worker thread
+    if (camera_->GetAutoAspectRatio())
+        camera_->SetAspectRatioInternal((float)viewSize_.x_ / (float)viewSize_.y_);
+    camera_->GetFrustum();
+    
+    queryCamera_ = camera_;
+    queryOctree_ = octree_;
+    queryFrameNumber_ = frame.frameNumber_;
+    queryCameraRevision_ = camera_->GetRevision();
+    queryOctreeRevision_ = octree_->GetDrawablesRevision();
+    // With occlusion, the geometry and light query depends on the occlusion buffer and can not be performed yet
+    queryHasDrawables_ = maxOccluderTriangles_ == 0;
+}
+
+void View::ExecuteQuery()
+{
+    {
+        ZoneOccluderOctreeQuery query(queryZonesOccluders_, camera_->GetFrustum(), DRAWABLE_GEOMETRY | DRAWABLE_ZONE,
+            camera_->GetViewMask());
+        octree_->GetDrawables(query);
+    }
+    
+    if (queryHasDrawables_)
+    {
+        FrustumOctreeQuery query(queryDrawables_, camera_->GetFrustum(), DRAWABLE_GEOMETRY | DRAWABLE_LIGHT,
+            camera_->GetViewMask());
+        octree_->GetDrawables(query);
+    }
+}
+
+void View::ShareQuery(View* view)
+{
+    queryZonesOccluders_ = view->queryZonesOccluders_;
+    queryDrawables_ = view->queryDrawables_;
+    queryCamera_ = view->queryCamera_;
+    queryOctree_ = view->queryOctree_;
+    queryFrameNumber_ = view->queryFrameNumber_;
+    queryCameraRevision_ = view->queryCameraRevision_;
+    queryOctreeRevision_ = view->queryOctreeRevision_;
+    queryHasDrawables_ = view->queryHasDrawables_;
+}
+
 void View::Update(const FrameInfo& frame)
+{
+    BeginUpdate(frame);
+    EndUpdate();
+}
+
+void View::BeginUpdate(const FrameInfo& frame, bool threaded)
 {
     frame_.camera_ = camera_;
     frame_.timeStep_ = frame.timeStep_;
     frame_.frameNumber_ = frame.frameNumber_;
     frame_.viewSize_ = viewSize_;
     
-    int maxSortedInstances = renderer_->GetMaxSortedInstances();
-    
-    // Clear buffers, geometry, light, occluder & batch list
+    // Clear buffers, geometry, light & occluder list. The batch queues are cleared in GetBatches() unless they can be retained
     renderTargets_.Clear();
     geometries_.Clear();
     lights_.Clear();
     zones_.Clear();
     occluders_.Clear();
-    vertexLightQueues_.Clear();
-    for (HashMap<StringHash, BatchQueue>::Iterator i = batchQueues_.Begin(); i != batchQueues_.End(); ++i)
-        i->second_.Clear(maxSortedInstances);
     
     if (hasScenePasses_ && (!camera_ || !octree_))
         return;
@@ -503,7 +662,21 @@ void View::Update(const FrameInfo& frame)
     if (camera_ && camera_->GetAutoAspectRatio())
         camera_->SetAspectRatioInternal((float)frame_.viewSize_.x_ / (float)frame_.viewSize_.y_);
     
+    threadedUpdate_ = threaded;
+    CullDrawables();
+    threadedUpdate_ = false;
+}
+
+void View::EndUpdate()
+{
+    if (hasScenePasses_ && (!camera_ || !octree_))
+    {
+        ClearBatches();
+        return;
+    }
+    
     GetDrawables();
+    ProcessLights();
     GetBatches();
 }
 
@@ -704,26 +877,38 @@ void View::SetGBufferShaderParameters(const IntVector2& texSize, const IntRect&
     graphics_->SetShaderParameter(PSP_GBUFFERINVSIZE, Vector4(invSizeX, invSizeY, 0.0f, 0.0f));
 }
 
-void View::GetDrawables()
+void View::CullDrawables()
 {
+    visibleDrawables_.Clear();
+    
     if (!octree_ || !camera_)
         return;
     
-    PROFILE(GetDrawables);
+    PROFILE(CullDrawables);
     
-    WorkQueue* queue = GetSubsystem<WorkQueue>();
     PODVector<Drawable*>& tempDrawables = tempDrawables_[0];
     
+    // Use the octree query results from PrepareQuery() if the camera and the octree's drawables have not changed since
+    bool queryValid = queryFrameNumber_ == frame_.frameNumber_ && camera_ == queryCamera_ && octree_ == queryOctree_ &&
+        camera_->GetRevision() == queryCameraRevision_ && octree_->GetDrawablesRevision() == queryOctreeRevision_;
+    queryFrameNumber_ = M_MAX_UNSIGNED;
+    
     // Get zones and occluders first
+    if (queryValid)
+        Swap(tempDrawables, queryZonesOccluders_);
+    else
     {
         ZoneOccluderOctreeQuery query(tempDrawables, camera_->GetFrustum(), DRAWABLE_GEOMETRY | DRAWABLE_ZONE, camera_->GetViewMask());
         octree_->GetDrawables(query);
     }
     
     highestZonePriority_ = M_MIN_INT;
-    int bestPriority = M_MIN_INT;
     Vector3 cameraPos = cameraNode_->GetWorldPosition();
     
+    // Get the precomputed visibility of the camera's cell, if the scene has a baked potentially visible set
+    PotentiallyVisibleSet* pvs = scene_ ? scene_->GetComponent<PotentiallyVisibleSet>() : 0;
+    pvsVisibility_ = pvs ? pvs->GetCellVisibility(cameraPos) : 0;
+    
     for (PODVector<Drawable*>::ConstIterator i = tempDrawables.Begin(); i != tempDrawables.End(); ++i)
     {
         Drawable* drawable = *i;
@@ -736,32 +921,26 @@ void View::GetDrawables()
             int priority = zone->GetPriority();
             if (priority > highestZonePriority_)
                 highestZonePriority_ = priority;
-            if (priority > bestPriority && zone->IsInside(cameraPos))
-            {
-                cameraZone_ = zone;
-                bestPriority = priority;
-            }
         }
-        else
+        else if (!IsCulledByPVS(drawable, pvsVisibility_))
             occluders_.Push(drawable);
     }
     
+    // Update the zone lookup grid. It is only rebuilt when the visible zones have changed
+    zoneGrid_.Update(zones_);
+    
+    Zone* zone = zoneGrid_.FindZone(cameraPos);
+    if (zone)
+        cameraZone_ = zone;
+    
     // Determine the zone at far clip distance. If not found, or camera zone has override mode, use camera zone
     cameraZoneOverride_ = cameraZone_->GetOverride();
     if (!cameraZoneOverride_)
     {
         Vector3 farClipPos = cameraPos + cameraNode_->GetWorldDirection() * Vector3(0.0f, 0.0f, camera_->GetFarClip());
-        bestPriority = M_MIN_INT;
-        
-        for (PODVector<Zone*>::Iterator i = zones_.Begin(); i != zones_.End(); ++i)
-        {
-            int priority = (*i)->GetPriority();
-            if (priority > bestPriority && (*i)->IsInside(farClipPos))
-            {
-                farClipZone_ = *i;
-                bestPriority = priority;
-            }
-        }
+        zone = zoneGrid_.FindZone(farClipPos);
+        if (zone)
+            farClipZone_ = zone;
     }
     if (farClipZone_ == renderer_->GetDefaultZone())
         farClipZone_ = cameraZone_;
@@ -787,6 +966,8 @@ void View::GetDrawables()
             DRAWABLE_LIGHT, camera_->GetViewMask());
         octree_->GetDrawables(query);
     }
+    else if (queryValid && queryHasDrawables_)
+        Swap(tempDrawables, queryDrawables_);
     else
     {
         FrustumOctreeQuery query(tempDrawables, camera_->GetFrustum(), DRAWABLE_GEOMETRY | 
@@ -794,7 +975,43 @@ void View::GetDrawables()
         octree_->GetDrawables(query);
     }
     
-    // Check drawable occlusion, find zones for moved drawables and collect geometries & lights in worker threads
+    // Check drawable occlusion in worker threads
+    {
+        for (unsigned i = 0; i < sceneResults_.Size(); ++i)
+            sceneResults_[i].drawables_.Clear();
+        
+        int numWorkItems = GetNumWorkItems();
+        int drawablesPerItem = tempDrawables.Size() / numWorkItems;
+        
+        PODVector<Drawable*>::Iterator start = tempDrawables.Begin();
+        // Create a work item for each thread
+        for (int i = 0; i < numWorkItems; ++i)
+        {
+            PODVector<Drawable*>::Iterator end = tempDrawables.End();
+            if (i < numWorkItems - 1 && end - start > drawablesPerItem)
+                end = start + drawablesPerItem;
+            
+            QueueWork(CullDrawablesWork, &(*start), &(*end), this);
+            
+            start = end;
+        }
+        
+        CompleteWork();
+    }
+    
+    for (unsigned i = 0; i < sceneResults_.Size(); ++i)
+        visibleDrawables_.Push(sceneResults_[i].drawables_);
+}
+
+void View::GetDrawables()
+{
+    if (!octree_ || !camera_)
+        return;
+    
+    PROFILE(GetDrawables);
+    
+    // Update the batches of the drawables that passed culling, find zones for moved drawables and collect geometries & lights
+    // in worker threads
     {
         for (unsigned i = 0; i < sceneResults_.Size(); ++i)
         {
@@ -806,30 +1023,23 @@ void View::GetDrawables()
             result.maxZ_ = 0.0f;
         }
         
-        int numWorkItems = queue->GetNumThreads() + 1; // Worker threads + main thread
-        int drawablesPerItem = tempDrawables.Size() / numWorkItems;
+        int numWorkItems = GetNumWorkItems();
+        int drawablesPerItem = visibleDrawables_.Size() / numWorkItems;
         
-        PODVector<Drawable*>::Iterator start = tempDrawables.Begin();
+        PODVector<Drawable*>::Iterator start = visibleDrawables_.Begin();
         // Create a work item for each thread
         for (int i = 0; i < numWorkItems; ++i)
         {
-            SharedPtr<WorkItem> item = queue->GetFreeItem();
-            item->priority_ = M_MAX_UNSIGNED;
-            item->workFunction_ = CheckVisibilityWork;
-            item->aux_ = this;
-
-            PODVector<Drawable*>::Iterator end = tempDrawables.End();
+            PODVector<Drawable*>::Iterator end = visibleDrawables_.End();
             if (i < numWorkItems - 1 && end - start > drawablesPerItem)
                 end = start + drawablesPerItem;
             
-            item->start_ = &(*start);
-            item->end_ = &(*end);
-            queue->AddWorkItem(item);
+            QueueWork(CheckVisibilityWork, &(*start), &(*end), this);
             
             start = end;
         }
         
-        queue->Complete(M_MAX_UNSIGNED);
+        CompleteWork();
     }
     
     // Combine lights, geometries & scene Z range from the threads
@@ -873,42 +1083,152 @@ void View::GetDrawables()
     Sort(lights_.Begin(), lights_.End(), CompareLights);
 }
 
-void View::GetBatches()
+void View::ProcessLights()
 {
+    nonThreadedGeometries_.Clear();
+    threadedGeometries_.Clear();
+    retainedQueues_.Clear();
+    retainBatchQueues_ = false;
+    
     if (!octree_ || !camera_)
         return;
     
-    nonThreadedGeometries_.Clear();
-    threadedGeometries_.Clear();
+    // If retained batches are enabled and the visible objects are the same as on the previous frame, the batch queues that
+    // do not contain changed geometries can be reused
+    bool retained = renderer_->GetRetainedBatches() && CheckRetainedBatches();
+    if (retained && changedDrawables_.Empty())
+    {
+        // If no light is shadowed, also the light processing can be skipped, and all batch queues restored
+        bool hasShadows = false;
+        for (Vector<RetainedLightQueue>::ConstIterator i = retainedLightQueues_.Begin(); i != retainedLightQueues_.End(); ++i)
+        {
+            if (i->numSplits_)
+            {
+                hasShadows = true;
+                break;
+            }
+        }
+        
+        if (!hasShadows)
+        {
+            batchesRetained_ = true;
+            return;
+        }
+    }
     
-    WorkQueue* queue = GetSubsystem<WorkQueue>();
-    PODVector<Light*> vertexLights;
-    BatchQueue* alphaQueue = batchQueues_.Contains(alphaPassName_) ? &batchQueues_[alphaPassName_] : (BatchQueue*)0;
+    if (!retained)
+        ClearBatches();
+    batchesRetained_ = false;
+    retainBatchQueues_ = retained;
     
-    // Process lit geometries and shadow casters for each light
+    PROFILE(ProcessLights);
+    
+    lightQueryResults_.Resize(lights_.Size());
+    for (unsigned i = 0; i < lightQueryResults_.Size(); ++i)
     {
-        PROFILE(ProcessLights);
+        LightQueryResult& query = lightQueryResults_[i];
+        Light* light = lights_[i];
+        query.light_ = light;
+        query.volumeCache_ = 0;
+        query.volumeCacheHit_ = false;
+        query.shadowCasterCacheHit_ = false;
         
-        lightQueryResults_.Resize(lights_.Size());
+        // Shadowed point and spot lights reuse their octree query results while nothing changes in their volume.
+        // Assign the caches here, as the hash map can not be modified in the worker threads
+        if (light->GetLightType() != LIGHT_DIRECTIONAL && IsShadowed(light))
+        {
+            LightVolumeCache& cache = lightVolumeCaches_[light];
+            cache.frameNumber_ = frame_.frameNumber_;
+            query.volumeCache_ = &cache;
+        }
+    }
+    
+    // Discard the caches of lights that are no longer visible or shadowed
+    for (HashMap<Light*, LightVolumeCache>::Iterator i = lightVolumeCaches_.Begin(); i != lightVolumeCaches_.End();)
+    {
+        if (i->second_.frameNumber_ != frame_.frameNumber_)
+            i = lightVolumeCaches_.Erase(i);
+        else
+            ++i;
+    }
+    
+    // If clustered light assignment is enabled, process unshadowed point and spot lights through the light grid first
+    PODVector<bool> processedLights(lights_.Size());
+    for (unsigned i = 0; i < processedLights.Size(); ++i)
+        processedLights[i] = false;
+    if (renderer_->GetClusteredLighting())
+        ProcessLightGrid(processedLights);
+    else if (lightGrid_.GetNumLights())
+        lightGrid_.ClearLights();
+    
+    for (unsigned i = 0; i < lightQueryResults_.Size(); ++i)
+    {
+        if (processedLights[i])
+            continue;
         
-        for (unsigned i = 0; i < lightQueryResults_.Size(); ++i)
+        QueueWork(ProcessLightWork, &lightQueryResults_[i], 0, this);
+    }
+    
+    // Ensure all lights have been processed before proceeding
+    CompleteWork();
+    
+    // Count the skipped octree queries, and the lights whose shadow caster checks were skipped. Lights without lit
+    // geometries do not check shadow casters at all
+    unsigned cacheHits = 0;
+    unsigned cacheMisses = 0;
+    unsigned casterCacheHits = 0;
+    unsigned casterCacheMisses = 0;
+    for (Vector<LightQueryResult>::ConstIterator i = lightQueryResults_.Begin(); i != lightQueryResults_.End(); ++i)
+    {
+        if (i->volumeCache_)
         {
-            SharedPtr<WorkItem> item = queue->GetFreeItem();
-            item->priority_ = M_MAX_UNSIGNED;
-            item->workFunction_ = ProcessLightWork;
-            item->aux_ = this;
-
-            LightQueryResult& query = lightQueryResults_[i];
-            query.light_ = lights_[i];
+            if (i->volumeCacheHit_)
+                ++cacheHits;
+            else
+                ++cacheMisses;
             
-            item->start_ = &query;
-            queue->AddWorkItem(item);
+            if (i->shadowCasterCacheHit_)
+                ++casterCacheHits;
+            else if (!i->litGeometries_.Empty())
+                ++casterCacheMisses;
         }
-        
-        // Ensure all lights have been processed before proceeding
-        queue->Complete(M_MAX_UNSIGNED);
+    }
+    if (cacheHits || cacheMisses)
+    {
+        PROFILE_COUNT(LightVolumeCacheHits, cacheHits);
+        PROFILE_COUNT(LightVolumeCacheMisses, cacheMisses);
+    }
+    if (casterCacheHits || casterCacheMisses)
+    {
+        PROFILE_COUNT(ShadowCasterCacheHits, casterCacheHits);
+        PROFILE_COUNT(ShadowCasterCacheMisses, casterCacheMisses);
+    }
+}
+
+void View::GetBatches()
+{
+    if (!octree_ || !camera_)
+    {
+        ClearBatches();
+        return;
     }
     
+    // If nothing affecting the batches has changed, reuse the previous frame's batch queues
+    if (batchesRetained_)
+    {
+        RestoreRetainedBatches();
+        return;
+    }
+    
+    bool retained = retainBatchQueues_;
+    PODVector<Light*> vertexLights;
+    BatchQueue* alphaQueue = batchQueues_.Contains(alphaPassName_) ? &batchQueues_[alphaPassName_] : (BatchQueue*)0;
+    // Alpha queue for the lit alpha batches, null if the alpha queue is reused
+    BatchQueue* litAlphaQueue = alphaQueue;
+    // Scene passes whose batch queues are rebuilt, as a bitmask of scene pass indices
+    unsigned dirtyPasses = M_MAX_UNSIGNED;
+    PODVector<bool> rebuildLitBatches;
+    
     // Build light queues and lit batches
     {
         PROFILE(GetLightBatches);
@@ -922,10 +1242,178 @@ void View::GetBatches()
                 ++numLightQueues;
         }
         
+        // The batches refer to the light queues by address, so they can only be reused if the same lights have queues
+        if (retained)
+        {
+            if (numLightQueues != retainedLightQueues_.Size())
+                retained = false;
+            else
+            {
+                unsigned index = 0;
+                for (Vector<LightQueryResult>::ConstIterator i = lightQueryResults_.Begin(); i != lightQueryResults_.End(); ++i)
+                {
+                    if (!i->light_->GetPerVertex() && i->litGeometries_.Size() && retainedLightQueues_[index++].light_ !=
+                        i->light_)
+                    {
+                        retained = false;
+                        break;
+                    }
+                }
+            }
+            
+            if (!retained)
+                ClearBatches();
+        }
+        
         lightQueues_.Resize(numLightQueues);
         maxLightsDrawables_.Clear();
         unsigned maxSortedInstances = renderer_->GetMaxSortedInstances();
         
+        // Pack the shadow maps of directional and spot lights into the atlas. Point lights use separate shadow maps, as
+        // the shaders address their faces through the indirection cube map relative to the whole texture
+        Texture2D* shadowAtlas = renderer_->GetShadowAtlasTexture();
+        if (shadowAtlas)
+        {
+            PODVector<ShadowAtlasRequest> requests;
+            for (Vector<LightQueryResult>::ConstIterator i = lightQueryResults_.Begin(); i != lightQueryResults_.End(); ++i)
+            {
+                Light* light = i->light_;
+                if (light->GetPerVertex() || i->litGeometries_.Empty() || !i->numSplits_ || light->GetLightType() == LIGHT_POINT)
+                    continue;
+                
+                int splitsX = 1;
+                int splitsY = 1;
+                if (light->GetLightType() == LIGHT_DIRECTIONAL)
+                {
+                    unsigned numSplits = light->GetNumShadowSplits();
+                    if (numSplits > 1)
+                        splitsX = 2;
+                    if (numSplits > 2)
+                        splitsY = 2;
+                }
+                
+                requests.Push(ShadowAtlasRequest(light, renderer_->GetShadowMapPixels(light, camera_, viewSize_.x_,
+                    viewSize_.y_), splitsX, splitsY));
+            }
+            
+            shadowAtlas_.SetSize(shadowAtlas->GetWidth(), shadowAtlas->GetHeight());
+            shadowAtlas_.Allocate(requests);
+        }
+        
+        // Initialize the light queues, store them to the lights so that they can be found later, and allocate shadow maps
+        PODVector<unsigned> numShadowSplits(numLightQueues);
+        PODVector<IntRect> shadowMapAreas(numLightQueues);
+        PODVector<bool> rebuildShadowBatches(numLightQueues);
+        rebuildLitBatches.Resize(numLightQueues);
+        bool litGeometriesChanged = false;
+        
+        for (Vector<LightQueryResult>::ConstIterator i = lightQueryResults_.Begin(); i != lightQueryResults_.End(); ++i)
+        {
+            const LightQueryResult& query = *i;
+            Light* light = query.light_;
+            if (light->GetPerVertex() || query.litGeometries_.Empty())
+                continue;
+            
+            unsigned index = usedLightQueues++;
+            LightBatchQueue& lightQueue = lightQueues_[index];
+            light->SetLightQueue(&lightQueue);
+            lightQueue.light_ = light;
+            lightQueue.shadowMap_ = 0;
+            
+            unsigned shadowSplits = query.numSplits_;
+            IntRect shadowMapArea;
+            if (shadowSplits > 0)
+            {
+                if (shadowAtlas && light->GetLightType() != LIGHT_POINT)
+                {
+                    shadowMapArea = shadowAtlas_.GetArea(light);
+                    if (shadowMapArea != IntRect::ZERO)
+                        lightQueue.shadowMap_ = shadowAtlas;
+                }
+                else
+                {
+                    lightQueue.shadowMap_ = renderer_->GetShadowMap(light, camera_, viewSize_.x_, viewSize_.y_);
+                    if (lightQueue.shadowMap_)
+                        shadowMapArea = IntRect(0, 0, lightQueue.shadowMap_->GetWidth(), lightQueue.shadowMap_->GetHeight());
+                }
+                // If did not manage to get a shadow map, convert the light to unshadowed
+                if (!lightQueue.shadowMap_)
+                    shadowSplits = 0;
+            }
+            numShadowSplits[index] = shadowSplits;
+            shadowMapAreas[index] = shadowMapArea;
+            
+            // Check which of the light's batch queues can be reused. The lit batches also depend on the shadowing
+            if (retained)
+            {
+                const RetainedLightQueue& retainedQueue = retainedLightQueues_[index];
+                bool rebuildLit = shadowSplits != retainedQueue.numSplits_ || query.litGeometries_ != retainedQueue.litGeometries_;
+                if (rebuildLit)
+                    litGeometriesChanged = true;
+                for (PODVector<Drawable*>::ConstIterator j = query.litGeometries_.Begin(); j != query.litGeometries_.End() &&
+                    !rebuildLit; ++j)
+                    rebuildLit = changedDrawables_.Contains(*j);
+                
+                rebuildLitBatches[index] = rebuildLit;
+                rebuildShadowBatches[index] = shadowSplits != retainedQueue.numSplits_ || !CheckRetainedShadowCasters(query,
+                    retainedQueue);
+            }
+            else
+            {
+                rebuildLitBatches[index] = true;
+                rebuildShadowBatches[index] = true;
+            }
+            
+            // If the shadow casters were reused from the light volume cache, and this light queue still holds the shadow
+            // batches built from them on the previous frame, the shadow batches can be reused
+            LightVolumeCache* cache = query.volumeCache_;
+            if (cache)
+            {
+                if (rebuildShadowBatches[index] && shadowSplits && query.shadowCasterCacheHit_ && cache->shadowQueue_ ==
+                    &lightQueue && cache->shadowQueueRevision_ == lightQueuesRevision_ && lightQueue.shadowSplits_.Size() ==
+                    shadowSplits)
+                    rebuildShadowBatches[index] = false;
+                
+                cache->shadowQueue_ = shadowSplits ? &lightQueue : 0;
+                cache->shadowQueueRevision_ = lightQueuesRevision_ + 1;
+            }
+        }
+        
+        ++lightQueuesRevision_;
+        
+        // Find the scene passes the changed geometries were or will be added to, and clear their queues. The other queues are
+        // reused. The alpha queue also contains lit alpha batches, so it is rebuilt if the lit geometries or shadowing changed
+        if (retained)
+        {
+            dirtyPasses = 0;
+            for (unsigned i = 0; i < geometries_.Size(); ++i)
+            {
+                if (changedDrawables_.Contains(geometries_[i]))
+                    dirtyPasses |= retainedDrawables_[i].passMask_ | GetScenePassMask(geometries_[i]);
+            }
+            
+            for (unsigned i = 0; i < scenePasses_.Size(); ++i)
+            {
+                if (litGeometriesChanged && scenePasses_[i].pass_ == alphaPassName_)
+                    dirtyPasses |= 1u << i;
+                if (!(dirtyPasses & (1u << i)))
+                    retainedQueues_.Insert(scenePasses_[i].batchQueue_);
+            }
+            for (unsigned i = 0; i < scenePasses_.Size(); ++i)
+            {
+                if (dirtyPasses & (1u << i))
+                {
+                    scenePasses_[i].batchQueue_->Clear(maxSortedInstances);
+                    retainedQueues_.Erase(scenePasses_[i].batchQueue_);
+                }
+            }
+        }
+        
+        if (alphaQueue && retainedQueues_.Contains(alphaQueue))
+            litAlphaQueue = 0;
+        
+        unsigned reusedShadowQueues = 0;
+        usedLightQueues = 0;
         for (Vector<LightQueryResult>::Iterator i = lightQueryResults_.Begin(); i != lightQueryResults_.End(); ++i)
         {
             LightQueryResult& query = *i;
@@ -939,39 +1427,47 @@ void View::GetBatches()
             // Per-pixel light
             if (!light->GetPerVertex())
             {
-                unsigned shadowSplits = query.numSplits_;
+                unsigned index = usedLightQueues++;
+                LightBatchQueue& lightQueue = lightQueues_[index];
+                unsigned shadowSplits = numShadowSplits[index];
+                bool rebuildLit = rebuildLitBatches[index];
+                bool rebuildShadows = rebuildShadowBatches[index];
                 
-                // Initialize light queue and store it to the light so that it can be found later
-                LightBatchQueue& lightQueue = lightQueues_[usedLightQueues++];
-                light->SetLightQueue(&lightQueue);
-                lightQueue.light_ = light;
-                lightQueue.shadowMap_ = 0;
-                lightQueue.litBaseBatches_.Clear(maxSortedInstances);
-                lightQueue.litBatches_.Clear(maxSortedInstances);
-                lightQueue.volumeBatches_.Clear();
+                if (rebuildLit)
+                {
+                    lightQueue.litBaseBatches_.Clear(maxSortedInstances);
+                    lightQueue.litBatches_.Clear(maxSortedInstances);
+                    lightQueue.volumeBatches_.Clear();
+                }
+                else
+                    retainedQueues_.Insert(&lightQueue.litBaseBatches_);
                 
-                // Allocate shadow map now
-                if (shadowSplits > 0)
+                // Setup shadow batch queues. If the shadow casters are unchanged, the batches only need this frame's shadow
+                // cameras
+                if (rebuildShadows)
+                    lightQueue.shadowSplits_.Resize(shadowSplits);
+                else if (shadowSplits)
                 {
-                    lightQueue.shadowMap_ = renderer_->GetShadowMap(light, camera_, viewSize_.x_, viewSize_.y_);
-                    // If did not manage to get a shadow map, convert the light to unshadowed
-                    if (!lightQueue.shadowMap_)
-                        shadowSplits = 0;
+                    retainedQueues_.Insert(&lightQueue.shadowSplits_[0].shadowBatches_);
+                    ++reusedShadowQueues;
                 }
                 
-                // Setup shadow batch queues
-                lightQueue.shadowSplits_.Resize(shadowSplits);
                 for (unsigned j = 0; j < shadowSplits; ++j)
                 {
                     ShadowBatchQueue& shadowQueue = lightQueue.shadowSplits_[j];
                     Camera* shadowCamera = query.shadowCameras_[j];
-                    shadowQueue.shadowCamera_ = shadowCamera;
                     shadowQueue.nearSplit_ = query.shadowNearSplits_[j];
                     shadowQueue.farSplit_ = query.shadowFarSplits_[j];
-                    shadowQueue.shadowBatches_.Clear(maxSortedInstances);
+                    if (rebuildShadows)
+                    {
+                        shadowQueue.shadowCamera_ = shadowCamera;
+                        shadowQueue.shadowBatches_.Clear(maxSortedInstances);
+                    }
+                    else
+                        SetShadowQueueCamera(shadowQueue, shadowCamera);
                     
                     // Setup the shadow split viewport and finalize shadow camera parameters
-                    shadowQueue.shadowViewport_ = GetShadowMapViewport(light, j, lightQueue.shadowMap_);
+                    shadowQueue.shadowViewport_ = GetShadowMapViewport(light, j, shadowMapAreas[index]);
                     FinalizeShadowCamera(shadowCamera, light, shadowQueue.shadowViewport_, query.shadowCasterBox_[j]);
                     
                     // Loop through shadow casters
@@ -990,6 +1486,9 @@ void View::GetBatches()
                                 threadedGeometries_.Push(drawable);
                         }
                         
+                        if (!rebuildShadows)
+                            continue;
+                        
                         Zone* zone = GetZone(drawable);
                         const Vector<SourceBatch>& batches = drawable->GetBatches();
                         
@@ -1024,14 +1523,16 @@ void View::GetBatches()
                     drawable->AddLight(light);
                     
                     // If drawable limits maximum lights, only record the light, and check maximum count / build batches later
-                    if (!drawable->GetMaxLights())
-                        GetLitBatches(drawable, lightQueue, alphaQueue);
-                    else
+                    if (drawable->GetMaxLights())
                         maxLightsDrawables_.Insert(drawable);
+                    else if (rebuildLit)
+                        GetLitBatches(drawable, lightQueue, litAlphaQueue);
+                    else if (litAlphaQueue)
+                        GetLitBatches(drawable, lightQueue, litAlphaQueue, false);
                 }
                 
                 // In deferred modes, store the light volume batch now
-                if (deferred_)
+                if (deferred_ && rebuildLit)
                 {
                     Batch volumeBatch;
                     volumeBatch.geometry_ = renderer_->GetLightGeometry(light);
@@ -1060,6 +1561,9 @@ void View::GetBatches()
                 }
             }
         }
+        
+        if (reusedShadowQueues)
+            PROFILE_COUNT(ShadowBatchQueuesReused, reusedShadowQueues);
     }
     
     // Process drawables with limited per-pixel light count
@@ -1078,8 +1582,13 @@ void View::GetBatches()
                 Light* light = lights[i];
                 // Find the correct light queue again
                 LightBatchQueue* queue = light->GetLightQueue();
-                if (queue)
-                    GetLitBatches(drawable, *queue, alphaQueue);
+                if (!queue)
+                    continue;
+                
+                if (rebuildLitBatches[queue - &lightQueues_[0]])
+                    GetLitBatches(drawable, *queue, litAlphaQueue);
+                else if (litAlphaQueue)
+                    GetLitBatches(drawable, *queue, litAlphaQueue, false);
             }
         }
     }
@@ -1097,6 +1606,17 @@ void View::GetBatches()
             else if (type == UPDATE_WORKER_THREAD)
                 threadedGeometries_.Push(drawable);
             
+            // The lit batches of an unchanged drawable may have been reused, so restore its lit base pass flags
+            if (retained && !changedDrawables_.Contains(drawable))
+            {
+                unsigned basePassFlags = retainedDrawables_[i - geometries_.Begin()].basePassFlags_;
+                for (unsigned j = 0; j < 32; ++j)
+                {
+                    if (basePassFlags & (1u << j))
+                        drawable->SetBasePass(j);
+                }
+            }
+            
             Zone* zone = GetZone(drawable);
             const Vector<SourceBatch>& batches = drawable->GetBatches();
             
@@ -1113,6 +1633,9 @@ void View::GetBatches()
                 if (srcBatch.material_ && srcBatch.material_->GetAuxViewFrameNumber() != frame_.frameNumber_ && !renderTarget_)
                     CheckMaterialForAuxView(srcBatch.material_);
                 
+                if (!dirtyPasses)
+                    continue;
+                
                 Technique* tech = GetTechnique(drawable, srcBatch.material_);
                 if (!srcBatch.geometry_ || !srcBatch.numWorldTransforms_ || !tech)
                     continue;
@@ -1127,6 +1650,9 @@ void View::GetBatches()
                 // Check each of the scene passes
                 for (unsigned k = 0; k < scenePasses_.Size(); ++k)
                 {
+                    if (k < 32 && !(dirtyPasses & (1u << k)))
+                        continue;
+                    
                     ScenePassInfo& info = scenePasses_[k];
                     destBatch.pass_ = tech->GetSupportedPass(info.pass_);
                     if (!destBatch.pass_)
@@ -1180,6 +1706,304 @@ void View::GetBatches()
             }
         }
     }
+    
+    if (!retainedQueues_.Empty())
+        PROFILE_COUNT(RetainedBatchQueues, retainedQueues_.Size());
+    
+    if (renderer_->GetRetainedBatches())
+        StoreRetainedBatches();
+}
+
+void View::ClearBatches()
+{
+    int maxSortedInstances = renderer_->GetMaxSortedInstances();
+    
+    vertexLightQueues_.Clear();
+    for (HashMap<StringHash, BatchQueue>::Iterator i = batchQueues_.Begin(); i != batchQueues_.End(); ++i)
+        i->second_.Clear(maxSortedInstances);
+    
+    retainedQueues_.Clear();
+    retainedBatchesValid_ = false;
+    batchesRetained_ = false;
+}
+
+bool View::CheckRetainedBatches()
+{
+    changedDrawables_.Clear();
+    
+    // The scene passes of the retained batches are recorded as a bitmask
+    if (!retainedBatchesValid_ || camera_ != retainedCamera_ || camera_->GetRevision() != retainedCameraRevision_ ||
+        GetBatchSettingsHash() != retainedSettingsHash_ || scenePasses_.Size() > 32)
+        return false;
+    
+    if (geometries_.Size() + lights_.Size() + zones_.Size() != retainedDrawables_.Size())
+        return false;
+    
+    PROFILE(CheckRetainedBatches);
+    
+    unsigned index = 0;
+    
+    // Changed geometries only require rebuilding the batch queues they are in
+    for (PODVector<Drawable*>::ConstIterator i = geometries_.Begin(); i != geometries_.End(); ++i)
+    {
+        const RetainedDrawable& retained = retainedDrawables_[index++];
+        if (*i != retained.drawable_)
+            return false;
+        if (!CheckRetainedDrawable(*i, retained, retainedSourceBatches_))
+            changedDrawables_.Insert(*i);
+    }
+    
+    // If most of the geometries changed, rebuilding everything is cheaper
+    if (changedDrawables_.Size() > geometries_.Size() / 2)
+        return false;
+    
+    // Changed lights and zones affect all batches
+    for (PODVector<Light*>::ConstIterator i = lights_.Begin(); i != lights_.End(); ++i)
+    {
+        const RetainedDrawable& retained = retainedDrawables_[index++];
+        if (*i != retained.drawable_ || !CheckRetainedDrawable(*i, retained, retainedSourceBatches_))
+            return false;
+    }
+    for (PODVector<Zone*>::ConstIterator i = zones_.Begin(); i != zones_.End(); ++i)
+    {
+        const RetainedDrawable& retained = retainedDrawables_[index++];
+        if (*i != retained.drawable_ || !CheckRetainedDrawable(*i, retained, retainedSourceBatches_))
+            return false;
+    }
+    
+    return true;
+}
+
+bool View::CheckRetainedDrawable(Drawable* drawable, const RetainedDrawable& retained, const PODVector<RetainedSourceBatch>&
+    sourceBatches) const
+{
+    const Vector<SourceBatch>& batches = drawable->GetBatches();
+    if (drawable->GetBatchRevision() != retained.revision_ || batches.Size() != retained.numBatches_)
+        return false;
+    
+    for (unsigned i = 0; i < batches.Size(); ++i)
+    {
+        const SourceBatch& srcBatch = batches[i];
+        const RetainedSourceBatch& retainedBatch = sourceBatches[retained.batchStart_ + i];
+        Material* material = srcBatch.material_;
+        
+        if (srcBatch.geometry_ != retainedBatch.geometry_ || material != retainedBatch.material_ || (material &&
+            material->GetRevision() != retainedBatch.materialRevision_) || srcBatch.distance_ != retainedBatch.distance_ ||
+            srcBatch.worldTransform_ != retainedBatch.worldTransform_ || srcBatch.numWorldTransforms_ !=
+            retainedBatch.numWorldTransforms_ || srcBatch.geometryType_ != retainedBatch.geometryType_ ||
+            srcBatch.overrideView_ != retainedBatch.overrideView_)
+            return false;
+    }
+    
+    return true;
+}
+
+bool View::CheckRetainedShadowCasters(const LightQueryResult& query, const RetainedLightQueue& retained) const
+{
+    if (query.shadowCasters_ != retained.shadowCasters_)
+        return false;
+    
+    for (unsigned i = 0; i < retained.numSplits_; ++i)
+    {
+        if (query.shadowCasterBegin_[i] != retained.shadowCasterBegin_[i] || query.shadowCasterEnd_[i] !=
+            retained.shadowCasterEnd_[i])
+            return false;
+    }
+    
+    // Shadow casters outside the view are not included in the visible geometry check, so check all of them here
+    for (unsigned i = 0; i < retained.casters_.Size(); ++i)
+    {
+        if (!CheckRetainedDrawable(query.shadowCasters_[i], retained.casters_[i], retainedSourceBatches_))
+            return false;
+    }
+    
+    return true;
+}
+
+void View::StoreRetainedBatches()
+{
+    retainedDrawables_.Clear();
+    retainedSourceBatches_.Clear();
+    retainedLightQueues_.Clear();
+    
+    // For geometries, also record the scene passes and lit base passes, which are needed when only some of the batch queues
+    // are rebuilt
+    for (PODVector<Drawable*>::ConstIterator i = geometries_.Begin(); i != geometries_.End(); ++i)
+    {
+        Drawable* drawable = *i;
+        StoreRetainedDrawable(drawable, retainedDrawables_, retainedSourceBatches_);
+        
+        RetainedDrawable& retained = retainedDrawables_.Back();
+        retained.passMask_ = GetScenePassMask(drawable);
+        for (unsigned j = 0; j < retained.numBatches_ && j < 32; ++j)
+        {
+            if (drawable->HasBasePass(j))
+                retained.basePassFlags_ |= 1u << j;
+        }
+    }
+    for (PODVector<Light*>::ConstIterator i = lights_.Begin(); i != lights_.End(); ++i)
+        StoreRetainedDrawable(*i, retainedDrawables_, retainedSourceBatches_);
+    for (PODVector<Zone*>::ConstIterator i = zones_.Begin(); i != zones_.End(); ++i)
+        StoreRetainedDrawable(*i, retainedDrawables_, retainedSourceBatches_);
+    
+    // Record the lit geometries and shadow casters of each light queue. Shadow cameras are reassigned each frame, so the
+    // shadow batches are pointed to the new cameras when reused
+    unsigned index = 0;
+    for (Vector<LightQueryResult>::ConstIterator i = lightQueryResults_.Begin(); i != lightQueryResults_.End(); ++i)
+    {
+        const LightQueryResult& query = *i;
+        if (query.light_->GetPerVertex() || query.litGeometries_.Empty())
+            continue;
+        
+        const LightBatchQueue& lightQueue = lightQueues_[index++];
+        retainedLightQueues_.Resize(retainedLightQueues_.Size() + 1);
+        RetainedLightQueue& retained = retainedLightQueues_.Back();
+        retained.light_ = query.light_;
+        retained.numSplits_ = lightQueue.shadowSplits_.Size();
+        retained.litGeometries_ = query.litGeometries_;
+        
+        if (retained.numSplits_)
+        {
+            retained.shadowCasters_ = query.shadowCasters_;
+            for (unsigned j = 0; j < retained.numSplits_; ++j)
+            {
+                retained.shadowCasterBegin_[j] = query.shadowCasterBegin_[j];
+                retained.shadowCasterEnd_[j] = query.shadowCasterEnd_[j];
+            }
+            for (PODVector<Drawable*>::ConstIterator j = query.shadowCasters_.Begin(); j != query.shadowCasters_.End(); ++j)
+                StoreRetainedDrawable(*j, retained.casters_, retainedSourceBatches_);
+        }
+    }
+    
+    retainedCamera_ = camera_;
+    retainedCameraRevision_ = camera_->GetRevision();
+    retainedSettingsHash_ = GetBatchSettingsHash();
+    retainedBatchesValid_ = true;
+}
+
+void View::StoreRetainedDrawable(Drawable* drawable, PODVector<RetainedDrawable>& dest, PODVector<RetainedSourceBatch>&
+    destBatches) const
+{
+    const Vector<SourceBatch>& batches = drawable->GetBatches();
+    
+    RetainedDrawable retained;
+    retained.drawable_ = drawable;
+    retained.revision_ = drawable->GetBatchRevision();
+    retained.numBatches_ = batches.Size();
+    retained.batchStart_ = destBatches.Size();
+    retained.passMask_ = 0;
+    retained.basePassFlags_ = 0;
+    dest.Push(retained);
+    
+    for (unsigned i = 0; i < batches.Size(); ++i)
+    {
+        const SourceBatch& srcBatch = batches[i];
+        
+        RetainedSourceBatch retainedBatch;
+        retainedBatch.distance_ = srcBatch.distance_;
+        retainedBatch.geometry_ = srcBatch.geometry_;
+        retainedBatch.material_ = srcBatch.material_;
+        retainedBatch.materialRevision_ = srcBatch.material_ ? srcBatch.material_->GetRevision() : 0;
+        retainedBatch.worldTransform_ = srcBatch.worldTransform_;
+        retainedBatch.numWorldTransforms_ = srcBatch.numWorldTransforms_;
+        retainedBatch.geometryType_ = srcBatch.geometryType_;
+        retainedBatch.overrideView_ = srcBatch.overrideView_;
+        destBatches.Push(retainedBatch);
+    }
+}
+
+void View::RestoreRetainedBatches()
+{
+    PROFILE(RestoreRetainedBatches);
+    
+    batchesRetained_ = true;
+    
+    // The geometry update queues and auxiliary view checks are still needed each frame
+    for (PODVector<Drawable*>::ConstIterator i = geometries_.Begin(); i != geometries_.End(); ++i)
+    {
+        Drawable* drawable = *i;
+        UpdateGeometryType type = drawable->GetUpdateGeometryType();
+        if (type == UPDATE_MAIN_THREAD)
+            nonThreadedGeometries_.Push(drawable);
+        else if (type == UPDATE_WORKER_THREAD)
+            threadedGeometries_.Push(drawable);
+        
+        if (!renderTarget_)
+        {
+            const Vector<SourceBatch>& batches = drawable->GetBatches();
+            for (unsigned j = 0; j < batches.Size(); ++j)
+            {
+                Material* material = batches[j].material_;
+                if (material && material->GetAuxViewFrameNumber() != frame_.frameNumber_)
+                    CheckMaterialForAuxView(material);
+            }
+        }
+    }
+    
+    // Restore the drawables' light lists and the lights' queue pointers, which are reset each frame
+    unsigned usedLightQueues = 0;
+    for (Vector<LightQueryResult>::ConstIterator i = lightQueryResults_.Begin(); i != lightQueryResults_.End(); ++i)
+    {
+        const LightQueryResult& query = *i;
+        if (query.litGeometries_.Empty())
+            continue;
+        
+        Light* light = query.light_;
+        if (!light->GetPerVertex())
+        {
+            light->SetLightQueue(&lightQueues_[usedLightQueues++]);
+            for (PODVector<Drawable*>::ConstIterator j = query.litGeometries_.Begin(); j != query.litGeometries_.End(); ++j)
+                (*j)->AddLight(light);
+        }
+        else
+        {
+            for (PODVector<Drawable*>::ConstIterator j = query.litGeometries_.Begin(); j != query.litGeometries_.End(); ++j)
+                (*j)->AddVertexLight(light);
+        }
+    }
+    
+    for (HashSet<Drawable*>::Iterator i = maxLightsDrawables_.Begin(); i != maxLightsDrawables_.End(); ++i)
+        (*i)->LimitLights();
+    
+    for (PODVector<Drawable*>::ConstIterator i = geometries_.Begin(); i != geometries_.End(); ++i)
+    {
+        if (!(*i)->GetVertexLights().Empty())
+            (*i)->LimitVertexLights();
+    }
+}
+
+unsigned View::GetBatchSettingsHash() const
+{
+    unsigned hash = 0;
+    
+    for (Vector<ScenePassInfo>::ConstIterator i = scenePasses_.Begin(); i != scenePasses_.End(); ++i)
+    {
+        CombineHash(hash, i->pass_.Value());
+        CombineHash(hash, i->allowInstancing_);
+        CombineHash(hash, i->markToStencil_);
+        CombineHash(hash, i->vertexLights_);
+    }
+    
+    CombineHash(hash, basePassName_.Value());
+    CombineHash(hash, alphaPassName_.Value());
+    CombineHash(hash, lightPassName_.Value());
+    CombineHash(hash, litBasePassName_.Value());
+    CombineHash(hash, litAlphaPassName_.Value());
+    CombineHash(hash, StringHash(lightVolumeVSName_).Value());
+    CombineHash(hash, StringHash(lightVolumePSName_).Value());
+    CombineHash(hash, deferred_);
+    CombineHash(hash, useLitBase_);
+    CombineHash(hash, drawShadows_);
+    CombineHash(hash, materialQuality_);
+    CombineHash(hash, minInstances_);
+    CombineHash(hash, cameraZone_);
+    CombineHash(hash, cameraZoneOverride_);
+    CombineHash(hash, renderer_->GetMaxSortedInstances());
+    CombineHash(hash, renderer_->GetClusteredLighting());
+    CombineHash(hash, renderer_->GetDynamicInstancing());
+    CombineHash(hash, renderer_->GetShadersChangedFrameNumber());
+    
+    return hash;
 }
 
 void View::UpdateGeometries()
@@ -1188,7 +2012,8 @@ void View::UpdateGeometries()
     
     WorkQueue* queue = GetSubsystem<WorkQueue>();
     
-    // Sort batches
+    // Sort batches. Retained batches, and batch queues reused from the previous frame, are already sorted
+    if (!batchesRetained_)
     {
         for (unsigned i = 0; i < renderPath_->commands_.Size(); ++i)
         {
@@ -1198,23 +2023,30 @@ void View::UpdateGeometries()
             
             if (command.type_ == CMD_SCENEPASS)
             {
+                BatchQueue* passQueue = &batchQueues_[command.pass_];
+                if (retainedQueues_.Contains(passQueue))
+                    continue;
+                
                 SharedPtr<WorkItem> item = queue->GetFreeItem();
                 item->priority_ = M_MAX_UNSIGNED;
                 item->workFunction_ = command.sortMode_ == SORT_FRONTTOBACK ? SortBatchQueueFrontToBackWork : SortBatchQueueBackToFrontWork;
-                item->start_ = &batchQueues_[command.pass_];
+                item->start_ = passQueue;
                 queue->AddWorkItem(item);
             }
         }
         
         for (Vector<LightBatchQueue>::Iterator i = lightQueues_.Begin(); i != lightQueues_.End(); ++i)
         {
-            SharedPtr<WorkItem> lightItem = queue->GetFreeItem();
-            lightItem->priority_ = M_MAX_UNSIGNED;
-            lightItem->workFunction_ = SortLightQueueWork;
-            lightItem->start_ = &(*i);
-            queue->AddWorkItem(lightItem);
+            if (!retainedQueues_.Contains(&i->litBaseBatches_))
+            {
+                SharedPtr<WorkItem> lightItem = queue->GetFreeItem();
+                lightItem->priority_ = M_MAX_UNSIGNED;
+                lightItem->workFunction_ = SortLightQueueWork;
+                lightItem->start_ = &(*i);
+                queue->AddWorkItem(lightItem);
+            }
 
-            if (i->shadowSplits_.Size())
+            if (i->shadowSplits_.Size() && !retainedQueues_.Contains(&i->shadowSplits_[0].shadowBatches_))
             {
                 SharedPtr<WorkItem> shadowItem = queue->GetFreeItem();
                 shadowItem->priority_ = M_MAX_UNSIGNED;
@@ -1270,9 +2102,91 @@ void View::UpdateGeometries()
     
     // Finally ensure all threaded work has completed
     queue->Complete(M_MAX_UNSIGNED);
+    
+    // Drawables may have prepared vertex data in the worker threads that must still be uploaded from the main thread
+    for (PODVector<Drawable*>::ConstIterator i = threadedGeometries_.Begin(); i != threadedGeometries_.End(); ++i)
+    {
+        if (*i && (*i)->GetUpdateGeometryType() == UPDATE_MAIN_THREAD)
+            (*i)->UpdateGeometry(frame_);
+    }
+}
+
+unsigned View::GetNumWorkItems() const
+{
+    // When updating in a worker thread, the work is executed serially
+    return threadedUpdate_ ? 1 : GetSubsystem<WorkQueue>()->GetNumThreads() + 1; // Worker threads + main thread
+}
+
+void View::QueueWork(void (*workFunction)(const WorkItem*, unsigned), void* start, void* end, void* aux)
+{
+    // The work queue can only be used from the main thread, so execute immediately when updating in a worker thread. The
+    // per-thread results of index 0 are then used
+    if (threadedUpdate_)
+    {
+        WorkItem item;
+        item.workFunction_ = workFunction;
+        item.start_ = start;
+        item.end_ = end;
+        item.aux_ = aux;
+        workFunction(&item, 0);
+        return;
+    }
+    
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    SharedPtr<WorkItem> item = queue->GetFreeItem();
+    item->priority_ = M_MAX_UNSIGNED;
+    item->workFunction_ = workFunction;
+    item->aux_ = aux;
+    item->start_ = start;
+    item->end_ = end;
+    queue->AddWorkItem(item);
+}
+
+void View::CompleteWork()
+{
+    if (!threadedUpdate_)
+        GetSubsystem<WorkQueue>()->Complete(M_MAX_UNSIGNED);
+}
+
+unsigned View::GetScenePassMask(Drawable* drawable)
+{
+    unsigned mask = 0;
+    const Vector<SourceBatch>& batches = drawable->GetBatches();
+    
+    for (unsigned i = 0; i < batches.Size(); ++i)
+    {
+        const SourceBatch& srcBatch = batches[i];
+        
+        Technique* tech = GetTechnique(drawable, srcBatch.material_);
+        if (!srcBatch.geometry_ || !srcBatch.numWorldTransforms_ || !tech)
+            continue;
+        
+        // Lit alpha batches go to the alpha pass queue
+        for (unsigned j = 0; j < scenePasses_.Size() && j < 32; ++j)
+        {
+            StringHash pass = scenePasses_[j].pass_;
+            if (tech->HasPass(pass) || (pass == alphaPassName_ && tech->HasPass(litAlphaPassName_)))
+                mask |= 1u << j;
+        }
+    }
+    
+    return mask;
+}
+
+void View::SetShadowQueueCamera(ShadowBatchQueue& queue, Camera* camera)
+{
+    if (queue.shadowCamera_ == camera)
+        return;
+    
+    queue.shadowCamera_ = camera;
+    for (PODVector<Batch>::Iterator i = queue.shadowBatches_.batches_.Begin(); i != queue.shadowBatches_.batches_.End(); ++i)
+        i->camera_ = camera;
+    for (HashMap<BatchGroupKey, BatchGroup>::Iterator i = queue.shadowBatches_.batchGroups_.Begin(); i !=
+        queue.shadowBatches_.batchGroups_.End(); ++i)
+        i->second_.camera_ = camera;
 }
 
-void View::GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQueue* alphaQueue)
+void View::GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQueue* alphaQueue, bool addLitBatches)
 {
     Light* light = lightQueue.light_;
     Zone* zone = GetZone(drawable);
@@ -1332,6 +2246,8 @@ void View::GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQ
         
         if (!isLitAlpha)
         {
+            if (!addLitBatches)
+                continue;
             if (destBatch.isBase_)
                 AddBatchToQueue(lightQueue.litBaseBatches_, destBatch, tech);
             else
@@ -1676,6 +2592,9 @@ void View::RenderQuad(RenderPathCommand& command)
     for (HashMap<StringHash, Variant>::ConstIterator k = parameters.Begin(); k != parameters.End(); ++k)
         graphics_->SetShaderParameter(k->first_, k->second_);
     
+    // Parameters are set directly below and may overlap any parameter group, so forget the remembered sources
+    graphics_->ClearParameterSources();
+    
     SetGlobalShaderParameters();
     SetCameraShaderParameters(camera_, false, false);
     
@@ -1953,6 +2872,7 @@ void View::BlitFramebuffer(Texture2D* source, RenderSurface* destination, bool d
     graphics_->SetShaders(graphics_->GetShader(VS, shaderName), graphics_->GetShader(PS, shaderName));
     
     SetGBufferShaderParameters(srcSize, srcRect);
+    graphics_->ClearParameterSource(SP_VIEWPORT);
     
     graphics_->SetTexture(TU_DIFFUSE, source);
     DrawFullscreenQuad(false);
@@ -1986,25 +2906,27 @@ void View::UpdateOccluders(PODVector<Drawable*>& occluders, Camera* camera)
     float occluderSizeThreshold_ = renderer_->GetOccluderSizeThreshold();
     float halfViewSize = camera->GetHalfViewSize();
     float invOrthoSize = 1.0f / camera->GetOrthoSize();
+    occluderKeys_.Clear();
 
     for (PODVector<Drawable*>::Iterator i = occluders.Begin(); i != occluders.End();)
     {
         Drawable* occluder = *i;
         bool erase = false;
         
-        if (!occluder->IsInView(frame_, true))
-            occluder->UpdateBatches(frame_);
+        // Calculate the distance here instead of updating the occluder's batches, as the occluder is not modified while
+        // culling, so that several views of the same scene can be culled at once
+        const BoundingBox& box = occluder->GetWorldBoundingBox();
+        float distance = camera->GetDistance(box.Center());
         
         // Check occluder's draw distance (in main camera view)
         float maxDistance = occluder->GetDrawDistance();
-        if (maxDistance <= 0.0f || occluder->GetDistance() <= maxDistance)
+        if (maxDistance <= 0.0f || distance <= maxDistance)
         {
             // Check that occluder is big enough on the screen
-            const BoundingBox& box = occluder->GetWorldBoundingBox();
             float diagonal = box.Size().Length();
             float compare;
             if (!camera->IsOrthographic())
-                compare = diagonal * halfViewSize / occluder->GetDistance();
+                compare = diagonal * halfViewSize / distance;
             else
                 compare = diagonal * invOrthoSize;
             
@@ -2014,7 +2936,7 @@ void View::UpdateOccluders(PODVector<Drawable*>& occluders, Camera* camera)
             {
                 // Store amount of triangles divided by screen size as a sorting key
                 // (best occluders are big and have few triangles)
-                occluder->SetSortValue((float)occluder->GetNumOccluderTriangles() / compare);
+                occluderKeys_.Push(MakePair((float)occluder->GetNumOccluderTriangles() / compare, occluder));
             }
         }
         else
@@ -2028,7 +2950,11 @@ void View::UpdateOccluders(PODVector<Drawable*>& occluders, Camera* camera)
     
     // Sort occluders so that if triangle budget is exceeded, best occluders have been drawn
     if (occluders.Size())
-        Sort(occluders.Begin(), occluders.End(), CompareDrawables);
+    {
+        Sort(occluderKeys_.Begin(), occluderKeys_.End());
+        for (unsigned j = 0; j < occluderKeys_.Size(); ++j)
+            occluders[j] = occluderKeys_[j].second_;
+    }
 }
 
 void View::DrawOccluders(OcclusionBuffer* buffer, const PODVector<Drawable*>& occluders)
@@ -2054,61 +2980,131 @@ void View::DrawOccluders(OcclusionBuffer* buffer, const PODVector<Drawable*>& oc
     buffer->BuildDepthHierarchy();
 }
 
+void View::ProcessLightGrid(PODVector<bool>& processedLights)
+{
+    lightGridQueries_.Clear();
+    
+    {
+        PROFILE(BuildLightGrid);
+        
+        lightGrid_.Define(camera_, minZ_, maxZ_);
+        for (unsigned i = 0; i < lightQueryResults_.Size(); ++i)
+        {
+            Light* light = lightQueryResults_[i].light_;
+            // Shadowed lights need the octree query also for shadow casters outside the view, so process them normally
+            if (IsShadowed(light) || !lightGrid_.AddLight(light))
+                continue;
+            
+            lightGridQueries_.Push(i);
+        }
+        
+        if (lightGridQueries_.Empty())
+            return;
+        
+        int numWorkItems = GetNumWorkItems();
+        int slicesPerItem = Max((int)(lightGridSlices_.Size() / numWorkItems), 1);
+        
+        PODVector<unsigned>::Iterator start = lightGridSlices_.Begin();
+        while (start != lightGridSlices_.End())
+        {
+            PODVector<unsigned>::Iterator end = lightGridSlices_.End();
+            if (end - start > slicesPerItem)
+                end = start + slicesPerItem;
+            
+            QueueWork(BuildLightGridWork, &(*start), &(*end), &lightGrid_);
+            
+            start = end;
+        }
+        
+        CompleteWork();
+    }
+    
+    unsigned numGridLights = lightGrid_.GetNumLights();
+    
+    {
+        PROFILE(AssignLightGrid);
+        
+        for (unsigned i = 0; i < lightGridResults_.Size(); ++i)
+        {
+            PerThreadLightGridResult& result = lightGridResults_[i];
+            result.litGeometries_.Resize(numGridLights);
+            for (unsigned j = 0; j < numGridLights; ++j)
+                result.litGeometries_[j].Clear();
+            result.visited_.Resize(numGridLights);
+            for (unsigned j = 0; j < numGridLights; ++j)
+                result.visited_[j] = 0;
+        }
+        
+        if (!geometries_.Empty())
+        {
+            int numWorkItems = GetNumWorkItems();
+            int drawablesPerItem = geometries_.Size() / numWorkItems;
+            
+            PODVector<Drawable*>::Iterator start = geometries_.Begin();
+            for (int i = 0; i < numWorkItems; ++i)
+            {
+                PODVector<Drawable*>::Iterator end = geometries_.End();
+                if (i < numWorkItems - 1 && end - start > drawablesPerItem)
+                    end = start + drawablesPerItem;
+                
+                QueueWork(AssignLightGridWork, &(*start), &(*end), this);
+                
+                start = end;
+            }
+            
+            CompleteWork();
+        }
+    }
+    
+    // Combine the per-thread lit geometries into the light query results
+    {
+        PROFILE(CombineLightGrid);
+        
+        for (unsigned i = 0; i < numGridLights; ++i)
+        {
+            unsigned queryIndex = lightGridQueries_[i];
+            LightQueryResult& query = lightQueryResults_[queryIndex];
+            query.litGeometries_.Clear();
+            query.numSplits_ = 0;
+            
+            for (unsigned j = 0; j < lightGridResults_.Size(); ++j)
+                query.litGeometries_.Push(lightGridResults_[j].litGeometries_[i]);
+            
+            processedLights[queryIndex] = true;
+        }
+    }
+}
+
 void View::ProcessLight(LightQueryResult& query, unsigned threadIndex)
 {
     Light* light = query.light_;
     LightType type = light->GetLightType();
     const Frustum& frustum = camera_->GetFrustum();
+    bool isShadowed = IsShadowed(light);
     
-    // Check if light should be shadowed
-    bool isShadowed = drawShadows_ && light->GetCastShadows() && !light->GetPerVertex() && light->GetShadowIntensity() < 1.0f;
-    // If shadow distance non-zero, check it
-    if (isShadowed && light->GetShadowDistance() > 0.0f && light->GetDistance() > light->GetShadowDistance())
-        isShadowed = false;
-    // OpenGL ES can not support point light shadows
-    #ifdef GL_ES_VERSION_2_0
-    if (isShadowed && type == LIGHT_POINT)
-        isShadowed = false;
-    #endif
     // Get lit geometries. They must match the light mask and be inside the main camera frustum to be considered
     PODVector<Drawable*>& tempDrawables = tempDrawables_[threadIndex];
     query.litGeometries_.Clear();
     
-    switch (type)
+    if (type == LIGHT_DIRECTIONAL)
     {
-    case LIGHT_DIRECTIONAL:
         for (unsigned i = 0; i < geometries_.Size(); ++i)
         {
             if (GetLightMask(geometries_[i]) & light->GetLightMask())
                 query.litGeometries_.Push(geometries_[i]);
         }
-        break;
-        
-    case LIGHT_SPOT:
-        {
-            FrustumOctreeQuery octreeQuery(tempDrawables, light->GetFrustum(), DRAWABLE_GEOMETRY,
-                camera_->GetViewMask());
-            octree_->GetDrawables(octreeQuery);
-            for (unsigned i = 0; i < tempDrawables.Size(); ++i)
-            {
-                if (tempDrawables[i]->IsInView(frame_) && (GetLightMask(tempDrawables[i]) & light->GetLightMask()))
-                    query.litGeometries_.Push(tempDrawables[i]);
-            }
-        }
-        break;
-        
-    case LIGHT_POINT:
+    }
+    
+    // For point and spot lights, get the geometries inside the light volume. They are reused for the shadow casters
+    const PODVector<Drawable*>& volumeDrawables = type != LIGHT_DIRECTIONAL ? GetLightVolumeDrawables(query, tempDrawables) :
+        tempDrawables;
+    if (type != LIGHT_DIRECTIONAL)
+    {
+        for (unsigned i = 0; i < volumeDrawables.Size(); ++i)
         {
-            SphereOctreeQuery octreeQuery(tempDrawables, Sphere(light->GetNode()->GetWorldPosition(), light->GetRange()),
-                DRAWABLE_GEOMETRY, camera_->GetViewMask());
-            octree_->GetDrawables(octreeQuery);
-            for (unsigned i = 0; i < tempDrawables.Size(); ++i)
-            {
-                if (tempDrawables[i]->IsInView(frame_) && (GetLightMask(tempDrawables[i]) & light->GetLightMask()))
-                    query.litGeometries_.Push(tempDrawables[i]);
-            }
+            if (volumeDrawables[i]->IsInView(frame_) && (GetLightMask(volumeDrawables[i]) & light->GetLightMask()))
+                query.litGeometries_.Push(volumeDrawables[i]);
         }
-        break;
     }
     
     // If no lit geometries or not shadowed, no need to process shadow cameras
@@ -2121,6 +3117,24 @@ void View::ProcessLight(LightQueryResult& query, unsigned threadIndex)
     // Determine number of shadow cameras and setup their initial positions
     SetupShadowCameras(query);
     
+    // If the light volume and the shadow cameras are unchanged, reuse the cached shadow casters of a point or spot light
+    LightVolumeCache* cache = query.volumeCache_;
+    query.shadowCasterCacheHit_ = query.volumeCacheHit_ && CheckShadowCasterCache(*cache, query);
+    if (query.shadowCasterCacheHit_)
+    {
+        query.shadowCasters_ = cache->shadowCasters_;
+        for (unsigned i = 0; i < query.numSplits_; ++i)
+        {
+            query.shadowCasterBegin_[i] = cache->shadowCasterBegin_[i];
+            query.shadowCasterEnd_[i] = cache->shadowCasterEnd_[i];
+            query.shadowCasterBox_[i] = cache->shadowCasterBox_[i];
+        }
+        
+        if (query.shadowCasters_.Empty())
+            query.numSplits_ = 0;
+        return;
+    }
+    
     // Process each split for shadow casters
     query.shadowCasters_.Clear();
     for (unsigned i = 0; i < query.numSplits_; ++i)
@@ -2148,15 +3162,194 @@ void View::ProcessLight(LightQueryResult& query, unsigned threadIndex)
         }
         
         // Check which shadow casters actually contribute to the shadowing
-        ProcessShadowCasters(query, tempDrawables, i);
+        ProcessShadowCasters(query, type == LIGHT_DIRECTIONAL ? tempDrawables : volumeDrawables, i);
     }
     
+    if (cache)
+        StoreShadowCasterCache(*cache, query);
+    
     // If no shadow casters, the light can be rendered unshadowed. At this point we have not allocated a shadow map yet, so the
     // only cost has been the shadow camera setup & queries
     if (query.shadowCasters_.Empty())
         query.numSplits_ = 0;
 }
 
+bool View::IsShadowed(Light* light) const
+{
+    bool isShadowed = drawShadows_ && light->GetCastShadows() && !light->GetPerVertex() && light->GetShadowIntensity() < 1.0f;
+    // If shadow distance non-zero, check it
+    if (isShadowed && light->GetShadowDistance() > 0.0f && light->GetDistance() > light->GetShadowDistance())
+        isShadowed = false;
+    // OpenGL ES can not support point light shadows
+    #ifdef GL_ES_VERSION_2_0
+    if (isShadowed && light->GetLightType() == LIGHT_POINT)
+        isShadowed = false;
+    #endif
+    
+    return isShadowed;
+}
+
+const PODVector<Drawable*>& View::GetLightVolumeDrawables(LightQueryResult& query, PODVector<Drawable*>& tempDrawables)
+{
+    Light* light = query.light_;
+    LightVolumeCache* cache = query.volumeCache_;
+    
+    query.volumeCacheHit_ = cache && CheckLightVolumeCache(*cache, light);
+    if (query.volumeCacheHit_)
+        return cache->drawables_;
+    if (cache)
+        cache->castersValid_ = false;
+    
+    if (light->GetLightType() == LIGHT_SPOT)
+    {
+        FrustumOctreeQuery octreeQuery(tempDrawables, light->GetFrustum(), DRAWABLE_GEOMETRY, camera_->GetViewMask());
+        octree_->GetDrawables(octreeQuery);
+    }
+    else
+    {
+        SphereOctreeQuery octreeQuery(tempDrawables, Sphere(light->GetNode()->GetWorldPosition(), light->GetRange()),
+            DRAWABLE_GEOMETRY, camera_->GetViewMask());
+        octree_->GetDrawables(octreeQuery);
+    }
+    
+    if (cache)
+    {
+        // Sort by address so that moved drawables can be looked up quickly when validating the cache
+        cache->drawables_ = tempDrawables;
+        Sort(cache->drawables_.Begin(), cache->drawables_.End());
+        cache->octree_ = octree_;
+        cache->transform_ = light->GetNode()->GetWorldTransform();
+        cache->lightType_ = light->GetLightType();
+        cache->range_ = light->GetRange();
+        cache->fov_ = light->GetFov();
+        cache->aspectRatio_ = light->GetAspectRatio();
+        cache->viewMask_ = camera_->GetViewMask();
+        cache->drawablesRevision_ = octree_->GetDrawablesRevision();
+        cache->updateNumber_ = octree_->GetUpdateNumber();
+        cache->valid_ = true;
+    }
+    
+    return tempDrawables;
+}
+
+bool View::CheckLightVolumeCache(LightVolumeCache& cache, Light* light) const
+{
+    // Drawables inserted into or removed from the octree, or light changes, require a new query
+    if (!cache.valid_ || cache.octree_ != octree_ || cache.drawablesRevision_ != octree_->GetDrawablesRevision() ||
+        cache.viewMask_ != camera_->GetViewMask() || cache.lightType_ != light->GetLightType() || cache.range_ !=
+        light->GetRange() || cache.fov_ != light->GetFov() || cache.aspectRatio_ != light->GetAspectRatio() ||
+        cache.transform_ != light->GetNode()->GetWorldTransform())
+        return false;
+    
+    unsigned updateNumber = octree_->GetUpdateNumber();
+    if (cache.updateNumber_ == updateNumber)
+        return true;
+    // Only the drawables moved during the latest update are known, so the cache can not be validated over several updates
+    if (cache.updateNumber_ + 1 != updateNumber)
+        return false;
+    
+    // A moved drawable invalidates the cache if it entered or left the light volume. Moving within the volume is fine, as
+    // the world bounding boxes are always read from the drawables themselves
+    LightType type = light->GetLightType();
+    Sphere sphere(light->GetNode()->GetWorldPosition(), light->GetRange());
+    const Frustum& frustum = light->GetFrustum();
+    const PODVector<Drawable*>& movedDrawables = octree_->GetMovedDrawables();
+    
+    for (PODVector<Drawable*>::ConstIterator i = movedDrawables.Begin(); i != movedDrawables.End(); ++i)
+    {
+        Drawable* drawable = *i;
+        if (!(drawable->GetViewMask() & cache.viewMask_))
+            continue;
+        
+        const BoundingBox& box = drawable->GetWorldBoundingBox();
+        bool inside = (type == LIGHT_SPOT ? frustum.IsInsideFast(box) : sphere.IsInsideFast(box)) != OUTSIDE;
+        
+        // Binary search the sorted cached drawables
+        unsigned first = 0;
+        unsigned last = cache.drawables_.Size();
+        while (first < last)
+        {
+            unsigned middle = (first + last) >> 1;
+            if (cache.drawables_[middle] < drawable)
+                first = middle + 1;
+            else
+                last = middle;
+        }
+        bool cached = first < cache.drawables_.Size() && cache.drawables_[first] == drawable;
+        
+        if (inside != cached)
+            return false;
+    }
+    
+    cache.updateNumber_ = updateNumber;
+    return true;
+}
+
+bool View::CheckShadowCasterCache(const LightVolumeCache& cache, const LightQueryResult& query) const
+{
+    // The shadow casters depend on the camera through the visible depth range, the shadow and draw distances and HLOD
+    if (!cache.castersValid_ || cache.casterCamera_ != camera_ || cache.casterCameraRevision_ != camera_->GetRevision() ||
+        cache.casterMinZ_ != minZ_ || cache.casterMaxZ_ != maxZ_ || cache.numSplits_ != query.numSplits_ ||
+        cache.revisions_.Size() != cache.drawables_.Size())
+        return false;
+    
+    for (unsigned i = 0; i < query.numSplits_; ++i)
+    {
+        Camera* shadowCamera = query.shadowCameras_[i];
+        if (shadowCamera->GetView() != cache.shadowViews_[i] || shadowCamera->GetProjection() != cache.shadowProjections_[i])
+            return false;
+    }
+    
+    // Moving a drawable, or changing its shadow casting, masks or distances increments its batch revision. Any such change
+    // inside the light volume may change the shadow casters
+    for (unsigned i = 0; i < cache.drawables_.Size(); ++i)
+    {
+        if (cache.drawables_[i]->GetBatchRevision() != cache.revisions_[i])
+            return false;
+    }
+    
+    // The shadow batches built from the casters also depend on their geometries and materials
+    for (unsigned i = 0; i < cache.casterStates_.Size(); ++i)
+    {
+        if (!CheckRetainedDrawable(cache.shadowCasters_[i], cache.casterStates_[i], cache.casterBatches_))
+            return false;
+    }
+    
+    return true;
+}
+
+void View::StoreShadowCasterCache(LightVolumeCache& cache, const LightQueryResult& query) const
+{
+    cache.casterCamera_ = camera_;
+    cache.casterCameraRevision_ = camera_->GetRevision();
+    cache.casterMinZ_ = minZ_;
+    cache.casterMaxZ_ = maxZ_;
+    cache.numSplits_ = query.numSplits_;
+    for (unsigned i = 0; i < query.numSplits_; ++i)
+    {
+        Camera* shadowCamera = query.shadowCameras_[i];
+        cache.shadowViews_[i] = shadowCamera->GetView();
+        cache.shadowProjections_[i] = shadowCamera->GetProjection();
+        cache.shadowCasterBegin_[i] = query.shadowCasterBegin_[i];
+        cache.shadowCasterEnd_[i] = query.shadowCasterEnd_[i];
+        cache.shadowCasterBox_[i] = query.shadowCasterBox_[i];
+    }
+    
+    cache.shadowCasters_ = query.shadowCasters_;
+    cache.revisions_.Resize(cache.drawables_.Size());
+    for (unsigned i = 0; i < cache.drawables_.Size(); ++i)
+        cache.revisions_[i] = cache.drawables_[i]->GetBatchRevision();
+    
+    cache.casterStates_.Clear();
+    cache.casterBatches_.Clear();
+    for (PODVector<Drawable*>::ConstIterator i = query.shadowCasters_.Begin(); i != query.shadowCasters_.End(); ++i)
+        StoreRetainedDrawable(*i, cache.casterStates_, cache.casterBatches_);
+    
+    // The casters were found anew, so the shadow batches built from the previous ones can not be reused
+    cache.shadowQueue_ = 0;
+    cache.castersValid_ = true;
+}
+
 void View::ProcessShadowCasters(LightQueryResult& query, const PODVector<Drawable*>& drawables, unsigned splitIndex)
 {
     Light* light = query.light_;
@@ -2201,6 +3394,9 @@ void View::ProcessShadowCasters(LightQueryResult& query, const PODVector<Drawabl
        // For point light, check that this drawable is inside the split shadow camera frustum
         if (type == LIGHT_POINT && shadowCameraFrustum.IsInsideFast(drawable->GetWorldBoundingBox()) == OUTSIDE)
             continue;
+        // Check HLOD switching in the main camera view, so that shadows match the visible geometry
+        if (IsHiddenByHLOD(drawable, camera_))
+            continue;
         
         // Check shadow distance
         float maxShadowDistance = drawable->GetShadowDistance();
@@ -2280,10 +3476,12 @@ bool View::IsShadowCasterVisible(Drawable* drawable, BoundingBox lightViewBox, C
     }
 }
 
-IntRect View::GetShadowMapViewport(Light* light, unsigned splitIndex, Texture2D* shadowMap)
+IntRect View::GetShadowMapViewport(Light* light, unsigned splitIndex, const IntRect& area)
 {
-    unsigned width = shadowMap->GetWidth();
-    unsigned height = shadowMap->GetHeight();
+    int x = area.left_;
+    int y = area.top_;
+    int width = area.Width();
+    int height = area.Height();
     
     switch (light->GetLightType())
     {
@@ -2291,20 +3489,20 @@ IntRect View::GetShadowMapViewport(Light* light, unsigned splitIndex, Texture2D*
         {
             int numSplits = light->GetNumShadowSplits();
             if (numSplits == 1)
-                return IntRect(0, 0, width, height);
+                return area;
             else if (numSplits == 2)
-                return IntRect(splitIndex * width / 2, 0, (splitIndex + 1) * width / 2, height);
+                return IntRect(x + splitIndex * width / 2, y, x + (splitIndex + 1) * width / 2, y + height);
             else
-                return IntRect((splitIndex & 1) * width / 2, (splitIndex / 2) * height / 2, ((splitIndex & 1) + 1) * width / 2,
-                    (splitIndex / 2 + 1) * height / 2);
+                return IntRect(x + (splitIndex & 1) * width / 2, y + (splitIndex / 2) * height / 2, x + ((splitIndex & 1) + 1) *
+                    width / 2, y + (splitIndex / 2 + 1) * height / 2);
         }
         
     case LIGHT_SPOT:
-        return IntRect(0, 0, width, height);
+        return area;
         
     case LIGHT_POINT:
-        return IntRect((splitIndex & 1) * width / 2, (splitIndex / 2) * height / 3, ((splitIndex & 1) + 1) * width / 2,
-            (splitIndex / 2 + 1) * height / 3);
+        return IntRect(x + (splitIndex & 1) * width / 2, y + (splitIndex / 2) * height / 3, x + ((splitIndex & 1) + 1) * width / 2,
+            y + (splitIndex / 2 + 1) * height / 3);
     }
     
     return IntRect();
@@ -2567,7 +3765,6 @@ void View::QuantizeDirLightShadowCamera(Camera* shadowCamera, Light* light, cons
 void View::FindZone(Drawable* drawable)
 {
     Vector3 center = drawable->GetWorldBoundingBox().Center();
-    int bestPriority = M_MIN_INT;
     Zone* newZone = 0;
     
     // If bounding box center is in view, the zone assignment is conclusive also for next frames. Otherwise it is temporary
@@ -2581,18 +3778,7 @@ void View::FindZone(Drawable* drawable)
         (drawable->GetZoneMask() & lastZone->GetZoneMask()) && lastZone->IsInside(center))
         newZone = lastZone;
     else
-    {
-        for (PODVector<Zone*>::Iterator i = zones_.Begin(); i != zones_.End(); ++i)
-        {
-            Zone* zone = *i;
-            int priority = zone->GetPriority();
-            if (priority > bestPriority && (drawable->GetZoneMask() & zone->GetZoneMask()) && zone->IsInside(center))
-            {
-                newZone = zone;
-                bestPriority = priority;
-            }
-        }
-    }
+        newZone = zoneGrid_.FindZone(center, drawable->GetZoneMask());
     
     drawable->SetZone(newZone, temporary);
 }
@@ -2743,28 +3929,76 @@ void View::PrepareInstancingBuffer()
         totalInstances += i->litBatches_.GetNumInstances();
     }
     
+    // Assign the instance ranges of all groups first, so that the transforms can be written in any order
+    unsigned freeIndex = 0;
+    instancedGroups_.Clear();
+    for (HashMap<StringHash, BatchQueue>::Iterator i = batchQueues_.Begin(); i != batchQueues_.End(); ++i)
+        i->second_.SetStartIndices(freeIndex, instancedGroups_);
+    
+    for (Vector<LightBatchQueue>::Iterator i = lightQueues_.Begin(); i != lightQueues_.End(); ++i)
+    {
+        for (unsigned j = 0; j < i->shadowSplits_.Size(); ++j)
+            i->shadowSplits_[j].shadowBatches_.SetStartIndices(freeIndex, instancedGroups_);
+        i->litBaseBatches_.SetStartIndices(freeIndex, instancedGroups_);
+        i->litBatches_.SetStartIndices(freeIndex, instancedGroups_);
+    }
+    
     // If fail to set buffer size, fall back to per-group locking
+    void* dest = 0;
+    VertexBuffer* instancingBuffer = 0;
     if (totalInstances && renderer_->ResizeInstancingBuffer(totalInstances))
     {
-        VertexBuffer* instancingBuffer = renderer_->GetInstancingBuffer();
-        unsigned freeIndex = 0;
-        void* dest = instancingBuffer->Lock(0, totalInstances, true);
-        if (!dest)
-            return;
-        
-        for (HashMap<StringHash, BatchQueue>::Iterator i = batchQueues_.Begin(); i != batchQueues_.End(); ++i)
-            i->second_.SetTransforms(dest, freeIndex);
+        instancingBuffer = renderer_->GetInstancingBuffer();
+        dest = instancingBuffer->Lock(0, totalInstances, true);
+    }
+    
+    if (!dest)
+    {
+        for (PODVector<BatchGroup*>::Iterator i = instancedGroups_.Begin(); i != instancedGroups_.End(); ++i)
+            (*i)->startIndex_ = M_MAX_UNSIGNED;
+        return;
+    }
+    
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    unsigned numWorkItems = queue->GetNumThreads() + 1; // Worker threads + main thread
+    
+    if (numWorkItems > 1 && totalInstances >= MIN_THREADED_INSTANCES)
+    {
+        // Split the groups so that each work item writes roughly the same amount of instances
+        unsigned instancesPerItem = totalInstances / numWorkItems;
+        unsigned itemInstances = 0;
+        PODVector<BatchGroup*>::Iterator start = instancedGroups_.Begin();
         
-        for (Vector<LightBatchQueue>::Iterator i = lightQueues_.Begin(); i != lightQueues_.End(); ++i)
+        for (PODVector<BatchGroup*>::Iterator i = instancedGroups_.Begin(); i != instancedGroups_.End(); ++i)
         {
-            for (unsigned j = 0; j < i->shadowSplits_.Size(); ++j)
-                i->shadowSplits_[j].shadowBatches_.SetTransforms(dest, freeIndex);
-            i->litBaseBatches_.SetTransforms(dest, freeIndex);
-            i->litBatches_.SetTransforms(dest, freeIndex);
+            itemInstances += (*i)->instances_.Size();
+            if (itemInstances >= instancesPerItem || i + 1 == instancedGroups_.End())
+            {
+                PODVector<BatchGroup*>::Iterator end = i + 1;
+                
+                SharedPtr<WorkItem> item = queue->GetFreeItem();
+                item->priority_ = M_MAX_UNSIGNED;
+                item->workFunction_ = WriteInstanceTransformsWork;
+                item->aux_ = dest;
+                item->start_ = &(*start);
+                item->end_ = &(*end);
+                queue->AddWorkItem(item);
+                
+                start = end;
+                itemInstances = 0;
+            }
         }
         
-        instancingBuffer->Unlock();
+        queue->Complete(M_MAX_UNSIGNED);
+    }
+    else
+    {
+        for (PODVector<BatchGroup*>::Iterator i = instancedGroups_.Begin(); i != instancedGroups_.End(); ++i)
+            (*i)->WriteTransforms(dest);
+        BatchGroup::FinishTransforms();
     }
+    
+    instancingBuffer->Unlock();
 }
 
 void View::SetupLightVolumeBatch(Batch& batch)
@@ -2828,7 +4062,17 @@ void View::RenderShadowMap(const LightBatchQueue& queue)
     for (unsigned i = 1; i < MAX_RENDERTARGETS; ++i)
         graphics_->SetRenderTarget(i, (RenderSurface*)0);
     graphics_->SetDepthStencil(shadowMap);
-    graphics_->SetViewport(IntRect(0, 0, shadowMap->GetWidth(), shadowMap->GetHeight()));
+    // Clear only the light's own splits, as the shadow map may be an atlas shared with other lights
+    IntRect clearRect(shadowMap->GetWidth(), shadowMap->GetHeight(), 0, 0);
+    for (unsigned i = 0; i < queue.shadowSplits_.Size(); ++i)
+    {
+        const IntRect& viewport = queue.shadowSplits_[i].shadowViewport_;
+        clearRect.left_ = Min(clearRect.left_, viewport.left_);
+        clearRect.top_ = Min(clearRect.top_, viewport.top_);
+        clearRect.right_ = Max(clearRect.right_, viewport.right_);
+        clearRect.bottom_ = Max(clearRect.bottom_, viewport.bottom_);
+    }
+    graphics_->SetViewport(clearRect);
     graphics_->Clear(CLEAR_DEPTH);
 
     // Set shadow depth bias
@@ -25,18 +25,23 @@
 #include "Batch.h"
 #include "HashSet.h"
 #include "Light.h"
+#include "LightGrid.h"
 #include "List.h"
 #include "Object.h"
 #include "Polyhedron.h"
+#include "ShadowAtlas.h"
 #include "Zone.h"
+#include "ZoneGrid.h"
 
 namespace Urho3D
 {
 
 class Camera;
 class DebugRenderer;
+class Geometry;
 class Light;
 class Drawable;
+class Material;
 class OcclusionBuffer;
 class Octree;
 class RenderPath;
@@ -48,11 +53,128 @@ class Zone;
 struct RenderPathCommand;
 struct WorkItem;
 
+/// Drawable state recorded for validating retained batches.
+struct RetainedDrawable
+{
+    /// Drawable.
+    Drawable* drawable_;
+    /// Batch revision.
+    unsigned revision_;
+    /// Number of source batches.
+    unsigned numBatches_;
+    /// Index of the first recorded source batch.
+    unsigned batchStart_;
+    /// Scene passes the drawable's batches were added to, as a bitmask of scene pass indices.
+    unsigned passMask_;
+    /// Lit base pass flags.
+    unsigned basePassFlags_;
+};
+
+/// Source batch state recorded for validating retained batches.
+struct RetainedSourceBatch
+{
+    /// Distance from camera.
+    float distance_;
+    /// Geometry.
+    Geometry* geometry_;
+    /// Material.
+    Material* material_;
+    /// Material revision.
+    unsigned materialRevision_;
+    /// World transform(s).
+    const Matrix3x4* worldTransform_;
+    /// Number of world transforms.
+    unsigned numWorldTransforms_;
+    /// %Geometry type.
+    GeometryType geometryType_;
+    /// Override view transform flag.
+    bool overrideView_;
+};
+
+/// Cached octree query result and shadow casters of a shadowed point or spot light's volume, reused while the light and the drawables in its volume do not change.
+struct LightVolumeCache
+{
+    /// Construct.
+    LightVolumeCache() :
+        octree_(0),
+        valid_(false),
+        casterCamera_(0),
+        shadowQueue_(0),
+        castersValid_(false)
+    {
+    }
+    
+    /// Octree the query was made to.
+    Octree* octree_;
+    /// Light world transform.
+    Matrix3x4 transform_;
+    /// Light type.
+    LightType lightType_;
+    /// Light range.
+    float range_;
+    /// Spot light field of view.
+    float fov_;
+    /// Spot light aspect ratio.
+    float aspectRatio_;
+    /// Camera view mask of the query.
+    unsigned viewMask_;
+    /// Octree drawables revision of the query.
+    unsigned drawablesRevision_;
+    /// Octree update number the drawables were last validated on.
+    unsigned updateNumber_;
+    /// Frame number the cache was last used on.
+    unsigned frameNumber_;
+    /// Drawables inside the light volume, sorted by address.
+    PODVector<Drawable*> drawables_;
+    /// Valid flag.
+    bool valid_;
+    /// Camera the shadow casters were found for.
+    Camera* casterCamera_;
+    /// Camera revision the shadow casters were found for.
+    unsigned casterCameraRevision_;
+    /// Minimum view space depth of visible geometry the shadow casters were found for.
+    float casterMinZ_;
+    /// Maximum view space depth of visible geometry the shadow casters were found for.
+    float casterMaxZ_;
+    /// Number of shadow splits.
+    unsigned numSplits_;
+    /// Shadow camera view transforms.
+    Matrix3x4 shadowViews_[MAX_LIGHT_SPLITS];
+    /// Shadow camera projections.
+    Matrix4 shadowProjections_[MAX_LIGHT_SPLITS];
+    /// Shadow casters.
+    PODVector<Drawable*> shadowCasters_;
+    /// Shadow caster start indices.
+    unsigned shadowCasterBegin_[MAX_LIGHT_SPLITS];
+    /// Shadow caster end indices.
+    unsigned shadowCasterEnd_[MAX_LIGHT_SPLITS];
+    /// Combined bounding box of shadow casters in light projection space.
+    BoundingBox shadowCasterBox_[MAX_LIGHT_SPLITS];
+    /// Batch revisions of the drawables inside the light volume when the shadow casters were found.
+    PODVector<unsigned> revisions_;
+    /// Recorded shadow caster states.
+    PODVector<RetainedDrawable> casterStates_;
+    /// Recorded shadow caster source batch states.
+    PODVector<RetainedSourceBatch> casterBatches_;
+    /// Light queue holding the shadow batches built from the cached shadow casters.
+    LightBatchQueue* shadowQueue_;
+    /// Light queues revision the shadow batches were last used on.
+    unsigned shadowQueueRevision_;
+    /// Shadow casters valid flag.
+    bool castersValid_;
+};
+
 /// Intermediate light processing result.
 struct LightQueryResult
 {
     /// Light.
     Light* light_;
+    /// Light volume cache, or null if not cached.
+    LightVolumeCache* volumeCache_;
+    /// Whether the light volume cache was reused.
+    bool volumeCacheHit_;
+    /// Whether the cached shadow casters were reused.
+    bool shadowCasterCacheHit_;
     /// Lit geometries.
     PODVector<Drawable*> litGeometries_;
     /// Shadow casters.
@@ -93,6 +215,8 @@ struct ScenePassInfo
 /// Per-thread geometry, light and scene range collection structure.
 struct PerThreadSceneResult
 {
+    /// Drawables that passed culling.
+    PODVector<Drawable*> drawables_;
     /// Geometry objects.
     PODVector<Drawable*> geometries_;
     /// Lights.
@@ -103,13 +227,45 @@ struct PerThreadSceneResult
     float maxZ_;
 };
 
+/// Per-thread light grid assignment results.
+struct PerThreadLightGridResult
+{
+    /// Lit geometries for each light of the grid.
+    Vector<PODVector<Drawable*> > litGeometries_;
+    /// Light indices of the drawable being processed.
+    PODVector<unsigned> lights_;
+    /// Visited flags for light candidate collection.
+    PODVector<unsigned char> visited_;
+};
+
+/// Light queue state recorded for validating retained batches.
+struct RetainedLightQueue
+{
+    /// Light.
+    Light* light_;
+    /// Number of shadow splits.
+    unsigned numSplits_;
+    /// Lit geometries.
+    PODVector<Drawable*> litGeometries_;
+    /// Shadow casters.
+    PODVector<Drawable*> shadowCasters_;
+    /// Shadow caster begin indices.
+    unsigned shadowCasterBegin_[MAX_LIGHT_SPLITS];
+    /// Shadow caster end indices.
+    unsigned shadowCasterEnd_[MAX_LIGHT_SPLITS];
+    /// Recorded shadow caster states.
+    PODVector<RetainedDrawable> casters_;
+};
+
 static const unsigned MAX_VIEWPORT_TEXTURES = 2;
 
 /// Internal structure for 3D rendering work. Created for each backbuffer and texture viewport, but not for shadow cameras.
 class URHO3D_API View : public Object
 {
+    friend void CullDrawablesWork(const WorkItem* item, unsigned threadIndex);
     friend void CheckVisibilityWork(const WorkItem* item, unsigned threadIndex);
     friend void ProcessLightWork(const WorkItem* item, unsigned threadIndex);
+    friend void AssignLightGridWork(const WorkItem* item, unsigned threadIndex);
     
     OBJECT(View);
     
@@ -121,8 +277,18 @@ public:
     
     /// Define with rendertarget and viewport. Return true if successful.
     bool Define(RenderSurface* renderTarget, Viewport* viewport);
+    /// Set up the octree queries ahead of Update(), so that the queries of several views can run in parallel. Is called by Renderer.
+    void PrepareQuery(const FrameInfo& frame);
+    /// Perform the prepared octree queries. May be called from a worker thread.
+    void ExecuteQuery();
+    /// Copy the octree query results of another prepared view with the same octree, camera and view size. Call only after the other view's query has been executed.
+    void ShareQuery(View* view);
     /// Update and cull objects and construct rendering batches.
     void Update(const FrameInfo& frame);
+    /// Perform the first part of Update(): cull objects without modifying them. Views with different cameras, also of the same scene, can be culled concurrently. If threaded, may be called from a worker thread, in which case the work is not split to the work queue. Is called by Renderer.
+    void BeginUpdate(const FrameInfo& frame, bool threaded = false);
+    /// Perform the second part of Update() in the main thread: update the visible objects, process lights and construct rendering batches. Is called by Renderer.
+    void EndUpdate();
     /// Render batches.
     void Render();
     
@@ -136,6 +302,8 @@ public:
     Octree* GetOctree() const { return octree_; }
     /// Return camera.
     Camera* GetCamera() const { return camera_; }
+    /// Return view dimensions.
+    const IntVector2& GetViewSize() const { return viewSize_; }
     /// Return information of the frame being rendered.
     const FrameInfo& GetFrameInfo() const { return frame_; }
     /// Return the rendertarget. 0 if using the backbuffer.
@@ -150,6 +318,8 @@ public:
     const PODVector<Light*>& GetLights() const { return lights_; }
     /// Return light batch queues.
     const Vector<LightBatchQueue>& GetLightQueues() const { return lightQueues_; }
+    /// Return the clustered light grid. Only contains lights if clustered light assignment was used on this frame.
+    const LightGrid& GetLightGrid() const { return lightGrid_; }
     /// Set global (per-frame) shader parameters. Called by Batch and internally by View.
     void SetGlobalShaderParameters();
     /// Set camera-specific shader parameters. Called by Batch and internally by View.
@@ -158,14 +328,46 @@ public:
     void SetGBufferShaderParameters(const IntVector2& texSize, const IntRect& viewRect);
     
 private:
-    /// Query the octree for drawable objects.
+    /// Query the octree for drawable objects and cull them by occlusion, without modifying them.
+    void CullDrawables();
+    /// Update the drawable objects that passed culling and collect the visible geometries and lights.
     void GetDrawables();
+    /// Process lit geometries and shadow casters for each light.
+    void ProcessLights();
     /// Construct batches from the drawable objects.
     void GetBatches();
+    /// Clear the batch queues and invalidate retained batches.
+    void ClearBatches();
+    /// Return whether the previous frame's batches can be reused.
+    bool CheckRetainedBatches();
+    /// Check a drawable's state against its recorded state.
+    bool CheckRetainedDrawable(Drawable* drawable, const RetainedDrawable& retained, const PODVector<RetainedSourceBatch>&
+        sourceBatches) const;
+    /// Check a light's shadow casters against the recorded state for retained batches.
+    bool CheckRetainedShadowCasters(const LightQueryResult& query, const RetainedLightQueue& retained) const;
+    /// Record the state the batches were built from.
+    void StoreRetainedBatches();
+    /// Record a drawable's state.
+    void StoreRetainedDrawable(Drawable* drawable, PODVector<RetainedDrawable>& dest, PODVector<RetainedSourceBatch>&
+        destBatches) const;
+    /// Restore per-frame drawable and light state when reusing the previous frame's batches.
+    void RestoreRetainedBatches();
+    /// Return hash code of the view settings that affect batch construction.
+    unsigned GetBatchSettingsHash() const;
     /// Update geometries and sort batches.
     void UpdateGeometries();
-    /// Get pixel lit batches for a certain light and drawable.
-    void GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQueue* alphaQueue);
+    /// Return number of work items to split parallel work into.
+    unsigned GetNumWorkItems() const;
+    /// Queue a work item, or execute it immediately if updating in a worker thread.
+    void QueueWork(void (*workFunction)(const WorkItem*, unsigned), void* start, void* end, void* aux);
+    /// Complete the queued work items.
+    void CompleteWork();
+    /// Return the scene passes a drawable's batches are added to, as a bitmask of scene pass indices.
+    unsigned GetScenePassMask(Drawable* drawable);
+    /// Get pixel lit batches for a certain light and drawable. If addLitBatches is false, only lit alpha batches are added.
+    void GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQueue* alphaQueue, bool addLitBatches = true);
+    /// Point a retained shadow batch queue and its batches to this frame's shadow camera.
+    void SetShadowQueueCamera(ShadowBatchQueue& queue, Camera* camera);
     /// Execute render commands.
     void ExecuteRenderPathCommands();
     /// Set rendertargets for current render command.
@@ -192,8 +394,20 @@ private:
     void UpdateOccluders(PODVector<Drawable*>& occluders, Camera* camera);
     /// Draw occluders to occlusion buffer.
     void DrawOccluders(OcclusionBuffer* buffer, const PODVector<Drawable*>& occluders);
+    /// Assign unshadowed point and spot lights to the visible geometries through the clustered light grid. Mark the lights that were processed.
+    void ProcessLightGrid(PODVector<bool>& processedLights);
     /// Query for lit geometries and shadow casters for a light.
     void ProcessLight(LightQueryResult& query, unsigned threadIndex);
+    /// Return whether a light should be rendered with shadows.
+    bool IsShadowed(Light* light) const;
+    /// Return the geometries inside a point or spot light's volume, either from the light volume cache or by querying the octree.
+    const PODVector<Drawable*>& GetLightVolumeDrawables(LightQueryResult& query, PODVector<Drawable*>& tempDrawables);
+    /// Check whether a light volume cache is still valid for a light. Takes the drawables moved during the latest octree update into account.
+    bool CheckLightVolumeCache(LightVolumeCache& cache, Light* light) const;
+    /// Check whether the cached shadow casters of a point or spot light can be reused.
+    bool CheckShadowCasterCache(const LightVolumeCache& cache, const LightQueryResult& query) const;
+    /// Store the shadow casters of a point or spot light to its light volume cache.
+    void StoreShadowCasterCache(LightVolumeCache& cache, const LightQueryResult& query) const;
     /// Process shadow casters' visibilities and build their combined view- or projection-space bounding box.
     void ProcessShadowCasters(LightQueryResult& query, const PODVector<Drawable*>& drawables, unsigned splitIndex);
     /// Set up initial shadow camera view(s).
@@ -206,8 +420,8 @@ private:
     void QuantizeDirLightShadowCamera(Camera* shadowCamera, Light* light, const IntRect& shadowViewport, const BoundingBox& viewBox);
     /// Check visibility of one shadow caster.
     bool IsShadowCasterVisible(Drawable* drawable, BoundingBox lightViewBox, Camera* shadowCamera, const Matrix3x4& lightView, const Frustum& lightViewFrustum, const BoundingBox& lightViewFrustumBox);
-    /// Return the viewport for a shadow map split.
-    IntRect GetShadowMapViewport(Light* light, unsigned splitIndex, Texture2D* shadowMap);
+    /// Return the viewport for a shadow map split within the light's shadow map area.
+    IntRect GetShadowMapViewport(Light* light, unsigned splitIndex, const IntRect& area);
     /// Find and set a new zone for a drawable when it has moved.
     void FindZone(Drawable* drawable);
     /// Return material technique, considering the drawable's LOD distance.
@@ -273,6 +487,8 @@ private:
     Zone* farClipZone_;
     /// Occlusion buffer for the main camera.
     OcclusionBuffer* occlusionBuffer_;
+    /// Potentially visible set bits of the cell the camera is inside, or null if not available.
+    const unsigned char* pvsVisibility_;
     /// Destination color rendertarget.
     RenderSurface* renderTarget_;
     /// Substitute rendertarget for deferred rendering. Allocated if necessary.
@@ -323,8 +539,14 @@ private:
     Vector<PODVector<Drawable*> > tempDrawables_;
     /// Per-thread geometries, lights and Z range collection results.
     Vector<PerThreadSceneResult> sceneResults_;
+    /// Drawables that passed culling in BeginUpdate(), to be updated in EndUpdate().
+    PODVector<Drawable*> visibleDrawables_;
+    /// Occluder sort keys.
+    PODVector<Pair<float, Drawable*> > occluderKeys_;
     /// Visible zones.
     PODVector<Zone*> zones_;
+    /// Zone lookup grid.
+    ZoneGrid zoneGrid_;
     /// Visible geometry objects.
     PODVector<Drawable*> geometries_;
     /// Geometry objects that will be updated in the main thread.
@@ -341,6 +563,20 @@ private:
     HashMap<StringHash, Texture2D*> renderTargets_;
     /// Intermediate light processing results.
     Vector<LightQueryResult> lightQueryResults_;
+    /// Light volume caches of shadowed point and spot lights.
+    HashMap<Light*, LightVolumeCache> lightVolumeCaches_;
+    /// Revision of the light queues, incremented each time they are reassigned to lights.
+    unsigned lightQueuesRevision_;
+    /// Shadow map atlas packing. Is kept per view so that the packing stays stable from frame to frame.
+    ShadowAtlas shadowAtlas_;
+    /// Clustered light grid.
+    LightGrid lightGrid_;
+    /// Light query result indices of the lights in the light grid.
+    PODVector<unsigned> lightGridQueries_;
+    /// Depth slice indices of the light grid for building in worker threads.
+    PODVector<unsigned> lightGridSlices_;
+    /// Per-thread light grid assignment results.
+    Vector<PerThreadLightGridResult> lightGridResults_;
     /// Info for scene render passes defined by the renderpath.
     Vector<ScenePassInfo> scenePasses_;
     /// Per-pixel light queues.
@@ -349,6 +585,8 @@ private:
     HashMap<unsigned long long, LightBatchQueue> vertexLightQueues_;
     /// Batch queues.
     HashMap<StringHash, BatchQueue> batchQueues_;
+    /// Instanced batch groups for writing the instancing buffer.
+    PODVector<BatchGroup*> instancedGroups_;
     /// Hash of the GBuffer pass, or null if none.
     StringHash gBufferPassName_;
     /// Hash of the opaque forward base pass.
@@ -365,6 +603,46 @@ private:
     String lightVolumeVSName_;
     /// Name of light volume pixel shader.
     String lightVolumePSName_;
+    /// Recorded drawable states of the retained batches.
+    PODVector<RetainedDrawable> retainedDrawables_;
+    /// Recorded source batch states of the retained batches.
+    PODVector<RetainedSourceBatch> retainedSourceBatches_;
+    /// Recorded light queue states of the retained batches.
+    Vector<RetainedLightQueue> retainedLightQueues_;
+    /// Visible geometries whose batches changed since the retained batches were built.
+    HashSet<Drawable*> changedDrawables_;
+    /// Batch queues reused from the previous frame. These are already sorted.
+    HashSet<BatchQueue*> retainedQueues_;
+    /// Camera the retained batches were built with.
+    Camera* retainedCamera_;
+    /// Camera revision the retained batches were built with.
+    unsigned retainedCameraRevision_;
+    /// View settings hash the retained batches were built with.
+    unsigned retainedSettingsHash_;
+    /// Retained batches valid flag.
+    bool retainedBatchesValid_;
+    /// Batches reused from the previous frame flag.
+    bool batchesRetained_;
+    /// Reuse the batch queues of unchanged drawables flag. Set when processing lights.
+    bool retainBatchQueues_;
+    /// Updating in a worker thread flag.
+    bool threadedUpdate_;
+    /// Zone and occluder results of the octree query performed ahead of Update().
+    PODVector<Drawable*> queryZonesOccluders_;
+    /// Geometry and light results of the octree query performed ahead of Update(). Only used when occlusion is disabled.
+    PODVector<Drawable*> queryDrawables_;
+    /// Camera of the prepared octree query.
+    Camera* queryCamera_;
+    /// Octree of the prepared octree query.
+    Octree* queryOctree_;
+    /// Frame number of the prepared octree query, or M_MAX_UNSIGNED if none.
+    unsigned queryFrameNumber_;
+    /// Camera revision of the prepared octree query.
+    unsigned queryCameraRevision_;
+    /// Octree drawable revision of the prepared octree query.
+    unsigned queryOctreeRevision_;
+    /// Prepared octree query includes geometries and lights flag.
+    bool queryHasDrawables_;
 };
 
 }
@@ -92,7 +92,7 @@ void Zone::RegisterObject(Context* context)
 
 void Zone::OnSetAttribute(const AttributeInfo& attr, const Variant& src)
 {
-    Serializable::OnSetAttribute(attr, src);
+    Drawable::OnSetAttribute(attr, src);
 
     // If bounding box or priority changes, dirty the drawable as applicable
     if ((attr.offset_ >= offsetof(Zone, boundingBox_) && attr.offset_ < (offsetof(Zone, boundingBox_) + sizeof(BoundingBox))) ||
@@ -116,6 +116,7 @@ void Zone::SetBoundingBox(const BoundingBox& box)
 void Zone::SetAmbientColor(const Color& color)
 {
     ambientColor_ = Color(color, 1.0f);
+    MarkBatchesDirty();
     MarkNetworkUpdate();
 }
 
@@ -158,6 +159,8 @@ void Zone::SetFogHeightScale(float scale)
 void Zone::SetPriority(int priority)
 {
     priority_ = priority;
+    MarkBatchesDirty();
+    OnMarkedDirty(node_);
     MarkNetworkUpdate();
 }
 
@@ -170,18 +173,22 @@ void Zone::SetZoneTexture(Texture* texture)
 void Zone::SetHeightFog(bool enable)
 {
     heightFog_ = enable;
+    MarkBatchesDirty();
     MarkNetworkUpdate();
 }
 
 void Zone::SetOverride(bool enable)
 {
     override_ = enable;
+    MarkBatchesDirty();
+    OnMarkedDirty(node_);
     MarkNetworkUpdate();
 }
 
 void Zone::SetAmbientGradient(bool enable)
 {
     ambientGradient_ = enable;
+    MarkBatchesDirty();
     MarkNetworkUpdate();
 }
 
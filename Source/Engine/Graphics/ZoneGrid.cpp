@@ -0,0 +1,167 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "Precompiled.h"
+#include "Zone.h"
+#include "ZoneGrid.h"
+
+#include "DebugNew.h"
+
+namespace Urho3D
+{
+
+ZoneGrid::ZoneGrid() :
+    cellSize_(Vector3::ONE),
+    numCellsX_(0),
+    numCellsY_(0),
+    numCellsZ_(0)
+{
+}
+
+bool ZoneGrid::Update(const PODVector<Zone*>& zones)
+{
+    bool changed = zones.Size() != lastZones_.Size();
+    
+    if (!changed)
+    {
+        for (unsigned i = 0; i < zones.Size(); ++i)
+        {
+            Zone* zone = zones[i];
+            if (zone != lastZones_[i] || zone->GetPriority() != lastPriorities_[i] || zone->GetWorldBoundingBox() != lastBoxes_[i])
+            {
+                changed = true;
+                break;
+            }
+        }
+    }
+    
+    if (!changed)
+        return false;
+    
+    lastZones_ = zones;
+    lastBoxes_.Resize(zones.Size());
+    lastPriorities_.Resize(zones.Size());
+    for (unsigned i = 0; i < zones.Size(); ++i)
+    {
+        lastBoxes_[i] = zones[i]->GetWorldBoundingBox();
+        lastPriorities_[i] = zones[i]->GetPriority();
+    }
+    
+    Build();
+    return true;
+}
+
+void ZoneGrid::Clear()
+{
+    zones_.Clear();
+    lastZones_.Clear();
+    lastBoxes_.Clear();
+    lastPriorities_.Clear();
+    cells_.Clear();
+    boundingBox_.defined_ = false;
+    numCellsX_ = numCellsY_ = numCellsZ_ = 0;
+}
+
+Zone* ZoneGrid::FindZone(const Vector3& point, unsigned zoneMask) const
+{
+    if (zones_.Empty() || boundingBox_.IsInside(point) == OUTSIDE)
+        return 0;
+    
+    Vector3 offset = point - boundingBox_.min_;
+    unsigned x = Min((int)(offset.x_ / cellSize_.x_), (int)numCellsX_ - 1);
+    unsigned y = Min((int)(offset.y_ / cellSize_.y_), (int)numCellsY_ - 1);
+    unsigned z = Min((int)(offset.z_ / cellSize_.z_), (int)numCellsZ_ - 1);
+    
+    // The candidates are in descending priority order, so the first match is the result
+    const PODVector<unsigned>& cell = cells_[(z * numCellsY_ + y) * numCellsX_ + x];
+    for (PODVector<unsigned>::ConstIterator i = cell.Begin(); i != cell.End(); ++i)
+    {
+        Zone* zone = zones_[*i];
+        if ((zone->GetZoneMask() & zoneMask) && zone->IsInside(point))
+            return zone;
+    }
+    
+    return 0;
+}
+
+void ZoneGrid::Build()
+{
+    // Order the zones by descending priority. Use insertion sort to keep the order stable for equal priorities
+    zones_.Clear();
+    boundingBox_.defined_ = false;
+    for (unsigned i = 0; i < lastZones_.Size(); ++i)
+    {
+        Zone* zone = lastZones_[i];
+        int priority = lastPriorities_[i];
+        unsigned j = zones_.Size();
+        while (j > 0 && zones_[j - 1]->GetPriority() < priority)
+            --j;
+        zones_.Insert(j, zone);
+        boundingBox_.Merge(lastBoxes_[i]);
+        
+        // Make sure the cached inverse transform is up to date before the zone is tested from worker threads
+        zone->GetInverseWorldTransform();
+    }
+    
+    if (zones_.Empty())
+    {
+        Clear();
+        return;
+    }
+    
+    // Use roughly a few cells per zone, up to a maximum resolution
+    unsigned numCells = (unsigned)ceilf(powf(4.0f * zones_.Size(), 1.0f / 3.0f));
+    numCellsX_ = numCellsY_ = numCellsZ_ = Clamp((int)numCells, 1, (int)ZONEGRID_MAX_CELLS);
+    
+    Vector3 size = boundingBox_.Size();
+    cellSize_ = Vector3(Max(size.x_ / numCellsX_, M_EPSILON), Max(size.y_ / numCellsY_, M_EPSILON), Max(size.z_ / numCellsZ_,
+        M_EPSILON));
+    
+    cells_.Resize(numCellsX_ * numCellsY_ * numCellsZ_);
+    for (unsigned i = 0; i < cells_.Size(); ++i)
+        cells_[i].Clear();
+    
+    for (unsigned i = 0; i < zones_.Size(); ++i)
+    {
+        const BoundingBox& box = zones_[i]->GetWorldBoundingBox();
+        Vector3 minOffset = box.min_ - boundingBox_.min_;
+        Vector3 maxOffset = box.max_ - boundingBox_.min_;
+        unsigned minX = Clamp((int)(minOffset.x_ / cellSize_.x_), 0, (int)numCellsX_ - 1);
+        unsigned minY = Clamp((int)(minOffset.y_ / cellSize_.y_), 0, (int)numCellsY_ - 1);
+        unsigned minZ = Clamp((int)(minOffset.z_ / cellSize_.z_), 0, (int)numCellsZ_ - 1);
+        unsigned maxX = Clamp((int)(maxOffset.x_ / cellSize_.x_), 0, (int)numCellsX_ - 1);
+        unsigned maxY = Clamp((int)(maxOffset.y_ / cellSize_.y_), 0, (int)numCellsY_ - 1);
+        unsigned maxZ = Clamp((int)(maxOffset.z_ / cellSize_.z_), 0, (int)numCellsZ_ - 1);
+        
+        for (unsigned z = minZ; z <= maxZ; ++z)
+        {
+            for (unsigned y = minY; y <= maxY; ++y)
+            {
+                for (unsigned x = minX; x <= maxX; ++x)
+                    cells_[(z * numCellsY_ + y) * numCellsX_ + x].Push(i);
+            }
+        }
+    }
+}
+
+}
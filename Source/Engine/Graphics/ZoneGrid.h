@@ -0,0 +1,81 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "BoundingBox.h"
+#include "Vector.h"
+
+namespace Urho3D
+{
+
+class Zone;
+
+static const unsigned ZONEGRID_MAX_CELLS = 16;
+
+/// Uniform grid of priority-ordered zone candidate lists for fast zone lookup.
+class URHO3D_API ZoneGrid
+{
+public:
+    /// Construct.
+    ZoneGrid();
+    
+    /// Update from a set of zones. The grid is only rebuilt if the zones, their world bounding boxes or priorities have changed. Return true if was rebuilt. Must be called from the main thread.
+    bool Update(const PODVector<Zone*>& zones);
+    /// Remove all zones.
+    void Clear();
+    /// Return the highest priority zone that contains a point and matches the zone mask, or null if none. Is thread-safe once updated.
+    Zone* FindZone(const Vector3& point, unsigned zoneMask = M_MAX_UNSIGNED) const;
+    
+    /// Return number of zones.
+    unsigned GetNumZones() const { return zones_.Size(); }
+    /// Return the combined world bounding box of the zones.
+    const BoundingBox& GetBoundingBox() const { return boundingBox_; }
+    
+private:
+    /// Rebuild the grid.
+    void Build();
+    
+    /// Zones in descending priority order.
+    PODVector<Zone*> zones_;
+    /// Zones in the order they were last updated with, for change detection.
+    PODVector<Zone*> lastZones_;
+    /// World bounding boxes of the zones in update order, for change detection.
+    Vector<BoundingBox> lastBoxes_;
+    /// Priorities of the zones in update order, for change detection.
+    PODVector<int> lastPriorities_;
+    /// Zone indices per cell, in descending priority order.
+    Vector<PODVector<unsigned> > cells_;
+    /// Combined world bounding box of the zones.
+    BoundingBox boundingBox_;
+    /// Cell size.
+    Vector3 cellSize_;
+    /// Number of cells on the X axis.
+    unsigned numCellsX_;
+    /// Number of cells on the Y axis.
+    unsigned numCellsY_;
+    /// Number of cells on the Z axis.
+    unsigned numCellsZ_;
+};
+
+}
@@ -177,6 +177,12 @@ template<> int ToluaIsPODVector<unsigned>(lua_State* L, int lo, const char* type
     return 0;
 }
 
+template<> int ToluaIsPODVector<float>(lua_State* L, int lo, const char* type, int def, tolua_Error* err)
+{
+    // Both are checked as Lua numbers
+    return ToluaIsPODVector<unsigned>(L, lo, type, def, err);
+}
+
 template<> int ToluaIsPODVector<Vector2>(lua_State* L, int lo, const char* type, int def, tolua_Error* err)
 {
     if (lua_istable(L, lo))
@@ -233,6 +239,35 @@ template<> void* ToluaToPODVector<unsigned>(lua_State* L, int narg, void* def)
     return &result;
 }
 
+template<> void* ToluaToPODVector<float>(lua_State* L, int narg, void* def)
+{
+    if (!lua_istable(L, narg))
+        return 0;
+
+    static PODVector<float> result;
+    result.Clear();
+
+    int length = lua_objlen(L, narg);
+    for (int i = 1; i <= length; ++i)
+    {
+        lua_pushinteger(L, i);
+        lua_gettable(L, narg);
+
+        if (!lua_isnumber(L, -1))
+        {
+            lua_pop(L, 1);
+            return 0;
+        }
+
+        float value = (float)tolua_tonumber(L, -1, 0);
+        result.Push(value);
+
+        lua_pop(L, 1);
+    }
+
+    return &result;
+}
+
 template<> void* ToluaToPODVector<Vector2>(lua_State* L, int narg, void* def)
 {
     if (!lua_istable(L, narg))
@@ -104,6 +104,8 @@ template<> int ToluaPushVector<StringHash>(lua_State* L, void* data, const char*
 template<typename T> int ToluaIsPODVector(lua_State* L, int lo, const char* type, int def, tolua_Error* err);
 /// Check is PODVector<unsigned>.
 template<> int ToluaIsPODVector<unsigned>(lua_State* L, int lo, const char* type, int def, tolua_Error* err);
+/// Check is PODVector<float>.
+template<> int ToluaIsPODVector<float>(lua_State* L, int lo, const char* type, int def, tolua_Error* err);
 /// Check is PODVector<Vector2>.
 template<> int ToluaIsPODVector<Vector2>(lua_State* L, int lo, const char* type, int def, tolua_Error* err);
 
@@ -111,6 +113,8 @@ template<> int ToluaIsPODVector<Vector2>(lua_State* L, int lo, const char* type,
 template<typename T> void* ToluaToPODVector(lua_State* L, int narg, void* def);
 /// Convert PODVector<unsigned>.
 template<> void* ToluaToPODVector<unsigned>(lua_State* L, int narg, void* def);
+/// Convert PODVector<float>.
+template<> void* ToluaToPODVector<float>(lua_State* L, int narg, void* def);
 /// Convert PODVector<Vector2>.
 template<> void* ToluaToPODVector<Vector2>(lua_State* L, int narg, void* def);
 
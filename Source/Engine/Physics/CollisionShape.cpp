@@ -882,6 +882,7 @@ void CollisionShape::OnNodeSet(Node* node)
 
         // Terrain collision shape depends on the terrain component's geometry updates. Subscribe to them
         SubscribeToEvent(node, E_TERRAINCREATED, HANDLER(CollisionShape, HandleTerrainCreated));
+        SubscribeToEvent(node, E_TERRAINREGIONUPDATED, HANDLER(CollisionShape, HandleTerrainRegionUpdated));
     }
 }
 
@@ -1106,6 +1107,50 @@ void CollisionShape::HandleTerrainCreated(StringHash eventType, VariantMap& even
     }
 }
 
+void CollisionShape::HandleTerrainRegionUpdated(StringHash eventType, VariantMap& eventData)
+{
+    using namespace TerrainRegionUpdated;
+
+    if (shapeType_ != SHAPE_TERRAIN)
+        return;
+
+    Terrain* terrain = GetComponent<Terrain>();
+    HeightfieldData* heightfield = static_cast<HeightfieldData*>(geometry_.Get());
+    if (!terrain || !heightfield || heightfield->heightData_ != terrain->GetHeightData())
+    {
+        UpdateShape();
+        NotifyRigidBody();
+        return;
+    }
+
+    // The heightfield shape reads the terrain height data directly, so it only needs to be recreated if the heights went
+    // outside its height range
+    const IntRect& region = eventData[P_REGION].GetIntRect();
+    const float* heightData = heightfield->heightData_.Get();
+    for (int z = region.top_; z < region.bottom_; ++z)
+    {
+        for (int x = region.left_; x < region.right_; ++x)
+        {
+            float height = heightData[z * heightfield->size_.x_ + x];
+            if (height < heightfield->minHeight_ || height > heightfield->maxHeight_)
+            {
+                UpdateShape();
+                NotifyRigidBody();
+                return;
+            }
+        }
+    }
+
+    // Otherwise wake up the rigid bodies in the modified region so that they react to the change
+    if (physicsWorld_)
+    {
+        PODVector<RigidBody*> bodies;
+        physicsWorld_->GetRigidBodies(bodies, BoundingBox(eventData[P_MIN].GetVector3(), eventData[P_MAX].GetVector3()));
+        for (PODVector<RigidBody*>::Iterator i = bodies.Begin(); i != bodies.End(); ++i)
+            (*i)->Activate();
+    }
+}
+
 void CollisionShape::HandleModelReloadFinished(StringHash eventType, VariantMap& eventData)
 {
     if (physicsWorld_)
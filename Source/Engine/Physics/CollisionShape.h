@@ -231,6 +231,8 @@ private:
     void UpdateShape();
     /// Update terrain collision shape from the terrain component.
     void HandleTerrainCreated(StringHash eventType, VariantMap& eventData);
+    /// Update terrain collision shape after a region of the terrain has been modified.
+    void HandleTerrainRegionUpdated(StringHash eventType, VariantMap& eventData);
     /// Update trimesh or convex shape after a model has reloaded itself.
     void HandleModelReloadFinished(StringHash eventType, VariantMap& eventData);
 
@@ -0,0 +1,932 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "Precompiled.h"
+#include "Compress.h"
+#include "MathDefs.h"
+#include "Thread.h"
+#include "WorkQueue.h"
+
+#include <cstring>
+
+#ifdef URHO3D_SSE
+#include <xmmintrin.h>
+#endif
+
+#include "DebugNew.h"
+
+namespace Urho3D
+{
+
+/// Minimum image size in pixels to compress in worker threads.
+static const int MIN_PARALLEL_COMPRESS_PIXELS = 64 * 64;
+/// Number of least squares endpoint refinements per DXT color block for each quality level.
+static const int dxtRefineIterations[] = { 0, 1, 4 };
+/// DXT1 interpolation weights of the first endpoint for each index in four and three color modes.
+static const float dxtEndpointWeights[2][4] = { { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f }, { 1.0f, 0.0f, 0.5f, 0.0f } };
+/// ETC1 intensity modifier tables.
+static const int etcModifiers[8][4] =
+{
+    { 2, 8, -2, -8 },
+    { 5, 17, -5, -17 },
+    { 9, 29, -9, -29 },
+    { 13, 42, -13, -42 },
+    { 18, 60, -18, -60 },
+    { 24, 80, -24, -80 },
+    { 33, 106, -33, -106 },
+    { 47, 183, -47, -183 }
+};
+
+/// Color channels of a 4x4 block as floats for DXT endpoint fitting.
+struct ColorBlock
+{
+    /// Red of each pixel.
+    float r_[16];
+    /// Green of each pixel.
+    float g_[16];
+    /// Blue of each pixel.
+    float b_[16];
+    /// Fitting weight of each pixel. Zero for pixels that are transparent in DXT1.
+    float weight_[16];
+};
+
+/// DXT color endpoints with indices and the resulting squared error.
+struct ColorFit
+{
+    /// 565 endpoints.
+    unsigned short endpoints_[2];
+    /// Palette index of each pixel.
+    unsigned char indices_[16];
+    /// Whether uses the DXT1 three color mode.
+    bool threeColor_;
+    /// Squared error.
+    float error_;
+};
+
+/// Read a 4x4 block of RGBA pixels, replicating the edge pixels outside the image.
+static void ReadBlock(unsigned char* pixels, const unsigned char* rgba, int width, int height, int x, int y)
+{
+    for (int py = 0; py < 4; ++py)
+    {
+        const unsigned char* row = rgba + Min(y + py, height - 1) * width * 4;
+        for (int px = 0; px < 4; ++px)
+            memcpy(pixels + (py * 4 + px) * 4, row + Min(x + px, width - 1) * 4, 4);
+    }
+}
+
+/// Quantize a color to 565.
+static unsigned short Pack565(float r, float g, float b)
+{
+    int red = Clamp((int)(r * 31.0f / 255.0f + 0.5f), 0, 31);
+    int green = Clamp((int)(g * 63.0f / 255.0f + 0.5f), 0, 63);
+    int blue = Clamp((int)(b * 31.0f / 255.0f + 0.5f), 0, 31);
+    return (unsigned short)((red << 11) | (green << 5) | blue);
+}
+
+/// Expand a 565 color to 8 bits per channel like the decoder.
+static void Unpack565(unsigned short value, int* color)
+{
+    int red = (value >> 11) & 0x1f;
+    int green = (value >> 5) & 0x3f;
+    int blue = value & 0x1f;
+    color[0] = (red << 3) | (red >> 2);
+    color[1] = (green << 2) | (green >> 4);
+    color[2] = (blue << 3) | (blue >> 2);
+}
+
+/// Build the palette of a DXT color block with the same integer arithmetic as the decoder.
+static void GetColorPalette(float palette[4][3], unsigned short endpoint0, unsigned short endpoint1, bool threeColor)
+{
+    int color0[3];
+    int color1[3];
+    Unpack565(endpoint0, color0);
+    Unpack565(endpoint1, color1);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        palette[0][i] = (float)color0[i];
+        palette[1][i] = (float)color1[i];
+        if (threeColor)
+        {
+            palette[2][i] = (float)((color0[i] + color1[i]) / 2);
+            palette[3][i] = 0.0f;
+        }
+        else
+        {
+            palette[2][i] = (float)((2 * color0[i] + color1[i]) / 3);
+            palette[3][i] = (float)((color0[i] + 2 * color1[i]) / 3);
+        }
+    }
+}
+
+/// Choose the nearest palette entry for each pixel and return the weighted squared error. Only the first numColors entries are considered.
+static float FitColorIndices(unsigned char* indices, const ColorBlock& block, const float palette[4][3], int numColors)
+{
+#ifdef URHO3D_SSE
+    __m128 totalError = _mm_setzero_ps();
+    for (int i = 0; i < 16; i += 4)
+    {
+        __m128 r = _mm_loadu_ps(&block.r_[i]);
+        __m128 g = _mm_loadu_ps(&block.g_[i]);
+        __m128 b = _mm_loadu_ps(&block.b_[i]);
+        __m128 bestError = _mm_set1_ps(M_INFINITY);
+        __m128 bestIndex = _mm_setzero_ps();
+
+        for (int j = 0; j < numColors; ++j)
+        {
+            __m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[j][0]));
+            __m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[j][1]));
+            __m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[j][2]));
+            __m128 error = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+            __m128 closer = _mm_cmplt_ps(error, bestError);
+            bestError = _mm_min_ps(error, bestError);
+            bestIndex = _mm_or_ps(_mm_andnot_ps(closer, bestIndex), _mm_and_ps(closer, _mm_set1_ps((float)j)));
+        }
+
+        totalError = _mm_add_ps(totalError, _mm_mul_ps(bestError, _mm_loadu_ps(&block.weight_[i])));
+        float index[4];
+        _mm_storeu_ps(index, bestIndex);
+        for (int j = 0; j < 4; ++j)
+            indices[i + j] = (unsigned char)index[j];
+    }
+
+    float error[4];
+    _mm_storeu_ps(error, totalError);
+    return error[0] + error[1] + error[2] + error[3];
+#else
+    float totalError = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float bestError = M_INFINITY;
+        for (int j = 0; j < numColors; ++j)
+        {
+            float dr = block.r_[i] - palette[j][0];
+            float dg = block.g_[i] - palette[j][1];
+            float db = block.b_[i] - palette[j][2];
+            float error = dr * dr + dg * dg + db * db;
+            if (error < bestError)
+            {
+                bestError = error;
+                indices[i] = (unsigned char)j;
+            }
+        }
+        totalError += bestError * block.weight_[i];
+    }
+    return totalError;
+#endif
+}
+
+/// Fit the indices of quantized endpoints. Transparent pixels use the last index of the three color mode.
+static void FitColorEndpoints(ColorFit& fit, const ColorBlock& block, unsigned short endpoint0, unsigned short endpoint1, bool threeColor)
+{
+    float palette[4][3];
+    GetColorPalette(palette, endpoint0, endpoint1, threeColor);
+    fit.endpoints_[0] = endpoint0;
+    fit.endpoints_[1] = endpoint1;
+    fit.threeColor_ = threeColor;
+    fit.error_ = FitColorIndices(fit.indices_, block, palette, threeColor ? 3 : 4);
+
+    if (threeColor)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            if (block.weight_[i] == 0.0f)
+                fit.indices_[i] = 3;
+        }
+    }
+}
+
+/// Solve the endpoints which minimize the squared error for the current indices by least squares. Return false if the indices do not determine them.
+static bool SolveColorEndpoints(float* endpoint0, float* endpoint1, const ColorBlock& block, const ColorFit& fit)
+{
+    const float* weights = dxtEndpointWeights[fit.threeColor_ ? 1 : 0];
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[3] = { 0.0f, 0.0f, 0.0f };
+    float bx[3] = { 0.0f, 0.0f, 0.0f };
+
+    for (int i = 0; i < 16; ++i)
+    {
+        if (block.weight_[i] == 0.0f)
+            continue;
+        float a = weights[fit.indices_[i]];
+        float b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        ax[0] += a * block.r_[i];
+        ax[1] += a * block.g_[i];
+        ax[2] += a * block.b_[i];
+        bx[0] += b * block.r_[i];
+        bx[1] += b * block.g_[i];
+        bx[2] += b * block.b_[i];
+    }
+
+    float det = aa * bb - ab * ab;
+    if (Abs(det) < M_EPSILON)
+        return false;
+
+    float invDet = 1.0f / det;
+    for (int i = 0; i < 3; ++i)
+    {
+        endpoint0[i] = (ax[i] * bb - bx[i] * ab) * invDet;
+        endpoint1[i] = (bx[i] * aa - ax[i] * ab) * invDet;
+    }
+    return true;
+}
+
+/// Return the best 5 or 6-bit endpoint pair for reproducing a single channel value through an interpolated palette entry.
+static void FitSingleChannel(int& endpoint0, int& endpoint1, int value, int bits, bool threeColor)
+{
+    int maxValue = (1 << bits) - 1;
+    int bestError = M_MAX_INT;
+    for (int i = 0; i <= maxValue; ++i)
+    {
+        int expanded0 = bits == 5 ? (i << 3) | (i >> 2) : (i << 2) | (i >> 4);
+
+        // Only the second endpoints near the one that interpolates exactly need to be tested
+        int target = threeColor ? 2 * value - expanded0 : 3 * value - 2 * expanded0;
+        int nearest = (Clamp(target, 0, 255) * maxValue + 127) / 255;
+        for (int j = Max(nearest - 1, 0); j <= Min(nearest + 1, maxValue); ++j)
+        {
+            int expanded1 = bits == 5 ? (j << 3) | (j >> 2) : (j << 2) | (j >> 4);
+            int interpolated = threeColor ? (expanded0 + expanded1) / 2 : (2 * expanded0 + expanded1) / 3;
+            int error = Abs(interpolated - value);
+            if (error < bestError)
+            {
+                bestError = error;
+                endpoint0 = i;
+                endpoint1 = j;
+            }
+        }
+    }
+}
+
+/// Write a DXT color block, ordering the endpoints so that the decoder chooses the fitted palette mode.
+static void WriteColorBlock(unsigned char* dest, ColorFit& fit, bool dxt1)
+{
+    unsigned short endpoint0 = fit.endpoints_[0];
+    unsigned short endpoint1 = fit.endpoints_[1];
+
+    if (dxt1 && endpoint0 == endpoint1 && !fit.threeColor_)
+    {
+        // Equal endpoints decode as the three color mode, where all opaque entries equal the endpoint
+        for (int i = 0; i < 16; ++i)
+            fit.indices_[i] = 0;
+    }
+    else if (fit.threeColor_ ? endpoint0 > endpoint1 : endpoint0 < endpoint1)
+    {
+        Swap(endpoint0, endpoint1);
+        for (int i = 0; i < 16; ++i)
+        {
+            if (fit.indices_[i] < 2)
+                fit.indices_[i] ^= 1;
+            else if (!fit.threeColor_)
+                fit.indices_[i] ^= 1;
+        }
+    }
+
+    dest[0] = (unsigned char)(endpoint0 & 0xff);
+    dest[1] = (unsigned char)(endpoint0 >> 8);
+    dest[2] = (unsigned char)(endpoint1 & 0xff);
+    dest[3] = (unsigned char)(endpoint1 >> 8);
+    for (int y = 0; y < 4; ++y)
+    {
+        const unsigned char* rowIndices = &fit.indices_[y * 4];
+        dest[4 + y] = (unsigned char)(rowIndices[0] | (rowIndices[1] << 2) | (rowIndices[2] << 4) | (rowIndices[3] << 6));
+    }
+}
+
+/// Compress the color of a 4x4 block to a DXT color block.
+static void CompressColorBlock(unsigned char* dest, const unsigned char* pixels, bool dxt1, CompressionQuality quality)
+{
+    ColorBlock block;
+    bool transparent = false;
+    bool opaque = false;
+    bool singleColor = true;
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    float totalWeight = 0.0f;
+
+    for (int i = 0; i < 16; ++i)
+    {
+        const unsigned char* pixel = pixels + i * 4;
+        block.r_[i] = (float)pixel[0];
+        block.g_[i] = (float)pixel[1];
+        block.b_[i] = (float)pixel[2];
+        block.weight_[i] = (dxt1 && pixel[3] < 128) ? 0.0f : 1.0f;
+
+        if (block.weight_[i] == 0.0f)
+        {
+            transparent = true;
+            continue;
+        }
+
+        if (opaque && (block.r_[i] != mean[0] / totalWeight || block.g_[i] != mean[1] / totalWeight ||
+            block.b_[i] != mean[2] / totalWeight))
+            singleColor = false;
+        opaque = true;
+        mean[0] += block.r_[i];
+        mean[1] += block.g_[i];
+        mean[2] += block.b_[i];
+        totalWeight += 1.0f;
+    }
+
+    ColorFit best;
+
+    // Fully transparent DXT1 block
+    if (!opaque)
+    {
+        best.endpoints_[0] = 0;
+        best.endpoints_[1] = 0;
+        best.threeColor_ = true;
+        for (int i = 0; i < 16; ++i)
+            best.indices_[i] = 3;
+        WriteColorBlock(dest, best, dxt1);
+        return;
+    }
+
+    for (int i = 0; i < 3; ++i)
+        mean[i] /= totalWeight;
+
+    if (singleColor)
+    {
+        // Reproduce a single color through the interpolated palette entry, which reaches values between the 565 steps
+        int value[3] = { (int)mean[0], (int)mean[1], (int)mean[2] };
+        int endpoint0[3], endpoint1[3];
+        for (int i = 0; i < 3; ++i)
+            FitSingleChannel(endpoint0[i], endpoint1[i], value[i], i == 1 ? 6 : 5, transparent);
+        FitColorEndpoints(best, block, (unsigned short)((endpoint0[0] << 11) | (endpoint0[1] << 5) | endpoint0[2]),
+            (unsigned short)((endpoint1[0] << 11) | (endpoint1[1] << 5) | endpoint1[2]), transparent);
+
+        // Compare against using the endpoint directly
+        ColorFit direct;
+        unsigned short packed = Pack565(mean[0], mean[1], mean[2]);
+        FitColorEndpoints(direct, block, packed, packed, transparent);
+        if (direct.error_ <= best.error_)
+            best = direct;
+
+        WriteColorBlock(dest, best, dxt1);
+        return;
+    }
+
+    // Find the principal axis of the colors by power iteration on the covariance matrix
+    float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i)
+    {
+        if (block.weight_[i] == 0.0f)
+            continue;
+        float r = block.r_[i] - mean[0];
+        float g = block.g_[i] - mean[1];
+        float b = block.b_[i] - mean[2];
+        covariance[0] += r * r;
+        covariance[1] += r * g;
+        covariance[2] += r * b;
+        covariance[3] += g * g;
+        covariance[4] += g * b;
+        covariance[5] += b * b;
+    }
+
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int i = 0; i < 8; ++i)
+    {
+        float x = axis[0] * covariance[0] + axis[1] * covariance[1] + axis[2] * covariance[2];
+        float y = axis[0] * covariance[1] + axis[1] * covariance[3] + axis[2] * covariance[4];
+        float z = axis[0] * covariance[2] + axis[1] * covariance[4] + axis[2] * covariance[5];
+        float length = Max(Max(Abs(x), Abs(y)), Abs(z));
+        if (length < M_EPSILON)
+            break;
+        axis[0] = x / length;
+        axis[1] = y / length;
+        axis[2] = z / length;
+    }
+
+    // Take the extreme projections on the axis as endpoints, inset slightly as the palette ends are used less than the middle
+    float minDot = M_INFINITY;
+    float maxDot = -M_INFINITY;
+    for (int i = 0; i < 16; ++i)
+    {
+        if (block.weight_[i] == 0.0f)
+            continue;
+        float dot = (block.r_[i] - mean[0]) * axis[0] + (block.g_[i] - mean[1]) * axis[1] + (block.b_[i] - mean[2]) * axis[2];
+        minDot = Min(minDot, dot);
+        maxDot = Max(maxDot, dot);
+    }
+
+    float axisLengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float inset = (maxDot - minDot) / 16.0f;
+    float endpoint0[3], endpoint1[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        endpoint0[i] = mean[i] + axis[i] * (maxDot - inset) / axisLengthSquared;
+        endpoint1[i] = mean[i] + axis[i] * (minDot + inset) / axisLengthSquared;
+    }
+
+    // Transparent pixels in DXT1 require the three color mode
+    FitColorEndpoints(best, block, Pack565(endpoint0[0], endpoint0[1], endpoint0[2]), Pack565(endpoint1[0], endpoint1[1],
+        endpoint1[2]), transparent);
+
+    if (quality == CQ_HIGH && dxt1 && !transparent)
+    {
+        ColorFit threeColor;
+        FitColorEndpoints(threeColor, block, best.endpoints_[0], best.endpoints_[1], true);
+        if (threeColor.error_ < best.error_)
+            best = threeColor;
+    }
+
+    // Refine the endpoints by least squares until the error no longer decreases
+    for (int i = 0; i < dxtRefineIterations[quality]; ++i)
+    {
+        if (!SolveColorEndpoints(endpoint0, endpoint1, block, best))
+            break;
+
+        ColorFit refined;
+        FitColorEndpoints(refined, block, Pack565(endpoint0[0], endpoint0[1], endpoint0[2]), Pack565(endpoint1[0], endpoint1[1],
+            endpoint1[2]), best.threeColor_);
+        if (refined.error_ >= best.error_)
+            break;
+        best = refined;
+    }
+
+    WriteColorBlock(dest, best, dxt1);
+}
+
+/// Build the DXT5 alpha palette with the same integer arithmetic as the decoder.
+static void GetAlphaPalette(int* palette, int alpha0, int alpha1)
+{
+    palette[0] = alpha0;
+    palette[1] = alpha1;
+    if (alpha0 <= alpha1)
+    {
+        for (int i = 1; i < 5; ++i)
+            palette[1 + i] = ((5 - i) * alpha0 + i * alpha1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    else
+    {
+        for (int i = 1; i < 7; ++i)
+            palette[1 + i] = ((7 - i) * alpha0 + i * alpha1) / 7;
+    }
+}
+
+/// Choose the nearest DXT5 alpha palette entry for each pixel and return the squared error.
+static int FitAlphaIndices(unsigned char* indices, const unsigned char* pixels, int alpha0, int alpha1)
+{
+    int palette[8];
+    GetAlphaPalette(palette, alpha0, alpha1);
+
+    int totalError = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int alpha = pixels[i * 4 + 3];
+        int bestError = M_MAX_INT;
+        for (int j = 0; j < 8; ++j)
+        {
+            int error = (alpha - palette[j]) * (alpha - palette[j]);
+            if (error < bestError)
+            {
+                bestError = error;
+                indices[i] = (unsigned char)j;
+            }
+        }
+        totalError += bestError;
+    }
+    return totalError;
+}
+
+/// Compress the alpha of a 4x4 block to a DXT5 alpha block.
+static void CompressAlphaBlockDXT5(unsigned char* dest, const unsigned char* pixels, CompressionQuality quality)
+{
+    int minAlpha = 255, maxAlpha = 0;
+    int minInnerAlpha = 255, maxInnerAlpha = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int alpha = pixels[i * 4 + 3];
+        minAlpha = Min(minAlpha, alpha);
+        maxAlpha = Max(maxAlpha, alpha);
+        if (alpha > 0 && alpha < 255)
+        {
+            minInnerAlpha = Min(minInnerAlpha, alpha);
+            maxInnerAlpha = Max(maxInnerAlpha, alpha);
+        }
+    }
+
+    unsigned char indices[16];
+    unsigned char bestIndices[16];
+    int bestAlpha0 = minAlpha;
+    int bestAlpha1 = maxAlpha;
+    int bestError = M_MAX_INT;
+
+    if (minAlpha == maxAlpha)
+    {
+        // Equal endpoints select the six interpolated entries mode, where the first entry is the value
+        memset(bestIndices, 0, sizeof bestIndices);
+    }
+    else
+    {
+        // Seven interpolated entries between the extremes
+        int range = quality == CQ_HIGH ? Min(2, (maxAlpha - minAlpha - 1) / 2) : 0;
+        for (int i = 0; i <= range; ++i)
+        {
+            for (int j = 0; j <= range; ++j)
+            {
+                int error = FitAlphaIndices(indices, pixels, maxAlpha - i, minAlpha + j);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    bestAlpha0 = maxAlpha - i;
+                    bestAlpha1 = minAlpha + j;
+                    memcpy(bestIndices, indices, sizeof indices);
+                }
+            }
+        }
+
+        // Five interpolated entries between the values other than 0 and 255, which are then exact
+        if (quality != CQ_FAST)
+        {
+            if (minInnerAlpha > maxInnerAlpha)
+                minInnerAlpha = maxInnerAlpha = 0;
+            int error = FitAlphaIndices(indices, pixels, minInnerAlpha, maxInnerAlpha);
+            if (error < bestError)
+            {
+                bestError = error;
+                bestAlpha0 = minInnerAlpha;
+                bestAlpha1 = maxInnerAlpha;
+                memcpy(bestIndices, indices, sizeof indices);
+            }
+        }
+    }
+
+    dest[0] = (unsigned char)bestAlpha0;
+    dest[1] = (unsigned char)bestAlpha1;
+    for (int i = 0; i < 2; ++i)
+    {
+        unsigned value = 0;
+        for (int j = 0; j < 8; ++j)
+            value |= (unsigned)bestIndices[i * 8 + j] << (j * 3);
+        dest[2 + i * 3] = (unsigned char)(value & 0xff);
+        dest[3 + i * 3] = (unsigned char)((value >> 8) & 0xff);
+        dest[4 + i * 3] = (unsigned char)(value >> 16);
+    }
+}
+
+/// Compress the alpha of a 4x4 block to a DXT3 alpha block.
+static void CompressAlphaBlockDXT3(unsigned char* dest, const unsigned char* pixels)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        int lo = (pixels[i * 8 + 3] + 8) / 17;
+        int hi = (pixels[i * 8 + 7] + 8) / 17;
+        dest[i] = (unsigned char)(lo | (hi << 4));
+    }
+}
+
+/// Compress a 4x4 block of RGBA pixels to DXT.
+static void CompressBlockDXT(unsigned char* dest, const unsigned char* pixels, CompressedFormat format, CompressionQuality quality)
+{
+    if (format == CF_DXT1)
+        CompressColorBlock(dest, pixels, true, quality);
+    else
+    {
+        if (format == CF_DXT3)
+            CompressAlphaBlockDXT3(dest, pixels);
+        else
+            CompressAlphaBlockDXT5(dest, pixels, quality);
+        CompressColorBlock(dest + 8, pixels, false, quality);
+    }
+}
+
+/// Return the squared error of an ETC1 subblock with the best intensity table for a base color. Fill the table and modifier indices of the subblock pixels only if the error is below the limit, otherwise return the limit.
+static int FitSubblockETC(int& table, unsigned char* modifiers, const unsigned char* pixels, const int* subblock, const int* base,
+    int errorLimit)
+{
+    int bestError = errorLimit;
+    unsigned char tableModifiers[8];
+
+    for (int i = 0; i < 8; ++i)
+    {
+        int tableError = 0;
+        for (int j = 0; j < 8 && tableError < bestError; ++j)
+        {
+            const unsigned char* pixel = pixels + subblock[j] * 4;
+            int bestPixelError = M_MAX_INT;
+            for (int k = 0; k < 4; ++k)
+            {
+                int dr = Clamp(base[0] + etcModifiers[i][k], 0, 255) - pixel[0];
+                int dg = Clamp(base[1] + etcModifiers[i][k], 0, 255) - pixel[1];
+                int db = Clamp(base[2] + etcModifiers[i][k], 0, 255) - pixel[2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < bestPixelError)
+                {
+                    bestPixelError = error;
+                    tableModifiers[j] = (unsigned char)k;
+                }
+            }
+            tableError += bestPixelError;
+        }
+
+        if (tableError < bestError)
+        {
+            bestError = tableError;
+            table = i;
+            memcpy(modifiers, tableModifiers, sizeof tableModifiers);
+        }
+    }
+
+    return bestError;
+}
+
+/// ETC1 subblock encoding.
+struct SubblockETC
+{
+    /// Quantized base color.
+    int color_[3];
+    /// Intensity table.
+    int table_;
+    /// Modifier index of each subblock pixel.
+    unsigned char modifiers_[8];
+    /// Squared error.
+    int error_;
+};
+
+/// Expand a 4 or 5-bit ETC1 base color channel to 8 bits.
+static int ExpandETC(int value, bool differential)
+{
+    return differential ? (value << 3) | (value >> 2) : (value << 4) | value;
+}
+
+/// Fit an ETC1 subblock for a quantized base color. Return false if the error would not be below the limit.
+static bool FitSubblockColorETC(SubblockETC& fit, const unsigned char* pixels, const int* subblock, const int* color, bool differential,
+    int errorLimit = M_MAX_INT)
+{
+    int base[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        fit.color_[i] = color[i];
+        base[i] = ExpandETC(color[i], differential);
+    }
+    fit.error_ = FitSubblockETC(fit.table_, fit.modifiers_, pixels, subblock, base, errorLimit);
+    return fit.error_ < errorLimit;
+}
+
+/// Fit an ETC1 subblock starting from the quantized average color, searching the neighboring base colors for high quality.
+static void FitSubblockAverageETC(SubblockETC& fit, const unsigned char* pixels, const int* subblock, bool differential,
+    CompressionQuality quality)
+{
+    int maxValue = differential ? 31 : 15;
+    int sum[3] = { 0, 0, 0 };
+    for (int i = 0; i < 8; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+            sum[j] += pixels[subblock[i] * 4 + j];
+    }
+
+    int average[3];
+    for (int i = 0; i < 3; ++i)
+        average[i] = Clamp((sum[i] * maxValue + 8 * 255 / 2) / (8 * 255), 0, maxValue);
+    FitSubblockColorETC(fit, pixels, subblock, average, differential);
+
+    if (quality == CQ_HIGH)
+    {
+        SubblockETC candidate;
+        int color[3];
+        for (int r = -1; r <= 1; ++r)
+        {
+            for (int g = -1; g <= 1; ++g)
+            {
+                for (int b = -1; b <= 1; ++b)
+                {
+                    color[0] = average[0] + r;
+                    color[1] = average[1] + g;
+                    color[2] = average[2] + b;
+                    if ((!r && !g && !b) || color[0] < 0 || color[1] < 0 || color[2] < 0 || color[0] > maxValue ||
+                        color[1] > maxValue || color[2] > maxValue)
+                        continue;
+                    if (FitSubblockColorETC(candidate, pixels, subblock, color, differential, fit.error_))
+                        fit = candidate;
+                }
+            }
+        }
+    }
+}
+
+/// Return whether two differential mode base colors can be encoded.
+static bool IsDifferentialValid(const SubblockETC& subblock0, const SubblockETC& subblock1)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        int diff = subblock1.color_[i] - subblock0.color_[i];
+        if (diff < -4 || diff > 3)
+            return false;
+    }
+    return true;
+}
+
+/// Compress a 4x4 block of RGBA pixels to ETC1.
+static void CompressBlockETC(unsigned char* dest, const unsigned char* pixels, CompressionQuality quality)
+{
+    // Subblock pixel indices (y * 4 + x) for side by side and for stacked subblocks
+    static const int subblocks[2][2][8] =
+    {
+        { { 0, 4, 8, 12, 1, 5, 9, 13 }, { 2, 6, 10, 14, 3, 7, 11, 15 } },
+        { { 0, 1, 2, 3, 4, 5, 6, 7 }, { 8, 9, 10, 11, 12, 13, 14, 15 } }
+    };
+
+    SubblockETC best[2];
+    bool bestDifferential = false;
+    int bestFlip = 0;
+    int bestError = M_MAX_INT;
+
+    for (int flip = 0; flip < 2; ++flip)
+    {
+        SubblockETC fits[2];
+        bool differential = false;
+
+        // Differential mode has more color precision, but the base colors must be close to each other
+        FitSubblockAverageETC(fits[0], pixels, subblocks[flip][0], true, quality);
+        FitSubblockAverageETC(fits[1], pixels, subblocks[flip][1], true, quality);
+        if (IsDifferentialValid(fits[0], fits[1]))
+            differential = true;
+        else if (quality == CQ_HIGH)
+        {
+            // The searched base colors may have drifted apart, so retry the plain averages
+            FitSubblockAverageETC(fits[0], pixels, subblocks[flip][0], true, CQ_NORMAL);
+            FitSubblockAverageETC(fits[1], pixels, subblocks[flip][1], true, CQ_NORMAL);
+            differential = IsDifferentialValid(fits[0], fits[1]);
+        }
+
+        if (!differential || quality != CQ_FAST)
+        {
+            SubblockETC individual[2];
+            FitSubblockAverageETC(individual[0], pixels, subblocks[flip][0], false, quality);
+            FitSubblockAverageETC(individual[1], pixels, subblocks[flip][1], false, quality);
+            if (!differential || individual[0].error_ + individual[1].error_ < fits[0].error_ + fits[1].error_)
+            {
+                fits[0] = individual[0];
+                fits[1] = individual[1];
+                differential = false;
+            }
+        }
+
+        int error = fits[0].error_ + fits[1].error_;
+        if (error < bestError)
+        {
+            bestError = error;
+            best[0] = fits[0];
+            best[1] = fits[1];
+            bestDifferential = differential;
+            bestFlip = flip;
+        }
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        if (bestDifferential)
+            dest[i] = (unsigned char)((best[0].color_[i] << 3) | ((best[1].color_[i] - best[0].color_[i]) & 0x7));
+        else
+            dest[i] = (unsigned char)((best[0].color_[i] << 4) | best[1].color_[i]);
+    }
+    dest[3] = (unsigned char)((best[0].table_ << 5) | (best[1].table_ << 2) | (bestDifferential ? 2 : 0) | bestFlip);
+
+    // The modifier index bits are stored per pixel in column-major order, most significant bits first
+    unsigned msb = 0;
+    unsigned lsb = 0;
+    for (int i = 0; i < 2; ++i)
+    {
+        for (int j = 0; j < 8; ++j)
+        {
+            int pixel = subblocks[bestFlip][i][j];
+            int bit = (pixel & 3) * 4 + (pixel >> 2);
+            msb |= (unsigned)(best[i].modifiers_[j] >> 1) << bit;
+            lsb |= (unsigned)(best[i].modifiers_[j] & 1) << bit;
+        }
+    }
+    dest[4] = (unsigned char)(msb >> 8);
+    dest[5] = (unsigned char)(msb & 0xff);
+    dest[6] = (unsigned char)(lsb >> 8);
+    dest[7] = (unsigned char)(lsb & 0xff);
+}
+
+/// Compress rows of blocks.
+static void CompressRows(unsigned char* dest, const unsigned char* rgba, int width, int height, CompressedFormat format,
+    CompressionQuality quality, int startRow, int endRow)
+{
+    unsigned bytesPerBlock = (format == CF_DXT1 || format == CF_ETC1) ? 8 : 16;
+    unsigned char* destBlock = dest + startRow * ((width + 3) / 4) * bytesPerBlock;
+    unsigned char pixels[16 * 4];
+
+    for (int row = startRow; row < endRow; ++row)
+    {
+        for (int x = 0; x < width; x += 4)
+        {
+            ReadBlock(pixels, rgba, width, height, x, row * 4);
+            if (format == CF_ETC1)
+                CompressBlockETC(destBlock, pixels, quality);
+            else
+                CompressBlockDXT(destBlock, pixels, format, quality);
+            destBlock += bytesPerBlock;
+        }
+    }
+}
+
+/// Rows of blocks to compress in a work item.
+struct CompressRowsWork
+{
+    /// Destination blocks of the whole image.
+    unsigned char* dest_;
+    /// Source RGBA image.
+    const unsigned char* rgba_;
+    /// Image width.
+    int width_;
+    /// Image height.
+    int height_;
+    /// Compressed format.
+    CompressedFormat format_;
+    /// Compression quality.
+    CompressionQuality quality_;
+    /// First row of blocks.
+    int startRow_;
+    /// Row of blocks to stop at.
+    int endRow_;
+};
+
+void CompressRowsWorkFunction(const WorkItem* item, unsigned threadIndex)
+{
+    const CompressRowsWork* rows = reinterpret_cast<const CompressRowsWork*>(item->start_);
+    CompressRows(rows->dest_, rows->rgba_, rows->width_, rows->height_, rows->format_, rows->quality_, rows->startRow_, rows->endRow_);
+}
+
+/// Compress an image, in parallel rows of blocks if possible.
+static void CompressImage(unsigned char* dest, const unsigned char* rgba, int width, int height, CompressedFormat format,
+    CompressionQuality quality, WorkQueue* queue)
+{
+    int numRows = (height + 3) / 4;
+
+    // Completing work is only allowed from the main thread
+    if (!queue || !queue->GetNumThreads() || width * height < MIN_PARALLEL_COMPRESS_PIXELS || !Thread::IsMainThread())
+    {
+        CompressRows(dest, rgba, width, height, format, quality, 0, numRows);
+        return;
+    }
+
+    // Use more work items than threads, as the time per block varies with the content
+    int numWorkItems = Min(numRows, (int)(queue->GetNumThreads() + 1) * 4);
+    PODVector<CompressRowsWork> rows(numWorkItems);
+
+    for (int i = 0; i < numWorkItems; ++i)
+    {
+        CompressRowsWork& itemRows = rows[i];
+        itemRows.dest_ = dest;
+        itemRows.rgba_ = rgba;
+        itemRows.width_ = width;
+        itemRows.height_ = height;
+        itemRows.format_ = format;
+        itemRows.quality_ = quality;
+        itemRows.startRow_ = numRows * i / numWorkItems;
+        itemRows.endRow_ = numRows * (i + 1) / numWorkItems;
+
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = CompressRowsWorkFunction;
+        item->start_ = &itemRows;
+        queue->AddWorkItem(item);
+    }
+
+    queue->Complete(M_MAX_UNSIGNED);
+}
+
+void CompressImageDXT(unsigned char* dest, const unsigned char* rgba, int width, int height, CompressedFormat format,
+    CompressionQuality quality, WorkQueue* queue)
+{
+    if (format != CF_DXT1 && format != CF_DXT3 && format != CF_DXT5)
+        return;
+
+    CompressImage(dest, rgba, width, height, format, quality, queue);
+}
+
+void CompressImageETC(unsigned char* dest, const unsigned char* rgba, int width, int height, CompressionQuality quality,
+    WorkQueue* queue)
+{
+    CompressImage(dest, rgba, width, height, CF_ETC1, quality, queue);
+}
+
+}
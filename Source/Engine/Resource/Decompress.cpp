@@ -22,6 +22,17 @@
 
 #include "Precompiled.h"
 #include "Decompress.h"
+#include "MathDefs.h"
+#include "Thread.h"
+#include "WorkQueue.h"
+
+#include <cstring>
+
+// SSE2 is required for the integer operations of the SIMD block decode
+#if defined(URHO3D_SSE) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define DECOMPRESS_SSE2
+#include <emmintrin.h>
+#endif
 
 // DXT decompression based on the Squish library, modified for Urho3D
 
@@ -73,13 +84,9 @@ static int Unpack565( unsigned char const* packed, unsigned char* colour )
     return value;
 }
 
-static void DecompressColourDXT( unsigned char* rgba, void const* block, bool isDxt1 )
+static void GetColourCodesDXT( unsigned char* codes, unsigned char const* bytes, bool isDxt1 )
 {
-    // get the block bytes
-    unsigned char const* bytes = reinterpret_cast< unsigned char const* >( block );
-    
     // unpack the endpoints
-    unsigned char codes[16];
     int a = Unpack565( bytes, codes );
     int b = Unpack565( bytes + 2, codes + 4 );
     
@@ -104,6 +111,16 @@ static void DecompressColourDXT( unsigned char* rgba, void const* block, bool is
     // fill in alpha for the intermediate values
     codes[8 + 3] = 255;
     codes[12 + 3] = ( isDxt1 && a <= b ) ? 0 : 255;
+}
+
+static void DecompressColourDXT( unsigned char* rgba, void const* block, bool isDxt1 )
+{
+    // get the block bytes
+    unsigned char const* bytes = reinterpret_cast< unsigned char const* >( block );
+    
+    // build the codebook
+    unsigned char codes[16];
+    GetColourCodesDXT( codes, bytes, isDxt1 );
     
     // unpack the indices
     unsigned char indices[16];
@@ -147,15 +164,13 @@ static void DecompressAlphaDXT3( unsigned char* rgba, void const* block )
     }
 }
 
-static void DecompressAlphaDXT5( unsigned char* rgba, void const* block )
+static void GetAlphaCodesDXT5( unsigned char* codes, unsigned char const* bytes )
 {
     // get the two alpha values
-    unsigned char const* bytes = reinterpret_cast< unsigned char const* >( block );
     int alpha0 = bytes[0];
     int alpha1 = bytes[1];
     
     // compare the values to build the codebook
-    unsigned char codes[8];
     codes[0] = ( unsigned char )alpha0;
     codes[1] = ( unsigned char )alpha1;
     if( alpha0 <= alpha1 )
@@ -172,9 +187,11 @@ static void DecompressAlphaDXT5( unsigned char* rgba, void const* block )
         for( int i = 1; i < 7; ++i )
             codes[1 + i] = ( unsigned char )( ( ( 7 - i )*alpha0 + i*alpha1 )/7 );
     }
-    
+}
+
+static void GetAlphaIndicesDXT5( unsigned char* indices, unsigned char const* bytes )
+{
     // decode the indices
-    unsigned char indices[16];
     unsigned char const* src = bytes + 2;
     unsigned char* dest = indices;
     for( int i = 0; i < 2; ++i )
@@ -194,6 +211,17 @@ static void DecompressAlphaDXT5( unsigned char* rgba, void const* block )
             *dest++ = ( unsigned char )index;
         }
     }
+}
+
+static void DecompressAlphaDXT5( unsigned char* rgba, void const* block )
+{
+    unsigned char const* bytes = reinterpret_cast< unsigned char const* >( block );
+    
+    // build the codebook and decode the indices
+    unsigned char codes[8];
+    unsigned char indices[16];
+    GetAlphaCodesDXT5( codes, bytes );
+    GetAlphaIndicesDXT5( indices, bytes );
     
     // write out the indexed codebook values
     for( int i = 0; i < 16; ++i )
@@ -218,52 +246,116 @@ static void DecompressDXT( unsigned char* rgba, const void* block, CompressedFor
         DecompressAlphaDXT5( rgba, alphaBock );
 }
 
-void DecompressImageDXT( unsigned char* rgba, const void* blocks, int width, int height, int depth, CompressedFormat format )
+#ifdef DECOMPRESS_SSE2
+/// Replace the alpha of four rows of RGBA pixels with 16 alpha values.
+static void MergeAlphaSSE2(__m128i* rows, __m128i alpha)
 {
-    // initialise the block input
-    unsigned char const* sourceBlock = reinterpret_cast< unsigned char const* >( blocks );
-    int bytesPerBlock = format == CF_DXT1 ? 8 : 16;
-    
-    // loop over blocks
-    for( int z = 0; z < depth; ++z )
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i colorMask = _mm_set1_epi32(0x00ffffff);
+    __m128i alphaLo = _mm_unpacklo_epi8(zero, alpha);
+    __m128i alphaHi = _mm_unpackhi_epi8(zero, alpha);
+    rows[0] = _mm_or_si128(_mm_and_si128(rows[0], colorMask), _mm_unpacklo_epi16(zero, alphaLo));
+    rows[1] = _mm_or_si128(_mm_and_si128(rows[1], colorMask), _mm_unpackhi_epi16(zero, alphaLo));
+    rows[2] = _mm_or_si128(_mm_and_si128(rows[2], colorMask), _mm_unpacklo_epi16(zero, alphaHi));
+    rows[3] = _mm_or_si128(_mm_and_si128(rows[3], colorMask), _mm_unpackhi_epi16(zero, alphaHi));
+}
+#endif
+
+/// Decompress a DXT block to four rows of RGBA pixels with the given row stride in bytes.
+static void DecompressBlockDXT(unsigned char* rgba, unsigned stride, const unsigned char* block, CompressedFormat format)
+{
+#ifdef DECOMPRESS_SSE2
+    const unsigned char* colorBlock = format == CF_DXT1 ? block : block + 8;
+
+    // The codebooks are built like in the scalar path, then each pixel selects its entry with compare masks
+    unsigned char colorCodes[16];
+    GetColourCodesDXT(colorCodes, colorBlock, format == CF_DXT1);
+    __m128i colors[4];
+    for (int i = 0; i < 4; ++i)
+        colors[i] = _mm_set1_epi32(colorCodes[i * 4] | (colorCodes[i * 4 + 1] << 8) | (colorCodes[i * 4 + 2] << 16) | (colorCodes[i * 4 + 3] << 24));
+
+    // Each 32-bit lane masks out the 2-bit color index of one pixel in a row
+    const __m128i indexMask = _mm_setr_epi32(0x3, 0xc, 0x30, 0xc0);
+    const __m128i indexOne = _mm_setr_epi32(0x1, 0x4, 0x10, 0x40);
+    const __m128i indexTwo = _mm_setr_epi32(0x2, 0x8, 0x20, 0x80);
+    __m128i rows[4];
+    for (int y = 0; y < 4; ++y)
     {
-        int sz = width*height*4*z;
-        for( int y = 0; y < height; y += 4 )
+        __m128i index = _mm_and_si128(_mm_set1_epi32(colorBlock[4 + y]), indexMask);
+        __m128i color = _mm_and_si128(_mm_cmpeq_epi32(index, _mm_setzero_si128()), colors[0]);
+        color = _mm_or_si128(color, _mm_and_si128(_mm_cmpeq_epi32(index, indexOne), colors[1]));
+        color = _mm_or_si128(color, _mm_and_si128(_mm_cmpeq_epi32(index, indexTwo), colors[2]));
+        color = _mm_or_si128(color, _mm_and_si128(_mm_cmpeq_epi32(index, indexMask), colors[3]));
+        rows[y] = color;
+    }
+
+    if (format == CF_DXT5)
+    {
+        // Select the alpha of all 16 pixels at once from the 8-entry codebook
+        unsigned char alphaCodes[8];
+        unsigned char alphaIndices[16];
+        GetAlphaCodesDXT5(alphaCodes, block);
+        GetAlphaIndicesDXT5(alphaIndices, block);
+        __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alphaIndices));
+        __m128i alpha = _mm_setzero_si128();
+        for (int i = 0; i < 8; ++i)
+            alpha = _mm_or_si128(alpha, _mm_and_si128(_mm_cmpeq_epi8(index, _mm_set1_epi8((char)i)), _mm_set1_epi8((char)alphaCodes[i])));
+        MergeAlphaSSE2(rows, alpha);
+    }
+    else if (format == CF_DXT3)
+    {
+        unsigned char alphas[16];
+        for (int i = 0; i < 8; ++i)
         {
-            for( int x = 0; x < width; x += 4 )
+            unsigned char lo = block[i] & 0x0f;
+            unsigned char hi = block[i] & 0xf0;
+            alphas[2 * i] = lo | (lo << 4);
+            alphas[2 * i + 1] = hi | (hi >> 4);
+        }
+        MergeAlphaSSE2(rows, _mm_loadu_si128(reinterpret_cast<const __m128i*>(alphas)));
+    }
+
+    for (int y = 0; y < 4; ++y)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + y * stride), rows[y]);
+#else
+    unsigned char blockRgba[4 * 16];
+    DecompressDXT(blockRgba, block, format);
+    for (int y = 0; y < 4; ++y)
+        memcpy(rgba + y * stride, blockRgba + y * 16, 16);
+#endif
+}
+
+/// Decompress rows of DXT blocks. The rows are counted over all depth slices.
+static void DecompressRowsDXT(unsigned char* rgba, const unsigned char* blocks, int width, int height, CompressedFormat format,
+    int startRow, int endRow)
+{
+    int blocksPerRow = (width + 3) / 4;
+    int rowsPerSlice = (height + 3) / 4;
+    unsigned bytesPerBlock = format == CF_DXT1 ? 8 : 16;
+    unsigned stride = width * 4;
+    const unsigned char* sourceBlock = blocks + startRow * blocksPerRow * bytesPerBlock;
+
+    for (int row = startRow; row < endRow; ++row)
+    {
+        int y = (row % rowsPerSlice) * 4;
+        int rowHeight = Min(height - y, 4);
+        unsigned char* destRow = rgba + (row / rowsPerSlice) * height * stride + y * stride;
+
+        for (int x = 0; x < width; x += 4)
+        {
+            if (x + 4 <= width && rowHeight == 4)
+                DecompressBlockDXT(destRow + x * 4, stride, sourceBlock, format);
+            else
             {
-                // decompress the block
-                unsigned char targetRgba[4*16];
-                DecompressDXT( targetRgba, sourceBlock, format );
-                
-                // write the decompressed pixels to the correct image locations
-                unsigned char const* sourcePixel = targetRgba;
-                for( int py = 0; py < 4; ++py )
-                {
-                    for( int px = 0; px < 4; ++px )
-                    {
-                        // get the target location
-                        int sx = x + px;
-                        int sy = y + py;
-                        if( sx < width && sy < height )
-                        {
-                            unsigned char* targetPixel = rgba + sz + 4*( width*sy + sx );
-                            
-                            // copy the rgba value
-                            for( int i = 0; i < 4; ++i )
-                                *targetPixel++ = *sourcePixel++;
-                        }
-                        else
-                        {
-                            // skip this pixel as its outside the image
-                            sourcePixel += 4;
-                        }
-                    }
-                }
-                
-                // advance
-                sourceBlock += bytesPerBlock;
+                // Decompress a block crossing the image edge to a temporary buffer and copy the pixels inside the image
+                unsigned char blockRgba[4 * 16];
+                DecompressBlockDXT(blockRgba, 16, sourceBlock, format);
+                int blockWidth = Min(width - x, 4);
+                for (int py = 0; py < rowHeight; ++py)
+                    memcpy(destRow + py * stride + x * 4, blockRgba + py * 16, blockWidth * 4);
             }
+
+            sourceBlock += bytesPerBlock;
         }
     }
 }
@@ -303,10 +395,10 @@ const int mod[8][4]={{2, 8,-2,-8},
                     {47, 183, -47, -183}};
 
 // lsb: hgfedcba ponmlkji msb: hgfedcba ponmlkji due to endianness
-static unsigned long ModifyPixel(int red, int green, int blue, int x, int y, unsigned long modBlock, int modTable)
+static unsigned ModifyPixel(int red, int green, int blue, int x, int y, unsigned modBlock, int modTable)
 {
     int index = x*4+y, pixelMod;
-    unsigned long mostSig = modBlock<<1;
+    unsigned mostSig = modBlock<<1;
     if (index<8)    //hgfedcba
         pixelMod = mod[modTable][((modBlock>>(index+24))&0x1)+((mostSig>>(index+8))&0x2)];
     else    // ponmlkj
@@ -321,7 +413,7 @@ static unsigned long ModifyPixel(int red, int green, int blue, int x, int y, uns
 
 static void DecompressETC(unsigned char* pDestData, const void* pSrcData)
 {
-    unsigned long blockTop, blockBot, *input = (unsigned long*)pSrcData, *output;
+    unsigned blockTop, blockBot, *input = (unsigned*)pSrcData, *output;
     unsigned char red1, green1, blue1, red2, green2, blue2;
     bool bFlip, bDiff;
     int modtable1,modtable2;
@@ -329,7 +421,7 @@ static void DecompressETC(unsigned char* pDestData, const void* pSrcData)
     blockTop = *(input++);
     blockBot = *(input++);
     
-    output = (unsigned long*)pDestData;
+    output = (unsigned*)pDestData;
     // check flipbit
     bFlip = (blockTop & ETC_FLIP) != 0;
     bDiff = (blockTop & ETC_DIFF) != 0;
@@ -404,52 +496,109 @@ static void DecompressETC(unsigned char* pDestData, const void* pSrcData)
     }
 }
 
-void DecompressImageETC( unsigned char* rgba, const void* blocks, int width, int height )
+/// Decompress rows of ETC1 blocks.
+static void DecompressRowsETC(unsigned char* rgba, const unsigned char* blocks, int width, int height, int startRow, int endRow)
 {
-    // initialise the block input
-    unsigned char const* sourceBlock = reinterpret_cast< unsigned char const* >( blocks );
-    int bytesPerBlock = 8;
-    
-    // loop over blocks
-    for( int y = 0; y < height; y += 4 )
+    int blocksPerRow = (width + 3) / 4;
+    unsigned stride = width * 4;
+    const unsigned char* sourceBlock = blocks + startRow * blocksPerRow * 8;
+
+    for (int row = startRow; row < endRow; ++row)
     {
-        for( int x = 0; x < width; x += 4 )
+        int y = row * 4;
+        int rowHeight = Min(height - y, 4);
+        unsigned char* destRow = rgba + y * stride;
+
+        for (int x = 0; x < width; x += 4)
         {
-            // decompress the block
-            unsigned char targetRgba[4*16];
-            DecompressETC( targetRgba, sourceBlock );
-            
-            // write the decompressed pixels to the correct image locations
-            unsigned char const* sourcePixel = targetRgba;
-            for( int py = 0; py < 4; ++py )
-            {
-                for( int px = 0; px < 4; ++px )
-                {
-                    // get the target location
-                    int sx = x + px;
-                    int sy = y + py;
-                    if( sx < width && sy < height )
-                    {
-                        unsigned char* targetPixel = rgba + 4*( width*sy + sx );
-                        
-                        // copy the rgba value
-                        for( int i = 0; i < 4; ++i )
-                            *targetPixel++ = *sourcePixel++;
-                    }
-                    else
-                    {
-                        // skip this pixel as its outside the image
-                        sourcePixel += 4;
-                    }
-                }
-            }
-            
-            // advance
-            sourceBlock += bytesPerBlock;
+            unsigned char blockRgba[4 * 16];
+            DecompressETC(blockRgba, sourceBlock);
+            int blockWidth = Min(width - x, 4);
+            for (int py = 0; py < rowHeight; ++py)
+                memcpy(destRow + py * stride + x * 4, blockRgba + py * 16, blockWidth * 4);
+
+            sourceBlock += 8;
         }
     }
 }
 
+/// Minimum image size in pixels to decompress in worker threads.
+static const int MIN_PARALLEL_DECOMPRESS_PIXELS = 256 * 256;
+
+/// Rows of compressed blocks to decompress in a work item.
+struct DecompressRows
+{
+    /// Destination RGBA image.
+    unsigned char* dest_;
+    /// Compressed blocks of the whole image.
+    const unsigned char* blocks_;
+    /// Image width.
+    int width_;
+    /// Image height.
+    int height_;
+    /// Compressed format.
+    CompressedFormat format_;
+    /// First row of blocks.
+    int startRow_;
+    /// Row of blocks to stop at.
+    int endRow_;
+};
+
+void DecompressRowsWork(const WorkItem* item, unsigned threadIndex)
+{
+    const DecompressRows* rows = reinterpret_cast<const DecompressRows*>(item->start_);
+    if (rows->format_ == CF_ETC1)
+        DecompressRowsETC(rows->dest_, rows->blocks_, rows->width_, rows->height_, rows->startRow_, rows->endRow_);
+    else
+        DecompressRowsDXT(rows->dest_, rows->blocks_, rows->width_, rows->height_, rows->format_, rows->startRow_, rows->endRow_);
+}
+
+/// Decompress rows of blocks in parallel. Return false if the image is too small or there are no worker threads to use.
+static bool DecompressRowsParallel(unsigned char* rgba, const void* blocks, int width, int height, int depth, CompressedFormat format,
+    WorkQueue* queue)
+{
+    // Completing work is only allowed from the main thread, so background loading decompresses serially
+    if (!queue || !queue->GetNumThreads() || width * height * depth < MIN_PARALLEL_DECOMPRESS_PIXELS || !Thread::IsMainThread())
+        return false;
+
+    int numRows = (height + 3) / 4 * depth;
+    int numWorkItems = Min(numRows, (int)queue->GetNumThreads() + 1);
+    PODVector<DecompressRows> rows(numWorkItems);
+
+    for (int i = 0; i < numWorkItems; ++i)
+    {
+        DecompressRows& itemRows = rows[i];
+        itemRows.dest_ = rgba;
+        itemRows.blocks_ = reinterpret_cast<const unsigned char*>(blocks);
+        itemRows.width_ = width;
+        itemRows.height_ = height;
+        itemRows.format_ = format;
+        itemRows.startRow_ = numRows * i / numWorkItems;
+        itemRows.endRow_ = numRows * (i + 1) / numWorkItems;
+
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = DecompressRowsWork;
+        item->start_ = &itemRows;
+        queue->AddWorkItem(item);
+    }
+
+    queue->Complete(M_MAX_UNSIGNED);
+    return true;
+}
+
+void DecompressImageDXT(unsigned char* rgba, const void* blocks, int width, int height, int depth, CompressedFormat format, WorkQueue* queue)
+{
+    if (!DecompressRowsParallel(rgba, blocks, width, height, depth, format, queue))
+        DecompressRowsDXT(rgba, reinterpret_cast<const unsigned char*>(blocks), width, height, format, 0, (height + 3) / 4 * depth);
+}
+
+void DecompressImageETC(unsigned char* rgba, const void* blocks, int width, int height, WorkQueue* queue)
+{
+    if (!DecompressRowsParallel(rgba, blocks, width, height, 1, CF_ETC1, queue))
+        DecompressRowsETC(rgba, reinterpret_cast<const unsigned char*>(blocks), width, height, 0, (height + 3) / 4);
+}
+
 #define PT_INDEX    (2) /*The Punch-through index*/
 #define BLK_Y_SIZE  (4) /*always 4 for all 2D block types*/
 #define BLK_X_MAX   (8) /*Max X dimension for blocks*/
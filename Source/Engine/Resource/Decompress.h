@@ -27,10 +27,12 @@
 namespace Urho3D
 {
 
-/// Decompress a DXT compressed image to RGBA.
-URHO3D_API void DecompressImageDXT(unsigned char* dest, const void* blocks, int width, int height, int depth, CompressedFormat format);
-/// Decompress an ETC1 compressed image to RGBA.
-URHO3D_API void DecompressImageETC(unsigned char* dest, const void* blocks, int width, int height);
+class WorkQueue;
+
+/// Decompress a DXT compressed image to RGBA. If a work queue with worker threads is given, decompress rows of blocks in parallel when called from the main thread.
+URHO3D_API void DecompressImageDXT(unsigned char* dest, const void* blocks, int width, int height, int depth, CompressedFormat format, WorkQueue* queue = 0);
+/// Decompress an ETC1 compressed image to RGBA. If a work queue with worker threads is given, decompress rows of blocks in parallel when called from the main thread.
+URHO3D_API void DecompressImageETC(unsigned char* dest, const void* blocks, int width, int height, WorkQueue* queue = 0);
 /// Decompress a PVRTC compressed image to RGBA.
 URHO3D_API void DecompressImagePVRTC(unsigned char* dest, const void* blocks, int width, int height, CompressedFormat format);
 /// Flip a compressed block vertically.
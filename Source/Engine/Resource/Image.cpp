@@ -21,13 +21,16 @@
 //
 
 #include "Precompiled.h"
+#include "Compress.h"
 #include "Context.h"
 #include "Decompress.h"
 #include "File.h"
 #include "FileSystem.h"
 #include "Log.h"
 #include "Profiler.h"
+#include "WorkQueue.h"
 
+#include <cmath>
 #include <cstdlib>
 #include <cstring>
 #include <stb_image.h>
@@ -49,6 +52,17 @@ extern "C" unsigned char *stbi_write_png_to_mem(unsigned char *pixels, int strid
 #define FOURCC_DXT4 (MAKEFOURCC('D','X','T','4'))
 #define FOURCC_DXT5 (MAKEFOURCC('D','X','T','5'))
 
+#define DDSD_CAPS 0x1
+#define DDSD_HEIGHT 0x2
+#define DDSD_WIDTH 0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE 0x80000
+#define DDPF_FOURCC 0x4
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP 0x400000
+
 namespace Urho3D
 {
 
@@ -169,7 +183,19 @@ struct DDSurfaceDesc2
     unsigned dwTextureStage_;
 };
 
-bool CompressedLevel::Decompress(unsigned char* dest)
+/// Convert an sRGB color channel to linear.
+static float SRGBToLinear(float value)
+{
+    return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+/// Convert a linear color channel to sRGB.
+static float LinearToSRGB(float value)
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+}
+
+bool CompressedLevel::Decompress(unsigned char* dest, WorkQueue* queue)
 {
     if (!data_)
         return false;
@@ -179,11 +205,11 @@ bool CompressedLevel::Decompress(unsigned char* dest)
     case CF_DXT1:
     case CF_DXT3:
     case CF_DXT5:
-        DecompressImageDXT(dest, data_, width_, height_, depth_, format_);
+        DecompressImageDXT(dest, data_, width_, height_, depth_, format_, queue);
         return true;
 
     case CF_ETC1:
-        DecompressImageETC(dest, data_, width_, height_);
+        DecompressImageETC(dest, data_, width_, height_, queue);
         return true;
 
     case CF_PVRTC_RGB_2BPP:
@@ -957,6 +983,119 @@ void Image::ClearInt(unsigned uintColor)
         data_[i] = src[i % components_];
 }
 
+bool Image::Compress(CompressedFormat format, CompressionQuality quality, bool mipmaps, bool sRGB)
+{
+    if (!data_)
+        return false;
+
+    if (IsCompressed())
+    {
+        LOGERROR("Image is already compressed");
+        return false;
+    }
+    if (depth_ > 1)
+    {
+        LOGERROR("Compressing 3D images is not supported");
+        return false;
+    }
+    if (format != CF_DXT1 && format != CF_DXT3 && format != CF_DXT5 && format != CF_ETC1)
+    {
+        LOGERROR("Unsupported compressed format, only DXT1, DXT3, DXT5 and ETC1 can be compressed to");
+        return false;
+    }
+
+    PROFILE(CompressImage);
+
+    // Calculate the size of the mip levels, which are halved like in GetCompressedLevel()
+    unsigned blockSize = (format == CF_DXT1 || format == CF_ETC1) ? 8 : 16;
+    unsigned numLevels = 0;
+    unsigned dataSize = 0;
+    for (int width = width_, height = height_;; width = Max(width / 2, 1), height = Max(height / 2, 1))
+    {
+        dataSize += ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+        ++numLevels;
+        if (!mipmaps || (width == 1 && height == 1))
+            break;
+    }
+
+    int levelWidth = width_;
+    int levelHeight = height_;
+    PODVector<unsigned char> rgba(levelWidth * levelHeight * 4);
+    for (int y = 0; y < levelHeight; ++y)
+    {
+        for (int x = 0; x < levelWidth; ++x)
+        {
+            unsigned color = GetPixelInt(x, y);
+            memcpy(&rgba[(y * levelWidth + x) * 4], &color, 4);
+        }
+    }
+
+    // The mip levels are filtered from a float copy to avoid accumulating rounding errors
+    PODVector<float> linear;
+    if (numLevels > 1)
+    {
+        linear.Resize(rgba.Size());
+        for (unsigned i = 0; i < rgba.Size(); ++i)
+        {
+            float value = rgba[i] / 255.0f;
+            linear[i] = (sRGB && (i & 3) != 3) ? SRGBToLinear(value) : value;
+        }
+    }
+
+    SharedArrayPtr<unsigned char> compressedData(new unsigned char[dataSize]);
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    unsigned offset = 0;
+
+    for (unsigned i = 0; i < numLevels; ++i)
+    {
+        if (format == CF_ETC1)
+            CompressImageETC(compressedData.Get() + offset, &rgba[0], levelWidth, levelHeight, quality, queue);
+        else
+            CompressImageDXT(compressedData.Get() + offset, &rgba[0], levelWidth, levelHeight, format, quality, queue);
+        offset += ((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * blockSize;
+
+        if (i == numLevels - 1)
+            break;
+
+        // Box filter the next level
+        int nextWidth = Max(levelWidth / 2, 1);
+        int nextHeight = Max(levelHeight / 2, 1);
+        PODVector<float> nextLinear(nextWidth * nextHeight * 4);
+        for (int y = 0; y < nextHeight; ++y)
+        {
+            const float* row0 = &linear[Min(y * 2, levelHeight - 1) * levelWidth * 4];
+            const float* row1 = &linear[Min(y * 2 + 1, levelHeight - 1) * levelWidth * 4];
+            float* dest = &nextLinear[y * nextWidth * 4];
+            for (int x = 0; x < nextWidth; ++x)
+            {
+                int x0 = Min(x * 2, levelWidth - 1) * 4;
+                int x1 = Min(x * 2 + 1, levelWidth - 1) * 4;
+                for (int j = 0; j < 4; ++j)
+                    *dest++ = 0.25f * (row0[x0 + j] + row0[x1 + j] + row1[x0 + j] + row1[x1 + j]);
+            }
+        }
+
+        linear.Swap(nextLinear);
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+        rgba.Resize(linear.Size());
+        for (unsigned j = 0; j < linear.Size(); ++j)
+        {
+            float value = (sRGB && (j & 3) != 3) ? LinearToSRGB(linear[j]) : linear[j];
+            rgba[j] = (unsigned char)(Clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+    }
+
+    // Replace the pixel data with the compressed levels. Components are reported like for a loaded DDS file
+    data_ = compressedData;
+    compressedFormat_ = format;
+    numCompressedLevels_ = numLevels;
+    components_ = blockSize == 8 ? 3 : 4;
+    nextLevel_.Reset();
+    SetMemoryUse(dataSize);
+    return true;
+}
+
 bool Image::SaveBMP(const String& fileName) const
 {
     PROFILE(SaveImageBMP);
@@ -1049,6 +1188,145 @@ bool Image::SaveJPG(const String & fileName, int quality) const
         return false;
 }
 
+bool Image::SaveDDS(const String& fileName) const
+{
+    PROFILE(SaveImageDDS);
+
+    FileSystem* fileSystem = GetSubsystem<FileSystem>();
+    if (fileSystem && !fileSystem->CheckAccess(GetPath(fileName)))
+    {
+        LOGERROR("Access denied to " + fileName);
+        return false;
+    }
+
+    unsigned fourCC;
+    switch (compressedFormat_)
+    {
+    case CF_DXT1:
+        fourCC = FOURCC_DXT1;
+        break;
+
+    case CF_DXT3:
+        fourCC = FOURCC_DXT3;
+        break;
+
+    case CF_DXT5:
+        fourCC = FOURCC_DXT5;
+        break;
+
+    default:
+        LOGERROR("Can not save image to DDS, only DXT compressed images are supported");
+        return false;
+    }
+
+    unsigned dataSize = 0;
+    for (unsigned i = 0; i < numCompressedLevels_; ++i)
+    {
+        CompressedLevel level = GetCompressedLevel(i);
+        if (!level.data_)
+            return false;
+        dataSize += level.dataSize_;
+    }
+
+    DDSurfaceDesc2 ddsd;
+    memset(&ddsd, 0, sizeof ddsd);
+    ddsd.dwSize_ = sizeof ddsd;
+    ddsd.dwFlags_ = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE;
+    ddsd.dwHeight_ = height_;
+    ddsd.dwWidth_ = width_;
+    ddsd.dwLinearSize_ = GetCompressedLevel(0).dataSize_;
+    ddsd.dwMipMapCount_ = numCompressedLevels_;
+    ddsd.ddpfPixelFormat_.dwSize_ = sizeof ddsd.ddpfPixelFormat_;
+    ddsd.ddpfPixelFormat_.dwFlags_ = DDPF_FOURCC;
+    ddsd.ddpfPixelFormat_.dwFourCC_ = fourCC;
+    ddsd.ddsCaps_.dwCaps_ = DDSCAPS_TEXTURE;
+    if (numCompressedLevels_ > 1)
+    {
+        ddsd.dwFlags_ |= DDSD_MIPMAPCOUNT;
+        ddsd.ddsCaps_.dwCaps_ |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+    }
+
+    File outFile(context_, fileName, FILE_WRITE);
+    if (!outFile.IsOpen())
+        return false;
+
+    outFile.WriteFileID("DDS ");
+    outFile.Write(&ddsd, sizeof ddsd);
+    return outFile.Write(data_.Get(), dataSize) == dataSize;
+}
+
+bool Image::SaveKTX(const String& fileName) const
+{
+    PROFILE(SaveImageKTX);
+
+    FileSystem* fileSystem = GetSubsystem<FileSystem>();
+    if (fileSystem && !fileSystem->CheckAccess(GetPath(fileName)))
+    {
+        LOGERROR("Access denied to " + fileName);
+        return false;
+    }
+
+    // Use the same OpenGL internal formats as the loader recognizes
+    unsigned internalFormat;
+    unsigned baseInternalFormat = 0x1908; // GL_RGBA
+    switch (compressedFormat_)
+    {
+    case CF_DXT1:
+        internalFormat = 0x83f1;
+        break;
+
+    case CF_DXT3:
+        internalFormat = 0x83f2;
+        break;
+
+    case CF_DXT5:
+        internalFormat = 0x83f3;
+        break;
+
+    case CF_ETC1:
+        internalFormat = 0x8d64;
+        baseInternalFormat = 0x1907; // GL_RGB
+        break;
+
+    default:
+        LOGERROR("Can not save image to KTX, only DXT and ETC1 compressed images are supported");
+        return false;
+    }
+
+    File outFile(context_, fileName, FILE_WRITE);
+    if (!outFile.IsOpen())
+        return false;
+
+    static const unsigned char ktxIdentifier[] = { 0xab, 'K', 'T', 'X', ' ', '1', '1', 0xbb, '\r', '\n', 0x1a, '\n' };
+    outFile.Write(ktxIdentifier, sizeof ktxIdentifier);
+    outFile.WriteUInt(0x04030201);
+    outFile.WriteUInt(0); // Type
+    outFile.WriteUInt(1); // Type size
+    outFile.WriteUInt(0); // Format
+    outFile.WriteUInt(internalFormat);
+    outFile.WriteUInt(baseInternalFormat);
+    outFile.WriteUInt(width_);
+    outFile.WriteUInt(height_);
+    outFile.WriteUInt(0); // Depth
+    outFile.WriteUInt(0); // Array elements
+    outFile.WriteUInt(1); // Faces
+    outFile.WriteUInt(numCompressedLevels_);
+    outFile.WriteUInt(0); // Key value bytes
+
+    // The compressed level sizes are multiples of 4, so no padding is needed
+    for (unsigned i = 0; i < numCompressedLevels_; ++i)
+    {
+        CompressedLevel level = GetCompressedLevel(i);
+        if (!level.data_)
+            return false;
+        outFile.WriteUInt(level.dataSize_);
+        if (outFile.Write(level.data_, level.dataSize_) != level.dataSize_)
+            return false;
+    }
+
+    return true;
+}
+
 Color Image::GetPixel(int x, int y) const
 {
     return GetPixel(x, y, 0);
@@ -30,6 +30,8 @@ struct SDL_Surface;
 namespace Urho3D
 {
 
+class WorkQueue;
+
 static const int COLOR_LUT_SIZE = 16;
 
 /// Supported compressed image formats.
@@ -47,6 +49,14 @@ enum CompressedFormat
     CF_PVRTC_RGBA_4BPP,
 };
 
+/// Block compression quality. Higher quality searches more endpoints and is slower.
+enum CompressionQuality
+{
+    CQ_FAST = 0,
+    CQ_NORMAL,
+    CQ_HIGH
+};
+
 /// Compressed image mip level.
 struct CompressedLevel
 {
@@ -63,8 +73,8 @@ struct CompressedLevel
     {
     }
 
-    /// Decompress to RGBA. The destination buffer required is width * height * 4 bytes. Return true if successful.
-    bool Decompress(unsigned char* dest);
+    /// Decompress to RGBA. The destination buffer required is width * height * 4 bytes. DXT and ETC1 formats are decompressed in parallel if a work queue is given. Return true if successful.
+    bool Decompress(unsigned char* dest, WorkQueue* queue = 0);
 
     /// Compressed image data.
     unsigned char* data_;
@@ -130,6 +140,8 @@ public:
     void Clear(const Color& color);
     /// Clear the image with an integer color. R component is in the 8 lowest bits.
     void ClearInt(unsigned uintColor);
+    /// Compress to DXT1, DXT3, DXT5 or ETC1, optionally generating a full mip chain. If sRGB is true, the color channels are decoded to linear space for mip filtering; set false for normal maps and other non-color data. Uses the worker threads if available. 3D images are not supported. Return true if successful.
+    bool Compress(CompressedFormat format, CompressionQuality quality = CQ_NORMAL, bool mipmaps = true, bool sRGB = true);
     /// Save in BMP format. Return true if successful.
     bool SaveBMP(const String& fileName) const;
     /// Save in PNG format. Return true if successful.
@@ -138,6 +150,10 @@ public:
     bool SaveTGA(const String& fileName) const;
     /// Save in JPG format with compression quality. Return true if successful.
     bool SaveJPG(const String& fileName, int quality) const;
+    /// Save a DXT compressed image with its mip levels in DDS format. Return true if successful.
+    bool SaveDDS(const String& fileName) const;
+    /// Save a DXT or ETC1 compressed image with its mip levels in KTX format. Return true if successful.
+    bool SaveKTX(const String& fileName) const;
 
     /// Return a 2D pixel color.
     Color GetPixel(int x, int y) const;
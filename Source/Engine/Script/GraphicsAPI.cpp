@@ -31,11 +31,13 @@
 #include "DebugRenderer.h"
 #include "DecalSet.h"
 #include "Graphics.h"
+#include "HLODCluster.h"
 #include "Light.h"
 #include "Material.h"
 #include "Octree.h"
 #include "ParticleEffect.h"
 #include "ParticleEmitter.h"
+#include "PotentiallyVisibleSet.h"
 #include "Renderer.h"
 #include "RenderPath.h"
 #include "Scene.h"
@@ -48,6 +50,7 @@
 #include "Texture3D.h"
 #include "TextureCube.h"
 #include "Skybox.h"
+#include "StaticBatch.h"
 #include "Zone.h"
 
 #ifdef _MSC_VER
@@ -912,6 +915,37 @@ static void RegisterStaticModelGroup(asIScriptEngine* engine)
     engine->RegisterObjectMethod("StaticModelGroup", "Node@+ get_instanceNodes(uint) const", asMETHOD(StaticModelGroup, GetInstanceNode), asCALL_THISCALL);
 }
 
+static void RegisterStaticBatch(asIScriptEngine* engine)
+{
+    RegisterStaticModel<StaticBatch>(engine, "StaticBatch", true);
+    engine->RegisterObjectMethod("StaticBatch", "void AddBatchNode(Node@+)", asMETHOD(StaticBatch, AddBatchNode), asCALL_THISCALL);
+    engine->RegisterObjectMethod("StaticBatch", "void RemoveBatchNode(Node@+)", asMETHOD(StaticBatch, RemoveBatchNode), asCALL_THISCALL);
+    engine->RegisterObjectMethod("StaticBatch", "void RemoveAllBatchNodes()", asMETHOD(StaticBatch, RemoveAllBatchNodes), asCALL_THISCALL);
+    engine->RegisterObjectMethod("StaticBatch", "void Build()", asMETHOD(StaticBatch, Build), asCALL_THISCALL);
+    engine->RegisterObjectMethod("StaticBatch", "uint get_numBatchNodes() const", asMETHOD(StaticBatch, GetNumBatchNodes), asCALL_THISCALL);
+    engine->RegisterObjectMethod("StaticBatch", "Node@+ get_batchNodes(uint) const", asMETHOD(StaticBatch, GetBatchNode), asCALL_THISCALL);
+    engine->RegisterObjectMethod("StaticBatch", "uint get_numMembers() const", asMETHOD(StaticBatch, GetNumMembers), asCALL_THISCALL);
+    engine->RegisterGlobalFunction("uint CreateStaticBatches(Node@+, float)", asFUNCTION(StaticBatch::CreateBatches), asCALL_CDECL);
+}
+
+static void RegisterHLODCluster(asIScriptEngine* engine)
+{
+    RegisterStaticModel<HLODCluster>(engine, "HLODCluster", true);
+    engine->RegisterObjectMethod("HLODCluster", "void AddClusterNode(Node@+)", asMETHOD(HLODCluster, AddClusterNode), asCALL_THISCALL);
+    engine->RegisterObjectMethod("HLODCluster", "void RemoveClusterNode(Node@+)", asMETHOD(HLODCluster, RemoveClusterNode), asCALL_THISCALL);
+    engine->RegisterObjectMethod("HLODCluster", "void RemoveAllClusterNodes()", asMETHOD(HLODCluster, RemoveAllClusterNodes), asCALL_THISCALL);
+    engine->RegisterObjectMethod("HLODCluster", "void Build()", asMETHOD(HLODCluster, Build), asCALL_THISCALL);
+    engine->RegisterObjectMethod("HLODCluster", "bool IsProxyActive(Camera@+)", asMETHOD(HLODCluster, IsProxyActive), asCALL_THISCALL);
+    engine->RegisterObjectMethod("HLODCluster", "void set_switchDistance(float)", asMETHOD(HLODCluster, SetSwitchDistance), asCALL_THISCALL);
+    engine->RegisterObjectMethod("HLODCluster", "float get_switchDistance() const", asMETHOD(HLODCluster, GetSwitchDistance), asCALL_THISCALL);
+    engine->RegisterObjectMethod("HLODCluster", "void set_proxyLodLevel(uint)", asMETHOD(HLODCluster, SetProxyLodLevel), asCALL_THISCALL);
+    engine->RegisterObjectMethod("HLODCluster", "uint get_proxyLodLevel() const", asMETHOD(HLODCluster, GetProxyLodLevel), asCALL_THISCALL);
+    engine->RegisterObjectMethod("HLODCluster", "uint get_numClusterNodes() const", asMETHOD(HLODCluster, GetNumClusterNodes), asCALL_THISCALL);
+    engine->RegisterObjectMethod("HLODCluster", "Node@+ get_clusterNodes(uint) const", asMETHOD(HLODCluster, GetClusterNode), asCALL_THISCALL);
+    engine->RegisterObjectMethod("HLODCluster", "uint get_numMembers() const", asMETHOD(HLODCluster, GetNumMembers), asCALL_THISCALL);
+    engine->RegisterGlobalFunction("uint CreateHLODClusters(Node@+, float, float)", asFUNCTION(HLODCluster::CreateClusters), asCALL_CDECL);
+}
+
 static void RegisterSkybox(asIScriptEngine* engine)
 {
     RegisterStaticModel<Skybox>(engine, "Skybox", true);
@@ -979,6 +1013,7 @@ static void RegisterAnimatedModel(asIScriptEngine* engine)
     engine->RegisterObjectMethod("AnimatedModel", "void RemoveAllAnimationStates()", asMETHOD(AnimatedModel, RemoveAllAnimationStates), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "void SetMorphWeight(uint, float)", asMETHODPR(AnimatedModel, SetMorphWeight, (unsigned, float), void), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "void ResetMorphWeights()", asMETHOD(AnimatedModel, ResetMorphWeights), asCALL_THISCALL);
+    engine->RegisterObjectMethod("AnimatedModel", "Node@+ CreateBoneNode(const String&in)", asMETHOD(AnimatedModel, CreateBoneNode), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "float GetMorphWeight(uint) const", asMETHODPR(AnimatedModel, GetMorphWeight, (unsigned) const, float), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "AnimationState@+ GetAnimationState(Animation@+) const", asMETHODPR(AnimatedModel, GetAnimationState, (Animation*) const, AnimationState*), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "AnimationState@+ GetAnimationState(uint) const", asMETHODPR(AnimatedModel, GetAnimationState, (unsigned) const, AnimationState*), asCALL_THISCALL);
@@ -987,6 +1022,10 @@ static void RegisterAnimatedModel(asIScriptEngine* engine)
     engine->RegisterObjectMethod("AnimatedModel", "float get_animationLodBias() const", asMETHOD(AnimatedModel, GetAnimationLodBias), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "void set_updateInvisible(bool)", asMETHOD(AnimatedModel, SetUpdateInvisible), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "bool get_updateInvisible() const", asMETHOD(AnimatedModel, GetUpdateInvisible), asCALL_THISCALL);
+    engine->RegisterObjectMethod("AnimatedModel", "void set_nodelessSkeleton(bool)", asMETHOD(AnimatedModel, SetNodelessSkeleton), asCALL_THISCALL);
+    engine->RegisterObjectMethod("AnimatedModel", "bool get_nodelessSkeleton() const", asMETHOD(AnimatedModel, GetNodelessSkeleton), asCALL_THISCALL);
+    engine->RegisterObjectMethod("AnimatedModel", "void set_poseCacheStep(float)", asMETHOD(AnimatedModel, SetPoseCacheStep), asCALL_THISCALL);
+    engine->RegisterObjectMethod("AnimatedModel", "float get_poseCacheStep() const", asMETHOD(AnimatedModel, GetPoseCacheStep), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "Skeleton@+ get_skeleton()", asMETHOD(AnimatedModel, GetSkeleton), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "uint get_numAnimationStates() const", asMETHOD(AnimatedModel, GetNumAnimationStates), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "AnimationState@+ get_animationStates(const String&in) const", asMETHODPR(AnimatedModel, GetAnimationState, (const String&) const, AnimationState*), asCALL_THISCALL);
@@ -1259,14 +1298,35 @@ static void RegisterDecalSet(asIScriptEngine* engine)
     engine->RegisterObjectMethod("DecalSet", "uint get_maxVertices() const", asMETHOD(DecalSet, GetMaxVertices), asCALL_THISCALL);
     engine->RegisterObjectMethod("DecalSet", "void set_maxIndices(uint)", asMETHOD(DecalSet, SetMaxIndices), asCALL_THISCALL);
     engine->RegisterObjectMethod("DecalSet", "uint get_maxIndices() const", asMETHOD(DecalSet, GetMaxIndices), asCALL_THISCALL);
+    engine->RegisterObjectMethod("DecalSet", "void set_asyncCreation(bool)", asMETHOD(DecalSet, SetAsyncCreation), asCALL_THISCALL);
+    engine->RegisterObjectMethod("DecalSet", "bool get_asyncCreation() const", asMETHOD(DecalSet, GetAsyncCreation), asCALL_THISCALL);
+    engine->RegisterObjectMethod("DecalSet", "uint get_numPendingDecals() const", asMETHOD(DecalSet, GetNumPendingDecals), asCALL_THISCALL);
     engine->RegisterObjectMethod("DecalSet", "Zone@+ get_zone() const", asMETHOD(DecalSet, GetZone), asCALL_THISCALL);
 }
 
+static bool TerrainSetHeights(const IntRect& rect, CScriptArray* heights, Terrain* ptr)
+{
+    PODVector<float> data = ArrayToPODVector<float>(heights);
+    if (rect.Width() <= 0 || rect.Height() <= 0)
+    {
+        LOGERROR("Invalid terrain region");
+        return false;
+    }
+    if (data.Empty() || data.Size() < (unsigned)(rect.Width() * rect.Height()))
+    {
+        LOGERROR("Not enough heights for the terrain region");
+        return false;
+    }
+
+    return ptr->SetHeights(rect, &data[0]);
+}
+
 static void RegisterTerrain(asIScriptEngine* engine)
 {
     RegisterDrawable<TerrainPatch>(engine, "TerrainPatch");
     RegisterComponent<Terrain>(engine, "Terrain");
     engine->RegisterObjectMethod("Terrain", "void ApplyHeightMap()", asMETHOD(Terrain, ApplyHeightMap), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Terrain", "bool SetHeights(const IntRect&in, Array<float>@+)", asFUNCTION(TerrainSetHeights), asCALL_CDECL_OBJLAST);
     engine->RegisterObjectMethod("Terrain", "float GetHeight(const Vector3&in) const", asMETHOD(Terrain, GetHeight), asCALL_THISCALL);
     engine->RegisterObjectMethod("Terrain", "Vector3 GetNormal(const Vector3&in) const", asMETHOD(Terrain, GetNormal), asCALL_THISCALL);
     engine->RegisterObjectMethod("Terrain", "TerrainPatch@+ GetPatch(int, int) const", asMETHODPR(Terrain, GetPatch, (int, int) const, TerrainPatch*), asCALL_THISCALL);
@@ -1373,6 +1433,10 @@ static void RegisterGraphics(asIScriptEngine* engine)
     engine->RegisterObjectMethod("Graphics", "bool get_deviceLost() const", asMETHOD(Graphics, IsDeviceLost), asCALL_THISCALL);
     engine->RegisterObjectMethod("Graphics", "uint get_numPrimitives() const", asMETHOD(Graphics, GetNumPrimitives), asCALL_THISCALL);
     engine->RegisterObjectMethod("Graphics", "uint get_numBatches() const", asMETHOD(Graphics, GetNumBatches), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Graphics", "uint get_numStateChanges() const", asMETHOD(Graphics, GetNumStateChanges), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Graphics", "uint get_numRedundantStateChanges() const", asMETHOD(Graphics, GetNumRedundantStateChanges), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Graphics", "uint get_numParameterUpdates() const", asMETHOD(Graphics, GetNumParameterUpdates), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Graphics", "uint get_numRedundantParameterUpdates() const", asMETHOD(Graphics, GetNumRedundantParameterUpdates), asCALL_THISCALL);
     engine->RegisterObjectMethod("Graphics", "bool get_sm3Support() const", asMETHOD(Graphics, GetSM3Support), asCALL_THISCALL);
     engine->RegisterObjectMethod("Graphics", "bool get_instancingSupport() const", asMETHOD(Graphics, GetInstancingSupport), asCALL_THISCALL);
     engine->RegisterObjectMethod("Graphics", "bool get_lightPrepassSupport() const", asMETHOD(Graphics, GetLightPrepassSupport), asCALL_THISCALL);
@@ -1380,6 +1444,7 @@ static void RegisterGraphics(asIScriptEngine* engine)
     engine->RegisterObjectMethod("Graphics", "bool get_hardwareShadowSupport() const", asMETHOD(Graphics, GetHardwareShadowSupport), asCALL_THISCALL);
     engine->RegisterObjectMethod("Graphics", "bool get_sRGBSupport() const", asMETHOD(Graphics, GetSRGBSupport), asCALL_THISCALL);
     engine->RegisterObjectMethod("Graphics", "bool get_sRGBWriteSupport() const", asMETHOD(Graphics, GetSRGBWriteSupport), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Graphics", "bool get_packedVertexSupport() const", asMETHOD(Graphics, GetPackedVertexSupport), asCALL_THISCALL);
     engine->RegisterObjectMethod("Graphics", "void set_forceSM2(bool)", asMETHOD(Graphics, SetForceSM2), asCALL_THISCALL);
     engine->RegisterObjectMethod("Graphics", "bool get_forceSM2() const", asMETHOD(Graphics, GetForceSM2), asCALL_THISCALL);
     engine->RegisterObjectMethod("Graphics", "Array<IntVector2>@ get_resolutions() const", asFUNCTION(GraphicsGetResolutions), asCALL_CDECL_OBJLAST);
@@ -1439,6 +1504,10 @@ static void RegisterRenderer(asIScriptEngine* engine)
     engine->RegisterObjectMethod("Renderer", "int get_shadowQuality() const", asMETHOD(Renderer, GetShadowQuality), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "void set_maxShadowMaps(int)", asMETHOD(Renderer, SetMaxShadowMaps), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "int get_maxShadowMaps() const", asMETHOD(Renderer, GetMaxShadowMaps), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "void set_shadowAtlas(bool)", asMETHOD(Renderer, SetShadowAtlas), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "bool get_shadowAtlas() const", asMETHOD(Renderer, GetShadowAtlas), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "void set_shadowAtlasSize(int)", asMETHOD(Renderer, SetShadowAtlasSize), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "int get_shadowAtlasSize() const", asMETHOD(Renderer, GetShadowAtlasSize), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "void set_reuseShadowMaps(bool)", asMETHOD(Renderer, SetReuseShadowMaps), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "bool get_reuseShadowMaps() const", asMETHOD(Renderer, GetReuseShadowMaps), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "void set_dynamicInstancing(bool)", asMETHOD(Renderer, SetDynamicInstancing), asCALL_THISCALL);
@@ -1455,6 +1524,10 @@ static void RegisterRenderer(asIScriptEngine* engine)
     engine->RegisterObjectMethod("Renderer", "int get_occlusionBufferSize() const", asMETHOD(Renderer, GetOcclusionBufferSize), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "void set_occluderSizeThreshold(float)", asMETHOD(Renderer, SetOccluderSizeThreshold), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "float get_occluderSizeThreshold() const", asMETHOD(Renderer, GetOccluderSizeThreshold), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "void set_clusteredLighting(bool)", asMETHOD(Renderer, SetClusteredLighting), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "bool get_clusteredLighting() const", asMETHOD(Renderer, GetClusteredLighting), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "void set_retainedBatches(bool)", asMETHOD(Renderer, SetRetainedBatches), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "bool get_retainedBatches() const", asMETHOD(Renderer, GetRetainedBatches), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "void set_mobileShadowBiasMul(float)", asMETHOD(Renderer, SetMobileShadowBiasMul), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "float get_mobileShadowBiasMul() const", asMETHOD(Renderer, GetMobileShadowBiasMul), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "void set_mobileShadowBiasAdd(float)", asMETHOD(Renderer, SetMobileShadowBiasAdd), asCALL_THISCALL);
@@ -1466,6 +1539,8 @@ static void RegisterRenderer(asIScriptEngine* engine)
     engine->RegisterObjectMethod("Renderer", "uint get_numLights(bool) const", asMETHOD(Renderer, GetNumLights), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "uint get_numShadowMaps(bool) const", asMETHOD(Renderer, GetNumShadowMaps), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "uint get_numOccluders(bool) const", asMETHOD(Renderer, GetNumOccluders), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "uint get_transientBytesUploaded() const", asMETHOD(Renderer, GetTransientBytesUploaded), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "uint get_numTransientReallocations() const", asMETHOD(Renderer, GetNumTransientReallocations), asCALL_THISCALL);
     engine->RegisterGlobalFunction("Renderer@+ get_renderer()", asFUNCTION(GetRenderer), asCALL_CDECL);
 }
 
@@ -1618,6 +1693,33 @@ static void RegisterOctree(asIScriptEngine* engine)
     engine->RegisterGlobalFunction("Octree@+ get_octree()", asFUNCTION(GetOctree), asCALL_CDECL);
 }
 
+static bool PotentiallyVisibleSetIsVisible(const Vector3& position, Drawable* drawable, PotentiallyVisibleSet* ptr)
+{
+    return ptr->IsVisible(ptr->GetCellIndex(position), drawable);
+}
+
+static void RegisterPotentiallyVisibleSet(asIScriptEngine* engine)
+{
+    RegisterComponent<PotentiallyVisibleSet>(engine, "PotentiallyVisibleSet");
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "bool Bake()", asMETHOD(PotentiallyVisibleSet, Bake), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "void Clear()", asMETHOD(PotentiallyVisibleSet, Clear), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "bool IsVisible(const Vector3&in, Drawable@+) const", asFUNCTION(PotentiallyVisibleSetIsVisible), asCALL_CDECL_OBJLAST);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "uint GetCellIndex(const Vector3&in) const", asMETHOD(PotentiallyVisibleSet, GetCellIndex), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "void set_boundingBox(const BoundingBox&in)", asMETHOD(PotentiallyVisibleSet, SetBoundingBox), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "const BoundingBox& get_boundingBox() const", asMETHOD(PotentiallyVisibleSet, GetBoundingBox), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "void set_cellSize(const Vector3&in)", asMETHOD(PotentiallyVisibleSet, SetCellSize), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "const Vector3& get_cellSize() const", asMETHOD(PotentiallyVisibleSet, GetCellSize), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "void set_viewMask(uint)", asMETHOD(PotentiallyVisibleSet, SetViewMask), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "uint get_viewMask() const", asMETHOD(PotentiallyVisibleSet, GetViewMask), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "void set_bakeResolution(int)", asMETHOD(PotentiallyVisibleSet, SetBakeResolution), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "int get_bakeResolution() const", asMETHOD(PotentiallyVisibleSet, GetBakeResolution), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "void set_cellSamples(int)", asMETHOD(PotentiallyVisibleSet, SetCellSamples), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "int get_cellSamples() const", asMETHOD(PotentiallyVisibleSet, GetCellSamples), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "bool get_baked() const", asMETHOD(PotentiallyVisibleSet, IsBaked), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "uint get_numCells() const", asMETHOD(PotentiallyVisibleSet, GetNumCells), asCALL_THISCALL);
+    engine->RegisterObjectMethod("PotentiallyVisibleSet", "uint get_numDrawables() const", asMETHOD(PotentiallyVisibleSet, GetNumDrawables), asCALL_THISCALL);
+}
+
 void RegisterGraphicsAPI(asIScriptEngine* engine)
 {
     RegisterSkeleton(engine);
@@ -1633,6 +1735,8 @@ void RegisterGraphicsAPI(asIScriptEngine* engine)
     RegisterZone(engine);
     RegisterStaticModel(engine);
     RegisterStaticModelGroup(engine);
+    RegisterStaticBatch(engine);
+    RegisterHLODCluster(engine);
     RegisterSkybox(engine);
     RegisterAnimatedModel(engine);
     RegisterAnimationController(engine);
@@ -1643,6 +1747,7 @@ void RegisterGraphicsAPI(asIScriptEngine* engine)
     RegisterDecalSet(engine);
     RegisterTerrain(engine);
     RegisterOctree(engine);
+    RegisterPotentiallyVisibleSet(engine);
     RegisterGraphics(engine);
     RegisterRenderer(engine);
 }
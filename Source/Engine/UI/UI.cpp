@@ -38,6 +38,7 @@
 #include "Matrix3x4.h"
 #include "MessageBox.h"
 #include "Profiler.h"
+#include "Renderer.h"
 #include "ResourceCache.h"
 #include "ScrollBar.h"
 #include "Shader.h"
@@ -49,6 +50,7 @@
 #include "Text3D.h"
 #include "Texture2D.h"
 #include "ToolTip.h"
+#include "TransientBuffer.h"
 #include "UI.h"
 #include "UIEvents.h"
 #include "VertexBuffer.h"
@@ -106,7 +108,12 @@ UI::UI(Context* context) :
     #endif
     useMutableGlyphs_(false),
     forceAutoHint_(false),
-    nonModalBatchSize_(0)
+    nonModalBatchSize_(0),
+    vertexStart_(0),
+    debugVertexStart_(0),
+    writtenVertexDataSize_(0),
+    writtenDebugVertexDataSize_(0),
+    vertexDataWritten_(false)
 {
     rootElement_->SetTraversalMode(TM_DEPTH_FIRST);
     rootModalElement_->SetTraversalMode(TM_DEPTH_FIRST);
@@ -426,19 +433,31 @@ void UI::Render()
     if (cursor_ && osCursorVisible)
         cursor_->ApplyOSCursorShape();
 
-    SetVertexData(vertexBuffer_, vertexData_);
-    SetVertexData(debugVertexBuffer_, debugVertexData_);
-
-    // Render non-modal batches
-    Render(vertexBuffer_, batches_, 0, nonModalBatchSize_);
-    // Render debug draw
-    Render(debugVertexBuffer_, debugDrawBatches_, 0, debugDrawBatches_.Size());
-    // Render modal batches
-    Render(vertexBuffer_, batches_, nonModalBatchSize_, batches_.Size());
+    // The vertices are normally written when rendering begins and uploaded by Renderer along with the other transient
+    // geometry. Only if the UI geometry changed after that, it needs to be written and uploaded here
+    Renderer* renderer = GetSubsystem<Renderer>();
+    if (renderer)
+    {
+        TransientBuffer* buffer = renderer->GetTransientVertexBuffer(MASK_POSITION | MASK_COLOR | MASK_TEXCOORD1);
+        if (!vertexDataWritten_ || writtenVertexDataSize_ != vertexData_.Size() || writtenDebugVertexDataSize_ !=
+            debugVertexData_.Size())
+        {
+            WriteVertexData();
+            buffer->Upload();
+        }
+        
+        // Render non-modal batches
+        Render(buffer->GetVertexBuffer(), vertexStart_, batches_, 0, nonModalBatchSize_);
+        // Render debug draw
+        Render(buffer->GetVertexBuffer(), debugVertexStart_, debugDrawBatches_, 0, debugDrawBatches_.Size());
+        // Render modal batches
+        Render(buffer->GetVertexBuffer(), vertexStart_, batches_, nonModalBatchSize_, batches_.Size());
+    }
 
     // Clear the debug draw batches and data
     debugDrawBatches_.Clear();
     debugVertexData_.Clear();
+    vertexDataWritten_ = false;
 }
 
 void UI::DebugDraw(UIElement* element)
@@ -688,14 +707,12 @@ void UI::Initialize()
     rootElement_->SetSize(graphics->GetWidth(), graphics->GetHeight());
     rootModalElement_->SetSize(rootElement_->GetSize());
 
-    vertexBuffer_ = new VertexBuffer(context_);
-    debugVertexBuffer_ = new VertexBuffer(context_);
-
     initialized_ = true;
 
     SubscribeToEvent(E_BEGINFRAME, HANDLER(UI, HandleBeginFrame));
     SubscribeToEvent(E_POSTUPDATE, HANDLER(UI, HandlePostUpdate));
     SubscribeToEvent(E_RENDERUPDATE, HANDLER(UI, HandleRenderUpdate));
+    SubscribeToEvent(E_BEGINRENDERING, HANDLER(UI, HandleBeginRendering));
 
     LOGINFO("Initialized user interface");
 }
@@ -715,21 +732,35 @@ void UI::Update(float timeStep, UIElement* element)
         Update(timeStep, children[i]);
 }
 
-void UI::SetVertexData(VertexBuffer* dest, const PODVector<float>& vertexData)
+void UI::WriteVertexData()
 {
-    if (vertexData.Empty())
+    Renderer* renderer = GetSubsystem<Renderer>();
+    if (!renderer)
         return;
+    
+    // Write the vertices into the renderer's transient vertex buffer shared with other dynamic geometry
+    TransientBuffer* buffer = renderer->GetTransientVertexBuffer(MASK_POSITION | MASK_COLOR | MASK_TEXCOORD1);
+    vertexStart_ = SetVertexData(buffer, vertexData_);
+    debugVertexStart_ = SetVertexData(buffer, debugVertexData_);
+    writtenVertexDataSize_ = vertexData_.Size();
+    writtenDebugVertexDataSize_ = debugVertexData_.Size();
+    vertexDataWritten_ = true;
+}
+
+unsigned UI::SetVertexData(TransientBuffer* dest, const PODVector<float>& vertexData)
+{
+    if (vertexData.Empty())
+        return 0;
 
-    // Update quad geometry into the vertex buffer
-    // Resize the vertex buffer first if too small or much too large
-    unsigned numVertices = vertexData.Size() / UI_VERTEX_SIZE;
-    if (dest->GetVertexCount() < numVertices || dest->GetVertexCount() > numVertices * 2)
-        dest->SetSize(numVertices, MASK_POSITION | MASK_COLOR | MASK_TEXCOORD1, true);
+    unsigned start;
+    void* data = dest->Allocate(vertexData.Size() / UI_VERTEX_SIZE, start);
+    if (data)
+        memcpy(data, &vertexData[0], vertexData.Size() * sizeof(float));
 
-    dest->SetData(&vertexData[0]);
+    return start;
 }
 
-void UI::Render(VertexBuffer* buffer, const PODVector<UIBatch>& batches, unsigned batchStart, unsigned batchEnd)
+void UI::Render(VertexBuffer* buffer, unsigned vertexStart, const PODVector<UIBatch>& batches, unsigned batchStart, unsigned batchEnd)
 {
     // Engine does not render when window is closed or device is lost
     assert(graphics_ && graphics_->IsInitialized() && !graphics_->IsDeviceLost());
@@ -806,8 +837,8 @@ void UI::Render(VertexBuffer* buffer, const PODVector<UIBatch>& batches, unsigne
         graphics_->SetBlendMode(batch.blendMode_);
         graphics_->SetScissorTest(true, batch.scissor_);
         graphics_->SetTexture(0, batch.texture_);
-        graphics_->Draw(TRIANGLE_LIST, batch.vertexStart_ / UI_VERTEX_SIZE, (batch.vertexEnd_ - batch.vertexStart_) /
-            UI_VERTEX_SIZE);
+        graphics_->Draw(TRIANGLE_LIST, vertexStart + batch.vertexStart_ / UI_VERTEX_SIZE, (batch.vertexEnd_ -
+            batch.vertexStart_) / UI_VERTEX_SIZE);
     }
 }
 
@@ -1643,6 +1674,12 @@ void UI::HandleRenderUpdate(StringHash eventType, VariantMap& eventData)
     RenderUpdate();
 }
 
+void UI::HandleBeginRendering(StringHash eventType, VariantMap& eventData)
+{
+    // Write the vertices before Renderer uploads the transient geometry of the frame
+    WriteVertexData();
+}
+
 void UI::HandleDropFile(StringHash eventType, VariantMap& eventData)
 {
     Input* input = GetSubsystem<Input>();
@@ -33,6 +33,7 @@ class Cursor;
 class Graphics;
 class ResourceCache;
 class Timer;
+class TransientBuffer;
 class UIBatch;
 class UIElement;
 class VertexBuffer;
@@ -167,10 +168,12 @@ private:
     void Initialize();
     /// Update UI element logic recursively.
     void Update(float timeStep, UIElement* element);
-    /// Upload UI geometry into a vertex buffer.
-    void SetVertexData(VertexBuffer* dest, const PODVector<float>& vertexData);
+    /// Write the UI and debug draw geometry into the renderer's transient vertex buffer.
+    void WriteVertexData();
+    /// Write UI geometry into a transient vertex buffer. Return the index of the first vertex.
+    unsigned SetVertexData(TransientBuffer* dest, const PODVector<float>& vertexData);
     /// Render UI batches. Geometry must have been uploaded first.
-    void Render(VertexBuffer* buffer, const PODVector<UIBatch>& batches, unsigned batchStart, unsigned batchEnd);
+    void Render(VertexBuffer* buffer, unsigned vertexStart, const PODVector<UIBatch>& batches, unsigned batchStart, unsigned batchEnd);
     /// Generate batches from an UI element recursively. Skip the cursor element.
     void GetBatches(UIElement* element, IntRect currentScissor);
     /// Return UI element at screen position recursively.
@@ -221,6 +224,8 @@ private:
     void HandlePostUpdate(StringHash eventType, VariantMap& eventData);
     /// Handle render update event.
     void HandleRenderUpdate(StringHash eventType, VariantMap& eventData);
+    /// Handle frame rendering start event.
+    void HandleBeginRendering(StringHash eventType, VariantMap& eventData);
     /// Handle a file being drag-dropped into the application window.
     void HandleDropFile(StringHash eventType, VariantMap& eventData);
     /// Remove drag data and return next iterator.
@@ -248,10 +253,6 @@ private:
     PODVector<UIBatch> debugDrawBatches_;
     /// UI rendering vertex data for debug draw.
     PODVector<float> debugVertexData_;
-    /// UI vertex buffer.
-    SharedPtr<VertexBuffer> vertexBuffer_;
-    /// UI debug geometry vertex buffer.
-    SharedPtr<VertexBuffer> debugVertexBuffer_;
     /// UI element query vector.
     PODVector<UIElement*> tempElements_;
     /// Clipboard text.
@@ -288,6 +289,16 @@ private:
     bool forceAutoHint_;
     /// Non-modal batch size (used internally for rendering).
     unsigned nonModalBatchSize_;
+    /// Start of the UI vertices in the transient vertex buffer.
+    unsigned vertexStart_;
+    /// Start of the debug draw vertices in the transient vertex buffer.
+    unsigned debugVertexStart_;
+    /// Size of the UI vertex data when it was written.
+    unsigned writtenVertexDataSize_;
+    /// Size of the debug draw vertex data when it was written.
+    unsigned writtenDebugVertexDataSize_;
+    /// Vertex data written on this frame flag.
+    bool vertexDataWritten_;
     /// Timer used to trigger double click.
     Timer clickTimer_;
     /// UI element last clicked for tracking double clicks.
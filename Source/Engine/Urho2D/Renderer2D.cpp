@@ -26,16 +26,16 @@
 #include "Drawable2D.h"
 #include "Geometry.h"
 #include "GraphicsEvents.h"
-#include "IndexBuffer.h"
-#include "Log.h"
 #include "Material.h"
 #include "Node.h"
 #include "Profiler.h"
+#include "Renderer.h"
 #include "Renderer2D.h"
 #include "Scene.h"
 #include "Sort.h"
 #include "Technique.h"
 #include "Texture2D.h"
+#include "TransientBuffer.h"
 #include "VertexBuffer.h"
 #include "WorkQueue.h"
 
@@ -48,8 +48,9 @@ extern const char* blendModeNames[];
 
 Renderer2D::Renderer2D(Context* context) :
     Drawable(context, DRAWABLE_GEOMETRY),
-    indexBuffer_(new IndexBuffer(context_)),
-    vertexBuffer_(new VertexBuffer(context_)),
+    vertexBuffer_(0),
+    indexBuffer_(0),
+    largeIndexBuffer_(0),
     orderDirty_(true),
     frustum_(0),
     indexCount_(0),
@@ -112,86 +113,119 @@ void Renderer2D::UpdateBatches(const FrameInfo& frame)
     }
 }
 
-void Renderer2D::UpdateGeometry(const FrameInfo& frame)
+static void WriteDrawableVertices(const WorkItem* item, unsigned threadIndex)
 {
+    Drawable2D** start = reinterpret_cast<Drawable2D**>(item->start_);
+    Drawable2D** end = reinterpret_cast<Drawable2D**>(item->end_);
+    Vertex2D* dest = reinterpret_cast<Vertex2D*>(item->aux_);
+
+    while (start != end)
+    {
+        Drawable2D* drawable = *start++;
+        if (!drawable->GetVisibility())
+            continue;
+
+        const Vector<Vertex2D>& vertices = drawable->GetVertices();
+        for (unsigned i = 0; i < vertices.Size(); ++i)
+            dest[i] = vertices[i];
+        dest += vertices.Size();
+    }
+}
+
+void Renderer2D::WriteGeometry()
+{
+    if (!vertexCount_ || !vertexBuffer_)
+        return;
+
+    // Allocate the vertices and indices of this frame from the renderer's transient buffers
+    unsigned vertexStart;
+    Vertex2D* vertices = reinterpret_cast<Vertex2D*>(vertexBuffer_->Allocate(vertexCount_, vertexStart));
+    bool largeIndices = vertexStart + vertexCount_ > 0xffff;
+    TransientBuffer* indexBuffer = largeIndices ? largeIndexBuffer_ : indexBuffer_;
+    unsigned indexStart;
+    void* buffer = indexBuffer->Allocate(indexCount_, indexStart);
+    if (!vertices || !buffer)
+        return;
+
     // Fill index buffer
-    if (indexBuffer_->GetIndexCount() < indexCount_ || indexBuffer_->IsDataLost())
+    unsigned quadCount = indexCount_ / 6;
+    if (largeIndices)
     {
-        bool largeIndices = vertexCount_ > 0xffff;
-        indexBuffer_->SetSize(indexCount_, largeIndices);
-        void* buffer = indexBuffer_->Lock(0, indexCount_, true);
-        if (buffer)
+        unsigned* dest = reinterpret_cast<unsigned*>(buffer);
+        for (unsigned i = 0; i < quadCount; ++i)
         {
-            unsigned quadCount = indexCount_ / 6;
-            if (largeIndices)
-            {
-                unsigned* dest = reinterpret_cast<unsigned*>(buffer);
-                for (unsigned i = 0; i < quadCount; ++i)
-                {
-                    unsigned base = i * 4;
-                    dest[0] = base;
-                    dest[1] = base + 1;
-                    dest[2] = base + 2;
-                    dest[3] = base;
-                    dest[4] = base + 2;
-                    dest[5] = base + 3;
-                    dest += 6;
-                }
-            }
-            else
-            {
-                unsigned short* dest = reinterpret_cast<unsigned short*>(buffer);
-                for (unsigned i = 0; i < quadCount; ++i)
-                {
-                    unsigned base = i * 4;
-                    dest[0] = (unsigned short)(base);
-                    dest[1] = (unsigned short)(base + 1);
-                    dest[2] = (unsigned short)(base + 2);
-                    dest[3] = (unsigned short)(base);
-                    dest[4] = (unsigned short)(base + 2);
-                    dest[5] = (unsigned short)(base + 3);
-                    dest += 6;
-                }
-            }
-
-            indexBuffer_->Unlock();
+            unsigned base = vertexStart + i * 4;
+            dest[0] = base;
+            dest[1] = base + 1;
+            dest[2] = base + 2;
+            dest[3] = base;
+            dest[4] = base + 2;
+            dest[5] = base + 3;
+            dest += 6;
         }
-        else
+    }
+    else
+    {
+        unsigned short* dest = reinterpret_cast<unsigned short*>(buffer);
+        for (unsigned i = 0; i < quadCount; ++i)
         {
-            LOGERROR("Failed to lock index buffer");
-            return;
+            unsigned base = vertexStart + i * 4;
+            dest[0] = (unsigned short)(base);
+            dest[1] = (unsigned short)(base + 1);
+            dest[2] = (unsigned short)(base + 2);
+            dest[3] = (unsigned short)(base);
+            dest[4] = (unsigned short)(base + 2);
+            dest[5] = (unsigned short)(base + 3);
+            dest += 6;
         }
     }
 
-    if (vertexBuffer_->GetVertexCount() < vertexCount_)
-        vertexBuffer_->SetSize(vertexCount_, MASK_VERTEX2D);
+    // Fill vertex buffer. Split the drawables into work items that each write their own range
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    int numWorkItems = queue->GetNumThreads() + 1; // Worker threads + main thread
+    int drawablesPerItem = drawables_.Size() / numWorkItems;
 
-    if (vertexCount_)
+    PODVector<Drawable2D*>::Iterator start = drawables_.Begin();
+    Vertex2D* dest = vertices;
+    for (int i = 0; i < numWorkItems; ++i)
     {
-        Vertex2D* dest = reinterpret_cast<Vertex2D*>(vertexBuffer_->Lock(0, vertexCount_, true));
-        if (dest)
+        PODVector<Drawable2D*>::Iterator end = drawables_.End();
+        if (i < numWorkItems - 1 && end - start > drawablesPerItem)
+            end = start + drawablesPerItem;
+
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = WriteDrawableVertices;
+        item->aux_ = dest;
+        item->start_ = &(*start);
+        item->end_ = &(*end);
+        queue->AddWorkItem(item);
+
+        for (PODVector<Drawable2D*>::Iterator j = start; j != end; ++j)
         {
-            for (unsigned d = 0; d < drawables_.Size(); ++d)
-            {
-                if (!drawables_[d]->GetVisibility() || drawables_[d]->GetVertices().Empty())
-                    continue;
-
-                const Vector<Vertex2D>& vertices = drawables_[d]->GetVertices();
-                for (unsigned i = 0; i < vertices.Size(); ++i)
-                    dest[i] = vertices[i];
-                dest += vertices.Size();
-            }
-
-            vertexBuffer_->Unlock();
+            if ((*j)->GetVisibility())
+                dest += (*j)->GetVertices().Size();
         }
-        else
-            LOGERROR("Failed to lock vertex buffer");
+
+        start = end;
     }
-}
 
-UpdateGeometryType Renderer2D::GetUpdateGeometryType()
-{
-    return UPDATE_MAIN_THREAD;
+    queue->Complete(M_MAX_UNSIGNED);
+
+    // Point the batch geometries to the allocated ranges. The batches are consecutive in the buffers
+    unsigned batchIndexStart = indexStart;
+    unsigned batchVertexStart = vertexStart;
+    for (unsigned i = 0; i < batches_.Size(); ++i)
+    {
+        Geometry* geometry = geometries_[i];
+        unsigned batchIndexCount = geometry->GetIndexCount();
+        unsigned batchVertexCount = geometry->GetVertexCount();
+        geometry->SetIndexBuffer(indexBuffer->GetIndexBuffer());
+        geometry->SetVertexBuffer(0, vertexBuffer_->GetVertexBuffer(), MASK_VERTEX2D);
+        geometry->SetDrawRange(TRIANGLE_LIST, batchIndexStart, batchIndexCount, batchVertexStart, batchVertexCount, false);
+        batchIndexStart += batchIndexCount;
+        batchVertexStart += batchVertexCount;
+    }
 }
 
 void Renderer2D::AddDrawable(Drawable2D* drawable)
@@ -263,6 +297,14 @@ void Renderer2D::HandleBeginViewUpdate(StringHash eventType, VariantMap& eventDa
 
     PROFILE(UpdateRenderer2D);
 
+    // Get the transient buffers now, as the geometry may be updated in a worker thread
+    Renderer* renderer = GetSubsystem<Renderer>();
+    if (!renderer)
+        return;
+    vertexBuffer_ = renderer->GetTransientVertexBuffer(MASK_VERTEX2D);
+    indexBuffer_ = renderer->GetTransientIndexBuffer(false);
+    largeIndexBuffer_ = renderer->GetTransientIndexBuffer(true);
+
     if (!materialDirtyDrawables_.Empty())
     {
         for (unsigned i = 0; i < materialDirtyDrawables_.Size(); ++i)
@@ -327,7 +369,7 @@ void Renderer2D::HandleBeginViewUpdate(StringHash eventType, VariantMap& eventDa
     }
     indexCount_ = vertexCount_ / 4 * 6;
 
-    // Go through the drawables to form geometries & batches, but upload the actual vertex data later
+    // Go through the drawables to form geometries & batches, but write the actual vertex data later
     materials_.Clear();
 
     Material* material = 0;
@@ -375,6 +417,13 @@ void Renderer2D::HandleBeginViewUpdate(StringHash eventType, VariantMap& eventDa
         batches_[i].material_ = materials_[i];
         batches_[i].geometry_ = geometries_[i];
     }
+    
+    // Write the vertices and indices now, before the view queues its own work, so that completing the work items below
+    // does not wait for the rest of the view update
+    {
+        PROFILE(WriteRenderer2DGeometry);
+        WriteGeometry();
+    }
 }
 
 void Renderer2D::GetDrawables(PODVector<Drawable2D*>& dest, Node* node)
@@ -452,8 +501,6 @@ void Renderer2D::AddBatch(Material* material, unsigned indexStart, unsigned inde
     if (geometries_.Size() < batchSize)
     {
         SharedPtr<Geometry> geometry(new Geometry(context_));
-        geometry->SetIndexBuffer(indexBuffer_);
-        geometry->SetVertexBuffer(0, vertexBuffer_, MASK_VERTEX2D);
         geometries_.Push(geometry);
     }
 
@@ -28,9 +28,8 @@ namespace Urho3D
 {
 
 class Drawable2D;
-class IndexBuffer;
 class Material;
-class VertexBuffer;
+class TransientBuffer;
 
 /// 2D renderer components.
 class URHO3D_API Renderer2D : public Drawable
@@ -49,10 +48,6 @@ public:
     virtual void ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQueryResult>& results);
     /// Calculate distance and prepare batches for rendering. May be called from worker thread(s), possibly re-entrantly.
     virtual void UpdateBatches(const FrameInfo& frame);
-    /// Prepare geometry for rendering. Called from a worker thread if possible (no GPU update.)
-    virtual void UpdateGeometry(const FrameInfo& frame);
-    /// Return whether a geometry update is necessary, and if it can happen in a worker thread.
-    virtual UpdateGeometryType GetUpdateGeometryType();
 
     /// Add Drawable2D.
     void AddDrawable(Drawable2D* drawable);
@@ -78,11 +73,15 @@ private:
     Material* CreateMaterial(Texture2D* Texture, BlendMode blendMode);
     /// Add batch.
     void AddBatch(Material* material, unsigned indexStart, unsigned indexCount, unsigned vertexStart, unsigned vertexCount);
+    /// Write the vertices and indices of the visible drawables into the transient buffers and point the batch geometries to them.
+    void WriteGeometry();
 
-    /// Index buffer.
-    SharedPtr<IndexBuffer> indexBuffer_;
-    /// Vertex buffer.
-    SharedPtr<VertexBuffer> vertexBuffer_;
+    /// Transient vertex buffer shared with other dynamic geometry.
+    TransientBuffer* vertexBuffer_;
+    /// Transient 16-bit index buffer.
+    TransientBuffer* indexBuffer_;
+    /// Transient 32-bit index buffer.
+    TransientBuffer* largeIndexBuffer_;
     /// Drawables.
     PODVector<Drawable2D*> drawables_;
     /// Material dirty drawables.
@@ -27,10 +27,12 @@
 #include "File.h"
 #include "FileSystem.h"
 #include "Geometry.h"
+#include "GeometryOptimizer.h"
 #include "Graphics.h"
 #include "IndexBuffer.h"
 #include "Light.h"
 #include "Material.h"
+#include "MeshSimplifier.h"
 #include "Model.h"
 #include "Octree.h"
 #ifdef URHO3D_PHYSICS
@@ -43,6 +45,7 @@
 #include "StringUtils.h"
 #include "Vector3.h"
 #include "VertexBuffer.h"
+#include "VertexPacking.h"
 #include "WorkQueue.h"
 #include "XMLFile.h"
 #include "Zone.h"
@@ -87,6 +90,18 @@ struct OutModel
     unsigned totalIndices_;
 };
 
+struct OutGeometryData
+{
+    PODVector<Vector3> positions_;
+    PODVector<unsigned> indices_;
+    PODVector<unsigned> vertexBones_;
+    Vector<PODVector<unsigned> > lodIndices_;
+    PODVector<float> lodDistances_;
+    PODVector<unsigned> vertexOrder_;
+    VertexCacheStatistics originalCacheStats_;
+    VertexCacheStatistics optimizedCacheStats_;
+};
+
 struct OutScene
 {
     String outName_;
@@ -119,6 +134,16 @@ bool noOverwriteMaterial_ = false;
 bool noOverwriteTexture_ = false;
 bool noOverwriteNewerTexture_ = false;
 bool checkUniqueModel_ = true;
+bool compressAnimations_ = false;
+float animationPositionError_ = 0.001f;
+float animationRotationError_ = 0.1f;
+float animationScaleError_ = 0.001f;
+bool generateLods_ = false;
+PODVector<float> lodRatios_;
+// LOD distance per unit of simplification error, at which the error is one pixel at 1080p with a 45 degree field of view
+float lodDistanceScale_ = 1080.0f / (2.0f * tanf(22.5f * M_DEGTORAD));
+bool optimizeVertexCache_ = false;
+bool packVertices_ = false;
 Vector<String> nonSkinningBoneIncludes_;
 Vector<String> nonSkinningBoneExcludes_;
 
@@ -138,6 +163,11 @@ void CollectBonesFinal(PODVector<aiNode*>& dest, const HashSet<aiNode*>& necessa
 void CollectAnimations(OutModel* model = 0);
 void BuildBoneCollisionInfo(OutModel& model);
 void BuildAndSaveModel(OutModel& model);
+void ProcessGeometries(OutModel& model, Vector<OutGeometryData>& dest);
+void ProcessGeometryWork(const WorkItem* item, unsigned threadIndex);
+void GenerateLods(OutGeometryData& data);
+void OptimizeGeometry(OutGeometryData& data);
+SharedPtr<VertexBuffer> PackVertexBuffer(VertexBuffer* buffer, Vector3& positionOffset, float& positionScale);
 void BuildAndSaveAnimations(OutModel* model = 0);
 
 void ExportScene(const String& outName, bool asPrefab);
@@ -241,6 +271,17 @@ void Run(const Vector<String>& arguments)
             "-ct         Check and do not overwrite if texture exists\n"
             "-ctn        Check and do not overwrite if texture has newer timestamp\n"
             "-am         Export all meshes even if identical (scene mode only)\n"
+            "-ac <error> Compress animations into uniformly sampled, quantized tracks. The\n"
+            "            maximum error is given as position;rotation;scale, with rotation\n"
+            "            in degrees. Default 0.001;0.1;0.001\n"
+            "-lod <ratios> Generate LOD levels by simplifying the geometries to the given\n"
+            "            semicolon separated triangle ratios. Default 0.5;0.25;0.125. The LOD\n"
+            "            distances are chosen from the simplification error\n"
+            "-oc         Optimize the triangle and vertex order of the geometries for the\n"
+            "            vertex cache and overdraw, and print the cache miss ratios\n"
+            "-pv         Pack the vertex data into 16-bit normalized positions, normals and\n"
+            "            tangents, and half float texture coordinates. Skinned positions\n"
+            "            stay as floats\n"
         );
     }
     
@@ -371,9 +412,54 @@ void Run(const Vector<String>& arguments)
                 noOverwriteNewerTexture_ = true;
             else if (argument == "am")
                 checkUniqueModel_ = false;
+            else if (argument == "ac")
+            {
+                compressAnimations_ = true;
+                if (value.Length() && value[0] != '-')
+                {
+                    Vector<String> errors = value.Split(';');
+                    if (errors.Size() > 0)
+                        animationPositionError_ = ToFloat(errors[0]);
+                    if (errors.Size() > 1)
+                        animationRotationError_ = ToFloat(errors[1]);
+                    if (errors.Size() > 2)
+                        animationScaleError_ = ToFloat(errors[2]);
+                    ++i;
+                }
+            }
+            else if (argument == "lod")
+            {
+                generateLods_ = true;
+                if (value.Length() && value[0] != '-')
+                {
+                    Vector<String> ratios = value.Split(';');
+                    for (unsigned j = 0; j < ratios.Size(); ++j)
+                        lodRatios_.Push(Clamp(ToFloat(ratios[j]), 0.0f, 1.0f));
+                    ++i;
+                }
+            }
+            else if (argument == "oc")
+                optimizeVertexCache_ = true;
+            else if (argument == "pv")
+                packVertices_ = true;
         }
     }
     
+    if (generateLods_ && lodRatios_.Empty())
+    {
+        lodRatios_.Push(0.5f);
+        lodRatios_.Push(0.25f);
+        lodRatios_.Push(0.125f);
+    }
+    
+    if (generateLods_ || optimizeVertexCache_)
+    {
+        // Process the geometries in parallel
+        unsigned numCPUs = GetNumPhysicalCPUs();
+        if (numCPUs > 1)
+            context_->GetSubsystem<WorkQueue>()->CreateThreads(numCPUs - 1);
+    }
+    
     if (command == "model" || command == "scene" || command == "node" || command == "dump")
     {
         String inFile = arguments[1];
@@ -782,6 +868,20 @@ void BuildAndSaveModel(OutModel& model)
             combineBuffers = false;
     }
     
+    // Generate the LOD levels and optimize the triangle order first, as the LOD indices are stored in the same index
+    // buffers and the vertex order depends on all levels
+    Vector<OutGeometryData> geometryData(model.meshes_.Size());
+    unsigned totalLodIndices = 0;
+    if (generateLods_ || optimizeVertexCache_)
+    {
+        ProcessGeometries(model, geometryData);
+        for (unsigned i = 0; i < geometryData.Size(); ++i)
+        {
+            for (unsigned j = 0; j < geometryData[i].lodIndices_.Size(); ++j)
+                totalLodIndices += geometryData[i].lodIndices_[j].Size();
+        }
+    }
+    
     SharedPtr<IndexBuffer> ib;
     SharedPtr<VertexBuffer> vb;
     Vector<SharedPtr<VertexBuffer> > vbVector;
@@ -800,6 +900,11 @@ void BuildAndSaveModel(OutModel& model)
         if (!validFaces)
             continue;
         
+        const OutGeometryData& data = geometryData[i];
+        unsigned lodIndexCount = 0;
+        for (unsigned j = 0; j < data.lodIndices_.Size(); ++j)
+            lodIndexCount += data.lodIndices_[j].Size();
+        
         bool largeIndices;
         if (combineBuffers)
             largeIndices = model.totalIndices_ > 65535;
@@ -814,12 +919,12 @@ void BuildAndSaveModel(OutModel& model)
             
             if (combineBuffers)
             {
-                ib->SetSize(model.totalIndices_, largeIndices);
+                ib->SetSize(model.totalIndices_ + totalLodIndices, largeIndices);
                 vb->SetSize(model.totalVertices_, elementMask);
             }
             else
             {
-                ib->SetSize(validFaces * 3, largeIndices);
+                ib->SetSize(validFaces * 3 + lodIndexCount, largeIndices);
                 vb->SetSize(mesh->mNumVertices, elementMask);
             }
             
@@ -842,25 +947,59 @@ void BuildAndSaveModel(OutModel& model)
         
         PrintLine("Writing geometry " + String(i) + " with " + String(mesh->mNumVertices) + " vertices " +
             String(validFaces * 3) + " indices");
+        if (optimizeVertexCache_)
+        {
+            PrintLine("Vertex cache ACMR " + String(data.originalCacheStats_.acmr_) + " -> " +
+                String(data.optimizedCacheStats_.acmr_) + ", ATVR " + String(data.originalCacheStats_.atvr_) + " -> " +
+                String(data.optimizedCacheStats_.atvr_));
+        }
         
         unsigned char* vertexData = vb->GetShadowData();
         unsigned char* indexData = ib->GetShadowData();
         
-        // Build the index data
+        // Build the index data. The LOD level indices follow the full detail indices
         if (!largeIndices)
         {
             unsigned short* dest = (unsigned short*)indexData + startIndexOffset;
-            for (unsigned j = 0; j < mesh->mNumFaces; ++j)
-                WriteShortIndices(dest, mesh, j, startVertexOffset);
+            if (data.indices_.Empty())
+            {
+                for (unsigned j = 0; j < mesh->mNumFaces; ++j)
+                    WriteShortIndices(dest, mesh, j, startVertexOffset);
+            }
+            else
+            {
+                for (unsigned j = 0; j < data.indices_.Size(); ++j)
+                    *dest++ = data.indices_[j] + startVertexOffset;
+            }
+            for (unsigned j = 0; j < data.lodIndices_.Size(); ++j)
+            {
+                const PODVector<unsigned>& lodIndices = data.lodIndices_[j];
+                for (unsigned k = 0; k < lodIndices.Size(); ++k)
+                    *dest++ = lodIndices[k] + startVertexOffset;
+            }
         }
         else
         {
             unsigned* dest = (unsigned*)indexData + startIndexOffset;
-            for (unsigned j = 0; j < mesh->mNumFaces; ++j)
-                WriteLargeIndices(dest, mesh, j, startVertexOffset);
+            if (data.indices_.Empty())
+            {
+                for (unsigned j = 0; j < mesh->mNumFaces; ++j)
+                    WriteLargeIndices(dest, mesh, j, startVertexOffset);
+            }
+            else
+            {
+                for (unsigned j = 0; j < data.indices_.Size(); ++j)
+                    *dest++ = data.indices_[j] + startVertexOffset;
+            }
+            for (unsigned j = 0; j < data.lodIndices_.Size(); ++j)
+            {
+                const PODVector<unsigned>& lodIndices = data.lodIndices_[j];
+                for (unsigned k = 0; k < lodIndices.Size(); ++k)
+                    *dest++ = lodIndices[k] + startVertexOffset;
+            }
         }
         
-        // Build the vertex data
+        // Build the vertex data, in the order of first use if the geometry was optimized
         // If there are bones, get blend data
         Vector<PODVector<unsigned char> > blendIndices;
         Vector<PODVector<float> > blendWeights;
@@ -870,7 +1009,10 @@ void BuildAndSaveModel(OutModel& model)
         
         float* dest = (float*)((unsigned char*)vertexData + startVertexOffset * vb->GetVertexSize());
         for (unsigned j = 0; j < mesh->mNumVertices; ++j)
-            WriteVertex(dest, mesh, j, elementMask, box, vertexTransform, normalTransform, blendIndices, blendWeights);
+        {
+            unsigned index = data.vertexOrder_.Empty() ? j : data.vertexOrder_[j];
+            WriteVertex(dest, mesh, index, elementMask, box, vertexTransform, normalTransform, blendIndices, blendWeights);
+        }
         
         // Calculate the geometry center
         Vector3 center = Vector3::ZERO;
@@ -893,20 +1035,70 @@ void BuildAndSaveModel(OutModel& model)
         geom->SetIndexBuffer(ib);
         geom->SetVertexBuffer(0, vb);
         geom->SetDrawRange(TRIANGLE_LIST, startIndexOffset, validFaces * 3, true);
-        outModel->SetNumGeometryLodLevels(destGeomIndex, 1);
+        outModel->SetNumGeometryLodLevels(destGeomIndex, 1 + data.lodIndices_.Size());
         outModel->SetGeometry(destGeomIndex, 0, geom);
         outModel->SetGeometryCenter(destGeomIndex, center);
         if (model.bones_.Size() > MAX_SKIN_MATRICES)
             allBoneMappings.Push(boneMappings);
         
+        unsigned lodIndexStart = startIndexOffset + validFaces * 3;
+        for (unsigned j = 0; j < data.lodIndices_.Size(); ++j)
+        {
+            unsigned lodIndices = data.lodIndices_[j].Size();
+            PrintLine("Writing geometry " + String(i) + " LOD level " + String(j + 1) + " with " + String(lodIndices) +
+                " indices, distance " + String(data.lodDistances_[j]));
+            
+            SharedPtr<Geometry> lodGeom(new Geometry(context_));
+            lodGeom->SetIndexBuffer(ib);
+            lodGeom->SetVertexBuffer(0, vb);
+            lodGeom->SetDrawRange(TRIANGLE_LIST, lodIndexStart, lodIndices, true);
+            lodGeom->SetLodDistance(data.lodDistances_[j]);
+            outModel->SetGeometry(destGeomIndex, j + 1, lodGeom);
+            lodIndexStart += lodIndices;
+        }
+        
         startVertexOffset += mesh->mNumVertices;
-        startIndexOffset += validFaces * 3;
+        startIndexOffset += validFaces * 3 + lodIndexCount;
         ++destGeomIndex;
     }
     
+    // Pack the vertex buffers and point the geometries to the packed buffers
+    PODVector<Vector3> positionOffsets(vbVector.Size());
+    PODVector<float> positionScales(vbVector.Size());
+    if (packVertices_)
+    {
+        const Vector<Vector<SharedPtr<Geometry> > >& geometries = outModel->GetGeometries();
+        for (unsigned i = 0; i < vbVector.Size(); ++i)
+        {
+            SharedPtr<VertexBuffer> packedVb = PackVertexBuffer(vbVector[i], positionOffsets[i], positionScales[i]);
+            PrintLine("Packed vertex buffer " + String(i) + " from " + String(vbVector[i]->GetVertexSize()) + " to " +
+                String(packedVb->GetVertexSize()) + " bytes per vertex");
+            
+            for (unsigned j = 0; j < geometries.Size(); ++j)
+            {
+                for (unsigned k = 0; k < geometries[j].Size(); ++k)
+                {
+                    Geometry* geometry = geometries[j][k];
+                    if (geometry && geometry->GetVertexBuffer(0) == vbVector[i])
+                    {
+                        geometry->SetVertexBuffer(0, packedVb);
+                        geometry->SetPositionQuantization(positionOffsets[i], positionScales[i]);
+                    }
+                }
+            }
+            
+            vbVector[i] = packedVb;
+        }
+    }
+    
     // Define the model buffers and bounding box
     PODVector<unsigned> emptyMorphRange;
     outModel->SetVertexBuffers(vbVector, emptyMorphRange, emptyMorphRange);
+    if (packVertices_)
+    {
+        for (unsigned i = 0; i < vbVector.Size(); ++i)
+            outModel->SetPositionQuantization(i, positionOffsets[i], positionScales[i]);
+    }
     outModel->SetIndexBuffers(ibVector);
     outModel->SetBoundingBox(box);
     
@@ -981,6 +1173,189 @@ void BuildAndSaveModel(OutModel& model)
     }
 }
 
+void ProcessGeometries(OutModel& model, Vector<OutGeometryData>& dest)
+{
+    if (generateLods_)
+        PrintLine("Generating LOD levels");
+    if (optimizeVertexCache_)
+        PrintLine("Optimizing geometries for the vertex cache");
+    
+    WorkQueue* queue = context_->GetSubsystem<WorkQueue>();
+    
+    for (unsigned i = 0; i < model.meshes_.Size(); ++i)
+    {
+        aiMesh* mesh = model.meshes_[i];
+        if (!GetNumValidFaces(mesh))
+            continue;
+        
+        // Process in the baked model space, so that the simplification errors are comparable between geometries
+        OutGeometryData& data = dest[i];
+        Vector3 pos, scale;
+        Quaternion rot;
+        GetPosRotScale(GetMeshBakingTransform(model.meshNodes_[i], model.rootNode_), pos, rot, scale);
+        Matrix3x4 vertexTransform(pos, rot, scale);
+        
+        data.positions_.Resize(mesh->mNumVertices);
+        for (unsigned j = 0; j < mesh->mNumVertices; ++j)
+            data.positions_[j] = vertexTransform * ToVector3(mesh->mVertices[j]);
+        
+        for (unsigned j = 0; j < mesh->mNumFaces; ++j)
+        {
+            const aiFace& face = mesh->mFaces[j];
+            if (face.mNumIndices == 3)
+            {
+                data.indices_.Push(face.mIndices[0]);
+                data.indices_.Push(face.mIndices[1]);
+                data.indices_.Push(face.mIndices[2]);
+            }
+        }
+        
+        // For skinned geometry, get the dominant bone of each vertex to avoid collapsing across joints
+        if (generateLods_ && model.bones_.Size())
+        {
+            Vector<PODVector<unsigned char> > blendIndices;
+            Vector<PODVector<float> > blendWeights;
+            PODVector<unsigned> boneMappings;
+            GetBlendData(model, mesh, boneMappings, blendIndices, blendWeights);
+            
+            data.vertexBones_.Resize(mesh->mNumVertices);
+            for (unsigned j = 0; j < mesh->mNumVertices; ++j)
+            {
+                unsigned bone = M_MAX_UNSIGNED;
+                float maxWeight = 0.0f;
+                for (unsigned k = 0; k < blendWeights[j].Size(); ++k)
+                {
+                    if (blendWeights[j][k] > maxWeight)
+                    {
+                        bone = blendIndices[j][k];
+                        maxWeight = blendWeights[j][k];
+                    }
+                }
+                data.vertexBones_[j] = bone;
+            }
+        }
+        
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = ProcessGeometryWork;
+        item->aux_ = &data;
+        queue->AddWorkItem(item);
+    }
+    
+    queue->Complete(M_MAX_UNSIGNED);
+}
+
+void ProcessGeometryWork(const WorkItem* item, unsigned threadIndex)
+{
+    OutGeometryData& data = *(reinterpret_cast<OutGeometryData*>(item->aux_));
+    if (generateLods_)
+        GenerateLods(data);
+    if (optimizeVertexCache_)
+        OptimizeGeometry(data);
+}
+
+void GenerateLods(OutGeometryData& data)
+{
+    unsigned numTriangles = data.indices_.Size() / 3;
+    unsigned lastIndexCount = data.indices_.Size();
+    float lastDistance = 0.0f;
+    
+    // Each level is simplified from the full detail geometry, so that its error is measured against the original
+    for (unsigned i = 0; i < lodRatios_.Size(); ++i)
+    {
+        unsigned targetIndexCount = (unsigned)(numTriangles * lodRatios_[i]) * 3;
+        if (targetIndexCount >= lastIndexCount)
+            continue;
+        
+        PODVector<unsigned> lodIndices;
+        float error = SimplifyMesh(lodIndices, data.indices_, data.positions_, data.vertexBones_, targetIndexCount);
+        // Skip levels that could not be simplified further than the previous level
+        if (lodIndices.Empty() || lodIndices.Size() >= lastIndexCount)
+            continue;
+        
+        float distance = Max(error * lodDistanceScale_, lastDistance + M_EPSILON);
+        data.lodIndices_.Push(lodIndices);
+        data.lodDistances_.Push(distance);
+        lastIndexCount = lodIndices.Size();
+        lastDistance = distance;
+    }
+}
+
+void OptimizeGeometry(OutGeometryData& data)
+{
+    unsigned numVertices = data.positions_.Size();
+    data.originalCacheStats_ = AnalyzeVertexCache(&data.indices_[0], data.indices_.Size(), numVertices);
+    
+    OptimizeVertexCache(&data.indices_[0], data.indices_.Size(), numVertices);
+    OptimizeOverdraw(&data.indices_[0], data.indices_.Size(), &data.positions_[0], sizeof(Vector3), 0, numVertices);
+    for (unsigned i = 0; i < data.lodIndices_.Size(); ++i)
+    {
+        PODVector<unsigned>& lodIndices = data.lodIndices_[i];
+        OptimizeVertexCache(&lodIndices[0], lodIndices.Size(), numVertices);
+        OptimizeOverdraw(&lodIndices[0], lodIndices.Size(), &data.positions_[0], sizeof(Vector3), 0, numVertices);
+    }
+    
+    // Renumber the vertices in the order of first use over all LOD levels, so that the full detail level is fetched
+    // sequentially
+    PODVector<unsigned> allIndices(data.indices_);
+    for (unsigned i = 0; i < data.lodIndices_.Size(); ++i)
+        allIndices.Push(data.lodIndices_[i]);
+    PODVector<unsigned> remap(numVertices);
+    OptimizeVertexFetch(&remap[0], &allIndices[0], allIndices.Size(), numVertices);
+    
+    unsigned offset = 0;
+    for (unsigned i = 0; i < data.indices_.Size(); ++i)
+        data.indices_[i] = allIndices[offset++];
+    for (unsigned i = 0; i < data.lodIndices_.Size(); ++i)
+    {
+        PODVector<unsigned>& lodIndices = data.lodIndices_[i];
+        for (unsigned j = 0; j < lodIndices.Size(); ++j)
+            lodIndices[j] = allIndices[offset++];
+    }
+    
+    data.vertexOrder_.Resize(numVertices);
+    for (unsigned i = 0; i < numVertices; ++i)
+        data.vertexOrder_[remap[i]] = i;
+    
+    data.optimizedCacheStats_ = AnalyzeVertexCache(&data.indices_[0], data.indices_.Size(), numVertices);
+}
+
+SharedPtr<VertexBuffer> PackVertexBuffer(VertexBuffer* buffer, Vector3& positionOffset, float& positionScale)
+{
+    unsigned elementMask = buffer->GetElementMask();
+    unsigned packedMask = elementMask;
+    // Skinned positions would be unpacked again at load, so keep them as floats
+    if ((elementMask & MASK_POSITION) && !(elementMask & MASK_BLENDWEIGHTS))
+        packedMask |= MASK_PACKED_POSITION;
+    if (elementMask & MASK_NORMAL)
+        packedMask |= MASK_PACKED_NORMAL;
+    if (elementMask & (MASK_TEXCOORD1 | MASK_TEXCOORD2))
+        packedMask |= MASK_PACKED_TEXCOORD;
+    if (elementMask & MASK_TANGENT)
+        packedMask |= MASK_PACKED_TANGENT;
+    
+    unsigned vertexCount = buffer->GetVertexCount();
+    unsigned vertexSize = buffer->GetVertexSize();
+    const unsigned char* vertexData = buffer->GetShadowData();
+    
+    positionOffset = Vector3::ZERO;
+    positionScale = 1.0f;
+    if (packedMask & MASK_PACKED_POSITION)
+    {
+        BoundingBox box;
+        for (unsigned i = 0; i < vertexCount; ++i)
+            box.Merge(*((const Vector3*)(vertexData + i * vertexSize)));
+        GetPositionQuantization(box, positionOffset, positionScale);
+    }
+    
+    SharedPtr<VertexBuffer> packedBuffer(new VertexBuffer(context_));
+    packedBuffer->SetShadowed(true);
+    packedBuffer->SetSize(vertexCount, packedMask);
+    ConvertVertexData(packedBuffer->GetShadowData(), packedMask, vertexData, elementMask, vertexCount, positionOffset,
+        positionScale);
+    return packedBuffer;
+}
+
 void BuildAndSaveAnimations(OutModel* model)
 {
     const PODVector<aiAnimation*>& animations = model ? model->animations_ : sceneAnimations_;
@@ -1164,6 +1539,14 @@ void BuildAndSaveAnimations(OutModel* model)
         
         outAnim->SetTracks(tracks);
         
+        if (compressAnimations_)
+        {
+            unsigned oldMemoryUse = outAnim->GetMemoryUse();
+            outAnim->Compress(animationPositionError_, animationRotationError_, animationScaleError_);
+            PrintLine("Compressed animation " + animOutName + " from " + String(oldMemoryUse) + " to " +
+                String(outAnim->GetMemoryUse()) + " bytes");
+        }
+        
         File outFile(context_);
         if (!outFile.Open(animOutName, FILE_WRITE))
             ErrorExit("Could not open output file " + animOutName);
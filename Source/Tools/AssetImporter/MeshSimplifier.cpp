@@ -0,0 +1,539 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "HashSet.h"
+#include "MathDefs.h"
+#include "MeshSimplifier.h"
+#include "Sort.h"
+
+#include "DebugNew.h"
+
+/// Error weight of the constraint planes that keep open borders and UV seams in place.
+static const double BORDER_WEIGHT = 10.0;
+/// Error weight of collapses between vertices that follow a different dominant bone, relative to the squared edge length.
+static const float SKIN_WEIGHT = 1.0f;
+
+/// Vertex kind for simplification.
+enum SimplifyVertexKind
+{
+    SVK_MANIFOLD = 0,
+    SVK_BORDER,
+    SVK_SEAM,
+    SVK_LOCKED
+};
+
+/// Symmetric error quadric of weighted planes.
+struct Quadric
+{
+    /// Construct with zero error.
+    Quadric() :
+        a00_(0.0), a01_(0.0), a02_(0.0), a11_(0.0), a12_(0.0), a22_(0.0),
+        b0_(0.0), b1_(0.0), b2_(0.0),
+        c_(0.0),
+        weight_(0.0)
+    {
+    }
+
+    /// Add a plane defined by a unit normal and distance.
+    void AddPlane(const Vector3& normal, float distance, double weight)
+    {
+        double x = normal.x_, y = normal.y_, z = normal.z_, d = distance;
+        a00_ += weight * x * x;
+        a01_ += weight * x * y;
+        a02_ += weight * x * z;
+        a11_ += weight * y * y;
+        a12_ += weight * y * z;
+        a22_ += weight * z * z;
+        b0_ += weight * x * d;
+        b1_ += weight * y * d;
+        b2_ += weight * z * d;
+        c_ += weight * d * d;
+        weight_ += weight;
+    }
+
+    /// Add another quadric.
+    void Add(const Quadric& rhs)
+    {
+        a00_ += rhs.a00_;
+        a01_ += rhs.a01_;
+        a02_ += rhs.a02_;
+        a11_ += rhs.a11_;
+        a12_ += rhs.a12_;
+        a22_ += rhs.a22_;
+        b0_ += rhs.b0_;
+        b1_ += rhs.b1_;
+        b2_ += rhs.b2_;
+        c_ += rhs.c_;
+        weight_ += rhs.weight_;
+    }
+
+    /// Return the weighted sum of squared plane distances of a position.
+    double Evaluate(const Vector3& position) const
+    {
+        double x = position.x_, y = position.y_, z = position.z_;
+        return a00_ * x * x + a11_ * y * y + a22_ * z * z + 2.0 * (a01_ * x * y + a02_ * x * z + a12_ * y * z) +
+            2.0 * (b0_ * x + b1_ * y + b2_ * z) + c_;
+    }
+
+    double a00_, a01_, a02_, a11_, a12_, a22_;
+    double b0_, b1_, b2_;
+    double c_;
+    /// Sum of plane weights.
+    double weight_;
+};
+
+/// Edge collapse candidate.
+struct Collapse
+{
+    /// Vertex group to remove.
+    unsigned from_;
+    /// Vertex group to collapse onto.
+    unsigned to_;
+    /// Error of the collapse as a squared distance.
+    float cost_;
+};
+
+/// Compare vertex indices by position, then by index.
+struct PositionCompare
+{
+    PositionCompare(const PODVector<Vector3>& positions) :
+        positions_(&positions[0])
+    {
+    }
+
+    bool operator () (unsigned lhs, unsigned rhs) const
+    {
+        const Vector3& l = positions_[lhs];
+        const Vector3& r = positions_[rhs];
+        if (l.x_ != r.x_)
+            return l.x_ < r.x_;
+        if (l.y_ != r.y_)
+            return l.y_ < r.y_;
+        if (l.z_ != r.z_)
+            return l.z_ < r.z_;
+        return lhs < rhs;
+    }
+
+    const Vector3* positions_;
+};
+
+static bool CompareCollapses(const Collapse& lhs, const Collapse& rhs)
+{
+    if (lhs.cost_ != rhs.cost_)
+        return lhs.cost_ < rhs.cost_;
+    if (lhs.from_ != rhs.from_)
+        return lhs.from_ < rhs.from_;
+    return lhs.to_ < rhs.to_;
+}
+
+static unsigned long long EdgeKey(unsigned a, unsigned b)
+{
+    return ((unsigned long long)a << 32) | b;
+}
+
+static void MarkConstrainedEdge(PODVector<unsigned char>& kinds, PODVector<unsigned>& along, unsigned group, unsigned other,
+    SimplifyVertexKind kind)
+{
+    unsigned char& current = kinds[group];
+    if (current == SVK_LOCKED)
+        return;
+    // Vertices on both a border and a seam are corners, keep them
+    if (current != SVK_MANIFOLD && current != kind)
+    {
+        current = SVK_LOCKED;
+        return;
+    }
+
+    current = kind;
+    unsigned* neighbors = &along[group * 2];
+    if (neighbors[0] == other || neighbors[1] == other)
+        return;
+    if (neighbors[0] == M_MAX_UNSIGNED)
+        neighbors[0] = other;
+    else if (neighbors[1] == M_MAX_UNSIGNED)
+        neighbors[1] = other;
+    else
+        current = SVK_LOCKED;
+}
+
+static void ReplaceAlongNeighbor(PODVector<unsigned char>& kinds, PODVector<unsigned>& along, unsigned group, unsigned oldNeighbor,
+    unsigned newNeighbor)
+{
+    if (kinds[group] != SVK_BORDER && kinds[group] != SVK_SEAM)
+        return;
+
+    unsigned* neighbors = &along[group * 2];
+    if (neighbors[0] == oldNeighbor)
+        neighbors[0] = newNeighbor;
+    else if (neighbors[1] == oldNeighbor)
+        neighbors[1] = newNeighbor;
+
+    // A border or seam that has closed on itself can not be collapsed further
+    if (neighbors[0] == group || neighbors[1] == group || neighbors[0] == neighbors[1])
+        kinds[group] = SVK_LOCKED;
+}
+
+float SimplifyMesh(PODVector<unsigned>& dest, const PODVector<unsigned>& indices, const PODVector<Vector3>& positions,
+    const PODVector<unsigned>& vertexBones, unsigned targetIndexCount)
+{
+    dest = indices;
+    unsigned numVertices = positions.Size();
+    if (dest.Size() <= targetIndexCount || !numVertices)
+        return 0.0f;
+
+    bool useBones = vertexBones.Size() == numVertices;
+
+    // Group the vertices that share a position. The vertices of a group, called wedges, differ in other attributes such
+    // as UV coordinates at seams. The lowest vertex index represents the group
+    PODVector<unsigned> order(numVertices);
+    for (unsigned i = 0; i < numVertices; ++i)
+        order[i] = i;
+    Sort(order.Begin(), order.End(), PositionCompare(positions));
+
+    PODVector<unsigned> groups(numVertices);
+    PODVector<unsigned> wedges(numVertices);
+    for (unsigned i = 0; i < numVertices;)
+    {
+        unsigned j = i + 1;
+        while (j < numVertices && positions[order[j]] == positions[order[i]])
+            ++j;
+        for (unsigned k = i; k < j; ++k)
+        {
+            groups[order[k]] = order[i];
+            wedges[order[k]] = order[k + 1 < j ? k + 1 : i];
+        }
+        i = j;
+    }
+
+    // Remove triangles that are degenerate already
+    unsigned numValidIndices = 0;
+    for (unsigned i = 0; i < dest.Size(); i += 3)
+    {
+        unsigned a = dest[i];
+        unsigned b = dest[i + 1];
+        unsigned c = dest[i + 2];
+        if (groups[a] == groups[b] || groups[b] == groups[c] || groups[c] == groups[a])
+            continue;
+
+        dest[numValidIndices++] = a;
+        dest[numValidIndices++] = b;
+        dest[numValidIndices++] = c;
+    }
+    dest.Resize(numValidIndices);
+
+    // Find open borders and seams: an edge without an opposite edge is a seam if the opposite exists between other
+    // wedges of the same positions, otherwise it is a border
+    HashSet<unsigned long long> vertexEdges;
+    HashSet<unsigned long long> groupEdges;
+    for (unsigned i = 0; i < dest.Size(); i += 3)
+    {
+        for (unsigned j = 0; j < 3; ++j)
+        {
+            unsigned a = dest[i + j];
+            unsigned b = dest[i + (j + 1) % 3];
+            vertexEdges.Insert(EdgeKey(a, b));
+            groupEdges.Insert(EdgeKey(groups[a], groups[b]));
+        }
+    }
+
+    PODVector<Quadric> quadrics(numVertices);
+    PODVector<unsigned char> kinds(numVertices);
+    PODVector<unsigned> along(numVertices * 2);
+    for (unsigned i = 0; i < numVertices; ++i)
+    {
+        quadrics[i] = Quadric();
+        kinds[i] = SVK_MANIFOLD;
+        along[i * 2] = M_MAX_UNSIGNED;
+        along[i * 2 + 1] = M_MAX_UNSIGNED;
+    }
+
+    for (unsigned i = 0; i < dest.Size(); i += 3)
+    {
+        const Vector3& v0 = positions[dest[i]];
+        const Vector3& v1 = positions[dest[i + 1]];
+        const Vector3& v2 = positions[dest[i + 2]];
+        Vector3 normal = (v1 - v0).CrossProduct(v2 - v0);
+        float length = normal.Length();
+        if (length > 0.0f)
+        {
+            normal /= length;
+            float distance = -normal.DotProduct(v0);
+            for (unsigned j = 0; j < 3; ++j)
+                quadrics[groups[dest[i + j]]].AddPlane(normal, distance, 0.5 * length);
+        }
+
+        for (unsigned j = 0; j < 3; ++j)
+        {
+            unsigned a = dest[i + j];
+            unsigned b = dest[i + (j + 1) % 3];
+            if (vertexEdges.Contains(EdgeKey(b, a)))
+                continue;
+
+            bool border = !groupEdges.Contains(EdgeKey(groups[b], groups[a]));
+            SimplifyVertexKind kind = border ? SVK_BORDER : SVK_SEAM;
+            MarkConstrainedEdge(kinds, along, groups[a], groups[b], kind);
+            MarkConstrainedEdge(kinds, along, groups[b], groups[a], kind);
+
+            // Add a plane perpendicular to the triangle through the edge, so that the edge resists moving sideways
+            if (length > 0.0f)
+            {
+                Vector3 edge = positions[b] - positions[a];
+                Vector3 edgeNormal = edge.CrossProduct(normal).Normalized();
+                float edgeDistance = -edgeNormal.DotProduct(positions[a]);
+                double weight = BORDER_WEIGHT * edge.LengthSquared();
+                quadrics[groups[a]].AddPlane(edgeNormal, edgeDistance, weight);
+                quadrics[groups[b]].AddPlane(edgeNormal, edgeDistance, weight);
+            }
+        }
+    }
+
+    // Border and seam vertices need two neighbors along the border or seam to be collapsed along it
+    for (unsigned i = 0; i < numVertices; ++i)
+    {
+        if ((kinds[i] == SVK_BORDER || kinds[i] == SVK_SEAM) && along[i * 2 + 1] == M_MAX_UNSIGNED)
+            kinds[i] = SVK_LOCKED;
+    }
+
+    PODVector<unsigned> adjacencyOffsets(numVertices + 1);
+    PODVector<unsigned> adjacency;
+    PODVector<unsigned> vertexRemap(numVertices);
+    PODVector<unsigned char> passLocks(numVertices);
+    PODVector<Collapse> collapses;
+    PODVector<unsigned> wedgeFrom;
+    PODVector<unsigned> wedgeTo;
+    for (unsigned i = 0; i < numVertices; ++i)
+        vertexRemap[i] = i;
+
+    float maxCost = 0.0f;
+    bool limitCost = true;
+
+    while (dest.Size() > targetIndexCount)
+    {
+        // Build the triangle lists of the vertex groups
+        for (unsigned i = 0; i <= numVertices; ++i)
+            adjacencyOffsets[i] = 0;
+        for (unsigned i = 0; i < dest.Size(); ++i)
+            ++adjacencyOffsets[groups[dest[i]] + 1];
+        for (unsigned i = 0; i < numVertices; ++i)
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+        adjacency.Resize(dest.Size());
+        for (unsigned i = 0; i < dest.Size(); ++i)
+        {
+            unsigned group = groups[dest[i]];
+            adjacency[adjacencyOffsets[group]++] = i / 3;
+        }
+        for (unsigned i = numVertices; i > 0; --i)
+            adjacencyOffsets[i] = adjacencyOffsets[i - 1];
+        adjacencyOffsets[0] = 0;
+
+        // Gather the collapse candidates of all edges in both directions
+        collapses.Clear();
+        for (unsigned i = 0; i < dest.Size(); i += 3)
+        {
+            for (unsigned j = 0; j < 3; ++j)
+            {
+                unsigned a = groups[dest[i + j]];
+                unsigned b = groups[dest[i + (j + 1) % 3]];
+                for (unsigned k = 0; k < 2; ++k)
+                {
+                    unsigned from = k ? b : a;
+                    unsigned to = k ? a : b;
+
+                    if (kinds[from] == SVK_LOCKED)
+                        continue;
+                    if (kinds[from] != SVK_MANIFOLD && along[from * 2] != to && along[from * 2 + 1] != to)
+                        continue;
+
+                    const Vector3& position = positions[to];
+                    double weight = quadrics[from].weight_ + quadrics[to].weight_;
+                    double error = quadrics[from].Evaluate(position) + quadrics[to].Evaluate(position);
+                    float cost = weight > 0.0 ? Max((float)(error / weight), 0.0f) : 0.0f;
+                    if (useBones && vertexBones[from] != vertexBones[to])
+                        cost += SKIN_WEIGHT * (positions[from] - position).LengthSquared();
+
+                    Collapse collapse;
+                    collapse.from_ = from;
+                    collapse.to_ = to;
+                    collapse.cost_ = cost;
+                    collapses.Push(collapse);
+                }
+            }
+        }
+        if (collapses.Empty())
+            break;
+
+        Sort(collapses.Begin(), collapses.End(), CompareCollapses);
+
+        // Each collapse removes about two triangles. Only perform the cheapest collapses during a pass, so that expensive
+        // collapses are not chosen while cheaper ones are waiting for their neighbors to be unlocked
+        unsigned removeTriangles = (dest.Size() - targetIndexCount + 2) / 3;
+        unsigned limitIndex = removeTriangles / 2 < collapses.Size() ? removeTriangles / 2 : collapses.Size() - 1;
+        float costLimit = limitCost ? collapses[limitIndex].cost_ : M_INFINITY;
+
+        for (unsigned i = 0; i < numVertices; ++i)
+            passLocks[i] = 0;
+        unsigned removed = 0;
+
+        for (unsigned i = 0; i < collapses.Size() && removed < removeTriangles; ++i)
+        {
+            const Collapse& collapse = collapses[i];
+            if (collapse.cost_ > costLimit)
+                break;
+
+            unsigned from = collapse.from_;
+            unsigned to = collapse.to_;
+            if (passLocks[from] || passLocks[to])
+                continue;
+
+            const Vector3& position = positions[to];
+            unsigned adjacencyStart = adjacencyOffsets[from];
+            unsigned adjacencyEnd = adjacencyOffsets[from + 1];
+            bool valid = true;
+            unsigned collapsedTriangles = 0;
+
+            // Reject the collapse if a remaining triangle would flip
+            for (unsigned j = adjacencyStart; j < adjacencyEnd && valid; ++j)
+            {
+                const unsigned* triangle = &dest[adjacency[j] * 3];
+                unsigned corner = 0;
+                bool hasTo = false;
+                for (unsigned k = 0; k < 3; ++k)
+                {
+                    unsigned group = groups[triangle[k]];
+                    if (group == from)
+                        corner = k;
+                    else if (group == to)
+                        hasTo = true;
+                }
+                if (hasTo)
+                {
+                    ++collapsedTriangles;
+                    continue;
+                }
+
+                const Vector3& p0 = positions[triangle[corner]];
+                const Vector3& p1 = positions[triangle[(corner + 1) % 3]];
+                const Vector3& p2 = positions[triangle[(corner + 2) % 3]];
+                Vector3 oldNormal = (p1 - p0).CrossProduct(p2 - p0);
+                Vector3 newNormal = (p1 - position).CrossProduct(p2 - position);
+                if (oldNormal.DotProduct(newNormal) <= 0.0f)
+                    valid = false;
+            }
+            if (!valid)
+                continue;
+
+            // Each wedge must collapse onto the wedge it shares a triangle with, which keeps UV charts separate
+            wedgeFrom.Clear();
+            wedgeTo.Clear();
+            unsigned wedge = from;
+            do
+            {
+                bool used = false;
+                unsigned target = M_MAX_UNSIGNED;
+                for (unsigned j = adjacencyStart; j < adjacencyEnd && target == M_MAX_UNSIGNED; ++j)
+                {
+                    const unsigned* triangle = &dest[adjacency[j] * 3];
+                    if (triangle[0] != wedge && triangle[1] != wedge && triangle[2] != wedge)
+                        continue;
+                    used = true;
+                    for (unsigned k = 0; k < 3; ++k)
+                    {
+                        if (groups[triangle[k]] == to)
+                        {
+                            target = triangle[k];
+                            break;
+                        }
+                    }
+                }
+
+                if (used)
+                {
+                    if (target == M_MAX_UNSIGNED)
+                    {
+                        valid = false;
+                        break;
+                    }
+                    wedgeFrom.Push(wedge);
+                    wedgeTo.Push(target);
+                }
+
+                wedge = wedges[wedge];
+            }
+            while (wedge != from);
+            if (!valid)
+                continue;
+
+            for (unsigned j = 0; j < wedgeFrom.Size(); ++j)
+                vertexRemap[wedgeFrom[j]] = wedgeTo[j];
+            quadrics[to].Add(quadrics[from]);
+
+            if (kinds[from] == SVK_BORDER || kinds[from] == SVK_SEAM)
+            {
+                unsigned other = along[from * 2] == to ? along[from * 2 + 1] : along[from * 2];
+                ReplaceAlongNeighbor(kinds, along, to, from, other);
+                ReplaceAlongNeighbor(kinds, along, other, from, to);
+            }
+            kinds[from] = SVK_LOCKED;
+
+            // Lock the neighborhood for the rest of the pass, so that the flip checks of later collapses stay exact
+            passLocks[from] = 1;
+            passLocks[to] = 1;
+            for (unsigned j = adjacencyStart; j < adjacencyEnd; ++j)
+            {
+                const unsigned* triangle = &dest[adjacency[j] * 3];
+                for (unsigned k = 0; k < 3; ++k)
+                    passLocks[groups[triangle[k]]] = 1;
+            }
+
+            removed += collapsedTriangles;
+            maxCost = Max(maxCost, collapse.cost_);
+        }
+
+        if (!removed)
+        {
+            // Retry once without the cost limit before giving up
+            if (!limitCost)
+                break;
+            limitCost = false;
+            continue;
+        }
+        limitCost = true;
+
+        // Apply the collapses and remove the triangles that became degenerate
+        unsigned numIndices = 0;
+        for (unsigned i = 0; i < dest.Size(); i += 3)
+        {
+            unsigned a = vertexRemap[dest[i]];
+            unsigned b = vertexRemap[dest[i + 1]];
+            unsigned c = vertexRemap[dest[i + 2]];
+            if (groups[a] == groups[b] || groups[b] == groups[c] || groups[c] == groups[a])
+                continue;
+
+            dest[numIndices++] = a;
+            dest[numIndices++] = b;
+            dest[numIndices++] = c;
+        }
+        dest.Resize(numIndices);
+    }
+
+    return sqrtf(maxCost);
+}
@@ -23,6 +23,7 @@
 #include "Context.h"
 #include "File.h"
 #include "FileSystem.h"
+#include "GeometryOptimizer.h"
 #include "HashSet.h"
 #include "OgreImporterUtils.h"
 #include "ProcessUtils.h"
@@ -39,8 +40,6 @@
 
 #include "DebugNew.h"
 
-static const int VERTEX_CACHE_SIZE = 32;
-
 SharedPtr<Context> context_(new Context());
 SharedPtr<XMLFile> meshFile_(new XMLFile(context_));
 SharedPtr<XMLFile> skelFile_(new XMLFile(context_));
@@ -58,10 +57,12 @@ bool useOneBuffer_ = true;
 int main(int argc, char** argv);
 void Run(const Vector<String>& arguments);
 void LoadSkeleton(const String& skeletonFileName);
-void LoadMesh(const String& inputFileName, bool generateTangents, bool splitSubMeshes, bool exportMorphs);
+void LoadMesh(const String& inputFileName, bool generateTangents, bool splitSubMeshes, bool exportMorphs, bool optimizeGeometry,
+    bool packVertices);
 void WriteOutput(const String& outputFileName, bool exportAnimations, bool rotationsOnly, bool saveMaterialList);
-void OptimizeIndices(ModelSubGeometryLodLevel* subGeom, ModelVertexBuffer* vb, ModelIndexBuffer* ib);
-void CalculateScore(ModelVertex& vertex);
+void OptimizeIndices(ModelSubGeometryLodLevel* subGeom, ModelVertexBuffer* vb, ModelIndexBuffer* ib, bool optimizeOverdraw);
+void OptimizeVertices(ModelVertexBuffer* vb, ModelIndexBuffer* ib);
+void PackVertices(ModelVertexBuffer* vb);
 String SanitateAssetName(const String& name);
 
 int main(int argc, char** argv)
@@ -88,6 +89,11 @@ void Run(const Vector<String>& arguments)
             "-l      Output a material list file\n"
             "-na     Do not output animations\n"
             "-nm     Do not output morphs\n"
+            "-o      Optimize the triangle order also for overdraw, and the vertex order\n"
+            "        for vertex fetch. Not applied to vertex buffers with morphs\n"
+            "-p      Pack the vertex data into 16-bit normalized positions, normals and\n"
+            "        tangents, and half float texture coordinates. Not applied to vertex\n"
+            "        buffers with morphs. Skinned positions stay as floats\n"
             "-r      Output only rotations from animations\n"
             "-s      Split each submesh into own vertex buffer\n"
             "-t      Generate tangents\n"
@@ -100,6 +106,8 @@ void Run(const Vector<String>& arguments)
     bool exportMorphs = true;
     bool rotationsOnly = false;
     bool saveMaterialList = false;
+    bool optimizeGeometry = false;
+    bool packVertices = false;
     
     if (arguments.Size() > 2)
     {
@@ -110,6 +118,10 @@ void Run(const Vector<String>& arguments)
                 String argument = arguments[i].Substring(1).ToLower();
                 if (argument == "l")
                     saveMaterialList = true;
+                else if (argument == "o")
+                    optimizeGeometry = true;
+                else if (argument == "p")
+                    packVertices = true;
                 else if (argument == "r")
                     rotationsOnly = true;
                 else if (argument == "s")
@@ -134,7 +146,7 @@ void Run(const Vector<String>& arguments)
         }
     }
     
-    LoadMesh(arguments[0], generateTangents, splitSubMeshes, exportMorphs);
+    LoadMesh(arguments[0], generateTangents, splitSubMeshes, exportMorphs, optimizeGeometry, packVertices);
     WriteOutput(arguments[1], exportAnimations, rotationsOnly, saveMaterialList);
     
     PrintLine("Finished");
@@ -239,7 +251,8 @@ void LoadSkeleton(const String& skeletonFileName)
     }
 }
 
-void LoadMesh(const String& inputFileName, bool generateTangents, bool splitSubMeshes, bool exportMorphs)
+void LoadMesh(const String& inputFileName, bool generateTangents, bool splitSubMeshes, bool exportMorphs, bool optimizeGeometry,
+    bool packVertices)
 {
     File meshFileSource(context_);
     meshFileSource.Open(inputFileName);
@@ -583,7 +596,7 @@ void LoadMesh(const String& inputFileName, bool generateTangents, bool splitSubM
         indexStart += indices;
         vertexStart += vertices;
         
-        OptimizeIndices(&subGeometryLodLevel, vBuf, iBuf);
+        OptimizeIndices(&subGeometryLodLevel, vBuf, iBuf, optimizeGeometry);
         
         PrintLine("Processed submesh " + String(subMeshIndex + 1) + ": " + String(vertices) + " vertices " + 
             String(triangles) + " triangles");
@@ -657,7 +670,7 @@ void LoadMesh(const String& inputFileName, bool generateTangents, bool splitSubM
                         triangle = triangle.GetNext("face");
                     }
                     
-                    OptimizeIndices(&newLodLevel, vBuf, iBuf);
+                    OptimizeIndices(&newLodLevel, vBuf, iBuf, optimizeGeometry);
                     
                     subGeometries_[subMeshIndex].Push(newLodLevel);
                     PrintLine("Processed LOD level for submesh " + String(subMeshIndex + 1) + ": distance " + String(distance));
@@ -837,6 +850,26 @@ void LoadMesh(const String& inputFileName, bool generateTangents, bool splitSubM
             }
         }
     }
+    
+    // Vertex fetch optimization. Morphs refer to the vertices by index, so leave their buffers as is
+    if (optimizeGeometry)
+    {
+        for (unsigned i = 0; i < vertexBuffers_.Size(); ++i)
+        {
+            if (!vertexBuffers_[i].morphCount_)
+                OptimizeVertices(&vertexBuffers_[i], &indexBuffers_[i]);
+        }
+    }
+    
+    // Vertex packing. Morphed buffers would be unpacked again at load
+    if (packVertices)
+    {
+        for (unsigned i = 0; i < vertexBuffers_.Size(); ++i)
+        {
+            if (!vertexBuffers_[i].morphCount_)
+                PackVertices(&vertexBuffers_[i]);
+        }
+    }
 }
 
 void WriteOutput(const String& outputFileName, bool exportAnimations, bool rotationsOnly, bool saveMaterialList)
@@ -1052,169 +1085,81 @@ void WriteOutput(const String& outputFileName, bool exportAnimations, bool rotat
     }
 }
 
-void OptimizeIndices(ModelSubGeometryLodLevel* subGeom, ModelVertexBuffer* vb, ModelIndexBuffer* ib)
+void OptimizeIndices(ModelSubGeometryLodLevel* subGeom, ModelVertexBuffer* vb, ModelIndexBuffer* ib, bool optimizeOverdraw)
 {
-    PODVector<Triangle> oldTriangles;
-    PODVector<Triangle> newTriangles;
-    
     if (subGeom->indexCount_ % 3)
     {
         PrintLine("Index count is not divisible by 3, skipping index optimization");
         return;
     }
+    if (!subGeom->indexCount_ || vb->vertices_.Empty())
+        return;
     
-    for (unsigned i = 0; i < vb->vertices_.Size(); ++i)
-    {
-        vb->vertices_[i].useCount_ = 0;
-        vb->vertices_[i].cachePosition_ = -1;
-    }
+    unsigned* indices = &ib->indices_[subGeom->indexStart_];
+    unsigned indexCount = subGeom->indexCount_;
+    unsigned vertexCount = vb->vertices_.Size();
     
-    for (unsigned i = subGeom->indexStart_; i < subGeom->indexStart_ + subGeom->indexCount_; i += 3)
+    VertexCacheStatistics original = AnalyzeVertexCache(indices, indexCount, vertexCount);
+    OptimizeVertexCache(indices, indexCount, vertexCount);
+    if (optimizeOverdraw)
     {
-        Triangle triangle;
-        triangle.v0_ = ib->indices_[i];
-        triangle.v1_ = ib->indices_[i + 1];
-        triangle.v2_ = ib->indices_[i + 2];
-        vb->vertices_[triangle.v0_].useCount_++;
-        vb->vertices_[triangle.v1_].useCount_++;
-        vb->vertices_[triangle.v2_].useCount_++;
-        oldTriangles.Push(triangle);
+        OptimizeOverdraw(indices, indexCount, &vb->vertices_[0], sizeof(ModelVertex), offsetof(ModelVertex, position_),
+            vertexCount);
     }
+    VertexCacheStatistics optimized = AnalyzeVertexCache(indices, indexCount, vertexCount);
     
-    for (unsigned i = 0; i < vb->vertices_.Size(); ++i)
-        CalculateScore(vb->vertices_[i]);
-    
-    PODVector<unsigned> vertexCache;
-    
-    while (oldTriangles.Size())
+    PrintLine("Vertex cache ACMR " + String(original.acmr_) + " -> " + String(optimized.acmr_) + ", ATVR " +
+        String(original.atvr_) + " -> " + String(optimized.atvr_));
+}
+
+void OptimizeVertices(ModelVertexBuffer* vb, ModelIndexBuffer* ib)
+{
+    unsigned vertexCount = vb->vertices_.Size();
+    if (!vertexCount || ib->indices_.Empty())
+        return;
+    for (unsigned i = 0; i < ib->indices_.Size(); ++i)
     {
-        unsigned bestTriangle = M_MAX_UNSIGNED;
-        float bestTriangleScore = -1.0f;
-        
-        // Find the best triangle at this point
-        for (unsigned i = 0; i < oldTriangles.Size(); ++i)
+        if (ib->indices_[i] >= vertexCount)
         {
-            Triangle& triangle = oldTriangles[i];
-            float triangleScore = 
-                vb->vertices_[triangle.v0_].score_ +
-                vb->vertices_[triangle.v1_].score_ +
-                vb->vertices_[triangle.v2_].score_;
-            
-            if (triangleScore > bestTriangleScore)
-            {
-                bestTriangle = i;
-                bestTriangleScore = triangleScore;
-            }
-        }
-        
-        if (bestTriangle == M_MAX_UNSIGNED)
-        {
-            PrintLine("Could not find next triangle, aborting index optimization");
+            PrintLine("Index out of range, skipping vertex optimization");
             return;
         }
-        
-        // Add the best triangle
-        Triangle triangleCopy = oldTriangles[bestTriangle];
-        newTriangles.Push(triangleCopy);
-        oldTriangles.Erase(oldTriangles.Begin() + bestTriangle);
-        
-        // Reduce the use count
-        vb->vertices_[triangleCopy.v0_].useCount_--;
-        vb->vertices_[triangleCopy.v1_].useCount_--;
-        vb->vertices_[triangleCopy.v2_].useCount_--;
-        
-        // Model the LRU cache behaviour
-        // Erase the triangle vertices from the middle of the cache, if they were there
-        for (unsigned i = 0; i < vertexCache.Size(); ++i)
-        {
-            if ((vertexCache[i] == triangleCopy.v0_) ||
-                (vertexCache[i] == triangleCopy.v1_) ||
-                (vertexCache[i] == triangleCopy.v2_))
-            {
-                vertexCache.Erase(vertexCache.Begin() + i);
-                --i;
-            }
-        }
-        
-        // Then push them to the front
-        vertexCache.Insert(vertexCache.Begin(), triangleCopy.v0_);
-        vertexCache.Insert(vertexCache.Begin(), triangleCopy.v1_);
-        vertexCache.Insert(vertexCache.Begin(), triangleCopy.v2_);
-        
-        // Update positions & scores of all vertices in the cache
-        // Give position -1 if vertex is going to be erased
-        for (unsigned i = 0; i < vertexCache.Size(); ++i)
-        {
-            ModelVertex& vertex = vb->vertices_[vertexCache[i]];
-            if (i >= VERTEX_CACHE_SIZE)
-                vertex.cachePosition_ = -1;
-            else
-                vertex.cachePosition_ = i;
-            CalculateScore(vertex);
-        }
-        
-        // Finally erase the extra vertices
-        if (vertexCache.Size() > VERTEX_CACHE_SIZE)
-            vertexCache.Resize(VERTEX_CACHE_SIZE);
     }
     
-    // Rewrite the index data now
-    unsigned i = subGeom->indexStart_;
-    for (unsigned j = 0; j < newTriangles.Size(); ++j)
-    {
-        ib->indices_[i++] = newTriangles[j].v0_;
-        ib->indices_[i++] = newTriangles[j].v1_;
-        ib->indices_[i++] = newTriangles[j].v2_;
-    }
+    // Renumber by the first use in the whole index buffer, which holds the LOD levels of all submeshes using the buffer
+    PODVector<unsigned> remap(vertexCount);
+    OptimizeVertexFetch(&remap[0], &ib->indices_[0], ib->indices_.Size(), vertexCount);
+    
+    Vector<ModelVertex> vertices(vertexCount);
+    for (unsigned i = 0; i < vertexCount; ++i)
+        vertices[remap[i]] = vb->vertices_[i];
+    vb->vertices_ = vertices;
+    PrintLine("Optimized vertex order");
 }
 
-void CalculateScore(ModelVertex& vertex)
+void PackVertices(ModelVertexBuffer* vb)
 {
-    // Linear-Speed Vertex Cache Optimisation by Tom Forsyth from
-    // http://home.comcast.net/~tom_forsyth/papers/fast_vert_cache_opt.html
-    const float cacheDecayPower = 1.5f;
-    const float lastTriScore = 0.75f;
-    const float valenceBoostScale = 2.0f;
-    const float valenceBoostPower = 0.5f;
+    unsigned elementMask = vb->elementMask_;
+    // Skinned positions would be unpacked again at load, so keep them as floats
+    if ((elementMask & MASK_POSITION) && !(elementMask & MASK_BLENDWEIGHTS))
+        vb->elementMask_ |= MASK_PACKED_POSITION;
+    if (elementMask & MASK_NORMAL)
+        vb->elementMask_ |= MASK_PACKED_NORMAL;
+    if (elementMask & (MASK_TEXCOORD1 | MASK_TEXCOORD2))
+        vb->elementMask_ |= MASK_PACKED_TEXCOORD;
+    if (elementMask & MASK_TANGENT)
+        vb->elementMask_ |= MASK_PACKED_TANGENT;
     
-    if (vertex.useCount_ == 0)
-    {
-        // No tri needs this vertex!
-        vertex.score_ = -1.0f;
-        return;
-    }
-    
-    float score = 0.0f;
-    int cachePosition = vertex.cachePosition_;
-    if (cachePosition < 0)
-    {
-        // Vertex is not in FIFO cache - no score.
-    }
-    else
+    if (vb->elementMask_ & MASK_PACKED_POSITION)
     {
-        if (cachePosition < 3)
-        {
-            // This vertex was used in the last triangle,
-            // so it has a fixed score, whichever of the three
-            // it's in. Otherwise, you can get very different
-            // answers depending on whether you add
-            // the triangle 1,2,3 or 3,1,2 - which is silly.
-            score = lastTriScore;
-        }
-        else
-        {
-            // Points for being high in the cache.
-            const float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
-            score = 1.0f - (cachePosition - 3) * scaler;
-            score = powf(score, cacheDecayPower);
-        }
+        BoundingBox box;
+        for (unsigned i = 0; i < vb->vertices_.Size(); ++i)
+            box.Merge(vb->vertices_[i].position_);
+        GetPositionQuantization(box, vb->positionOffset_, vb->positionScale_);
     }
     
-    // Bonus points for having a low number of tris still to
-    // use the vert, so we get rid of lone verts quickly.
-    float valenceBoost = powf((float)vertex.useCount_, -valenceBoostPower);
-    score += valenceBoostScale * valenceBoost;
-    vertex.score_ = score;
+    PrintLine("Packed vertices from " + String(VertexBuffer::GetVertexSize(elementMask)) + " to " +
+        String(VertexBuffer::GetVertexSize(vb->elementMask_)) + " bytes");
 }
 
 String SanitateAssetName(const String& name)
@@ -27,16 +27,12 @@
 #include "Graphics.h"
 #include "Serializer.h"
 #include "Matrix3x4.h"
+#include "VectorBuffer.h"
+#include "VertexBuffer.h"
+#include "VertexPacking.h"
 
 using namespace Urho3D;
 
-struct Triangle
-{
-    unsigned v0_;
-    unsigned v1_;
-    unsigned v2_;
-};
-
 struct ModelBone
 {
     String name_;
@@ -95,10 +91,6 @@ struct ModelVertex
     float blendWeights_[4];
     unsigned char blendIndices_[4];
     bool hasBlendWeights_;
-    
-    unsigned useCount_;
-    int cachePosition_;
-    float score_;
 };
 
 struct ModelVertexBuffer
@@ -106,12 +98,16 @@ struct ModelVertexBuffer
     unsigned elementMask_;
     unsigned morphStart_;
     unsigned morphCount_;
+    Vector3 positionOffset_;
+    float positionScale_;
     Vector<ModelVertex> vertices_;
     
     ModelVertexBuffer() :
         elementMask_(0),
         morphStart_(0),
-        morphCount_(0)
+        morphCount_(0),
+        positionOffset_(Vector3::ZERO),
+        positionScale_(1.0f)
     {
     }
     
@@ -121,28 +117,50 @@ struct ModelVertexBuffer
         dest.WriteUInt(elementMask_);
         dest.WriteUInt(morphStart_);
         dest.WriteUInt(morphCount_);
+        if (elementMask_ & MASK_PACKED_POSITION)
+        {
+            dest.WriteVector3(positionOffset_);
+            dest.WriteFloat(positionScale_);
+        }
         
+        // Packed vertices are converted from the float vertices
+        unsigned floatMask = elementMask_ & ~MASK_PACKED_ELEMENTS;
+        if (floatMask != elementMask_ && !vertices_.Empty())
+        {
+            VectorBuffer floatData;
+            WriteVertices(floatData, floatMask);
+            PODVector<unsigned char> packedData(vertices_.Size() * VertexBuffer::GetVertexSize(elementMask_));
+            ConvertVertexData(&packedData[0], elementMask_, floatData.GetData(), floatMask, vertices_.Size(), positionOffset_,
+                positionScale_);
+            dest.Write(&packedData[0], packedData.Size());
+        }
+        else
+            WriteVertices(dest, floatMask);
+    }
+    
+    void WriteVertices(Serializer& dest, unsigned elementMask)
+    {
         for (unsigned i = 0; i < vertices_.Size(); ++i)
         {
-            if (elementMask_ & MASK_POSITION)
+            if (elementMask & MASK_POSITION)
                 dest.WriteVector3(vertices_[i].position_);
-            if (elementMask_ & MASK_NORMAL)
+            if (elementMask & MASK_NORMAL)
                 dest.WriteVector3(vertices_[i].normal_);
-            if (elementMask_ & MASK_COLOR)
+            if (elementMask & MASK_COLOR)
                 dest.WriteUInt(vertices_[i].color_.ToUInt());
-            if (elementMask_ & MASK_TEXCOORD1)
+            if (elementMask & MASK_TEXCOORD1)
                 dest.WriteVector2(vertices_[i].texCoord1_);
-            if (elementMask_ & MASK_TEXCOORD2)
+            if (elementMask & MASK_TEXCOORD2)
                 dest.WriteVector2(vertices_[i].texCoord2_);
-            if (elementMask_ & MASK_CUBETEXCOORD1)
+            if (elementMask & MASK_CUBETEXCOORD1)
                 dest.WriteVector3(vertices_[i].cubeTexCoord1_);
-            if (elementMask_ & MASK_CUBETEXCOORD2)
+            if (elementMask & MASK_CUBETEXCOORD2)
                 dest.WriteVector3(vertices_[i].cubeTexCoord2_);
-            if (elementMask_ & MASK_TANGENT)
+            if (elementMask & MASK_TANGENT)
                 dest.WriteVector4(vertices_[i].tangent_);
-            if (elementMask_ & MASK_BLENDWEIGHTS)
+            if (elementMask & MASK_BLENDWEIGHTS)
                 dest.Write(&vertices_[i].blendWeights_[0], 4 * sizeof(float));
-            if (elementMask_ & MASK_BLENDINDICES)
+            if (elementMask & MASK_BLENDINDICES)
                 dest.Write(&vertices_[i].blendIndices_[0], 4 * sizeof(unsigned char));
         }
     }
@@ -0,0 +1,160 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Context.h"
+#include "Engine.h"
+#include "File.h"
+#include "FileSystem.h"
+#include "Log.h"
+#include "Octree.h"
+#include "PotentiallyVisibleSet.h"
+#include "ProcessUtils.h"
+#include "Scene.h"
+#include "Timer.h"
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#include <cctype>
+
+#include "DebugNew.h"
+
+using namespace Urho3D;
+
+int main(int argc, char** argv)
+{
+    #ifdef WIN32
+    const Vector<String>& arguments = ParseArguments(GetCommandLineW());
+    #else
+    const Vector<String>& arguments = ParseArguments(argc, argv);
+    #endif
+
+    if (arguments.Size() < 2)
+        ErrorExit(
+            "Usage: PVSBaker <input scene> <output scene> [options]\n\n"
+            "Bakes the potentially visible set of the scene's static geometry. Uses the scene's\n"
+            "existing PotentiallyVisibleSet component, or creates one covering the static drawables.\n"
+            "The output scene is saved in XML format if the file extension is .xml.\n\n"
+            "Options:\n"
+            "-c<size>    Cell size, default 2\n"
+            "-s<samples> Sample points per cell axis, default 2\n"
+            "-r<size>    Occlusion buffer resolution per cube face, default 128\n"
+            "-p<paths>   Resource paths separated by semicolons, default Data;CoreData"
+        );
+
+    String inputFile = arguments[0];
+    String outputFile = arguments[1];
+    float cellSize = 0.0f;
+    int cellSamples = 0;
+    int resolution = 0;
+    String resourcePaths;
+
+    for (unsigned i = 2; i < arguments.Size(); ++i)
+    {
+        if (arguments[i].Length() > 1 && arguments[i][0] == '-')
+        {
+            String value = arguments[i].Substring(2);
+            switch (tolower(arguments[i][1]))
+            {
+            case 'c':
+                cellSize = ToFloat(value);
+                break;
+
+            case 's':
+                cellSamples = ToInt(value);
+                break;
+
+            case 'r':
+                resolution = ToInt(value);
+                break;
+
+            case 'p':
+                resourcePaths = value;
+                break;
+
+            default:
+                ErrorExit("Unrecognized option " + arguments[i]);
+            }
+        }
+    }
+
+    SharedPtr<Context> context(new Context());
+    SharedPtr<Engine> engine(new Engine(context));
+
+    // Bake in headless mode. The worker threads are used to bake cells in parallel
+    VariantMap engineParameters;
+    engineParameters["Headless"] = true;
+    engineParameters["LogName"] = String::EMPTY;
+    if (!resourcePaths.Empty())
+        engineParameters["ResourcePaths"] = resourcePaths;
+    if (!engine->Initialize(engineParameters))
+        ErrorExit("Could not initialize engine");
+
+    SharedPtr<Scene> scene(new Scene(context));
+    File inFile(context);
+    if (!inFile.Open(inputFile, FILE_READ))
+        ErrorExit("Could not open input scene " + inputFile);
+
+    bool xml = GetExtension(inputFile) == ".xml";
+    if (!(xml ? scene->LoadXML(inFile) : scene->Load(inFile)))
+        ErrorExit("Could not load input scene " + inputFile);
+    inFile.Close();
+
+    Octree* octree = scene->GetComponent<Octree>();
+    if (!octree)
+        ErrorExit("Input scene has no Octree component");
+
+    PotentiallyVisibleSet* pvs = scene->GetComponent<PotentiallyVisibleSet>();
+    if (!pvs)
+    {
+        // Cover only the static geometry, as the octree's default size would result in a huge number of cells
+        pvs = scene->CreateComponent<PotentiallyVisibleSet>();
+        BoundingBox staticBox = PotentiallyVisibleSet::GetStaticBoundingBox(octree, pvs->GetViewMask());
+        if (!staticBox.defined_)
+            ErrorExit("Input scene has no static drawables");
+        pvs->SetBoundingBox(staticBox);
+    }
+    if (cellSize > 0.0f)
+        pvs->SetCellSize(Vector3(cellSize, cellSize, cellSize));
+    if (cellSamples > 0)
+        pvs->SetCellSamples(cellSamples);
+    if (resolution > 0)
+        pvs->SetBakeResolution(resolution);
+
+    PrintLine("Baking " + String(pvs->GetNumBakeCells()) + " cells");
+    
+    HiresTimer bakeTimer;
+    if (!pvs->Bake())
+        ErrorExit("Could not bake potentially visible set");
+    PrintLine("Baked " + String(pvs->GetNumCells()) + " cells and " + String(pvs->GetNumDrawables()) + " drawables in " +
+        String(bakeTimer.GetUSec(false) / 1000) + " ms");
+
+    File outFile(context);
+    if (!outFile.Open(outputFile, FILE_WRITE))
+        ErrorExit("Could not open output scene " + outputFile);
+
+    if (!(GetExtension(outputFile) == ".xml" ? scene->SaveXML(outFile) : scene->Save(outFile)))
+        ErrorExit("Could not save output scene " + outputFile);
+
+    return 0;
+}
@@ -0,0 +1,139 @@
+//
+// Copyright (c) 2008-2014 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "Context.h"
+#include "Engine.h"
+#include "File.h"
+#include "FileSystem.h"
+#include "Image.h"
+#include "StringUtils.h"
+#include "ProcessUtils.h"
+#include "Timer.h"
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#include "DebugNew.h"
+
+using namespace Urho3D;
+
+int main(int argc, char** argv)
+{
+    #ifdef WIN32
+    const Vector<String>& arguments = ParseArguments(GetCommandLineW());
+    #else
+    const Vector<String>& arguments = ParseArguments(argc, argv);
+    #endif
+
+    if (arguments.Size() < 2)
+        ErrorExit(
+            "Usage: TextureCompressor <input image> <output image> [options]\n\n"
+            "Compresses an image to DXT or ETC1 with a full mip chain. The output is saved in\n"
+            "DDS format if the file extension is .dds, otherwise in KTX format.\n\n"
+            "Options:\n"
+            "-f<format>  Compressed format dxt1, dxt3, dxt5 or etc1, default dxt1 for RGB and\n"
+            "            dxt5 for RGBA images\n"
+            "-q<quality> Compression quality 0 (fast) - 2 (high), default 1\n"
+            "-l          Treat the image as linear data and filter the mip levels without sRGB\n"
+            "            decoding, use for normal maps and other non-color data\n"
+            "-nm         Do not generate mip levels\n"
+            "-st         Single-threaded compression"
+        );
+
+    String inputFile = arguments[0];
+    String outputFile = arguments[1];
+    String formatName;
+    CompressionQuality quality = CQ_NORMAL;
+    bool sRGB = true;
+    bool mipmaps = true;
+    bool threads = true;
+
+    for (unsigned i = 2; i < arguments.Size(); ++i)
+    {
+        if (arguments[i].Length() > 1 && arguments[i][0] == '-')
+        {
+            String argument = arguments[i].Substring(1).ToLower();
+            String value = argument.Substring(1);
+            if (argument == "l")
+                sRGB = false;
+            else if (argument == "nm")
+                mipmaps = false;
+            else if (argument == "st")
+                threads = false;
+            else if (argument[0] == 'f')
+                formatName = value;
+            else if (argument[0] == 'q')
+                quality = (CompressionQuality)Clamp(ToInt(value), (int)CQ_FAST, (int)CQ_HIGH);
+            else
+                ErrorExit("Unrecognized option " + arguments[i]);
+        }
+    }
+
+    SharedPtr<Context> context(new Context());
+    SharedPtr<Engine> engine(new Engine(context));
+
+    // Run in headless mode. The worker threads are used to compress block rows in parallel
+    VariantMap engineParameters;
+    engineParameters["Headless"] = true;
+    engineParameters["LogName"] = String::EMPTY;
+    engineParameters["WorkerThreads"] = threads;
+    engineParameters["ResourcePaths"] = String::EMPTY;
+    if (!engine->Initialize(engineParameters))
+        ErrorExit("Could not initialize engine");
+
+    SharedPtr<Image> image(new Image(context));
+    File inFile(context);
+    if (!inFile.Open(inputFile, FILE_READ))
+        ErrorExit("Could not open input image " + inputFile);
+    if (!image->Load(inFile))
+        ErrorExit("Could not load input image " + inputFile);
+    inFile.Close();
+
+    CompressedFormat format;
+    if (formatName.Empty())
+        format = image->GetComponents() == 4 ? CF_DXT5 : CF_DXT1;
+    else if (formatName == "dxt1")
+        format = CF_DXT1;
+    else if (formatName == "dxt3")
+        format = CF_DXT3;
+    else if (formatName == "dxt5")
+        format = CF_DXT5;
+    else if (formatName == "etc1")
+        format = CF_ETC1;
+    else
+        ErrorExit("Unrecognized compressed format " + formatName);
+
+    unsigned uncompressedSize = image->GetMemoryUse();
+    HiresTimer compressTimer;
+    if (!image->Compress(format, quality, mipmaps, sRGB))
+        ErrorExit("Could not compress image " + inputFile);
+    PrintLine("Compressed " + String(image->GetWidth()) + "x" + String(image->GetHeight()) + " image with " +
+        String(image->GetNumCompressedLevels()) + " levels from " + String(uncompressedSize) + " to " +
+        String(image->GetMemoryUse()) + " bytes in " + String(compressTimer.GetUSec(false) / 1000) + " ms");
+
+    if (!(GetExtension(outputFile) == ".dds" ? image->SaveDDS(outputFile) : image->SaveKTX(outputFile)))
+        ErrorExit("Could not save output image " + outputFile);
+
+    return 0;
+}